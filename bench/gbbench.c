@@ -0,0 +1,464 @@
+/*
+ * bench/gbbench.c
+ * 
+ * GBFix - Benchmark Suite
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+/*
+
+	Generates a corpus of synthetic ROMs, one per ROM size code plus a
+	few odd sizes, each with a valid and an invalid header, and times
+	the header and checksum paths of every I/O backend on them.
+
+	Results are written as JSON, one result per line. Given a baseline
+	produced by an earlier run, any result slower than the baseline by
+	more than the tolerance is reported and the exit code is nonzero.
+
+*/
+
+// Include used C header(s):
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/chksum.h"
+#include "../inc/gbhead.h"
+#include "../inc/romfile.h"
+
+#define MAX_RESULTS 1024
+
+typedef struct tagBENCH_ROM
+{
+	char szFileName[4096];
+	size_t cbRom;
+	int fValid;
+} BENCH_ROM, *PBENCH_ROM;
+
+typedef struct tagBENCH_RESULT
+{
+	char szName[128];
+	double dNs; // Median time per operation.
+	double dMBps; // Throughput, or zero if not meaningful.
+} BENCH_RESULT, *PBENCH_RESULT;
+
+typedef struct tagBENCH_PARAMS
+{
+	const char* pszOutFile;
+	const char* pszBaseline;
+	const char* pszCorpusDir;
+	double dTolerance; // Allowed slowdown in percent.
+	unsigned int nIters;
+	int fKeepCorpus;
+	int fQuick;
+} BENCH_PARAMS, *PBENCH_PARAMS;
+
+static BENCH_RESULT s_brResults[MAX_RESULTS];
+static size_t s_nResults;
+
+// ---------------------------------------------------------------------
+// Timing.
+// ---------------------------------------------------------------------
+
+static inline uint64_t getNs (void) {
+	
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+	
+}
+
+static int cmpDouble (const void* pA, const void* pB) {
+	
+	double dA = *(const double*)pA, dB = *(const double*)pB;
+	return (dA > dB) - (dA < dB);
+	
+}
+
+static void addResult (const char* pszName, double* pdSamples, unsigned int nSamples, size_t cbPerOp) {
+	
+	if (s_nResults >= MAX_RESULTS) return;
+	
+	qsort(pdSamples, nSamples, sizeof(double), cmpDouble);
+	
+	PBENCH_RESULT pbr = &s_brResults[s_nResults++];
+	snprintf(pbr->szName, sizeof(pbr->szName), "%s", pszName);
+	pbr->dNs = pdSamples[nSamples / 2];
+	pbr->dMBps = (cbPerOp && pbr->dNs > 0) ? (double)cbPerOp / pbr->dNs * 1e9 / (1 << 20) : 0;
+	
+}
+
+// ---------------------------------------------------------------------
+// Corpus generation.
+// ---------------------------------------------------------------------
+
+static int writeRom (PBENCH_ROM pbr, uint32_t uSeed) {
+	
+	uint8_t* pRom;
+	if ((pRom = malloc(pbr->cbRom)) == NULL) return -1;
+	
+	// Cheap xorshift fill; the content only needs to defeat shortcuts.
+	uint32_t uState = uSeed | 1;
+	for (size_t iByte = 0; iByte < pbr->cbRom; iByte++) {
+		uState ^= uState << 13;
+		uState ^= uState >> 17;
+		uState ^= uState << 5;
+		pRom[iByte] = (uint8_t)uState;
+	}
+	
+	PGBHEAD pHdr = (PGBHEAD)(pRom + GBHEAD_OFFSET);
+	memset(&pHdr->htTitle, 0, sizeof(GBH_TITLE));
+	memcpy(pHdr->htTitle.oldTitle.strTitle, "GBBENCH", 7);
+	pHdr->uSgbFlag = 0;
+	pHdr->uCartType = CT_MBC5_BATTERY_RAM;
+	pHdr->uRomSize = 0;
+	while ((32768ul << pHdr->uRomSize) < pbr->cbRom && pHdr->uRomSize < 8) pHdr->uRomSize++;
+	pHdr->uRamSize = 3;
+	pHdr->uRegion = REGION_INTERNATIONAL;
+	pHdr->uOldLicensee = 0x01;
+	pHdr->uRomVer = 0;
+	pHdr->uHdrChksum = mkGbHdrChksum(pHdr);
+	setGlobalChksum(pHdr, mkGbGlobalChksum(pHdr, pRom, pbr->cbRom));
+	
+	if (!pbr->fValid) {
+		pHdr->uHdrChksum ^= 0x5A;
+		setGlobalChksum(pHdr, correctGlobalChksum(pHdr) ^ 0xA5A5);
+	}
+	
+	FILE* pFile;
+	int nRet = -1;
+	if ((pFile = fopen(pbr->szFileName, "wb")) != NULL) {
+		if (fwrite(pRom, pbr->cbRom, 1, pFile) == 1) nRet = 0;
+		if (fclose(pFile)) nRet = -1;
+	}
+	
+	free(pRom);
+	return nRet;
+	
+}
+
+static size_t makeCorpus (const PBENCH_PARAMS pbp, PBENCH_ROM pbrRoms, size_t nMax) {
+	
+	size_t cbSizes[16];
+	size_t nSizes = 0;
+	
+	// Every ROM size code from 32kB to 8MB, then some sizes that match no
+	// code at all.
+	for (unsigned int uCode = 0; uCode <= 8; uCode++) {
+		if (pbp->fQuick && (uCode & 1)) continue;
+		cbSizes[nSizes++] = 32768ul << uCode;
+	}
+	cbSizes[nSizes++] = GBHEAD_ROMMIN;
+	cbSizes[nSizes++] = 48 * 1024;
+	cbSizes[nSizes++] = (1 << 20) + 1;
+	if (!pbp->fQuick) cbSizes[nSizes++] = (3 << 20) - 7;
+	
+	size_t nRoms = 0;
+	for (size_t iSize = 0; iSize < nSizes; iSize++) {
+		for (int fValid = 1; fValid >= 0 && nRoms < nMax; fValid--) {
+			PBENCH_ROM pbr = &pbrRoms[nRoms];
+			pbr->cbRom = cbSizes[iSize];
+			pbr->fValid = fValid;
+			snprintf(pbr->szFileName, sizeof(pbr->szFileName), "%s/rom_%zu_%s.gb",
+				pbp->pszCorpusDir, pbr->cbRom, fValid ? "valid" : "invalid");
+			
+			if (writeRom(pbr, (uint32_t)(pbr->cbRom * 2 + fValid))) {
+				fprintf(stderr, "Error: \"%s\": Could not write ROM: %m\n", pbr->szFileName);
+				return 0;
+			}
+			nRoms++;
+		}
+	}
+	
+	return nRoms;
+	
+}
+
+// ---------------------------------------------------------------------
+// Benchmarks.
+// ---------------------------------------------------------------------
+
+// Number of repetitions per sample, scaled so small operations are
+// still measurable.
+static unsigned int getReps (size_t cbWork) {
+	
+	if (cbWork >= (1 << 20)) return 1;
+	return (unsigned int)((1 << 20) / (cbWork + 4096));
+	
+}
+
+static void benchStdio (const PBENCH_PARAMS pbp, PBENCH_ROM pbr, double* pdSamples) {
+	
+	char szName[128];
+	const char* pszVar = pbr->fValid ? "valid" : "invalid";
+	unsigned int nReps = getReps(sizeof(GBHEAD));
+	GBHEAD hdr;
+	
+	// Header load.
+	for (unsigned int iIter = 0; iIter < pbp->nIters; iIter++) {
+		uint64_t nStart = getNs();
+		for (unsigned int iRep = 0; iRep < nReps; iRep++) loadHeaderFromFile(pbr->szFileName, &hdr);
+		pdSamples[iIter] = (double)(getNs() - nStart) / nReps;
+	}
+	snprintf(szName, sizeof(szName), "stdio/load_header/%s/%zu", pszVar, pbr->cbRom);
+	addResult(szName, pdSamples, pbp->nIters, 0);
+	
+	// Whole image load plus global checksum.
+	for (unsigned int iIter = 0; iIter < pbp->nIters; iIter++) {
+		uint8_t* pRom;
+		size_t cbRom;
+		uint64_t nStart = getNs();
+		if (loadRomFromFile(pbr->szFileName, &pRom, &cbRom) == 0) {
+			mkGbGlobalChksum(&hdr, pRom, cbRom);
+			free(pRom);
+		}
+		pdSamples[iIter] = (double)(getNs() - nStart);
+	}
+	snprintf(szName, sizeof(szName), "stdio/global_chksum/%s/%zu", pszVar, pbr->cbRom);
+	addResult(szName, pdSamples, pbp->nIters, pbr->cbRom);
+	
+	// Header save.
+	for (unsigned int iIter = 0; iIter < pbp->nIters; iIter++) {
+		uint64_t nStart = getNs();
+		saveHeaderToFile(pbr->szFileName, &hdr);
+		pdSamples[iIter] = (double)(getNs() - nStart);
+	}
+	snprintf(szName, sizeof(szName), "stdio/save/%s/%zu", pszVar, pbr->cbRom);
+	addResult(szName, pdSamples, pbp->nIters, 0);
+	
+}
+
+static void benchMmap (const PBENCH_PARAMS pbp, PBENCH_ROM pbr, double* pdSamples) {
+	
+	char szName[128];
+	const char* pszVar = pbr->fValid ? "valid" : "invalid";
+	unsigned int nReps = getReps(sizeof(GBHEAD));
+	ROM_FILE rf;
+	GBHEAD hdr;
+	
+	// Open, map and read the header.
+	for (unsigned int iIter = 0; iIter < pbp->nIters; iIter++) {
+		uint64_t nStart = getNs();
+		for (unsigned int iRep = 0; iRep < nReps; iRep++) {
+			if (openRomFile(pbr->szFileName, &rf, 0) == 0) {
+				readRomHeader(&rf, &hdr);
+				closeRomFile(&rf);
+			}
+		}
+		pdSamples[iIter] = (double)(getNs() - nStart) / nReps;
+	}
+	snprintf(szName, sizeof(szName), "mmap/load_header/%s/%zu", pszVar, pbr->cbRom);
+	addResult(szName, pdSamples, pbp->nIters, 0);
+	
+	// Header checksum.
+	unsigned int nHdrReps = 1 << 16;
+	for (unsigned int iIter = 0; iIter < pbp->nIters; iIter++) {
+		volatile uint8_t uSink = 0;
+		uint64_t nStart = getNs();
+		for (unsigned int iRep = 0; iRep < nHdrReps; iRep++) {
+			hdr.uRomVer = (uint8_t)iRep;
+			uSink += mkGbHdrChksum(&hdr);
+		}
+		pdSamples[iIter] = (double)(getNs() - nStart) / nHdrReps;
+	}
+	snprintf(szName, sizeof(szName), "mmap/hdr_chksum/%s/%zu", pszVar, pbr->cbRom);
+	addResult(szName, pdSamples, pbp->nIters, 0);
+	
+	// Global checksum with every kernel the CPU supports.
+	if (openRomFile(pbr->szFileName, &rf, 0) == 0) {
+		unsigned int uSavedImpl = getSumBytesImpl();
+		unsigned int nSumReps = getReps(rf.cbRom);
+		
+		for (unsigned int uImpl = SUMIMPL_SCALAR; uImpl < SUMIMPL_COUNT; uImpl++) {
+			if (selectSumBytesImpl(uImpl)) continue;
+			
+			for (unsigned int iIter = 0; iIter < pbp->nIters; iIter++) {
+				uint64_t nStart = getNs();
+				for (unsigned int iRep = 0; iRep < nSumReps; iRep++) mkGbGlobalChksum(&hdr, rf.pRom, rf.cbRom);
+				pdSamples[iIter] = (double)(getNs() - nStart) / nSumReps;
+			}
+			snprintf(szName, sizeof(szName), "mmap/global_chksum_%s/%s/%zu", getSumBytesImplStr(uImpl), pszVar, pbr->cbRom);
+			addResult(szName, pdSamples, pbp->nIters, rf.cbRom);
+		}
+		
+		selectSumBytesImpl(uSavedImpl);
+		closeRomFile(&rf);
+	}
+	
+	// Patch and flush the header. A byte is toggled every time so the
+	// page really is written.
+	for (unsigned int iIter = 0; iIter < pbp->nIters; iIter++) {
+		uint64_t nStart = getNs();
+		if (openRomFile(pbr->szFileName, &rf, RFF_WRITE) == 0) {
+			readRomHeader(&rf, &hdr);
+			hdr.uRomVer ^= 1;
+			writeRomHeader(&rf, &hdr);
+			closeRomFile(&rf);
+		}
+		pdSamples[iIter] = (double)(getNs() - nStart);
+	}
+	snprintf(szName, sizeof(szName), "mmap/save/%s/%zu", pszVar, pbr->cbRom);
+	addResult(szName, pdSamples, pbp->nIters, 0);
+	
+}
+
+// ---------------------------------------------------------------------
+// Output and baseline comparison.
+// ---------------------------------------------------------------------
+
+static int writeResults (const char* pszOutFile) {
+	
+	FILE* pOut = stdout;
+	if (pszOutFile != NULL && (pOut = fopen(pszOutFile, "w")) == NULL) {
+		fprintf(stderr, "Error: \"%s\": Could not open output: %m\n", pszOutFile);
+		return -1;
+	}
+	
+	fprintf(pOut, "{\"benchmark\":\"gbfix\",\"version\":1,\"sum_impl\":\"%s\",\"results\":[\n",
+		getSumBytesImplStr(getSumBytesImpl()));
+	for (size_t iResult = 0; iResult < s_nResults; iResult++) {
+		fprintf(pOut, "{\"name\":\"%s\",\"ns\":%.1f,\"mbps\":%.1f}%s\n", s_brResults[iResult].szName,
+			s_brResults[iResult].dNs, s_brResults[iResult].dMBps, (iResult + 1 < s_nResults) ? "," : "");
+	}
+	fprintf(pOut, "]}\n");
+	
+	if (pOut != stdout && fclose(pOut)) return -1;
+	return 0;
+	
+}
+
+static int compareBaseline (const PBENCH_PARAMS pbp) {
+	
+	FILE* pFile;
+	if ((pFile = fopen(pbp->pszBaseline, "r")) == NULL) {
+		fprintf(stderr, "Error: \"%s\": Could not open baseline: %m\n", pbp->pszBaseline);
+		return -1;
+	}
+	
+	char szLine[512];
+	int nRegressions = 0;
+	
+	// Results are written one per line, so no real JSON parser is needed.
+	while (fgets(szLine, sizeof(szLine), pFile) != NULL) {
+		char szName[128];
+		double dNs;
+		if (sscanf(szLine, "{\"name\":\"%127[^\"]\",\"ns\":%lf", szName, &dNs) != 2) continue;
+		
+		for (size_t iResult = 0; iResult < s_nResults; iResult++) {
+			if (strcmp(s_brResults[iResult].szName, szName) != 0) continue;
+			
+			double dLimit = dNs * (1.0 + pbp->dTolerance / 100.0);
+			if (s_brResults[iResult].dNs > dLimit) {
+				fprintf(stderr, "Regression: %s: %.1fns (baseline %.1fns, +%.1f%%)\n", szName,
+					s_brResults[iResult].dNs, dNs, (s_brResults[iResult].dNs / dNs - 1.0) * 100.0);
+				nRegressions++;
+			}
+			break;
+		}
+	}
+	
+	fclose(pFile);
+	return nRegressions;
+	
+}
+
+static void printUsage (const char* pszArgv0) {
+	
+	printf("Usage: %s [options]\n", pszArgv0);
+	printf("\t-o <FILE>  Write JSON results to <FILE> instead of stdout.\n");
+	printf("\t-b <FILE>  Compare against the baseline results in <FILE>.\n");
+	printf("\t-t <PCT>   Allowed slowdown against the baseline, in percent (default 25).\n");
+	printf("\t-i <N>     Samples per measurement (default 7).\n");
+	printf("\t-d <DIR>   Generate the corpus in <DIR> instead of a temporary directory.\n");
+	printf("\t-k         Keep the generated corpus.\n");
+	printf("\t-q         Quick run over fewer ROM sizes.\n");
+	
+}
+
+int main (int argc, char* argv[]) {
+	
+	BENCH_PARAMS bp;
+	memset(&bp, 0, sizeof(BENCH_PARAMS));
+	bp.dTolerance = 25.0;
+	bp.nIters = 7;
+	
+	int nOpt;
+	while ((nOpt = getopt(argc, argv, "o:b:t:i:d:kqh")) != -1) {
+		switch (nOpt) {
+		case 'o': bp.pszOutFile = optarg; break;
+		case 'b': bp.pszBaseline = optarg; break;
+		case 't': bp.dTolerance = strtod(optarg, NULL); break;
+		case 'i': bp.nIters = (unsigned int)strtoul(optarg, NULL, 0); break;
+		case 'd': bp.pszCorpusDir = optarg; break;
+		case 'k': bp.fKeepCorpus = 1; break;
+		case 'q': bp.fQuick = 1; break;
+		case 'h':
+			printUsage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			printUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (bp.nIters == 0) bp.nIters = 1;
+	
+	// Create the corpus.
+	char szTmpDir[] = "/tmp/gbbench.XXXXXX";
+	if (bp.pszCorpusDir == NULL) {
+		if (mkdtemp(szTmpDir) == NULL) {
+			fprintf(stderr, "Error: Could not create corpus directory: %m\n");
+			return EXIT_FAILURE;
+		}
+		bp.pszCorpusDir = szTmpDir;
+	}
+	
+	BENCH_ROM brRoms[32];
+	size_t nRoms = makeCorpus(&bp, brRoms, sizeof(brRoms) / sizeof(brRoms[0]));
+	double* pdSamples = calloc(bp.nIters, sizeof(double));
+	int nRet = EXIT_FAILURE;
+	
+	if (nRoms > 0 && pdSamples != NULL) {
+		for (size_t iRom = 0; iRom < nRoms; iRom++) {
+			benchStdio(&bp, &brRoms[iRom], pdSamples);
+			benchMmap(&bp, &brRoms[iRom], pdSamples);
+		}
+		
+		nRet = EXIT_SUCCESS;
+		if (writeResults(bp.pszOutFile)) nRet = EXIT_FAILURE;
+		if (bp.pszBaseline != NULL && compareBaseline(&bp) != 0) nRet = EXIT_FAILURE;
+	}
+	
+	// Remove the corpus.
+	if (!bp.fKeepCorpus) {
+		for (size_t iRom = 0; iRom < nRoms; iRom++) unlink(brRoms[iRom].szFileName);
+		if (bp.pszCorpusDir == szTmpDir) rmdir(szTmpDir);
+	}
+	
+	free(pdSamples);
+	return nRet;
+	
+}
+
+// EOF
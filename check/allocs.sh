@@ -0,0 +1,63 @@
+#!/bin/sh
+## ---------------------------------------------------------------------
+## 
+## check/allocs.sh
+## GBFix - Heap Allocation Check
+## 
+## Usage:
+## allocs.sh <gbfix> <mallocount.so> [file count]
+## 
+## Runs a parallel batch over many ROMs with mallocount.so preloaded and
+## fails unless no heap allocations were made once the workers started.
+## 
+## Copyright 2021 Lisa Murray
+## 
+## This program is free software; you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation; either version 3 of the License, or
+## any later version.
+## 
+## This program is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+## 
+## You should have received a copy of the GNU General Public License
+## along with this program; if not, write to the Free Software
+## Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+## MA 02110-1301, USA.
+## 
+## ---------------------------------------------------------------------
+
+GBFIX=$(realpath "$1")
+MALLOCOUNT=$(realpath "$2")
+NFILES=${3:-10000}
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "${DIR}"' EXIT
+
+## Blank 32 KiB ROMs are enough; every file still gets opened, checked
+## and summed.
+seq -f "${DIR}/r%05g.gb" 1 "${NFILES}" | xargs truncate -s 32768 || exit 1
+
+STATUS=0
+check () {
+	
+	COUNT=$(LD_PRELOAD="${MALLOCOUNT}" "${GBFIX}" "$@" -f "${DIR}" 2>&1 >/dev/null | \
+		sed -n 's/^mallocount: //p')
+	if [ "${COUNT}" = "0" ]; then
+		echo "ok   gbfix $*"
+	else
+		echo "FAIL gbfix $*: ${COUNT:-no} allocations after startup"
+		STATUS=1
+	fi
+	
+}
+
+check -j4
+check -j4 -v --hash
+check -j4 -d -v -t CHECK
+
+exit ${STATUS}
+
+## EOF
@@ -0,0 +1,77 @@
+#!/bin/sh
+## ---------------------------------------------------------------------
+## 
+## check/audit.sh
+## GBFix - Header Audit Check
+## 
+## Usage:
+## audit.sh <gbfix>
+## 
+## Audits CGB headers with and without a valid manufacturer code and
+## fails unless each gets exactly the title and manufacturer findings
+## it should.
+## 
+## Copyright 2021 Lisa Murray
+## 
+## This program is free software; you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation; either version 3 of the License, or
+## any later version.
+## 
+## This program is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+## 
+## You should have received a copy of the GNU General Public License
+## along with this program; if not, write to the Free Software
+## Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+## MA 02110-1301, USA.
+## 
+## ---------------------------------------------------------------------
+
+GBFIX=$(realpath "$1")
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "${DIR}"' EXIT
+
+## Write a blank 32 KiB ROM $1 with the 16 bytes $2 at the title.
+mkRom () {
+	
+	truncate -s 32768 "$1" || exit 1
+	printf "$2" | dd of="$1" bs=1 seek=308 conv=notrunc 2>/dev/null
+	
+}
+
+STATUS=0
+
+## Audit ROM $1 and compare its title and manufacturer findings with $2.
+check () {
+	
+	FOUND=$("${GBFIX}" --audit "$1" | grep '^"' | \
+		grep -o 'title has data after its end\|bad manufacturer code' | tr '\n' ',')
+	if [ "${FOUND}" = "$2" ]; then
+		echo "ok   $3"
+	else
+		echo "FAIL $3: found \"${FOUND}\", expected \"$2\""
+		STATUS=1
+	fi
+	
+}
+
+## A short title padded up to a manufacturer code, as on most CGB carts.
+mkRom "${DIR}/manu.gb" 'HELLO\000\000\000\000\000\000ABCD\200'
+check "${DIR}/manu.gb" "" "CGB title with manufacturer code"
+
+mkRom "${DIR}/blank.gb" 'HELLO\000\000\000\000\000\000\000\000\000\000\200'
+check "${DIR}/blank.gb" "" "CGB title with blank manufacturer code"
+
+mkRom "${DIR}/badmanu.gb" 'HELLO\000\000\000\000\000\000AB\001D\200'
+check "${DIR}/badmanu.gb" "bad manufacturer code," "CGB title with bad manufacturer code"
+
+mkRom "${DIR}/pad.gb" 'HELLO\000WORLD\000\000\000\000\200'
+check "${DIR}/pad.gb" "title has data after its end," "CGB title with data after its end"
+
+exit ${STATUS}
+
+## EOF
@@ -0,0 +1,103 @@
+#!/bin/sh
+## ---------------------------------------------------------------------
+## 
+## check/chksum.sh
+## GBFix - Global Checksum Check
+## 
+## Usage:
+## chksum.sh <gbfix>
+## 
+## Fixes a ROM whose stored global checksum is wrong in several ways and
+## fails unless every result carries its real global checksum.
+## 
+## Copyright 2021 Lisa Murray
+## 
+## This program is free software; you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation; either version 3 of the License, or
+## any later version.
+## 
+## This program is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+## 
+## You should have received a copy of the GNU General Public License
+## along with this program; if not, write to the Free Software
+## Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+## MA 02110-1301, USA.
+## 
+## ---------------------------------------------------------------------
+
+GBFIX=$(realpath "$1")
+
+DIR=$(mktemp -d) || exit 1
+trap 'rm -rf "${DIR}"' EXIT
+
+## A 36 KiB ROM whose stored global checksum (the text at 0x14E) does
+## not match its contents.
+yes 'GBFix' | head -c 36864 > "${DIR}/bad.gb" || exit 1
+
+## Print "ok" if the global checksum stored in ROM $1 is its real one.
+globalOk () {
+	
+	od -An -v -tu1 "$1" | awk '{
+		for (i = 1; i <= NF; i++) {
+			n++;
+			if (n == 335) uHi = $i; else if (n == 336) uLo = $i; else uSum += $i;
+		}
+	} END { if (uSum % 65536 == uHi * 256 + uLo) print "ok"; }'
+	
+}
+
+STATUS=0
+check () {
+	
+	if [ "$(globalOk "$1")" = "ok" ]; then
+		echo "ok   $2"
+	else
+		echo "FAIL $2: stale global checksum"
+		STATUS=1
+	fi
+	
+}
+
+cp "${DIR}/bad.gb" "${DIR}/title.gb"
+"${GBFIX}" -t CHECK -f "${DIR}/title.gb" >/dev/null
+check "${DIR}/title.gb" "gbfix -t CHECK"
+
+## A CGB header titled "HELLO" with manufacturer code "ABCD", retitled.
+## The title must stop short of the manufacturer code and CGB flag.
+cp "${DIR}/bad.gb" "${DIR}/cgb.gb"
+printf 'HELLO\000\000\000\000\000\000ABCD\200' | \
+	dd of="${DIR}/cgb.gb" bs=1 seek=308 conv=notrunc 2>/dev/null
+MANU=$(od -An -tx1 -j 319 -N 5 "${DIR}/cgb.gb")
+"${GBFIX}" -t NEWNAME -f "${DIR}/cgb.gb" >/dev/null
+check "${DIR}/cgb.gb" "gbfix -t NEWNAME on CGB"
+if [ "$(od -An -tx1 -j 319 -N 5 "${DIR}/cgb.gb")" != "${MANU}" ]; then
+	echo "FAIL gbfix -t NEWNAME on CGB: manufacturer code or CGB flag changed"
+	STATUS=1
+fi
+
+"${GBFIX}" -f "${DIR}/bad.gb" -o "${DIR}/out.gb" >/dev/null
+check "${DIR}/out.gb" "gbfix -o"
+
+cp "${DIR}/bad.gb" "${DIR}/pad.gb"
+"${GBFIX}" --pad -f "${DIR}/pad.gb" >/dev/null
+check "${DIR}/pad.gb" "gbfix --pad"
+
+## The same ROM as a 32 KiB image followed by 32 KiB of 0xFF fill.
+head -c 32768 "${DIR}/bad.gb" > "${DIR}/trim.gb"
+head -c 32768 /dev/zero | tr '\000' '\377' >> "${DIR}/trim.gb"
+"${GBFIX}" --trim -f "${DIR}/trim.gb" >/dev/null
+check "${DIR}/trim.gb" "gbfix --trim"
+
+## An IPS patch writing "IPS!" at 0x200.
+printf 'PATCH\000\002\000\000\004IPS!EOF' > "${DIR}/p.ips"
+cp "${DIR}/bad.gb" "${DIR}/patch.gb"
+"${GBFIX}" --patch "${DIR}/p.ips" -f "${DIR}/patch.gb" >/dev/null
+check "${DIR}/patch.gb" "gbfix --patch"
+
+exit ${STATUS}
+
+## EOF
@@ -0,0 +1,137 @@
+/*
+ * check/libcheck.c
+ * 
+ * GBFix - Library Check
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+/*
+	Linked against libgbfix.so by "make check". Opens, validates and
+	fixes a ROM image through the library's entry points alone, and
+	checks every GBFIX_E* error path. The checksums the library reports
+	and writes are compared with ones computed here byte by byte. Exits
+	nonzero if anything does not match.
+*/
+
+// Include used C header(s):
+#include <stdio.h>
+#include <string.h>
+
+// Include module header(s):
+#include "../inc/libgbfix.h"
+
+#define ROM_SIZE 0x10000 // Size of the test image.
+
+static uint8_t s_uRom[ROM_SIZE];
+static int s_nFailed;
+
+static void check (const int fOk, const char* pszWhat) {
+	
+	printf("%s %s\n", fOk ? "ok  " : "FAIL", pszWhat);
+	if (!fOk) s_nFailed++;
+	
+}
+
+// Header checksum, straight from its definition.
+static uint8_t refHdrChksum (const uint8_t* pRom) {
+	
+	uint8_t uChksum = 0;
+	for (size_t iByte = 0x134; iByte < 0x14D; iByte++) uChksum = (uint8_t)(uChksum - pRom[iByte] - 1);
+	return uChksum;
+	
+}
+
+// Global checksum, straight from its definition.
+static uint16_t refGlobalChksum (const uint8_t* pRom, const size_t cbRom) {
+	
+	uint16_t uChksum = 0;
+	for (size_t iByte = 0; iByte < cbRom; iByte++)
+		if (iByte != 0x14E && iByte != 0x14F) uChksum = (uint16_t)(uChksum + pRom[iByte]);
+	return uChksum;
+	
+}
+
+// Global checksum stored in an image.
+static uint16_t getStoredChksum (const uint8_t* pRom) {
+	
+	return (uint16_t)((pRom[0x14E] << 8) | pRom[0x14F]);
+	
+}
+
+int main (void) {
+	
+	GBFIX_CTX ctx;
+	GBFIX_STATUS gs;
+	HDR_UPDATES hu;
+	GBHEAD hdr;
+	
+	// An image with both checksums wrong.
+	for (size_t iByte = 0; iByte < ROM_SIZE; iByte++) s_uRom[iByte] = (uint8_t)(iByte * 7 + (iByte >> 8));
+	s_uRom[0x14D] = (uint8_t)(refHdrChksum(s_uRom) + 1);
+	s_uRom[0x14E] = (uint8_t)~(refGlobalChksum(s_uRom, ROM_SIZE) >> 8);
+	s_uRom[0x14F] = 0;
+	
+	// Error paths.
+	check(gbfixInit(NULL, s_uRom, ROM_SIZE) == GBFIX_EFAULT, "gbfixInit without a context is GBFIX_EFAULT");
+	check(gbfixInit(&ctx, NULL, ROM_SIZE) == GBFIX_EFAULT, "gbfixInit without an image is GBFIX_EFAULT");
+	check(gbfixInit(&ctx, s_uRom, GBHEAD_ROMMIN - 1) == GBFIX_ETOOSMALL, "gbfixInit on a short image is GBFIX_ETOOSMALL");
+	
+	gbfixReset(&ctx);
+	check(gbfixValidate(&ctx, &gs) == GBFIX_ENOINIT, "gbfixValidate after gbfixReset is GBFIX_ENOINIT");
+	check(gbfixFix(&ctx, NULL) == GBFIX_ENOINIT, "gbfixFix after gbfixReset is GBFIX_ENOINIT");
+	check(gbfixGetHeader(&ctx, &hdr) == GBFIX_ENOINIT, "gbfixGetHeader after gbfixReset is GBFIX_ENOINIT");
+	
+	memset(&hu, 0, sizeof(HDR_UPDATES));
+	hu.uFlags = ~(unsigned long int)UPF_MASK;
+	check(gbfixInit(&ctx, s_uRom, ROM_SIZE) == GBFIX_OK &&
+		gbfixApplyUpdates(&ctx, &hu) == GBFIX_EINVAL, "gbfixApplyUpdates with unknown flags is GBFIX_EINVAL");
+	check(gbfixValidate(&ctx, NULL) == GBFIX_EFAULT, "gbfixValidate without a status is GBFIX_EFAULT");
+	
+	check(gbfixInitConst(&ctx, s_uRom, ROM_SIZE) == GBFIX_OK &&
+		gbfixFix(&ctx, NULL) == GBFIX_ERDONLY, "gbfixFix on a read only image is GBFIX_ERDONLY");
+	check(strcmp(gbfixStrError(GBFIX_ERDONLY), "Image is read only") == 0 &&
+		strcmp(gbfixStrError(1), "Unknown error") == 0, "gbfixStrError describes the codes");
+	
+	// Validate the broken image.
+	check(gbfixValidate(&ctx, &gs) == GBFIX_OK && !(gs.uFlags & (GBXS_HDROK | GBXS_GLOBALOK)),
+		"gbfixValidate finds both checksums wrong");
+	check(gs.uHdrChksum == refHdrChksum(s_uRom) && gs.uGlobalChksum == refGlobalChksum(s_uRom, ROM_SIZE),
+		"gbfixValidate reports the correct checksums");
+	
+	// Retitle and fix it.
+	memset(&hu, 0, sizeof(HDR_UPDATES));
+	hu.uFlags = UPF_TITLE;
+	strcpy(hu.pszTitle, "LIBCHECK");
+	check(gbfixInit(&ctx, s_uRom, ROM_SIZE) == GBFIX_OK && gbfixApplyUpdates(&ctx, &hu) == GBFIX_OK &&
+		gbfixFix(&ctx, &gs) == GBFIX_OK, "gbfixFix on a retitled image succeeds");
+	check(memcmp(s_uRom + 0x134, "LIBCHECK\0\0\0\0\0\0\0", 15) == 0, "gbfixFix writes the new title");
+	check(s_uRom[0x14D] == refHdrChksum(s_uRom) && getStoredChksum(s_uRom) == refGlobalChksum(s_uRom, ROM_SIZE),
+		"gbfixFix writes the correct checksums");
+	check(gs.uGlobalChksum == getStoredChksum(s_uRom), "gbfixFix reports the checksum it wrote");
+	
+	check(gbfixInitConst(&ctx, s_uRom, ROM_SIZE) == GBFIX_OK && gbfixValidate(&ctx, &gs) == GBFIX_OK &&
+		(gs.uFlags & (GBXS_HDROK | GBXS_GLOBALOK)) == (GBXS_HDROK | GBXS_GLOBALOK),
+		"gbfixValidate finds the fixed image correct");
+	
+	return (s_nFailed != 0);
+	
+}
+
+// EOF
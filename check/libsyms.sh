@@ -0,0 +1,44 @@
+#!/bin/sh
+## ---------------------------------------------------------------------
+## 
+## check/libsyms.sh
+## GBFix - Library Export Check
+## 
+## Usage:
+## libsyms.sh <libgbfix.so>
+## 
+## Fails if the shared library exports any function or variable other
+## than its gbfix* entry points.
+## 
+## Copyright 2021 Lisa Murray
+## 
+## This program is free software; you can redistribute it and/or modify
+## it under the terms of the GNU General Public License as published by
+## the Free Software Foundation; either version 3 of the License, or
+## any later version.
+## 
+## This program is distributed in the hope that it will be useful,
+## but WITHOUT ANY WARRANTY; without even the implied warranty of
+## MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## GNU General Public License for more details.
+## 
+## You should have received a copy of the GNU General Public License
+## along with this program; if not, write to the Free Software
+## Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+## MA 02110-1301, USA.
+## 
+## ---------------------------------------------------------------------
+
+SYMS=$(nm -D --defined-only "$1") || exit 1
+
+## _init and _fini come from the C runtime, not from the library.
+EXTRA=$(echo "${SYMS}" | awk '$2 ~ /^[TDBR]$/ { print $3 }' | \
+	grep -v '^gbfix\|^_init$\|^_fini$' | tr '\n' ' ')
+
+if [ -n "${EXTRA}" ]; then
+	echo "FAIL $1 exports internal symbols: ${EXTRA}"
+	exit 1
+fi
+echo "ok   $1 only exports gbfix* entry points"
+
+## EOF
@@ -0,0 +1,120 @@
+/*
+ * check/mallocount.c
+ * 
+ * GBFix - Heap Allocation Counter
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+/*
+
+	Preloaded into gbfix by "make check". Counts the heap allocations
+	made on any thread from the moment the first worker thread is
+	created, which is when startup is over and files are being
+	processed, and prints the count as "mallocount: <N>" to stderr at
+	exit. The thread-local storage the C library allocates for each new
+	thread is not counted.
+
+*/
+
+// dlsym() and RTLD_NEXT are GNU extensions.
+#define _GNU_SOURCE
+
+// Include used C header(s):
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef int (*PFN_PTHREADCREATE) (pthread_t*, const pthread_attr_t*, void* (*) (void*), void*);
+
+extern void* __libc_malloc (size_t cb);
+extern void* __libc_calloc (size_t n, size_t cb);
+extern void* __libc_realloc (void* p, size_t cb);
+extern void* __libc_memalign (size_t cbAlign, size_t cb);
+
+static int s_fCounting; // Set once the first worker thread is created.
+static unsigned long int s_nAllocs;
+static __thread int s_fCreating; // Set while this thread creates another.
+
+static inline void countAlloc (void) {
+	
+	if (__atomic_load_n(&s_fCounting, __ATOMIC_RELAXED) && !s_fCreating) __atomic_fetch_add(&s_nAllocs, 1, __ATOMIC_RELAXED);
+	
+}
+
+void* malloc (size_t cb) {
+	
+	countAlloc();
+	return __libc_malloc(cb);
+	
+}
+
+void* calloc (size_t n, size_t cb) {
+	
+	countAlloc();
+	return __libc_calloc(n, cb);
+	
+}
+
+void* realloc (void* p, size_t cb) {
+	
+	countAlloc();
+	return __libc_realloc(p, cb);
+	
+}
+
+int posix_memalign (void** pp, size_t cbAlign, size_t cb) {
+	
+	countAlloc();
+	if ((*pp = __libc_memalign(cbAlign, cb)) == NULL) return 12; // ENOMEM
+	return 0;
+	
+}
+
+void* aligned_alloc (size_t cbAlign, size_t cb) {
+	
+	countAlloc();
+	return __libc_memalign(cbAlign, cb);
+	
+}
+
+int pthread_create (pthread_t* pThread, const pthread_attr_t* pAttr, void* (*pfnStart) (void*), void* pArg) {
+	
+	static PFN_PTHREADCREATE s_pfnCreate;
+	if (s_pfnCreate == NULL) s_pfnCreate = (PFN_PTHREADCREATE)dlsym(RTLD_NEXT, "pthread_create");
+	
+	s_fCreating = 1;
+	int nRet = s_pfnCreate(pThread, pAttr, pfnStart, pArg);
+	s_fCreating = 0;
+	__atomic_store_n(&s_fCounting, 1, __ATOMIC_RELAXED);
+	return nRet;
+	
+}
+
+__attribute__((destructor)) static void printAllocCount (void) {
+	
+	char szMsg[64];
+	int cchMsg = snprintf(szMsg, sizeof(szMsg), "mallocount: %lu\n", __atomic_load_n(&s_nAllocs, __ATOMIC_RELAXED));
+	if (write(STDERR_FILENO, szMsg, (size_t)cchMsg) < 0) return;
+	
+}
+
+// EOF
@@ -22,13 +22,26 @@
  * 
  */
 
+// fopencookie() is a GNU extension.
+#define _GNU_SOURCE
+
 // Include used C header(s):
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 // Include module header(s):
 #include "gbfix.h"
@@ -37,27 +50,44 @@ const char s_pszAppName[] = "GBFix";
 const char s_pszAppVer[] = "0.3.4-proto";
 const char s_pszCopyright[] = "Copyright 2021 Lisa Murray";
 
-int doFileOperations (PRUN_PARAMS prp);
-static inline void validateChksums (PRUN_PARAMS prp);
+static void printBanner (void);
+void doCacheOperations (PRUN_PARAMS prp);
+int doBatchOperations (PRUN_PARAMS prp);
+int doStreamOperations (const PRUN_PARAMS prp);
+int doServeOperations (const PRUN_PARAMS prp);
+int doClientOperations (const PRUN_PARAMS prp, PROM_JOB pJob);
+int doWatchOperations (PRUN_PARAMS prp);
+int doAuditOperations (PRUN_PARAMS prp);
+int doInventoryOperations (PRUN_PARAMS prp);
+int doIndexOperations (PRUN_PARAMS prp);
+int doMulticartOperations (PRUN_PARAMS prp);
+int doFileOperations (const PRUN_PARAMS prp, PROM_JOB pJob);
+static int patchRomJob (const PRUN_PARAMS prp, PROM_JOB pJob);
+static int processRomFile (const PRUN_PARAMS prp, PROM_JOB pJob);
+static int saveRomJob (const PRUN_PARAMS prp, PROM_JOB pJob);
+static void hashRomJob (const PRUN_PARAMS prp, PROM_JOB pJob);
+static void storeRomCache (const PRUN_PARAMS prp, PROM_JOB pJob, const PGBHEAD pHdrOnDisk);
+static inline void validateChksums (const PRUN_PARAMS prp, PROM_JOB pJob);
+static void validateLogo (const PRUN_PARAMS prp, PROM_JOB pJob);
+static void planRomPad (const PRUN_PARAMS prp, PROM_JOB pJob);
+static void planRomTrim (const PRUN_PARAMS prp, PROM_JOB pJob);
+static void printRomFill (const PRUN_PARAMS prp, PROM_JOB pJob);
 inline size_t getFileSize (const char* pszFileName);
 
 int main (int argc, char* argv[]) {
 	
-	// Print application name and version identifier.
-	printf("%s v%s\n%s\n", s_pszAppName, s_pszAppVer, s_pszCopyright);
-	
 	RUN_PARAMS rpParams; // Runtime parameters.
+	FILE_LIST flFiles; // ROM files to operate on.
+	HDR_UPDATES huUpdates; // Header updates to apply.
+	HDR_PLAN hpUpdates; // Header updates, compiled once for every ROM.
+	int fOptsDone = 0; // Whether getopt_long ran out of options.
 	
 	// Initialize runtime parameters.
 	memset(&rpParams, 0, sizeof(RUN_PARAMS));
-	
-	if ((rpParams.pHdrUps = malloc(sizeof(HDR_UPDATES))) == NULL) {
-		fprintf(stderr, "Error: Could not allocate buffer for header updates.\n");
-		setExitCode(&rpParams, EXIT_FAILURE);
-		doExit(&rpParams);
-	}
-	
-	memset(rpParams.pHdrUps, 0, sizeof(HDR_UPDATES));
+	memset(&flFiles, 0, sizeof(FILE_LIST));
+	memset(&huUpdates, 0, sizeof(HDR_UPDATES));
+	rpParams.pFileList = &flFiles;
+	rpParams.pHdrUps = &huUpdates;
 	
 	// Process command-line arguments.
 	if (argc > 1) {
@@ -82,6 +112,25 @@ int main (int argc, char* argv[]) {
 				{ "cgbflags", required_argument, 0, 'c' },
 				{ "carttype", required_argument, 0, 'C' },
 				{ "ramsize", required_argument, 0, 'R' },
+				{ "jobs", required_argument, 0, 'j' },
+				{ "full-rescan", no_argument, 0, 0 },
+				{ "cache", optional_argument, 0, 0 },
+				{ "cache-clear", no_argument, 0, 0 },
+				{ "cache-gc", optional_argument, 0, 0 },
+				{ "output", required_argument, 0, 'o' },
+				{ "serve", required_argument, 0, 0 },
+				{ "client", required_argument, 0, 0 },
+				{ "watch", required_argument, 0, 0 },
+				{ "audit", no_argument, 0, 0 },
+				{ "fix-logo", no_argument, 0, 0 },
+				{ "inventory", no_argument, 0, 0 },
+				{ "format", required_argument, 0, 0 },
+				{ "hash", optional_argument, 0, 0 },
+				{ "pad", optional_argument, 0, 0 },
+				{ "trim", no_argument, 0, 0 },
+				{ "fill-info", no_argument, 0, 0 },
+				{ "patch", required_argument, 0, 0 },
+				{ "stats", optional_argument, 0, 0 },
 				{ 0, 0, 0, 0}
 			};
 			
@@ -90,8 +139,9 @@ int main (int argc, char* argv[]) {
 			
 			// Get options.
 			iLongOpt = 0; // Reset long option index.
-			if ((nOpt = getopt_long(argc, argv, "hf:vdr:s:V:t:m:c:C:R:", optLongOpts, &iLongOpt)) == -1) {
+			if ((nOpt = getopt_long(argc, argv, "hf:o:vdr:s:V:t:m:c:C:R:j:", optLongOpts, &iLongOpt)) == -1) {
 				setExitCode(&rpParams, EXIT_SUCCESS);
+				fOptsDone = 1;
 				break;
 			}
 			
@@ -102,6 +152,7 @@ int main (int argc, char* argv[]) {
 				switch (iLongOpt) {
 				case 1:
 					// Print out GPL notice.
+					printBanner();
 					printGplNotice();
 					setExitCode(&rpParams, EXIT_SUCCESS);
 					break;
@@ -111,6 +162,123 @@ int main (int argc, char* argv[]) {
 					rpParams.uFlags |= RPF_NOROMINFO;
 					break;
 					
+				case 15:
+					// Set full-rescan flag.
+					rpParams.uFlags |= RPF_FULLRESCAN;
+					break;
+					
+				case 16:
+					// Enable checksum cache.
+					rpParams.uFlags |= RPF_CACHE;
+					if (optarg != NULL) rpParams.pszCachePath = optarg;
+					break;
+					
+				case 17:
+					// Invalidate checksum cache.
+					rpParams.uFlags |= RPF_CACHECLEAR;
+					break;
+					
+				case 18:
+					// Collect stale checksum cache entries.
+					rpParams.uFlags |= RPF_CACHEGC;
+					rpParams.nCacheGcDays = (optarg != NULL) ? (unsigned int)strtoul(optarg, NULL, 0) : 30;
+					break;
+					
+				case 20:
+					// Run as a daemon.
+					rpParams.uFlags |= RPF_SERVE;
+					rpParams.pszSocket = optarg;
+					break;
+					
+				case 21:
+					// Send files to a daemon.
+					rpParams.uFlags |= RPF_CLIENT;
+					rpParams.pszSocket = optarg;
+					break;
+					
+				case 22:
+					// Watch a directory.
+					rpParams.uFlags |= RPF_WATCH;
+					rpParams.pszWatchDir = optarg;
+					break;
+					
+				case 23:
+					// Set audit flag.
+					rpParams.uFlags |= RPF_AUDIT;
+					break;
+					
+				case 24:
+					// Restore Nintendo logo.
+					rpParams.uFlags |= RPF_UPDATEROM;
+					rpParams.pHdrUps->uFlags |= UPF_LOGO;
+					break;
+					
+				case 25:
+					// Set inventory flag.
+					rpParams.uFlags |= RPF_INVENTORY;
+					break;
+					
+				case 26:
+					// Set output format.
+					if (getReportFormat(optarg, &rpParams.uFormat)) {
+						fprintf(stderr, "Error: Unknown output format: \"%s\"\n", optarg);
+						errno = 0;
+						setExitCode(&rpParams, EXIT_FAILURE);
+					}
+					break;
+					
+				case 27:
+					// Select content hashes.
+					if (getRomHashFlags(optarg, &rpParams.uHashes)) {
+						fprintf(stderr, "Error: Unknown hash in \"%s\"\n", optarg);
+						errno = 0;
+						setExitCode(&rpParams, EXIT_FAILURE);
+					}
+					break;
+					
+				case 28:
+					// Pad ROMs to the next valid size.
+					rpParams.uFlags |= RPF_UPDATEROM | RPF_PAD;
+					rpParams.uPadByte = (optarg != NULL) ? (uint8_t)strtoul(optarg, NULL, 0) : 0xFF;
+					if (rpParams.uFlags & RPF_TRIM) {
+						fprintf(stderr, "Error: --pad and --trim cannot be combined.\n");
+						setExitCode(&rpParams, EXIT_FAILURE);
+					}
+					break;
+					
+				case 29:
+					// Trim trailing fill down to the smallest valid size.
+					rpParams.uFlags |= RPF_UPDATEROM | RPF_TRIM;
+					if (rpParams.uFlags & RPF_PAD) {
+						fprintf(stderr, "Error: --pad and --trim cannot be combined.\n");
+						setExitCode(&rpParams, EXIT_FAILURE);
+					}
+					break;
+					
+				case 30:
+					// Report used and fill bytes per bank.
+					rpParams.uFlags |= RPF_FILLINFO;
+					break;
+					
+				case 31:
+					// Apply an IPS or BPS patch.
+					rpParams.uFlags |= RPF_UPDATEROM;
+					rpParams.pszPatch = optarg;
+					break;
+					
+				case 32:
+					// Time each file and print totals at exit.
+					rpParams.uFlags |= RPF_STATS;
+					unsigned int uStatsFormat;
+					if (getStatsFormat(optarg, &uStatsFormat)) {
+						fprintf(stderr, "Error: Unknown stats format: \"%s\"\n", optarg);
+						errno = 0;
+						setExitCode(&rpParams, EXIT_FAILURE);
+						break;
+					}
+					rpParams.uStatsFormat = uStatsFormat;
+					break;
+					
 				default:
 					// Handle unsupported long option.
 					fprintf(stderr, "Error: Unsupported long option: \"%s\"\n", optLongOpts[iLongOpt].name);
@@ -121,44 +289,36 @@ int main (int argc, char* argv[]) {
 				
 			case 'h':
 				// Show help message.
+				printBanner();
 				printHelp();
 				setExitCode(&rpParams, EXIT_SUCCESS);
 				break;
 				
 			case 'f':
-				// Select file.
-				
-				if (rpParams.uFlags & RPF_ROMFILE || rpParams.pszFileName != NULL) {
-					fprintf(stderr, "Error: ROM file already selected. Cannot operate on two files.\n");
-					break;
-				} else {
-					rpParams.uFlags |= RPF_ROMFILE;
-				}
-				
-				// Allocate string buffer.
-				rpParams.cchFileName = strlen(optarg);
-				if ((rpParams.pszFileName = malloc(rpParams.cchFileName * sizeof(char))) == NULL) {
-					perror("Could not allocate memory for file name buffer.\n");
+				// Add file, directory or @listfile.
+				if (addFileArg(rpParams.pFileList, optarg)) {
+					fprintf(stderr, "Error: Could not add file \"%s\": %m\n", optarg);
 					errno = 0;
 					setExitCode(&rpParams, EXIT_FAILURE);
 					break;
 				}
-				memset(rpParams.pszFileName, 0, rpParams.cchFileName * sizeof(char));
 				
-				// Copy into string buffer.
-				if (!strncpy(rpParams.pszFileName, optarg, rpParams.cchFileName)) {
-					perror("Could not copy file name to internal buffer.\n");
-					errno = 0;
-					setExitCode(&rpParams, EXIT_FAILURE);
-					break;
-				}
+				rpParams.uFlags |= RPF_ROMFILE;
+				break;
+				
+			case 'o':
+				// Set output file.
+				rpParams.pszOutFile = optarg;
+				break;
 				
+			case 'j':
+				// Set number of parallel jobs.
+				rpParams.nJobs = (unsigned int)strtoul(optarg, NULL, 0);
 				break;
 				
 			case 'v':
 				// Set verbose mode.
 				rpParams.uFlags |= RPF_VERBOSE;
-				printf("Using verbose mode.\n");
 				break;
 				
 			case 'd':
@@ -263,9 +423,106 @@ int main (int argc, char* argv[]) {
 		setExitCode(&rpParams, EXIT_FAILURE);
 	}
 	
-	// Perform operations on the ROM header.
-	if (doFileOperations(&rpParams))
+	// Pick up a command, or file names left over after the options.
+	if (fOptsDone && optind < argc && (strcmp(argv[optind], "index") == 0 || strcmp(argv[optind], "multicart") == 0)) {
+		rpParams.pszCommand = argv[optind];
+		rpParams.ppszCmdArgs = &argv[optind + 1];
+		rpParams.nCmdArgs = argc - optind - 1;
+	} else if (fOptsDone) {
+		for (int iArg = optind; iArg < argc; iArg++) {
+			if (addFileArg(rpParams.pFileList, argv[iArg])) {
+				fprintf(stderr, "Error: Could not add file \"%s\": %m\n", argv[iArg]);
+				setExitCode(&rpParams, EXIT_FAILURE);
+				break;
+			}
+			rpParams.uFlags |= RPF_ROMFILE;
+		}
+	}
+	
+	// Machine-readable reports replace all per-file text, so that only
+	// the report itself is written to stdout.
+	REPORT rptOut;
+	if (rpParams.uFormat == OUTFMT_TEXT) {
+		printBanner();
+		if (rpParams.uFlags & RPF_VERBOSE) {
+			printf("Using verbose mode.\n");
+			if (rpParams.uHashes) printf("Using %s CRC-32 and %s SHA-1 kernels.\n",
+				getRomHashImplStr(HASHF_CRC32), getRomHashImplStr(HASHF_SHA1));
+		}
+	} else if (rpParams.uFlags & (RPF_SERVE | RPF_CLIENT | RPF_WATCH)) {
+		fprintf(stderr, "Error: Only text output is supported with a daemon or a watched directory.\n");
+		setExitCode(&rpParams, EXIT_FAILURE);
+		doExit(&rpParams);
+	} else {
+		rpParams.uFlags |= RPF_NOROMINFO;
+		rpParams.uFlags &= ~RPF_VERBOSE;
+		
+		fflush(stdout);
+		if (openReport(&rptOut, STDOUT_FILENO, rpParams.uFormat)) {
+			perror("Could not allocate buffer for report.\n");
+			setExitCode(&rpParams, EXIT_FAILURE);
+			doExit(&rpParams);
+		}
+		rpParams.pReport = &rptOut;
+	}
+	
+	// Patches are only applied by the batch path.
+	if (rpParams.pszPatch != NULL && (rpParams.uFlags & (RPF_SERVE | RPF_CLIENT | RPF_WATCH | RPF_AUDIT | RPF_INVENTORY))) {
+		fprintf(stderr, "Error: A patch can only be applied to ROM files named on the command line.\n");
+		setExitCode(&rpParams, EXIT_FAILURE);
+		doExit(&rpParams);
+	}
+	
+	// So is --stats.
+	if ((rpParams.uFlags & RPF_STATS) && (rpParams.pszCommand != NULL || (rpParams.uFlags & (RPF_SERVE | RPF_WATCH | RPF_AUDIT | RPF_INVENTORY)))) {
+		fprintf(stderr, "Error: --stats can only be used with ROM files named on the command line.\n");
+		setExitCode(&rpParams, EXIT_FAILURE);
+		doExit(&rpParams);
+	}
+	
+	// Compile the header updates once for every ROM.
+	compileHdrPlan(rpParams.pHdrUps, &hpUpdates);
+	rpParams.pHdrPlan = &hpUpdates;
+	
+	// Open and maintain the checksum cache.
+	doCacheOperations(&rpParams);
+	
+	// Statistics are gathered by the batch path, which files and clients
+	// both go through.
+	RUN_STATS rsRun;
+	if ((rpParams.uFlags & RPF_STATS) && fOptsDone) {
+		initRunStats(&rsRun);
+		rpParams.pStats = &rsRun;
+	}
+	
+	// Perform operations on the ROM headers, or serve them to clients.
+	if (rpParams.pszCommand != NULL && strcmp(rpParams.pszCommand, "multicart") == 0) {
+		if (doMulticartOperations(&rpParams)) setExitCode(&rpParams, EXIT_FAILURE);
+	} else if (rpParams.pszCommand != NULL) {
+		if (doIndexOperations(&rpParams)) setExitCode(&rpParams, EXIT_FAILURE);
+	} else if (rpParams.uFlags & RPF_SERVE) {
+		if (doServeOperations(&rpParams)) setExitCode(&rpParams, EXIT_FAILURE);
+	} else if (rpParams.uFlags & RPF_WATCH) {
+		if (doWatchOperations(&rpParams)) setExitCode(&rpParams, EXIT_FAILURE);
+	} else if (rpParams.uFlags & RPF_AUDIT) {
+		if (doAuditOperations(&rpParams)) setExitCode(&rpParams, EXIT_FAILURE);
+	} else if (rpParams.uFlags & RPF_INVENTORY) {
+		if (doInventoryOperations(&rpParams)) setExitCode(&rpParams, EXIT_FAILURE);
+	} else if (doBatchOperations(&rpParams)) {
 		fprintf(stderr, "Error: Fatal error while performing file operations.\n");
+		setExitCode(&rpParams, EXIT_FAILURE);
+	}
+	
+	if (rpParams.pStats != NULL) {
+		printRunStats(stderr, rpParams.pStats, rpParams.uStatsFormat);
+		freeRunStats(rpParams.pStats);
+		rpParams.pStats = NULL;
+	}
+	
+	if (rpParams.pReport != NULL && closeReport(rpParams.pReport)) {
+		perror("Could not write report.\n");
+		setExitCode(&rpParams, EXIT_FAILURE);
+	}
 	
 	// Exit program.
 	doExit(&rpParams);
@@ -273,7 +530,318 @@ int main (int argc, char* argv[]) {
 	
 }
 
-int doFileOperations (PRUN_PARAMS prp) {
+// Print application name and version identifier, once.
+static void printBanner (void) {
+	
+	static int fShown = 0;
+	
+	if (fShown) return;
+	fShown = 1;
+	printf("%s v%s\n%s\n", s_pszAppName, s_pszAppVer, s_pszCopyright);
+	
+}
+
+void doCacheOperations (PRUN_PARAMS prp) {
+	
+	if (!(prp->uFlags & (RPF_CACHE | RPF_CACHECLEAR | RPF_CACHEGC))) return;
+	
+	const char* pszCachePath = prp->pszCachePath;
+	if (pszCachePath == NULL && (pszCachePath = getDefaultCachePath()) == NULL) {
+		fprintf(stderr, "Warning: No location for the checksum cache: %m\n");
+		errno = 0;
+		return;
+	}
+	
+	// Open the cache. Running without it is always possible, so
+	// failures only produce warnings.
+	if ((prp->pCache = malloc(sizeof(ROM_CACHE))) == NULL || openCache(pszCachePath, prp->pCache)) {
+		fprintf(stderr, "Warning: Could not open checksum cache \"%s\": %m\n", pszCachePath);
+		errno = 0;
+		free(prp->pCache);
+		prp->pCache = NULL;
+		return;
+	}
+	
+	if (prp->uFlags & RPF_CACHECLEAR) {
+		if (clearCache(prp->pCache)) {
+			fprintf(stderr, "Warning: Could not clear checksum cache: %m\n");
+			errno = 0;
+		} else if (prp->uFlags & RPF_VERBOSE) {
+			printf("Cleared checksum cache \"%s\".\n", pszCachePath);
+		}
+	}
+	
+	if (prp->uFlags & RPF_CACHEGC) {
+		size_t nDropped = 0;
+		if (gcCache(prp->pCache, (time_t)prp->nCacheGcDays * 86400, &nDropped)) {
+			fprintf(stderr, "Warning: Could not collect checksum cache: %m\n");
+			errno = 0;
+		} else if (prp->uFlags & RPF_VERBOSE) {
+			printf("Dropped %zu stale checksum cache entries.\n", nDropped);
+		}
+	}
+	
+}
+
+// Batch context shared by all jobs.
+typedef struct tagBATCH_CTX
+{
+	PRUN_PARAMS prp;
+	PROM_JOB pJobs;
+	int fBuffered; // Whether job output is buffered for ordered printing.
+	int nFailed; // Number of files that failed.
+	unsigned long int nBatch; // Number of the batch in this process.
+	char* pOutArena; // JOB_OUTSIZE + JOB_ERRSIZE bytes of output per job.
+	size_t cbOutArena;
+	PJOB_OUTBUF pBufs; // Output streams of each worker.
+	unsigned int nBufs;
+	unsigned int nBufsTaken; // Streams handed to workers so far.
+} BATCH_CTX, *PBATCH_CTX;
+
+// Batches run so far, so that a thread can tell whether its streams
+// belong to the running one.
+static unsigned long int s_nBatches;
+
+// Output streams of the worker running on this thread.
+static __thread PJOB_OUTBUF s_pWorkerBuf;
+static __thread unsigned long int s_nWorkerBatch;
+
+// Write callback of the worker streams. Output past the end of the job's
+// part of the arena is dropped, so a job never allocates.
+static ssize_t writeJobSink (void* pCookie, const char* pBuf, size_t cb) {
+	
+	PJOB_OUTSINK pSink = (PJOB_OUTSINK)pCookie;
+	size_t cbCopy = pSink->cchMax - pSink->cch;
+	if (cb > cbCopy) pSink->fTruncated = 1;
+	else cbCopy = cb;
+	
+	memcpy(pSink->pch + pSink->cch, pBuf, cbCopy);
+	pSink->cch += cbCopy;
+	return (ssize_t)cb;
+	
+}
+
+static void closeWorkerOutBufs (PBATCH_CTX pbc) {
+	
+	for (unsigned int iBuf = 0; iBuf < pbc->nBufs; iBuf++) {
+		fclose(pbc->pBufs[iBuf].pOut);
+		fclose(pbc->pBufs[iBuf].pErr);
+	}
+	free(pbc->pBufs);
+	pbc->pBufs = NULL;
+	pbc->nBufs = 0;
+	
+	if (pbc->pOutArena != NULL) munmap(pbc->pOutArena, pbc->cbOutArena);
+	pbc->pOutArena = NULL;
+	
+}
+
+// Make the output arena and the streams of every worker before the
+// workers start, so that running a job allocates nothing. The arena
+// holds a part for every job and is only backed by memory where output
+// is written; each part is given back once it has been printed.
+static int openWorkerOutBufs (PBATCH_CTX pbc, const size_t nJobs, const unsigned int nWorkers) {
+	
+	const cookie_io_functions_t iof = { .write = writeJobSink };
+	
+	pbc->nBatch = ++s_nBatches;
+	pbc->cbOutArena = nJobs * (JOB_OUTSIZE + JOB_ERRSIZE);
+	pbc->pOutArena = mmap(NULL, pbc->cbOutArena, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (pbc->pOutArena == MAP_FAILED) {
+		pbc->pOutArena = NULL;
+		return -1;
+	}
+	
+	if ((pbc->pBufs = calloc(nWorkers, sizeof(JOB_OUTBUF))) == NULL) goto fail;
+	for (; pbc->nBufs < nWorkers; pbc->nBufs++) {
+		PJOB_OUTBUF pBuf = &pbc->pBufs[pbc->nBufs];
+		if ((pBuf->pOut = fopencookie(&pBuf->sinkOut, "w", iof)) == NULL) goto fail;
+		if ((pBuf->pErr = fopencookie(&pBuf->sinkErr, "w", iof)) == NULL) {
+			fclose(pBuf->pOut);
+			goto fail;
+		}
+		setvbuf(pBuf->pOut, NULL, _IONBF, 0);
+		setvbuf(pBuf->pErr, NULL, _IONBF, 0);
+	}
+	
+	return 0;
+	
+fail:
+	{
+		int nErr = errno;
+		closeWorkerOutBufs(pbc);
+		errno = nErr;
+	}
+	return -1;
+	
+}
+
+// Get the output streams of this worker thread, taking a set on its
+// first job.
+static PJOB_OUTBUF getWorkerOutBuf (PBATCH_CTX pbc) {
+	
+	if (s_pWorkerBuf != NULL && s_nWorkerBatch == pbc->nBatch) return s_pWorkerBuf;
+	
+	unsigned int iBuf = __atomic_fetch_add(&pbc->nBufsTaken, 1, __ATOMIC_RELAXED);
+	if (iBuf >= pbc->nBufs) return NULL;
+	
+	s_pWorkerBuf = &pbc->pBufs[iBuf];
+	s_nWorkerBatch = pbc->nBatch;
+	return s_pWorkerBuf;
+	
+}
+
+// Point the job's streams at its part of the output arena, where its
+// output waits to be printed whole and in order, or else at stdout and
+// stderr. Nothing but the report goes to stdout when there is one.
+static void beginJobOutput (PBATCH_CTX pbc, size_t iJob) {
+	
+	PROM_JOB pJob = &pbc->pJobs[iJob];
+	pJob->pOut = stdout;
+	pJob->pErr = stderr;
+	if (!pbc->fBuffered || (pJob->pOutBuf = getWorkerOutBuf(pbc)) == NULL) return;
+	
+	PJOB_OUTBUF pBuf = pJob->pOutBuf;
+	char* pch = pbc->pOutArena + iJob * (JOB_OUTSIZE + JOB_ERRSIZE);
+	pBuf->sinkOut = (JOB_OUTSINK){ .pch = pch, .cchMax = JOB_OUTSIZE };
+	pBuf->sinkErr = (JOB_OUTSINK){ .pch = pch + JOB_OUTSIZE, .cchMax = JOB_ERRSIZE };
+	
+	if (pbc->prp->pReport == NULL) pJob->pOut = pBuf->pOut;
+	pJob->pErr = pBuf->pErr;
+	
+}
+
+static void endJobOutput (PROM_JOB pJob) {
+	
+	PJOB_OUTBUF pBuf = pJob->pOutBuf;
+	if (pBuf == NULL) return;
+	
+	pJob->pchJobOut = pBuf->sinkOut.pch;
+	pJob->cchJobOut = pBuf->sinkOut.cch;
+	pJob->pchJobErr = pBuf->sinkErr.pch;
+	pJob->cchJobErr = pBuf->sinkErr.cch;
+	pJob->fOutTruncated = pBuf->sinkOut.fTruncated || pBuf->sinkErr.fTruncated;
+	
+}
+
+// Print the output a job left in the arena, and give its part back.
+static void printJobOutput (PROM_JOB pJob) {
+	
+	if (pJob->pOutBuf == NULL) return;
+	
+	fwrite(pJob->pchJobOut, 1, pJob->cchJobOut, stdout);
+	fflush(stdout);
+	fwrite(pJob->pchJobErr, 1, pJob->cchJobErr, stderr);
+	if (pJob->fOutTruncated) fprintf(stderr, "Warning: \"%s\": Output was cut short.\n", pJob->pszFileName);
+	
+	madvise((void*)pJob->pchJobOut, JOB_OUTSIZE + JOB_ERRSIZE, MADV_DONTNEED);
+	
+}
+
+// Phase timing for --stats. Without it, a phase costs one flag test at
+// each end and the clock is never read.
+static inline uint64_t startJobPhase (const PRUN_PARAMS prp) {
+	
+	return (prp->uFlags & RPF_STATS) ? getMonotonicNs() : 0;
+	
+}
+
+static inline void endJobPhase (const PRUN_PARAMS prp, PROM_JOB pJob, const unsigned int uPhase, const uint64_t nStart,
+	const size_t cb) {
+	
+	if (!(prp->uFlags & RPF_STATS)) return;
+	pJob->stats.nPhaseNs[uPhase] += getMonotonicNs() - nStart;
+	pJob->stats.cbPhase[uPhase] += cb;
+	
+}
+
+static void runBatchJob (size_t iJob, void* pCtx) {
+	
+	PBATCH_CTX pbc = (PBATCH_CTX)pCtx;
+	PROM_JOB pJob = &pbc->pJobs[iJob];
+	
+	beginJobOutput(pbc, iJob);
+	const uint64_t nStart = startJobPhase(pbc->prp);
+	pJob->nResult = doFileOperations(pbc->prp, pJob);
+	if (pbc->prp->uFlags & RPF_STATS) pJob->stats.nTotalNs = getMonotonicNs() - nStart;
+	endJobOutput(pJob);
+	
+}
+
+static void runClientJob (size_t iJob, void* pCtx) {
+	
+	PBATCH_CTX pbc = (PBATCH_CTX)pCtx;
+	PROM_JOB pJob = &pbc->pJobs[iJob];
+	
+	beginJobOutput(pbc, iJob);
+	const uint64_t nStart = startJobPhase(pbc->prp);
+	pJob->nResult = doClientOperations(pbc->prp, pJob);
+	
+	// The daemon does the work, so only the round trip is known.
+	if (pbc->prp->uFlags & RPF_STATS) {
+		pJob->stats.nTotalNs = getMonotonicNs() - nStart;
+		if (stat(pJob->pszFileName, &pJob->stRom)) errno = 0;
+	}
+	endJobOutput(pJob);
+	
+}
+
+// Get the correct global checksum of the file as it was read, before
+// its header was updated and before any padding or trimming. Both are
+// carried back out of uGlobalChksum, which includes them.
+static inline uint16_t getReadGlobalChksum (const PROM_JOB pJob) {
+	
+	uint16_t uChksum = (uint16_t)(pJob->uGlobalChksum - (uint16_t)((size_t)pJob->nResize * pJob->uResizeFill));
+	return updGbGlobalChksum(uChksum, &pJob->hdr, &pJob->hdrOrig);
+	
+}
+
+// Add the record of a finished job to the report.
+static void reportBatchJob (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	REPORT_REC rr;
+	memset(&rr, 0, sizeof(REPORT_REC));
+	rr.pszFileName = pJob->pszFileName;
+	rr.nErr = pJob->nErr;
+	
+	if (pJob->nErr == 0) {
+		rr.pHdr = &pJob->hdrOrig;
+		rr.cbFile = (uint64_t)pJob->stRom.st_size - (uint64_t)(pJob->fResized ? pJob->nResize : 0);
+		rr.fGlobalKnown = pJob->fGlobalExact;
+		if (pJob->fGlobalExact) rr.uGlobalChksum = getReadGlobalChksum(pJob);
+		
+		if (pJob->hashes.uHashes) rr.pHashes = &pJob->hashes;
+		rr.fUpdated = ((prp->uFlags & RPF_UPDATEROM) && !(prp->uFlags & RPF_DRYRUN) && pJob->nResult == 0 &&
+			memcmp(&pJob->hdr, &pJob->hdrOrig, sizeof(GBHEAD)) != 0);
+	}
+	
+	writeReport(prp->pReport, &rr);
+	
+}
+
+static void finishBatchJob (size_t iJob, void* pCtx) {
+	
+	PBATCH_CTX pbc = (PBATCH_CTX)pCtx;
+	PROM_JOB pJob = &pbc->pJobs[iJob];
+	
+	if (pJob->nResult) pbc->nFailed++;
+	
+	if (pbc->prp->pReport != NULL) reportBatchJob(pbc->prp, pJob);
+	
+	if (pbc->prp->pStats != NULL) {
+		pJob->stats.cbFile = (uint64_t)pJob->stRom.st_size;
+		pJob->stats.fFailed = (pJob->nResult != 0);
+		if (addRunStats(pbc->prp->pStats, &pJob->stats)) {
+			fprintf(stderr, "Warning: Could not record stats for \"%s\": %m\n", pJob->pszFileName);
+			errno = 0;
+		}
+	}
+	
+	printJobOutput(pJob);
+	
+}
+
+int doBatchOperations (PRUN_PARAMS prp) {
 	
 	if (prp == NULL) {
 		errno = EFAULT;
@@ -283,138 +851,1948 @@ int doFileOperations (PRUN_PARAMS prp) {
 	}
 	
 	// Check for ROM file flag set.
-	if (!(prp->uFlags & RPF_ROMFILE)) {
-		setExitCode(prp, EXIT_SUCCESS);
+	if (!(prp->uFlags & RPF_ROMFILE) || prp->pFileList->nFiles == 0) return 0;
+	
+	// A ROM read from stdin is fixed in a single streaming pass.
+	for (size_t iFile = 0; iFile < prp->pFileList->nFiles; iFile++) {
+		if (strcmp(prp->pFileList->ppszFiles[iFile], "-") != 0) continue;
+		
+		if (prp->pFileList->nFiles > 1) {
+			fprintf(stderr, "Error: A ROM read from stdin cannot be combined with other files.\n");
+			return 1;
+		}
+		
+		if (prp->pReport != NULL) {
+			fprintf(stderr, "Error: Only text output is supported for a ROM read from stdin.\n");
+			return 1;
+		}
+		
+		if (doStreamOperations(prp)) setExitCode(prp, EXIT_FAILURE);
 		return 0;
 	}
 	
-	// Check file name buffer.
-	if (prp->pszFileName == NULL) {
-		fprintf(stderr, "Error: File name buffer not allocated.\n");
-		setExitCode(prp, EXIT_FAILURE);
-		return 1;
+	// An output file takes the fixed copy of exactly one ROM.
+	if (prp->pszOutFile != NULL) {
+		if (prp->pFileList->nFiles > 1 || (prp->uFlags & RPF_CLIENT)) {
+			fprintf(stderr, "Error: An output file can only be given for a single ROM fixed locally.\n");
+			return 1;
+		}
+		prp->uFlags |= RPF_UPDATEROM;
 	}
 	
-	// Allocate header buffer.
-	if ((prp->pHdr = malloc(sizeof(GBHEAD))) == NULL) {
-		perror("Could not allocate buffer for header.\n");
-		errno = 0;
-		setExitCode(prp, EXIT_FAILURE);
-		return 1;
+	// The patch is mapped once and shared by every job.
+	ROM_PATCH patch;
+	if (prp->pszPatch != NULL) {
+		if (openRomPatch(prp->pszPatch, &patch)) {
+			fprintf(stderr, "Error: \"%s\": Failed to open patch: %s\n", prp->pszPatch,
+				(errno == EBADMSG) ? "Patch fails its own CRC-32 check" : strerror(errno));
+			errno = 0;
+			return 1;
+		}
+		prp->pPatch = &patch;
+		if (prp->uFlags & RPF_VERBOSE)
+			printf("Applying %s patch \"%s\".\n", getRomPatchFormatStr(patch.uFormat), prp->pszPatch);
 	}
 	
-	// Read header from file.
-	if (loadHeaderFromFile(prp->pszFileName, prp->pHdr)) {
-		perror("Failed to load ROM header.\n");
+	BATCH_CTX bc;
+	memset(&bc, 0, sizeof(BATCH_CTX));
+	bc.prp = prp;
+	
+	// Allocate job states.
+	if ((bc.pJobs = calloc(prp->pFileList->nFiles, sizeof(ROM_JOB))) == NULL) {
+		perror("Could not allocate buffer for file jobs.\n");
 		errno = 0;
-		setExitCode(prp, EXIT_FAILURE);
+		if (prp->pPatch != NULL) closeRomPatch(prp->pPatch);
 		return 1;
 	}
 	
-	// Print ROM info.
-	if (!(prp->uFlags & RPF_NOROMINFO)) {
-		printf("Using file: \"%s\"\n", prp->pszFileName);
-		printRomInfo(prp->pHdr);
-	}
-	
-	// Skip file updates if update flag not set.
-	if (!(prp->uFlags & RPF_UPDATEROM)) {
-		setExitCode(prp, EXIT_SUCCESS);
-		return 0;
-	}
-	
-	// TODO: Add routine to copy updates from the update structure into header to write back.
+	for (size_t iJob = 0; iJob < prp->pFileList->nFiles; iJob++)
+		bc.pJobs[iJob].pszFileName = prp->pFileList->ppszFiles[iJob];
 	
-	validateChksums(prp);
+	unsigned int nThreads = prp->nJobs ? prp->nJobs : getDefaultJobCount();
+	if (nThreads > prp->pFileList->nFiles) nThreads = (unsigned int)prp->pFileList->nFiles;
+	bc.fBuffered = (nThreads > 1);
 	
-	// Print updated ROM header information.
-	if (prp->uFlags & RPF_VERBOSE || prp->uFlags & RPF_DRYRUN) {
-		printf("Updated ROM header:\n");
-		printRomInfo(prp->pHdr);
+	// Without buffers for ordered output, go through the files one at
+	// a time.
+	if (bc.fBuffered && openWorkerOutBufs(&bc, prp->pFileList->nFiles, nThreads)) {
+		fprintf(stderr, "Warning: Could not allocate output buffers, processing one file at a time: %m\n");
+		errno = 0;
+		nThreads = 1;
+		bc.fBuffered = 0;
 	}
 	
-	// Prevent save if dry run is enabled.
-	if (prp->uFlags & RPF_DRYRUN) {
-		setExitCode(prp, EXIT_SUCCESS);
-		return 0;
+	// Make room for the stats of every job.
+	if (prp->pStats != NULL && reserveRunStats(prp->pStats, prp->pFileList->nFiles)) {
+		fprintf(stderr, "Warning: Could not allocate buffer for stats: %m\n");
+		errno = 0;
 	}
 	
-	// Write header back to file.
-	if (saveHeaderToFile(prp->pszFileName, prp->pHdr)) {
-		perror("Failed to save ROM header to file.\n");
+	// Files processed in parallel already keep every CPU busy, so only
+	// split a single file's checksum scan across threads otherwise.
+	setSumBytesThreads(bc.fBuffered ? 1 : nThreads);
+	
+	// Run the jobs, here or on the daemon.
+	if (prp->uFlags & RPF_CLIENT) signal(SIGPIPE, SIG_IGN);
+	if (runJobs(prp->pFileList->nFiles, nThreads, (prp->uFlags & RPF_CLIENT) ? runClientJob : runBatchJob, finishBatchJob, &bc)) {
+		perror("Could not start file jobs.\n");
 		errno = 0;
-		setExitCode(prp, EXIT_FAILURE);
+		closeWorkerOutBufs(&bc);
+		free(bc.pJobs);
+		if (prp->pPatch != NULL) closeRomPatch(prp->pPatch);
 		return 1;
 	}
 	
-	// Set successful exit code & exit.
-	setExitCode(prp, EXIT_SUCCESS);
+	closeWorkerOutBufs(&bc);
+	free(bc.pJobs);
+	if (prp->pPatch != NULL) closeRomPatch(prp->pPatch);
+	prp->pPatch = NULL;
+	
+	if (bc.nFailed) setExitCode(prp, EXIT_FAILURE);
 	return 0;
 	
 }
 
-static inline void validateChksums (PRUN_PARAMS prp) {
+// Audit result of one file.
+typedef struct tagAUDIT_RESULT
+{
+	uint64_t uFindings; // HCF(HCB_*) mask.
+	int nErr; // errno value if the header could not be read.
+	uint64_t cbFile; // Size of the file.
+	GBHEAD hdr; // Header as read, kept for the report.
+} AUDIT_RESULT, *PAUDIT_RESULT;
+
+// Audit context shared by all jobs.
+typedef struct tagAUDIT_CTX
+{
+	PRUN_PARAMS prp;
+	PAUDIT_RESULT pResults;
+	size_t nFound[HCB_COUNT]; // Number of files with each finding.
+	size_t nFlagged; // Number of files with any finding.
+	size_t nFatal; // Number of files that will not boot.
+	size_t nFailed; // Number of files that could not be read.
+} AUDIT_CTX, *PAUDIT_CTX;
+
+static void runAuditJob (size_t iJob, void* pCtx) {
 	
-	uint8_t uNewHdrChksum = mkGbHdrChksum(prp->pHdr);
-	// uint16_t uNewGlobalChksum = mkGbHdrGlobalChksum(prp->pgbHdr);
+	PAUDIT_CTX pac = (PAUDIT_CTX)pCtx;
+	PAUDIT_RESULT par = &pac->pResults[iJob];
+	struct stat st;
+	int fd;
 	
-	// Update header checksum.
-	if (prp->pHdr->uHdrChksum != uNewHdrChksum) {
-		if (prp->uFlags & RPF_UPDATEROM) {
-			if (prp->uFlags & RPF_VERBOSE) printf("Updating header checksum to 0x%X.\n", uNewHdrChksum);
-			prp->pHdr->uHdrChksum = uNewHdrChksum;
-		} else {
-			printf("Warning: Header checksum is invalid. ROM will be unbootable on hardware! Correct value is 0x%X.\n", uNewHdrChksum);
-		}
+	// Only the header is read, so the audit costs one small read per file.
+	if ((fd = open(pac->prp->pFileList->ppszFiles[iJob], O_RDONLY | O_CLOEXEC)) < 0) {
+		par->nErr = errno;
+	} else {
+		if (fstat(fd, &st)) par->nErr = errno;
+		else if (pread(fd, &par->hdr, sizeof(GBHEAD), GBHEAD_OFFSET) != sizeof(GBHEAD)) par->nErr = errno ? errno : EINVAL;
+		else if (checkGbHeader(&par->hdr, (par->cbFile = (uint64_t)st.st_size), &par->uFindings)) par->nErr = errno;
+		close(fd);
 	}
+	errno = 0;
 	
-	// Update global checksum.
-	printf("Warning: Global checksum checker not yet implemented.\n");
-	/*
-	if (correctGlobalChksum(prp->pgbHdr) != uNewGlobalChksum) {
-		if (prp->uFlags & RPF_UPDATEROM) {
-			if (prp->uFlags & RPF_VERBOSE) printf("Updating global checksum to 0x%X.\n", uNewHdrChksum);
-			prp->pHdr->uGlobalChksum = uNewGlobalChksum;
-		} else {
-			printf("Warning: Global checksum is invalid. Real hardware \
-will not care, but emulators might give warnings!\n");
+}
+
+static void finishAuditJob (size_t iJob, void* pCtx) {
+	
+	PAUDIT_CTX pac = (PAUDIT_CTX)pCtx;
+	PAUDIT_RESULT par = &pac->pResults[iJob];
+	const char* pszFileName = pac->prp->pFileList->ppszFiles[iJob];
+	
+	if (pac->prp->pReport != NULL) {
+		REPORT_REC rr;
+		memset(&rr, 0, sizeof(REPORT_REC));
+		rr.pszFileName = pszFileName;
+		rr.nErr = par->nErr;
+		if (par->nErr == 0) {
+			rr.pHdr = &par->hdr;
+			rr.cbFile = par->cbFile;
 		}
+		writeReport(pac->prp->pReport, &rr);
+		
+		if (par->nErr) pac->nFailed++;
+		else if (par->uFindings & HCF_FATAL) pac->nFatal++;
+		return;
 	}
-	*/
 	
-}
-
-int doFileChecks (PRUN_PARAMS prp) {
+	if (par->nErr) {
+		fflush(stdout);
+		fprintf(stderr, "Error: \"%s\": Failed to load ROM header: %s\n", pszFileName, strerror(par->nErr));
+		pac->nFailed++;
+		return;
+	}
 	
-	// Stat the file.
-	struct stat st;
-	if (stat(prp->pszFileName, &st)) return 1;
+	if (par->uFindings == 0) {
+		if (pac->prp->uFlags & RPF_VERBOSE) printf("\"%s\": ok\n", pszFileName);
+		return;
+	}
 	
-	// Get the ROM size.
-	size_t cbRom;
-	if ((cbRom = getRomSizeInkB(prp->pHdr)) == 0) {
-		perror("Could not get ROM size field.\n");
-		errno = 0;
+	pac->nFlagged++;
+	if (par->uFindings & HCF_FATAL) pac->nFatal++;
+	
+	printf("\"%s\":", pszFileName);
+	const char* pszSep = " ";
+	for (unsigned int nBit = 0; nBit < HCB_COUNT; nBit++) {
+		if (!(par->uFindings & HCF(nBit))) continue;
+		pac->nFound[nBit]++;
+		printf("%s%s", pszSep, getHdrCheckStr(nBit));
+		pszSep = ", ";
 	}
-	cbRom <<= 10; // Convert to bytes.
+	printf("\n");
 	
-	// Compare the file size to the ROM size.
-	if (st.st_size != cbRom) {
-		
-		//prp->pHdrUps->uFlags |= UPF_ROMSIZE;
-		//prp->pHdrUps->uRomSize =
+}
+
+/*
+ * 
+ * name: doAuditOperations
+ * 
+ * 		Validates the header of every file without fixing anything, and
+ * 	prints the findings per file followed by a summary. Files are read
+ * 	in parallel and only their headers are read.
+ * 
+ * @param:
+ * 		PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * @return: int
+ * 		Returns zero if the audit ran, or nonzero on error. The exit
+ * 	code is set to failure if any file could not be read or will not
+ * 	boot.
+ * 
+ */
+int doAuditOperations (PRUN_PARAMS prp) {
+	
+	if (prp->uFlags & (RPF_UPDATEROM | RPF_CLIENT)) {
+		fprintf(stderr, "Error: An audit cannot be combined with header updates or a daemon.\n");
+		return 1;
+	}
+	
+	if (!(prp->uFlags & RPF_ROMFILE) || prp->pFileList->nFiles == 0) return 0;
+	
+	AUDIT_CTX ac;
+	memset(&ac, 0, sizeof(AUDIT_CTX));
+	ac.prp = prp;
+	
+	if ((ac.pResults = calloc(prp->pFileList->nFiles, sizeof(AUDIT_RESULT))) == NULL) {
+		perror("Could not allocate buffer for audit results.\n");
+		errno = 0;
+		return 1;
+	}
+	
+	unsigned int nThreads = prp->nJobs ? prp->nJobs : getDefaultJobCount();
+	if (runJobs(prp->pFileList->nFiles, nThreads, runAuditJob, finishAuditJob, &ac)) {
+		perror("Could not start audit jobs.\n");
+		errno = 0;
+		free(ac.pResults);
+		return 1;
+	}
+	free(ac.pResults);
+	
+	if (prp->pReport != NULL) {
+		if (ac.nFailed || ac.nFatal) setExitCode(prp, EXIT_FAILURE);
+		return 0;
+	}
+	
+	printf("Audited %zu file(s): %zu with findings, %zu unbootable, %zu unreadable.\n",
+		prp->pFileList->nFiles, ac.nFlagged, ac.nFatal, ac.nFailed);
+	for (unsigned int nBit = 0; nBit < HCB_COUNT; nBit++)
+		if (ac.nFound[nBit]) printf("\t%-44s %zu\n", getHdrCheckStr(nBit), ac.nFound[nBit]);
+	
+	if (ac.nFailed || ac.nFatal) setExitCode(prp, EXIT_FAILURE);
+	return 0;
+	
+}
+
+static void printInventoryHeader (size_t iFile, const PGBHEAD pHdr, int nErr, void* pCtx) {
+	
+	PRUN_PARAMS prp = (PRUN_PARAMS)pCtx;
+	const char* pszFileName = prp->pFileList->ppszFiles[iFile];
+	
+	if (prp->pReport != NULL) {
+		REPORT_REC rr;
+		memset(&rr, 0, sizeof(REPORT_REC));
+		rr.pszFileName = pszFileName;
+		rr.nErr = nErr;
+		rr.pHdr = pHdr;
+		writeReport(prp->pReport, &rr);
+		if (pHdr == NULL) setExitCode(prp, EXIT_FAILURE);
+		return;
+	}
+	
+	if (pHdr == NULL) {
+		fflush(stdout);
+		fprintf(stderr, "Error: \"%s\": Failed to load ROM header: %s\n", pszFileName, strerror(nErr));
+		setExitCode(prp, EXIT_FAILURE);
+		return;
+	}
+	
+	printf("Using file: \"%s\"\n", pszFileName);
+	printRomInfo(stdout, pHdr);
+	
+}
+
+/*
+ * 
+ * name: doInventoryOperations
+ * 
+ * 		Prints the header of every file, reading only the headers and
+ * 	keeping many reads in flight so slow storage is not waited on one
+ * 	file at a time.
+ * 
+ * @param:
+ * 		PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * @return: int
+ * 		Returns zero on success, or nonzero on error. The exit code is
+ * 	set to failure if any file could not be read.
+ * 
+ */
+int doInventoryOperations (PRUN_PARAMS prp) {
+	
+	if (prp->uFlags & (RPF_UPDATEROM | RPF_CLIENT | RPF_AUDIT)) {
+		fprintf(stderr, "Error: An inventory cannot be combined with header updates, an audit or a daemon.\n");
+		return 1;
+	}
+	
+	if (!(prp->uFlags & RPF_ROMFILE) || prp->pFileList->nFiles == 0) return 0;
+	
+	unsigned int nThreads = prp->nJobs ? prp->nJobs : getDefaultJobCount();
+	if (scanHeaders((const char* const*)prp->pFileList->ppszFiles, prp->pFileList->nFiles, nThreads, printInventoryHeader, prp)) {
+		perror("Could not read headers.\n");
+		errno = 0;
+		return 1;
+	}
+	
+	return 0;
+	
+}
+
+// Index build context shared by all jobs.
+typedef struct tagINDEX_CTX
+{
+	PRUN_PARAMS prp;
+	PROM_INDEX pOld; // Index being refreshed, or NULL.
+	const char* const* ppszFiles; // Files to index.
+	PINDEX_ROW pRows;
+	int* pnErrs; // errno value per file, or zero if indexed.
+	unsigned char* pfReused; // Whether each row was taken from pOld.
+	int fRefresh; // Drop vanished files instead of reporting them.
+	size_t nReused, nScanned, nDropped, nFailed;
+} INDEX_CTX, *PINDEX_CTX;
+
+// Read one file's header and checksums into its row.
+static int scanIndexRow (const PRUN_PARAMS prp, PINDEX_ROW pRow, const struct stat* pst) {
+	
+	ROM_FILE rf;
+	if (openRomFile(pRow->pszPath, &rf, 0)) return -1;
+	
+	if (readRomHeader(&rf, &pRow->hdr)) {
+		int nErr = errno;
+		closeRomFile(&rf);
+		errno = nErr;
+		return -1;
+	}
+	
+	uint64_t uFindings = 0;
+	checkGbHeader(&pRow->hdr, (uint64_t)pst->st_size, &uFindings);
+	pRow->uFindings = (uint32_t)uFindings;
+	
+	// The checksum cache saves the full scan for files seen before.
+	CACHE_ENTRY ce;
+	if (prp->pCache != NULL && lookupCache(prp->pCache, pst, &ce) > 0) {
+		pRow->uGlobalChksum = ce.uGlobalChksum;
+	} else {
+		pRow->uGlobalChksum = mkGbGlobalChksum(&pRow->hdr, rf.pRom, rf.cbRom);
+		if (prp->pCache != NULL) {
+			memset(&ce, 0, sizeof(CACHE_ENTRY));
+			ce.uHdrChksum = mkGbHdrChksum(&pRow->hdr);
+			ce.uGlobalChksum = pRow->uGlobalChksum;
+			if (pRow->hdr.uHdrChksum == ce.uHdrChksum) ce.uFlags |= CEF_HDROK;
+			if (correctGlobalChksum(&pRow->hdr) == ce.uGlobalChksum) ce.uFlags |= CEF_GLOBALOK;
+			storeCache(prp->pCache, pst, &ce);
+		}
+	}
+	closeRomFile(&rf);
+	errno = 0;
+	
+	pRow->uStatus = 0;
+	if (pRow->hdr.uHdrChksum == mkGbHdrChksum(&pRow->hdr)) pRow->uStatus |= IXS_HDROK;
+	if (correctGlobalChksum(&pRow->hdr) == pRow->uGlobalChksum) pRow->uStatus |= IXS_GLOBALOK;
+	
+	return 0;
+	
+}
+
+static void runIndexJob (size_t iJob, void* pCtx) {
+	
+	PINDEX_CTX pic = (PINDEX_CTX)pCtx;
+	PINDEX_ROW pRow = &pic->pRows[iJob];
+	struct stat st;
+	size_t iOldRow;
+	
+	// Rows are keyed by absolute path so the index can be refreshed
+	// from any directory.
+	char* pszPath;
+	if ((pszPath = realpath(pic->ppszFiles[iJob], NULL)) == NULL || stat(pszPath, &st)) {
+		pic->pnErrs[iJob] = errno;
+		free(pszPath);
+		errno = 0;
+		return;
+	}
+	pRow->pszPath = pszPath;
+	
+	// Files whose identity is unchanged keep their old row.
+	if (pic->pOld != NULL && findRomIndexRow(pic->pOld, pszPath, &iOldRow) == 1) {
+		const INDEX_ID* pId = &pic->pOld->pIds[iOldRow];
+		if (pId->uDev == (uint64_t)st.st_dev && pId->uIno == (uint64_t)st.st_ino &&
+			pId->uSize == (uint64_t)st.st_size &&
+			pId->nMtimeNs == (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec &&
+			getRomIndexRow(pic->pOld, iOldRow, pRow) == 0) {
+			pRow->pszPath = pszPath;
+			pic->pfReused[iJob] = 1;
+			return;
+		}
+	}
+	
+	pRow->id.uDev = (uint64_t)st.st_dev;
+	pRow->id.uIno = (uint64_t)st.st_ino;
+	pRow->id.uSize = (uint64_t)st.st_size;
+	pRow->id.nMtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	
+	if (scanIndexRow(pic->prp, pRow, &st)) {
+		pic->pnErrs[iJob] = errno;
+		errno = 0;
+	}
+	
+}
+
+static void finishIndexJob (size_t iJob, void* pCtx) {
+	
+	PINDEX_CTX pic = (PINDEX_CTX)pCtx;
+	int nErr = pic->pnErrs[iJob];
+	
+	if (nErr == 0) {
+		if (pic->pfReused[iJob]) pic->nReused++;
+		else pic->nScanned++;
+		return;
+	}
+	
+	if (pic->fRefresh && nErr == ENOENT) {
+		pic->nDropped++;
+		return;
+	}
+	
+	fflush(stdout);
+	fprintf(stderr, "Error: \"%s\": Failed to index ROM: %s\n", pic->ppszFiles[iJob], strerror(nErr));
+	pic->nFailed++;
+	
+}
+
+// Index the files given, or the files already in the index when
+// refreshing, reusing the rows of files that did not change.
+static int buildRomIndex (PRUN_PARAMS prp, const char* pszIndex, const int fRefresh) {
+	
+	ROM_INDEX riOld;
+	INDEX_CTX ic;
+	memset(&ic, 0, sizeof(INDEX_CTX));
+	ic.prp = prp;
+	ic.fRefresh = fRefresh;
+	
+	if (openRomIndex(pszIndex, &riOld) == 0) {
+		ic.pOld = &riOld;
+	} else if (fRefresh || errno != ENOENT) {
+		fprintf(stderr, "Error: \"%s\": Failed to open index: %m\n", pszIndex);
+		errno = 0;
+		return 1;
+	}
+	errno = 0;
+	
+	size_t nFiles = fRefresh ? riOld.nRows : prp->pFileList->nFiles;
+	const char** ppszFiles = NULL;
+	int nRet = 1;
+	
+	if (nFiles != 0 && ((ic.pRows = calloc(nFiles, sizeof(INDEX_ROW))) == NULL ||
+		(ic.pnErrs = calloc(nFiles, sizeof(int))) == NULL ||
+		(ic.pfReused = calloc(nFiles, 1)) == NULL ||
+		(ppszFiles = calloc(nFiles, sizeof(char*))) == NULL)) {
+		perror("Could not allocate buffer for index rows.\n");
+		errno = 0;
+		goto done;
+	}
+	
+	for (size_t iFile = 0; iFile < nFiles; iFile++)
+		ppszFiles[iFile] = fRefresh ? getRomIndexPath(&riOld, iFile) : prp->pFileList->ppszFiles[iFile];
+	ic.ppszFiles = ppszFiles;
+	
+	// Build the path table before the jobs share the old index.
+	size_t iUnused;
+	if (ic.pOld != NULL && findRomIndexRow(ic.pOld, "", &iUnused) < 0) {
+		perror("Could not allocate buffer for index lookups.\n");
+		errno = 0;
+		goto done;
+	}
+	
+	unsigned int nThreads = prp->nJobs ? prp->nJobs : getDefaultJobCount();
+	setSumBytesThreads(1);
+	if (runJobs(nFiles, nThreads, runIndexJob, finishIndexJob, &ic)) {
+		perror("Could not start index jobs.\n");
+		errno = 0;
+		goto done;
+	}
+	
+	// Keep the rows that were indexed, in order.
+	size_t nRows = 0;
+	for (size_t iFile = 0; iFile < nFiles; iFile++) {
+		if (ic.pnErrs[iFile]) continue;
+		
+		// Swap rather than copy, so every path is still freed once.
+		INDEX_ROW irKept = ic.pRows[iFile];
+		ic.pRows[iFile] = ic.pRows[nRows];
+		ic.pRows[nRows++] = irKept;
+	}
+	
+	if (writeRomIndex(pszIndex, ic.pRows, nRows)) {
+		fprintf(stderr, "Error: \"%s\": Failed to write index: %m\n", pszIndex);
+		errno = 0;
+		goto done;
+	}
+	
+	if (prp->pReport == NULL)
+		printf("Indexed %zu file(s): %zu unchanged, %zu scanned, %zu removed, %zu failed.\n",
+			nRows, ic.nReused, ic.nScanned, ic.nDropped, ic.nFailed);
+	
+	if (ic.nFailed) setExitCode(prp, EXIT_FAILURE);
+	nRet = 0;
+	
+done:
+	for (size_t iFile = 0; ic.pRows != NULL && iFile < nFiles; iFile++) free((char*)ic.pRows[iFile].pszPath);
+	free(ic.pRows);
+	free(ic.pnErrs);
+	free(ic.pfReused);
+	free(ppszFiles);
+	if (ic.pOld != NULL) closeRomIndex(ic.pOld);
+	return nRet;
+	
+}
+
+// Print the rows of the index that satisfy every predicate.
+static int queryIndex (PRUN_PARAMS prp, const char* pszIndex, char** ppszPreds, const int nPreds) {
+	
+	ROM_INDEX ri;
+	PINDEX_PRED pPreds = NULL;
+	uint8_t* pSel = NULL;
+	int nRet = 1;
+	
+	if (openRomIndex(pszIndex, &ri)) {
+		fprintf(stderr, "Error: \"%s\": Failed to open index: %m\n", pszIndex);
+		errno = 0;
+		return 1;
+	}
+	
+	if ((pPreds = calloc(nPreds + 1, sizeof(INDEX_PRED))) == NULL || (pSel = malloc(ri.nRows + 1)) == NULL) {
+		perror("Could not allocate buffer for query.\n");
+		errno = 0;
+		goto done;
+	}
+	
+	for (int iPred = 0; iPred < nPreds; iPred++) {
+		if (parseIndexPred(ppszPreds[iPred], &pPreds[iPred])) {
+			fprintf(stderr, "Error: Bad query predicate: \"%s\"\n", ppszPreds[iPred]);
+			errno = 0;
+			goto done;
+		}
+	}
+	
+	size_t nMatches;
+	if (queryRomIndex(&ri, pPreds, nPreds, pSel, &nMatches)) {
+		perror("Could not run query.\n");
+		errno = 0;
+		goto done;
+	}
+	
+	INDEX_ROW ir;
+	for (size_t iRow = 0; iRow < ri.nRows; iRow++) {
+		if (!pSel[iRow] || getRomIndexRow(&ri, iRow, &ir)) continue;
 		
-		// Get new ROM size.
-		uint8_t uRomSizeNew = 0;
-		while (((32 << uRomSizeNew) << 10) != st.st_size) uRomSizeNew++;
+		if (prp->pReport == NULL) {
+			printf("%s\n", ir.pszPath);
+			continue;
+		}
 		
-		if (prp->uFlags & RPF_DRYRUN) {
-			printf("Warning: ROM size (%ldkB (0x%X)) and file size (%ldkB) do not match! Should be updated to %ldkB (0x%X).\n", cbRom >> 10, prp->pHdr->uRomSize, st.st_size >> 10, uRomSizeNew >> 10, uRomSizeNew);
+		REPORT_REC rr;
+		memset(&rr, 0, sizeof(REPORT_REC));
+		rr.pszFileName = ir.pszPath;
+		rr.pHdr = &ir.hdr;
+		rr.cbFile = ir.id.uSize;
+		rr.fGlobalKnown = 1;
+		rr.uGlobalChksum = ir.uGlobalChksum;
+		writeReport(prp->pReport, &rr);
+	}
+	
+	if (prp->uFlags & RPF_VERBOSE) printf("%zu of %zu ROM(s) match.\n", nMatches, ri.nRows);
+	nRet = 0;
+	
+done:
+	free(pPreds);
+	free(pSel);
+	closeRomIndex(&ri);
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: doIndexOperations
+ * 
+ * 		Runs an index command: "index build <INDEX> <FILE>..." indexes
+ * 	the files, "index refresh <INDEX>" rescans the files already in the
+ * 	index that changed, and "index query <INDEX> <PREDICATE>..." lists
+ * 	the indexed ROMs matching every predicate.
+ * 
+ * @param:
+ * 		PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * @return: int
+ * 		Returns zero on success, or nonzero on error.
+ * 
+ */
+int doIndexOperations (PRUN_PARAMS prp) {
+	
+	if (prp->uFlags & (RPF_UPDATEROM | RPF_CLIENT | RPF_AUDIT | RPF_INVENTORY)) {
+		fprintf(stderr, "Error: An index command cannot be combined with header updates, an audit or a daemon.\n");
+		return 1;
+	}
+	
+	if (prp->nCmdArgs < 2) {
+		fprintf(stderr, "Error: Expected \"index build|refresh|query <INDEX> ...\".\n");
+		return 1;
+	}
+	
+	const char* pszVerb = prp->ppszCmdArgs[0];
+	const char* pszIndex = prp->ppszCmdArgs[1];
+	
+	if (strcmp(pszVerb, "query") == 0) return queryIndex(prp, pszIndex, &prp->ppszCmdArgs[2], prp->nCmdArgs - 2);
+	
+	if (strcmp(pszVerb, "refresh") == 0) {
+		if (prp->nCmdArgs > 2) {
+			fprintf(stderr, "Error: \"index refresh\" takes no files; use \"index build\" to change them.\n");
+			return 1;
+		}
+		return buildRomIndex(prp, pszIndex, 1);
+	}
+	
+	if (strcmp(pszVerb, "build") == 0) {
+		for (int iArg = 2; iArg < prp->nCmdArgs; iArg++) {
+			if (addFileArg(prp->pFileList, prp->ppszCmdArgs[iArg])) {
+				fprintf(stderr, "Error: Could not add file \"%s\": %m\n", prp->ppszCmdArgs[iArg]);
+				errno = 0;
+				return 1;
+			}
+		}
+		return buildRomIndex(prp, pszIndex, 0);
+	}
+	
+	fprintf(stderr, "Error: Unknown index command: \"%s\"\n", pszVerb);
+	return 1;
+	
+}
+
+/*
+ * 
+ * name: doMulticartOperations
+ * 
+ * 		Runs "multicart <OUT> <MENU> <ROM>...", which assembles the menu
+ * 	and the ROMs into one image. The menu's header becomes the outer
+ * 	header and takes any header updates; the fill byte is the one given
+ * 	to --pad, or 0xFF. The image is built in a new file next to OUT and
+ * 	renamed over it once complete. Its mapping is never touched; the
+ * 	ROMs are copied in by the kernel.
+ * 
+ * @param:
+ * 		PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * @return: int
+ * 		Returns zero on success, or nonzero on error.
+ * 
+ */
+int doMulticartOperations (PRUN_PARAMS prp) {
+	
+	static const char szSuffix[] = ".gbfix-XXXXXX";
+	
+	if (prp->uFlags & (RPF_TRIM | RPF_CLIENT | RPF_SERVE | RPF_WATCH | RPF_AUDIT | RPF_INVENTORY) ||
+		prp->pszPatch != NULL || prp->pszOutFile != NULL) {
+		fprintf(stderr, "Error: A multicart cannot be combined with trimming, a patch, -o, an audit or a daemon.\n");
+		return 1;
+	}
+	
+	if (prp->uFormat != OUTFMT_TEXT) {
+		fprintf(stderr, "Error: Only text output is supported when building a multicart.\n");
+		return 1;
+	}
+	
+	if (prp->nCmdArgs < 3) {
+		fprintf(stderr, "Error: Expected \"multicart <OUT> <MENU> <ROM>...\".\n");
+		return 1;
+	}
+	
+	const char* pszOut = prp->ppszCmdArgs[0];
+	const uint8_t uFill = (prp->uFlags & RPF_PAD) ? prp->uPadByte : 0xFF;
+	char szTemp[PATH_MAX];
+	int fTemp = 0; // Whether szTemp names a file to remove on error.
+	int nRet = 1;
+	MULTICART mc;
+	ROM_FILE rfOut = { .fd = -1 };
+	
+	if (strlen(pszOut) + sizeof(szSuffix) > sizeof(szTemp)) {
+		fprintf(stderr, "Error: \"%s\": Output file name is too long.\n", pszOut);
+		return 1;
+	}
+	
+	if (openMulticart(&mc, (const char* const*)&prp->ppszCmdArgs[1], (size_t)prp->nCmdArgs - 1, uFill)) {
+		fprintf(stderr, "Error: \"%s\": Failed to open ROM file: %m\n", prp->ppszCmdArgs[1 + mc.nEntries]);
+		goto done;
+	}
+	
+	// The menu's header is the outer one.
+	if (prp->uFlags & RPF_UPDATEROM) applyHdrPlan(&mc.pEntries[0].hdr, prp->pHdrPlan);
+	
+	if (planMulticart(&mc)) {
+		if (errno == ENOTSUP) {
+			fprintf(stderr, "Error: \"%s\": Menu cartridge type 0x%02X is not an MBC1 or MMM01 multicart mapper.\n",
+				mc.pEntries[0].pszFileName, mc.pEntries[0].hdr.uCartType);
+		} else if (errno == EFBIG) {
+			fprintf(stderr, "Error: An MBC1 multicart holds the menu and at most %d games of up to 256kiB.\n", MC_MBC1MAX - 1);
 		} else {
-			prp->pHdrUps->uFlags |= UPF_ROMSIZE;
-			prp->pHdrUps->uRomSize = uRomSizeNew;
+			fprintf(stderr, "Error: Could not lay out multicart: %m\n");
+		}
+		goto done;
+	}
+	
+	if (mc.pEntries[0].hdr.uRomSize > ROMSIZE_MAX)
+		fprintf(stderr, "Warning: Multicart of %zu bytes is larger than any standard ROM size; using size code 0x%02X.\n",
+			mc.cbImage, mc.pEntries[0].hdr.uRomSize);
+	
+	if (prp->uFlags & (RPF_VERBOSE | RPF_DRYRUN)) {
+		printf("Building %s multicart of %zu bytes, filled with 0x%02X:\n", getMulticartLayoutStr(mc.uLayout), mc.cbImage, uFill);
+		for (size_t iEnt = 0; iEnt < mc.nEntries; iEnt++) {
+			const PMC_ENTRY pEnt = &mc.pEntries[iEnt];
+			printf("\t0x%08jX-0x%08jX: %s \"%s\" (%zu bytes)\n", (uintmax_t)pEnt->offImage,
+				(uintmax_t)pEnt->offImage + pEnt->cbSlot - 1, (iEnt == 0) ? "Menu" : "ROM ", pEnt->pszFileName, pEnt->rf.cbRom);
+		}
+	}
+	
+	if (prp->uFlags & RPF_DRYRUN) {
+		nRet = 0;
+		goto done;
+	}
+	
+	strcpy(szTemp, pszOut);
+	strcat(szTemp, szSuffix);
+	if (createRomFile(szTemp, mc.cbImage, NULL, &rfOut)) {
+		fprintf(stderr, "Error: \"%s\": Failed to create output file: %m\n", pszOut);
+		goto done;
+	}
+	fTemp = 1;
+	fchmod(rfOut.fd, 0644);
+	
+	if (buildMulticart(&mc, rfOut.fd) || fdatasync(rfOut.fd) || closeRomFile(&rfOut)) {
+		fprintf(stderr, "Error: \"%s\": Failed to write multicart: %m\n", pszOut);
+		goto done;
+	}
+	if (rename(szTemp, pszOut)) {
+		fprintf(stderr, "Error: \"%s\": Failed to publish multicart: %m\n", pszOut);
+		goto done;
+	}
+	
+	if (prp->uFlags & RPF_VERBOSE) printf("Global checksum of multicart is 0x%02X%02X.\n",
+		mc.pEntries[0].hdr.uGlobalChksum[0], mc.pEntries[0].hdr.uGlobalChksum[1]);
+	nRet = 0;
+	
+done:
+	if (rfOut.fd >= 0) closeRomFile(&rfOut);
+	if (nRet && fTemp) unlink(szTemp);
+	closeMulticart(&mc);
+	errno = 0;
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: doStreamOperations
+ * 
+ * 		Fixes a ROM read from stdin and writes it to the output file in
+ * 	one pass. The header is updated and its checksum settled as soon
+ * 	as the first chunk arrives, the global checksum is summed as the
+ * 	chunks go through, and its two bytes are patched in at the end.
+ * 	The output must therefore be seekable.
+ * 
+ * @param:
+ * 		const PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * @return: int
+ * 		Returns zero on success, or nonzero on error.
+ * 
+ */
+int doStreamOperations (const PRUN_PARAMS prp) {
+	
+	const size_t cbChunk = 1 << 20; // Streaming chunk size.
+	const int fDryRun = (prp->uFlags & RPF_DRYRUN) != 0;
+	
+	if (prp->pszOutFile == NULL && !fDryRun) {
+		fprintf(stderr, "Error: A ROM read from stdin needs an output file (-o).\n");
+		return 1;
+	}
+	
+	if (prp->uFlags & (RPF_PAD | RPF_TRIM) || prp->pszPatch != NULL) {
+		fprintf(stderr, "Error: A ROM read from stdin cannot be padded, trimmed or patched.\n");
+		return 1;
+	}
+	
+	if (prp->uHashes) fprintf(stderr, "Warning: Content hashes are not computed for a ROM read from stdin.\n");
+	
+	uint8_t* pBuf;
+	if ((pBuf = malloc(cbChunk)) == NULL) {
+		perror("Could not allocate stream buffer.\n");
+		errno = 0;
+		return 1;
+	}
+	
+	int fdOut = -1;
+	int nRet = 1;
+	uint64_t uSum = 0; // Global checksum accumulator.
+	uint64_t cbTotal = 0; // Bytes streamed.
+	ssize_t cbRead;
+	GBHEAD hdr, hdrOrig;
+	
+	// The first chunk must contain the whole header.
+	if ((cbRead = readFull(STDIN_FILENO, pBuf, cbChunk)) < 0) {
+		fprintf(stderr, "Error: Failed to read ROM from stdin: %m\n");
+		goto done;
+	}
+	if (cbRead < GBHEAD_ROMMIN) {
+		fprintf(stderr, "Error: ROM read from stdin is too small to hold a header.\n");
+		goto done;
+	}
+	
+	memcpy(&hdr, pBuf + GBHEAD_OFFSET, sizeof(GBHEAD));
+	memcpy(&hdrOrig, &hdr, sizeof(GBHEAD));
+	
+	if (!(prp->uFlags & RPF_NOROMINFO)) {
+		printf("Using file: <stdin>\n");
+		printRomInfo(stdout, &hdr);
+	}
+	
+	// Update the header and settle its checksum.
+	if (prp->uFlags & RPF_UPDATEROM) applyHdrPlan(&hdr, prp->pHdrPlan);
+	
+	uint8_t uNewHdrChksum = mkGbHdrChksum(&hdr);
+	if (hdr.uHdrChksum != uNewHdrChksum && (prp->uFlags & RPF_VERBOSE))
+		printf("Updating header checksum to 0x%X.\n", uNewHdrChksum);
+	hdr.uHdrChksum = uNewHdrChksum;
+	memcpy(pBuf + GBHEAD_OFFSET, &hdr, sizeof(GBHEAD));
+	
+	// Open the output and make sure the checksum can be patched later.
+	if (!fDryRun) {
+		if ((fdOut = open(prp->pszOutFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+			fprintf(stderr, "Error: \"%s\": Failed to open output file: %m\n", prp->pszOutFile);
+			goto done;
+		}
+		if (lseek(fdOut, 0, SEEK_CUR) < 0) {
+			fprintf(stderr, "Error: \"%s\": Output file must be seekable: %m\n", prp->pszOutFile);
+			goto done;
+		}
+	}
+	
+	// Sum everything but the global checksum bytes of the first chunk.
+	uSum = sumBytes(pBuf, offsetof(GBHEAD, uGlobalChksum) + GBHEAD_OFFSET) +
+		sumBytes(pBuf + GBHEAD_ROMMIN, (size_t)cbRead - GBHEAD_ROMMIN);
+	
+	// Stream the rest of the image through.
+	while (cbRead > 0) {
+		if (fdOut >= 0 && writeFull(fdOut, pBuf, (size_t)cbRead)) {
+			fprintf(stderr, "Error: \"%s\": Failed to write output file: %m\n", prp->pszOutFile);
+			goto done;
 		}
+		cbTotal += (uint64_t)cbRead;
+		
+		if ((size_t)cbRead < cbChunk) break;
+		if ((cbRead = readFull(STDIN_FILENO, pBuf, cbChunk)) < 0) {
+			fprintf(stderr, "Error: Failed to read ROM from stdin: %m\n");
+			goto done;
+		}
+		uSum += sumBytes(pBuf, (size_t)cbRead);
+	}
+	
+	// Patch in the global checksum.
+	uint16_t uNewGlobalChksum = (uint16_t)(uSum & 0xFFFF);
+	if (correctGlobalChksum(&hdr) != uNewGlobalChksum && (prp->uFlags & RPF_VERBOSE))
+		printf("Updating global checksum to 0x%X.\n", uNewGlobalChksum);
+	setGlobalChksum(&hdr, uNewGlobalChksum);
+	
+	if (fdOut >= 0 && pwrite(fdOut, hdr.uGlobalChksum, sizeof(hdr.uGlobalChksum),
+		GBHEAD_OFFSET + offsetof(GBHEAD, uGlobalChksum)) != sizeof(hdr.uGlobalChksum)) {
+		fprintf(stderr, "Error: \"%s\": Failed to write global checksum: %m\n", prp->pszOutFile);
+		goto done;
+	}
+	
+	if (prp->uFlags & RPF_VERBOSE || fDryRun) {
+		printf("Updated ROM header (%llu bytes streamed):\n", (unsigned long long)cbTotal);
+		printRomInfo(stdout, &hdr);
+	}
+	
+	nRet = 0;
+	
+done:
+	errno = 0;
+	if (fdOut >= 0 && close(fdOut) && nRet == 0) {
+		fprintf(stderr, "Error: \"%s\": Failed to close output file: %m\n", prp->pszOutFile);
+		nRet = 1;
+	}
+	free(pBuf);
+	return nRet;
+	
+}
+
+// Set by SIGINT and SIGTERM to stop the daemon or watcher.
+static volatile sig_atomic_t s_fStop = 0;
+
+static void onStopSignal (int nSig) {
+	
+	s_fStop = 1;
+	
+}
+
+static void installStopHandlers (void) {
+	
+	// Leaving out SA_RESTART makes blocking poll calls return so the
+	// loops notice the request promptly.
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = onStopSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	
+}
+
+// Daemon context shared by all workers.
+typedef struct tagSERVE_CTX
+{
+	PRUN_PARAMS prp;
+	int fdListen; // Non-blocking listening socket.
+} SERVE_CTX, *PSERVE_CTX;
+
+static const char* const s_pszServeOps[SRVOP_COUNT] = { "info", "verify", "fix" };
+
+/*
+ * 
+ * name: serveRequest
+ * 
+ * 		Runs one daemon request exactly as the command line would run
+ * 	the same file, collecting its output for the response.
+ * 
+ * @param:
+ * 		const PRUN_PARAMS prp:
+ * 			Pointer to the daemon's runtime parameters.
+ * 
+ * 		const PSRV_REQ pReq:
+ * 			Pointer to the received request.
+ * 
+ * 		const char* pszPath:
+ * 			File name from the request.
+ * 
+ * 		const char* pszName:
+ * 			Name to show for the file.
+ * 
+ * 		int fdConn:
+ * 			Descriptor to send the response to.
+ * 
+ * @return: int
+ * 		Returns zero if the response was sent, or nonzero if the
+ * 	connection should be dropped.
+ * 
+ */
+static int serveRequest (const PRUN_PARAMS prp, const PSRV_REQ pReq, const char* pszPath, const char* pszName, int fdConn) {
+	
+	RUN_PARAMS rp;
+	HDR_UPDATES hu;
+	HDR_PLAN hp;
+	ROM_JOB job;
+	
+	// Only the daemon's own user may have files rewritten with its
+	// rights, whatever the socket file allows.
+	if (checkServerPeer(fdConn)) {
+		static const char szDenied[] = "Error: Request refused: only the daemon's user may send requests.\n";
+		if (prp->uFlags & RPF_VERBOSE) printf("Request: %s \"%s\": refused: %m\n", s_pszServeOps[pReq->uOp], pszPath);
+		errno = 0;
+		return sendResponse(fdConn, 1, NULL, 0, szDenied, sizeof(szDenied) - 1);
+	}
+	
+	// Requests share the daemon's cache but bring their own options.
+	memcpy(&rp, prp, sizeof(RUN_PARAMS));
+	unpackRequest(pReq, &hu);
+	compileHdrPlan(&hu, &hp);
+	rp.pHdrUps = &hu;
+	rp.pHdrPlan = &hp;
+	rp.pFileList = NULL;
+	rp.uFlags &= RPF_FULLRESCAN;
+	if (pReq->uOpts & SRVO_VERBOSE) rp.uFlags |= RPF_VERBOSE;
+	if (pReq->uOpts & SRVO_DRYRUN) rp.uFlags |= RPF_DRYRUN;
+	if (pReq->uOpts & SRVO_NOROMINFO) rp.uFlags |= RPF_NOROMINFO;
+	if (pReq->uOpts & SRVO_FULLRESCAN) rp.uFlags |= RPF_FULLRESCAN;
+	if (pReq->uOpts & SRVO_PAD) rp.uFlags |= RPF_PAD;
+	if (pReq->uOpts & SRVO_TRIM) rp.uFlags |= RPF_TRIM;
+	if (pReq->uOpts & SRVO_FILLINFO) rp.uFlags |= RPF_FILLINFO;
+	rp.uPadByte = pReq->uPadByte;
+	if (pReq->uOp == SRVOP_FIX) rp.uFlags |= RPF_UPDATEROM;
+	
+	memset(&job, 0, sizeof(ROM_JOB));
+	job.pszFileName = pszName;
+	job.pszPath = pszPath;
+	if ((job.pOut = open_memstream(&job.pszOut, &job.cchOut)) == NULL ||
+		(job.pErr = open_memstream(&job.pszErr, &job.cchErr)) == NULL) {
+		if (job.pOut != NULL) fclose(job.pOut);
+		free(job.pszOut);
+		return sendResponse(fdConn, 1, NULL, 0, NULL, 0);
+	}
+	
+	if (pReq->uOp != SRVOP_INFO) {
+		job.nResult = doFileOperations(&rp, &job);
+	} else if (openRomFile(pszPath, &job.rf, 0) || readRomHeader(&job.rf, &job.hdr)) {
+		fprintf(job.pErr, "Error: \"%s\": Failed to load ROM header: %m\n", pszName);
+		errno = 0;
+		closeRomFile(&job.rf);
+		job.nResult = 1;
+	} else {
+		fprintf(job.pOut, "Using file: \"%s\"\n", pszName);
+		printRomInfo(job.pOut, &job.hdr);
+		closeRomFile(&job.rf);
+	}
+	
+	fclose(job.pOut);
+	fclose(job.pErr);
+	
+	if (prp->uFlags & RPF_VERBOSE)
+		printf("Request: %s \"%s\": %s\n", s_pszServeOps[pReq->uOp], pszPath, job.nResult ? "failed" : "ok");
+	
+	int nRet = sendResponse(fdConn, job.nResult, job.pszOut, job.cchOut, job.pszErr, job.cchErr);
+	free(job.pszOut);
+	free(job.pszErr);
+	return nRet;
+	
+}
+
+static void serveConnection (const PRUN_PARAMS prp, int fdConn) {
+	
+	SRV_REQ req;
+	char szPath[SRV_PATHMAX + 1];
+	char szName[SRV_PATHMAX + 1];
+	struct pollfd pfd = { .fd = fdConn, .events = POLLIN };
+	
+	// Answer requests until the client hangs up or the daemon stops.
+	while (!s_fStop) {
+		int nReady = poll(&pfd, 1, 500);
+		if (nReady < 0 && errno != EINTR) break;
+		if (nReady <= 0) continue;
+		
+		int nRecv = recvRequest(fdConn, &req, szPath, szName);
+		if (nRecv < 0 && (prp->uFlags & RPF_VERBOSE))
+			fprintf(stderr, "Warning: Dropped connection: %m\n");
+		if (nRecv <= 0 || serveRequest(prp, &req, szPath, szName, fdConn)) break;
+	}
+	errno = 0;
+	
+}
+
+static void runServeWorker (size_t iWorker, void* pCtx) {
+	
+	PSERVE_CTX psc = (PSERVE_CTX)pCtx;
+	struct pollfd pfd = { .fd = psc->fdListen, .events = POLLIN };
+	
+	// Every worker waits on the shared socket; whichever wakes first
+	// takes the connection and the others go back to waiting.
+	while (!s_fStop) {
+		if (poll(&pfd, 1, 500) <= 0) continue;
+		
+		int fdConn = accept(psc->fdListen, NULL, NULL);
+		if (fdConn < 0) continue;
+		
+		serveConnection(psc->prp, fdConn);
+		close(fdConn);
+	}
+	
+}
+
+/*
+ * 
+ * name: doServeOperations
+ * 
+ * 		Runs the daemon until SIGINT or SIGTERM. A pool of workers
+ * 	answers requests on the socket, sharing the open checksum cache,
+ * 	so clients skip process startup and reuse cached checksums.
+ * 
+ * @param:
+ * 		const PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * @return: int
+ * 		Returns zero on a clean shutdown, or nonzero on error.
+ * 
+ */
+int doServeOperations (const PRUN_PARAMS prp) {
+	
+	if (prp->uFlags & (RPF_ROMFILE | RPF_CLIENT)) {
+		fprintf(stderr, "Error: A daemon cannot be given ROM files or another daemon.\n");
+		return 1;
+	}
+	
+	installStopHandlers();
+	signal(SIGPIPE, SIG_IGN);
+	
+	SERVE_CTX sc;
+	sc.prp = prp;
+	if ((sc.fdListen = listenServer(prp->pszSocket)) < 0) {
+		fprintf(stderr, "Error: \"%s\": Could not listen on socket: %m\n", prp->pszSocket);
+		errno = 0;
+		return 1;
+	}
+	
+	// Requests already run side by side, so keep each scan on its worker.
+	unsigned int nWorkers = prp->nJobs ? prp->nJobs : getDefaultJobCount();
+	if (nWorkers > 1) setSumBytesThreads(1);
+	
+	printf("Serving on \"%s\" with %u worker(s).\n", prp->pszSocket, nWorkers);
+	fflush(stdout);
+	
+	int nRet = 0;
+	if (runJobs(nWorkers, nWorkers, runServeWorker, NULL, &sc)) {
+		perror("Could not start daemon workers.\n");
+		errno = 0;
+		nRet = 1;
+	}
+	
+	close(sc.fdListen);
+	unlink(prp->pszSocket);
+	
+	if (prp->uFlags & RPF_VERBOSE) printf("Daemon stopped.\n");
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: doClientOperations
+ * 
+ * 		Has a running daemon process one file and copies the output it
+ * 	sends back to the job's streams.
+ * 
+ * @param:
+ * 		const PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * 		PROM_JOB pJob:
+ * 			Pointer to the job for the file.
+ * 
+ * @return: int
+ * 		Returns zero on success, or nonzero if the daemon failed or
+ * 	could not be reached.
+ * 
+ */
+int doClientOperations (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	// The daemon runs in its own directory, so send absolute names.
+	char szPath[PATH_MAX];
+	if (realpath(pJob->pszFileName, szPath) == NULL) {
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to open ROM file: %m\n", pJob->pszFileName);
+		errno = 0;
+		return 1;
+	}
+	
+	unsigned int uOpts = 0;
+	if (prp->uFlags & RPF_VERBOSE) uOpts |= SRVO_VERBOSE;
+	if (prp->uFlags & RPF_DRYRUN) uOpts |= SRVO_DRYRUN;
+	if (prp->uFlags & RPF_NOROMINFO) uOpts |= SRVO_NOROMINFO;
+	if (prp->uFlags & RPF_FULLRESCAN) uOpts |= SRVO_FULLRESCAN;
+	if (prp->uFlags & RPF_PAD) uOpts |= SRVO_PAD;
+	if (prp->uFlags & RPF_TRIM) uOpts |= SRVO_TRIM;
+	if (prp->uFlags & RPF_FILLINFO) uOpts |= SRVO_FILLINFO;
+	
+	SRV_REQ req;
+	packRequest(&req, (prp->uFlags & RPF_UPDATEROM) ? SRVOP_FIX : SRVOP_VERIFY, uOpts, prp->pHdrUps);
+	req.uPadByte = prp->uPadByte;
+	
+	int fd;
+	int nResult = 1;
+	if ((fd = connectServer(prp->pszSocket)) < 0) {
+		fprintf(pJob->pErr, "Error: \"%s\": Could not connect to daemon: %m\n", prp->pszSocket);
+	} else if (sendRequest(fd, &req, szPath, pJob->pszFileName) || recvResponse(fd, &nResult, pJob->pOut, pJob->pErr)) {
+		fprintf(pJob->pErr, "Error: \"%s\": Daemon request failed: %m\n", pJob->pszFileName);
+		nResult = 1;
+	}
+	errno = 0;
+	
+	if (fd >= 0) close(fd);
+	return nResult;
+	
+}
+
+#define WATCH_DEBOUNCE_NS 100000000ULL // Quiet time before a rewritten ROM is fixed.
+
+// A ROM seen in the watched directory.
+typedef struct tagWATCH_FILE
+{
+	char* pszPath; // Path of the ROM.
+	uint64_t nsDue; // When its pending fix is due, or zero if none is.
+	int fFixed; // Whether stFixed is valid.
+	struct stat stFixed; // The file as the last fix left it.
+} WATCH_FILE, *PWATCH_FILE;
+
+/*
+ * 
+ * name: fixWatchedFile
+ * 
+ * 		Fixes a rewritten ROM, unless it is still exactly as the last
+ * 	fix left it. That covers the close event of gbfix's own write-back
+ * 	as well as writers that closed the file without changing it.
+ * 
+ * @param:
+ * 		const PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * 		PWATCH_FILE pwf:
+ * 			Pointer to the watched file.
+ * 
+ */
+static void fixWatchedFile (const PRUN_PARAMS prp, PWATCH_FILE pwf) {
+	
+	struct stat st;
+	if (stat(pwf->pszPath, &st)) {
+		// Removed or renamed away before it settled.
+		pwf->fFixed = 0;
+		errno = 0;
+		return;
+	}
+	
+	if (pwf->fFixed && st.st_dev == pwf->stFixed.st_dev && st.st_ino == pwf->stFixed.st_ino &&
+		st.st_size == pwf->stFixed.st_size && st.st_mtim.tv_sec == pwf->stFixed.st_mtim.tv_sec &&
+		st.st_mtim.tv_nsec == pwf->stFixed.st_mtim.tv_nsec) return;
+	
+	ROM_JOB job;
+	memset(&job, 0, sizeof(ROM_JOB));
+	job.pszFileName = pwf->pszPath;
+	job.pOut = stdout;
+	job.pErr = stderr;
+	
+	pwf->fFixed = 0;
+	if (doFileOperations(prp, &job) == 0) {
+		memcpy(&pwf->stFixed, &job.stRom, sizeof(struct stat));
+		pwf->fFixed = 1;
+	}
+	fflush(stdout);
+	
+}
+
+/*
+ * 
+ * name: doWatchOperations
+ * 
+ * 		Watches a directory until SIGINT or SIGTERM and fixes each ROM
+ * 	in it once it has been closed after writing, or moved in, and then
+ * 	left alone for WATCH_DEBOUNCE_NS. Bursts of events for the same
+ * 	file only lead to one fix.
+ * 
+ * @param:
+ * 		PRUN_PARAMS prp:
+ * 			Pointer to the runtime parameters.
+ * 
+ * @return: int
+ * 		Returns zero on a clean shutdown, or nonzero on error.
+ * 
+ */
+int doWatchOperations (PRUN_PARAMS prp) {
+	
+	if (prp->uFlags & (RPF_ROMFILE | RPF_CLIENT)) {
+		fprintf(stderr, "Error: A watched directory cannot be combined with ROM files or a daemon.\n");
+		return 1;
+	}
+	
+	// A rebuilt ROM carries whatever checksums the toolchain left, so
+	// always fix them and always from a full scan.
+	prp->uFlags |= RPF_UPDATEROM | RPF_FULLRESCAN;
+	installStopHandlers();
+	
+	int fdNotify;
+	if ((fdNotify = inotify_init1(IN_CLOEXEC)) < 0 ||
+		inotify_add_watch(fdNotify, prp->pszWatchDir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+		fprintf(stderr, "Error: \"%s\": Could not watch directory: %m\n", prp->pszWatchDir);
+		errno = 0;
+		if (fdNotify >= 0) close(fdNotify);
+		return 1;
+	}
+	
+	printf("Watching \"%s\".\n", prp->pszWatchDir);
+	fflush(stdout);
+	
+	PWATCH_FILE pFiles = NULL;
+	size_t nFiles = 0, nAlloc = 0;
+	char bufEvents[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	int nRet = 0;
+	
+	while (!s_fStop) {
+		
+		// Sleep until the next fix is due or something happens.
+		uint64_t nsNow = getMonotonicNs();
+		uint64_t nsNext = 0;
+		for (size_t iFile = 0; iFile < nFiles; iFile++)
+			if (pFiles[iFile].nsDue && (nsNext == 0 || pFiles[iFile].nsDue < nsNext)) nsNext = pFiles[iFile].nsDue;
+		
+		int nTimeout = -1;
+		if (nsNext) nTimeout = (nsNext > nsNow) ? (int)((nsNext - nsNow + 999999) / 1000000) : 0;
+		
+		struct pollfd pfd = { .fd = fdNotify, .events = POLLIN };
+		int nReady = poll(&pfd, 1, nTimeout);
+		if (nReady < 0 && errno != EINTR) {
+			fprintf(stderr, "Error: Failed to wait for file events: %m\n");
+			nRet = 1;
+			break;
+		}
+		
+		// Note events and push back their files' deadlines.
+		if (nReady > 0) {
+			ssize_t cbEvents = read(fdNotify, bufEvents, sizeof(bufEvents));
+			if (cbEvents < 0 && errno != EINTR) {
+				fprintf(stderr, "Error: Failed to read file events: %m\n");
+				nRet = 1;
+				break;
+			}
+			
+			nsNow = getMonotonicNs();
+			for (char* pEvent = bufEvents; cbEvents > 0 && pEvent < bufEvents + cbEvents;
+				pEvent += sizeof(struct inotify_event) + ((struct inotify_event*)pEvent)->len) {
+				const struct inotify_event* pie = (const struct inotify_event*)pEvent;
+				
+				if (pie->mask & IN_Q_OVERFLOW)
+					fprintf(stderr, "Warning: \"%s\": Too many file events; some rewrites were missed.\n", prp->pszWatchDir);
+				if (pie->len == 0 || (pie->mask & IN_ISDIR) || pie->name[0] == '.' || !hasRomExt(pie->name)) continue;
+				
+				size_t iFile;
+				size_t cchPath = strlen(prp->pszWatchDir) + strlen(pie->name) + 2;
+				char szPath[cchPath];
+				snprintf(szPath, cchPath, "%s/%s", prp->pszWatchDir, pie->name);
+				
+				for (iFile = 0; iFile < nFiles; iFile++)
+					if (strcmp(pFiles[iFile].pszPath, szPath) == 0) break;
+				
+				if (iFile == nFiles) {
+					if (nFiles == nAlloc) {
+						size_t nNewAlloc = nAlloc ? nAlloc * 2 : 16;
+						PWATCH_FILE pNew;
+						if ((pNew = realloc(pFiles, nNewAlloc * sizeof(WATCH_FILE))) == NULL) continue;
+						pFiles = pNew;
+						nAlloc = nNewAlloc;
+					}
+					memset(&pFiles[iFile], 0, sizeof(WATCH_FILE));
+					if ((pFiles[iFile].pszPath = strdup(szPath)) == NULL) continue;
+					nFiles++;
+				}
+				
+				pFiles[iFile].nsDue = nsNow + WATCH_DEBOUNCE_NS;
+			}
+		}
+		
+		// Fix every file that has been quiet long enough.
+		nsNow = getMonotonicNs();
+		for (size_t iFile = 0; iFile < nFiles; iFile++) {
+			if (pFiles[iFile].nsDue == 0 || pFiles[iFile].nsDue > nsNow) continue;
+			pFiles[iFile].nsDue = 0;
+			fixWatchedFile(prp, &pFiles[iFile]);
+		}
+	}
+	errno = 0;
+	
+	for (size_t iFile = 0; iFile < nFiles; iFile++) free(pFiles[iFile].pszPath);
+	free(pFiles);
+	close(fdNotify);
+	
+	if (prp->uFlags & RPF_VERBOSE) printf("Stopped watching.\n");
+	return nRet;
+	
+}
+
+// Name the fixed ROM is published under.
+static inline const char* getJobDest (const PRUN_PARAMS prp, const PROM_JOB pJob) {
+	
+	if (prp->pszOutFile != NULL) return prp->pszOutFile;
+	return (pJob->pszPath != NULL) ? pJob->pszPath : pJob->pszFileName;
+	
+}
+
+int doFileOperations (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	if (prp == NULL || pJob == NULL) {
+		errno = EFAULT;
+		perror("Bad/NULL pointer passed as runtime parameters.\n");
+		errno = 0;
+		return 1;
+	}
+	
+	// Map the ROM. Only map it writable if it is going to be patched.
+	unsigned long int uRomFileFlags = 0;
+	if ((prp->uFlags & RPF_UPDATEROM) && !(prp->uFlags & RPF_DRYRUN)) uRomFileFlags |= RFF_WRITE;
+	
+	// A patched ROM or one with an output file is written to a new file,
+	// so the original is only read.
+	const char* pszPath = (pJob->pszPath != NULL) ? pJob->pszPath : pJob->pszFileName;
+	if (prp->pPatch != NULL || prp->pszOutFile != NULL) uRomFileFlags = 0;
+	memset(&pJob->rfOut, 0, sizeof(ROM_FILE));
+	pJob->rfOut.fd = -1;
+	pJob->pszTemp = NULL;
+	pJob->fPatched = 0;
+	
+	uint64_t nStart = startJobPhase(prp);
+	if (openRomFile(pszPath, &pJob->rf, uRomFileFlags)) {
+		pJob->nErr = errno;
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to open ROM file: %m\n", pJob->pszFileName);
+		errno = 0;
+		return 1;
+	}
+	endJobPhase(prp, pJob, STATPH_OPEN, nStart, 0);
+	
+	int nRet = 0;
+	if (prp->pPatch != NULL) {
+		nStart = startJobPhase(prp);
+		nRet = patchRomJob(prp, pJob);
+		endJobPhase(prp, pJob, STATPH_PATCH, nStart, pJob->rf.cbRom);
+	}
+	if (nRet == 0) nRet = processRomFile(prp, pJob);
+	
+	// A new file must be wholly on disk before it is published under its
+	// final name, so that readers never see a partly written ROM.
+	nStart = startJobPhase(prp);
+	const size_t cbSaved = pJob->rf.cbRom;
+	const int fPublish = (pJob->pszTemp != NULL && !(prp->uFlags & RPF_DRYRUN));
+	const PROM_FILE prfNew = (pJob->rfOut.pRom != NULL) ? &pJob->rfOut : &pJob->rf;
+	if (fPublish && nRet == 0 && fdatasync(prfNew->fd)) {
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to save ROM file: %m\n", pJob->pszFileName);
+		errno = 0;
+		nRet = 1;
+	}
+	
+	// Unmap the ROM, flushing the header page if it was patched.
+	if (closeRomFile(&pJob->rf) && nRet == 0) {
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to save ROM header to file: %m\n", pJob->pszFileName);
+		errno = 0;
+		nRet = 1;
+	}
+	if (pJob->rfOut.pRom != NULL) closeRomFile(&pJob->rfOut);
+	
+	if (pJob->pszTemp == NULL) {
+		endJobPhase(prp, pJob, STATPH_SAVE, nStart, 0);
+		return nRet;
+	}
+	if (nRet == 0 && fPublish && rename(pJob->pszTemp, getJobDest(prp, pJob))) {
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to publish ROM file: %m\n", pJob->pszFileName);
+		errno = 0;
+		nRet = 1;
+	}
+	if (nRet || !fPublish) unlink(pJob->pszTemp);
+	pJob->pszTemp = NULL;
+	
+	endJobPhase(prp, pJob, STATPH_SAVE, nStart, fPublish ? cbSaved : 0);
+	return nRet;
+	
+}
+
+// Name of the new file of the job running on this thread. A thread runs
+// one job at a time and the name is dropped before the job returns, so
+// one buffer per thread serves every job.
+static __thread char s_szJobTemp[PATH_MAX];
+
+// Create the new file a job's ROM is written to, next to its destination,
+// and keep its name until it is published.
+static int createJobFile (PROM_JOB pJob, const char* pszDest, const size_t cbRom, const PROM_FILE prfCopy,
+	const mode_t uMode, PROM_FILE prf) {
+	
+	static const char szSuffix[] = ".gbfix-XXXXXX";
+	
+	if (strlen(pszDest) + sizeof(szSuffix) > sizeof(s_szJobTemp)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(s_szJobTemp, pszDest);
+	strcat(s_szJobTemp, szSuffix);
+	
+	if (createRomFile(s_szJobTemp, cbRom, prfCopy, prf)) return -1;
+	pJob->pszTemp = s_szJobTemp;
+	
+	fchmod(prf->fd, uMode & 07777);
+	return 0;
+	
+}
+
+// Apply the patch to the ROM, building the patched ROM in a new file
+// next to its destination, or only in memory on a dry run, and switch
+// the job over to that file. An IPS target starts as a copy of the ROM
+// and only the patched ranges are touched after that; its global
+// checksum follows from the ROM's real one, cached or summed once
+// here, and the byte differences of each record.
+static int patchRomJob (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	const PROM_PATCH pPatch = prp->pPatch;
+	size_t cbTarget;
+	uint32_t uCrc32;
+	
+	if (getRomPatchTarget(pPatch, pJob->rf.cbRom, &cbTarget)) {
+		fprintf(pJob->pErr, "Error: \"%s\": Patch does not fit this ROM (made for %zu bytes, ROM has %zu).\n",
+			pJob->pszFileName, pPatch->cbSource, pJob->rf.cbRom);
+		errno = 0;
+		return 1;
+	}
+	
+	if (checkRomPatchSource(pPatch, pJob->rf.pRom, pJob->rf.cbRom, &uCrc32)) {
+		fprintf(pJob->pErr, "Error: \"%s\": Patch was made for another ROM (CRC-32 0x%08X, ROM has 0x%08X).\n",
+			pJob->pszFileName, pPatch->uSourceCrc, uCrc32);
+		errno = 0;
+		return 1;
+	}
+	
+	// Start from the real global checksum of the ROM.
+	GBHEAD hdrSrc;
+	struct stat st;
+	CACHE_ENTRY ce;
+	uint16_t uChksum = 0;
+	if (readRomHeader(&pJob->rf, &hdrSrc) || fstat(pJob->rf.fd, &st)) {
+		pJob->nErr = errno;
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to load ROM header: %m\n", pJob->pszFileName);
+		errno = 0;
+		return 1;
+	}
+	if (pPatch->uFormat == PATCHFMT_BPS) {
+		// Computed exactly from the target instead.
+	} else if (!(prp->uFlags & RPF_FULLRESCAN) && prp->pCache != NULL && lookupCache(prp->pCache, &st, &ce) > 0) {
+		uChksum = ce.uGlobalChksum;
+	} else {
+		uChksum = mkGbGlobalChksum(&hdrSrc, pJob->rf.pRom, pJob->rf.cbRom);
+	}
+	
+	ROM_FILE rfTarget;
+	const PROM_FILE prfCopy = (pPatch->uFormat == PATCHFMT_IPS) ? &pJob->rf : NULL;
+	if ((prp->uFlags & RPF_DRYRUN) ? createRomFile(NULL, cbTarget, prfCopy, &rfTarget) :
+		createJobFile(pJob, getJobDest(prp, pJob), cbTarget, prfCopy, st.st_mode, &rfTarget)) {
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to create patched ROM file: %m\n", pJob->pszFileName);
+		errno = 0;
+		return 1;
+	}
+	
+	if (applyRomPatch(pPatch, pJob->rf.pRom, pJob->rf.cbRom, rfTarget.pRom, cbTarget, &uChksum)) {
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to apply patch: %s\n", pJob->pszFileName,
+			(errno == EBADMSG) ? "Patched ROM does not match the target CRC-32" : strerror(errno));
+		errno = 0;
+		closeRomFile(&rfTarget);
+		if (pJob->pszTemp != NULL) unlink(pJob->pszTemp);
+		pJob->pszTemp = NULL;
+		return 1;
+	}
+	
+	if ((prp->uFlags & RPF_VERBOSE || prp->uFlags & RPF_DRYRUN) && prp->pReport == NULL)
+		fprintf(pJob->pOut, "Patched ROM from %zukB to %zukB.\n", pJob->rf.cbRom >> 10, cbTarget >> 10);
+	
+	closeRomFile(&pJob->rf);
+	memcpy(&pJob->rf, &rfTarget, sizeof(ROM_FILE));
+	pJob->uPatchChksum = uChksum;
+	pJob->fPatched = 1;
+	return 0;
+	
+}
+
+// Bytes validateChksums() scans to settle the global checksum, for --stats.
+static inline size_t getChksumScanSize (const PRUN_PARAMS prp, const PROM_JOB pJob) {
+	
+	if (pJob->fSummed || pJob->fPatched) return 0;
+	if (pJob->fCached && !(prp->uFlags & RPF_FULLRESCAN)) return 0;
+	return pJob->rf.cbRom;
+	
+}
+
+static int processRomFile (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	// Read header from the mapping.
+	uint64_t nStart = startJobPhase(prp);
+	if (readRomHeader(&pJob->rf, &pJob->hdr)) {
+		pJob->nErr = errno;
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to load ROM header: %m\n", pJob->pszFileName);
+		errno = 0;
+		return 1;
+	}
+	memcpy(&pJob->hdrOrig, &pJob->hdr, sizeof(GBHEAD));
+	
+	// Look up checksums cached for the file as it is now.
+	pJob->nResize = 0;
+	pJob->uResizeFill = 0;
+	pJob->fResized = 0;
+	pJob->fCached = 0;
+	if (fstat(pJob->rf.fd, &pJob->stRom) == 0 && prp->pCache != NULL)
+		pJob->fCached = (lookupCache(prp->pCache, &pJob->stRom, &pJob->ceCached) > 0);
+	endJobPhase(prp, pJob, STATPH_OPEN, nStart, 0);
+	
+	nStart = startJobPhase(prp);
+	hashRomJob(prp, pJob);
+	endJobPhase(prp, pJob, STATPH_HASH, nStart, (prp->uHashes & ~(pJob->fCached ? pJob->ceCached.uHashes : 0)) ? pJob->rf.cbRom : 0);
+	
+	// Print ROM info.
+	nStart = startJobPhase(prp);
+	if (!(prp->uFlags & RPF_NOROMINFO)) {
+		fprintf(pJob->pOut, "Using file: \"%s\"\n", pJob->pszFileName);
+		printRomInfo(pJob->pOut, &pJob->hdr);
+	}
+	
+	if (pJob->hashes.uHashes && prp->pReport == NULL) printRomHashes(pJob->pOut, pJob->pszFileName, &pJob->hashes);
+	
+	printRomFill(prp, pJob);
+	validateLogo(prp, pJob);
+	endJobPhase(prp, pJob, STATPH_INFO, nStart, (prp->uFlags & RPF_FILLINFO) ? pJob->rf.cbRom : 0);
+	
+	// Skip file updates if update flag not set, only report checksums.
+	if (!(prp->uFlags & RPF_UPDATEROM)) {
+		nStart = startJobPhase(prp);
+		validateChksums(prp, pJob);
+		endJobPhase(prp, pJob, STATPH_CHKSUM, nStart, getChksumScanSize(prp, pJob));
+		storeRomCache(prp, pJob, &pJob->hdrOrig);
+		return 0;
+	}
+	
+	nStart = startJobPhase(prp);
+	applyHdrPlan(&pJob->hdr, prp->pHdrPlan);
+	planRomPad(prp, pJob);
+	planRomTrim(prp, pJob);
+	validateChksums(prp, pJob);
+	endJobPhase(prp, pJob, STATPH_CHKSUM, nStart, getChksumScanSize(prp, pJob));
+	
+	// Print updated ROM header information.
+	if ((prp->uFlags & RPF_VERBOSE || prp->uFlags & RPF_DRYRUN) && prp->pReport == NULL) {
+		fprintf(pJob->pOut, "Updated ROM header:\n");
+		printRomInfo(pJob->pOut, &pJob->hdr);
+	}
+	
+	// Prevent save if dry run is enabled.
+	if (prp->uFlags & RPF_DRYRUN) {
+		storeRomCache(prp, pJob, &pJob->hdrOrig);
+		return 0;
+	}
+	
+	nStart = startJobPhase(prp);
+	int nRet = saveRomJob(prp, pJob);
+	endJobPhase(prp, pJob, STATPH_SAVE, nStart, 0);
+	return nRet;
+	
+}
+
+// Write the fixed ROM out: resize it, write its header and flush it.
+static int saveRomJob (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	// With an output file, the fixed ROM goes to a copy of the original
+	// made next to it. The copy shares the original's blocks where the
+	// file system allows, so only the header page is actually written.
+	PROM_FILE prfOut = &pJob->rf;
+	if (pJob->pszTemp == NULL && prp->pszOutFile != NULL) {
+		if (createJobFile(pJob, prp->pszOutFile, pJob->rf.cbRom, &pJob->rf, pJob->stRom.st_mode, &pJob->rfOut)) {
+			fprintf(pJob->pErr, "Error: \"%s\": Failed to create output file: %m\n", prp->pszOutFile);
+			errno = 0;
+			return 1;
+		}
+		prfOut = &pJob->rfOut;
+	}
+	
+	// Resize the file before writing the header that declares its size.
+	if (pJob->nResize) {
+		if (resizeRomFile(prfOut, (size_t)((ptrdiff_t)pJob->rf.cbRom + pJob->nResize), pJob->uResizeFill)) {
+			fprintf(pJob->pErr, "Error: \"%s\": Failed to %s ROM file: %m\n", pJob->pszFileName,
+				(pJob->nResize > 0) ? "pad" : "trim");
+			errno = 0;
+			return 1;
+		}
+		pJob->fResized = 1;
+	}
+	
+	// Patch header into the mapping and flush the header page.
+	if (writeRomHeader(prfOut, &pJob->hdr) || syncRomFile(prfOut)) {
+		fprintf(pJob->pErr, "Error: \"%s\": Failed to save ROM header to file: %m\n", pJob->pszFileName);
+		errno = 0;
+		return 1;
+	}
+	
+	// Cache the fixed file under its new modification time.
+	if (fstat(prfOut->fd, &pJob->stRom) == 0 && prp->pCache != NULL)
+		storeRomCache(prp, pJob, &pJob->hdr);
+	
+	return 0;
+	
+}
+
+// Compute the content hashes of the file as read, taking what the
+// cache already holds. The byte sum gathered in the same pass spares
+// validateChksums() a second scan for the global checksum.
+static void hashRomJob (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	memset(&pJob->hashes, 0, sizeof(ROM_HASHES));
+	pJob->fSummed = 0;
+	if (!prp->uHashes) return;
+	
+	if (pJob->fCached) {
+		PCACHE_ENTRY pce = &pJob->ceCached;
+		pJob->hashes.uHashes = pce->uHashes & prp->uHashes;
+		pJob->hashes.uCrc32 = pce->uCrc32;
+		memcpy(pJob->hashes.uMd5, pce->uMd5, sizeof(pce->uMd5));
+		memcpy(pJob->hashes.uSha1, pce->uSha1, sizeof(pce->uSha1));
+	}
+	
+	unsigned int uMissing = prp->uHashes & ~pJob->hashes.uHashes;
+	if (!uMissing) return;
+	
+	ROM_HASHES rh;
+	if (hashRomImage(pJob->rf.pRom, pJob->rf.cbRom, uMissing, &rh)) {
+		fprintf(pJob->pErr, "Warning: \"%s\": Could not hash ROM: %m\n", pJob->pszFileName);
+		errno = 0;
+		return;
+	}
+	
+	pJob->hashes.uHashes |= uMissing;
+	pJob->hashes.uSum = rh.uSum;
+	if (uMissing & HASHF_CRC32) pJob->hashes.uCrc32 = rh.uCrc32;
+	if (uMissing & HASHF_MD5) memcpy(pJob->hashes.uMd5, rh.uMd5, sizeof(rh.uMd5));
+	if (uMissing & HASHF_SHA1) memcpy(pJob->hashes.uSha1, rh.uSha1, sizeof(rh.uSha1));
+	pJob->fSummed = 1;
+	
+}
+
+static void storeRomCache (const PRUN_PARAMS prp, PROM_JOB pJob, const PGBHEAD pHdrOnDisk) {
+	
+	// Only cache values that were actually computed or derived from
+	// computed ones, and only if they are not already cached. Hashes
+	// only describe the file as read, so they are dropped once the
+	// header on disk has changed. A ROM patched in memory on a dry run
+	// has no file to be cached under.
+	const int fAsRead = (pHdrOnDisk == &pJob->hdrOrig);
+	if (prp->pCache == NULL || !pJob->fGlobalExact) return;
+	if (pJob->fPatched && pJob->pszTemp == NULL) return;
+	
+	// A patched ROM is only cached once it has replaced the original.
+	if (pJob->fPatched && fAsRead) return;
+	if (pJob->fCached && fAsRead && !(pJob->hashes.uHashes & ~pJob->ceCached.uHashes)) return;
+	
+	CACHE_ENTRY ce;
+	memset(&ce, 0, sizeof(CACHE_ENTRY));
+	
+	// Hashes cached earlier but not asked for this time are still in
+	// pJob->hashes, see hashRomJob().
+	if (fAsRead) {
+		ce.uHashes = (uint8_t)(pJob->hashes.uHashes | (pJob->fCached ? pJob->ceCached.uHashes : 0));
+		ce.uCrc32 = pJob->hashes.uCrc32;
+		memcpy(ce.uMd5, pJob->hashes.uMd5, sizeof(ce.uMd5));
+		memcpy(ce.uSha1, pJob->hashes.uSha1, sizeof(ce.uSha1));
+	}
+	
+	// uGlobalChksum belongs to the current header; carry it over to the
+	// header that is actually on disk.
+	ce.uHdrChksum = mkGbHdrChksum(pHdrOnDisk);
+	ce.uGlobalChksum = fAsRead ? getReadGlobalChksum(pJob) : pJob->uGlobalChksum;
+	if (pHdrOnDisk->uHdrChksum == ce.uHdrChksum) ce.uFlags |= CEF_HDROK;
+	if (correctGlobalChksum(pHdrOnDisk) == ce.uGlobalChksum) ce.uFlags |= CEF_GLOBALOK;
+	
+	if (storeCache(prp->pCache, &pJob->stRom, &ce) && (prp->uFlags & RPF_VERBOSE))
+		fprintf(pJob->pErr, "Warning: \"%s\": Could not update checksum cache: %m\n", pJob->pszFileName);
+	errno = 0;
+	
+}
+
+static inline void validateChksums (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	PGBHEAD pHdr = &pJob->hdr;
+	uint8_t uNewHdrChksum = mkGbHdrChksum(pHdr);
+	
+	// Update header checksum.
+	if (pHdr->uHdrChksum != uNewHdrChksum) {
+		if (prp->uFlags & RPF_UPDATEROM) {
+			if (prp->uFlags & RPF_VERBOSE) fprintf(pJob->pOut, "Updating header checksum to 0x%X.\n", uNewHdrChksum);
+			pHdr->uHdrChksum = uNewHdrChksum;
+		} else if (prp->pReport == NULL) {
+			fprintf(pJob->pOut, "Warning: \"%s\": Header checksum is invalid. ROM will be unbootable on hardware! Correct value is 0x%X.\n", pJob->pszFileName, uNewHdrChksum);
+		}
+	}
+	
+	// The global checksum covers the header checksum, so it must be
+	// generated after the header checksum has been settled. When only
+	// the header changed it is adjusted by the header's byte deltas
+	// rather than rescanning the image, but only from a known correct
+	// sum: that of the hashing pass, the patch or the cache. The stored
+	// value is never trusted.
+	uint16_t uNewGlobalChksum;
+	pJob->fGlobalExact = 1;
+	if (pJob->fSummed) {
+		uint16_t uOrigGlobalChksum = (uint16_t)(pJob->hashes.uSum -
+			pJob->hdrOrig.uGlobalChksum[0] - pJob->hdrOrig.uGlobalChksum[1]);
+		uNewGlobalChksum = updGbGlobalChksum(uOrigGlobalChksum, &pJob->hdrOrig, pHdr);
+	} else if (pJob->fPatched) {
+		uNewGlobalChksum = updGbGlobalChksum(pJob->uPatchChksum, &pJob->hdrOrig, pHdr);
+	} else if (pJob->fCached && !(prp->uFlags & RPF_FULLRESCAN)) {
+		uNewGlobalChksum = updGbGlobalChksum(pJob->ceCached.uGlobalChksum, &pJob->hdrOrig, pHdr);
+	} else {
+		uNewGlobalChksum = mkGbGlobalChksum(pHdr, pJob->rf.pRom, pJob->rf.cbRom);
+	}
+	
+	// Padding adds its bytes to the sum without being scanned; trimmed
+	// fill takes them away again.
+	uNewGlobalChksum += (uint16_t)((size_t)pJob->nResize * pJob->uResizeFill);
+	pJob->uGlobalChksum = uNewGlobalChksum;
+	
+	// Update global checksum.
+	if (correctGlobalChksum(pHdr) != uNewGlobalChksum) {
+		if (prp->uFlags & RPF_UPDATEROM) {
+			if (prp->uFlags & RPF_VERBOSE) fprintf(pJob->pOut, "Updating global checksum to 0x%X.\n", uNewGlobalChksum);
+			setGlobalChksum(pHdr, uNewGlobalChksum);
+		} else if (prp->pReport == NULL) {
+			fprintf(pJob->pOut, "Warning: \"%s\": Global checksum is invalid. Real hardware \
+will not care, but emulators might give warnings! Correct value is 0x%X.\n", pJob->pszFileName, uNewGlobalChksum);
+		}
+	}
+	
+}
+
+static void validateLogo (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	uint64_t uDiff = cmpGbLogo(&pJob->hdr);
+	if (uDiff == 0 || prp->pReport != NULL) return;
+	
+	if ((prp->uFlags & RPF_UPDATEROM) && (prp->pHdrUps->uFlags & UPF_LOGO)) {
+		if (prp->uFlags & RPF_VERBOSE) fprintf(pJob->pOut, "Restoring Nintendo logo.\n");
+		return;
+	}
+	
+	// List every damaged byte by its address in the ROM.
+	fprintf(pJob->pOut, "Warning: \"%s\": Nintendo logo differs at", pJob->pszFileName);
+	for (unsigned int iByte = 0; iByte < sizeof(g_uNintendoLogo); iByte++)
+		if (uDiff & (UINT64_C(1) << iByte)) fprintf(pJob->pOut, " 0x%04lX", GBHEAD_OFFSET + offsetof(GBHEAD, uNintendoLogo) + iByte);
+	fprintf(pJob->pOut, ". ROM will be unbootable on %s! Use --fix-logo to restore it.\n",
+		(uDiff & LOGO_CGBMASK) ? "hardware" : "DMG and SGB hardware");
+	
+}
+
+// Work out how far --pad extends the ROM: up to the next valid ROM
+// size, which the size field is set to. The bytes are only appended
+// right before the header is written back.
+static void planRomPad (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	if (!(prp->uFlags & RPF_PAD)) return;
+	
+	size_t cbRom = pJob->rf.cbRom;
+	uint8_t uRomSizeNew = 0;
+	while (uRomSizeNew <= ROMSIZE_MAX && ((size_t)32 << 10 << uRomSizeNew) < cbRom) uRomSizeNew++;
+	
+	if (uRomSizeNew > ROMSIZE_MAX) {
+		fprintf(pJob->pErr, "Warning: \"%s\": File is larger than the largest ROM size (%ldkB) and cannot be padded.\n",
+			pJob->pszFileName, 32L << ROMSIZE_MAX);
+		return;
+	}
+	
+	pJob->nResize = (ptrdiff_t)(((size_t)32 << 10 << uRomSizeNew) - cbRom);
+	pJob->uResizeFill = prp->uPadByte;
+	
+	if ((prp->uFlags & RPF_VERBOSE || prp->uFlags & RPF_DRYRUN) && prp->pReport == NULL) {
+		if (pJob->nResize) fprintf(pJob->pOut, "Padding ROM from %zukB to %ldkB with 0x%02X.\n",
+			cbRom >> 10, 32L << uRomSizeNew, prp->uPadByte);
+		if (pJob->hdr.uRomSize != uRomSizeNew) fprintf(pJob->pOut, "Updating ROM size to 0x%X.\n", uRomSizeNew);
+	}
+	pJob->hdr.uRomSize = uRomSizeNew;
+	
+}
+
+// Trailing fill is whichever of 0xFF and 0x00 the image ends with. Returns
+// the size of the image without it.
+static inline size_t getRomUsedSize (const PROM_FILE prf, uint8_t* puFill) {
+	
+	*puFill = prf->pRom[prf->cbRom - 1];
+	if (*puFill != 0xFF && *puFill != 0x00) return prf->cbRom;
+	return findFillStart(prf->pRom, prf->cbRom, *puFill);
+	
+}
+
+// Work out how far --trim cuts the ROM: down to the smallest valid ROM
+// size that still holds everything but the trailing fill, which the size
+// field is set to. The file is only truncated right before the header is
+// written back.
+static void planRomTrim (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	if (!(prp->uFlags & RPF_TRIM)) return;
+	
+	size_t cbRom = pJob->rf.cbRom;
+	uint8_t uFill;
+	size_t cbUsed = getRomUsedSize(&pJob->rf, &uFill);
+	uint8_t uRomSizeNew = 0;
+	while (uRomSizeNew <= ROMSIZE_MAX && ((size_t)32 << 10 << uRomSizeNew) < cbUsed) uRomSizeNew++;
+	
+	if (uRomSizeNew > ROMSIZE_MAX || ((size_t)32 << 10 << uRomSizeNew) > cbRom) {
+		if ((prp->uFlags & RPF_VERBOSE || prp->uFlags & RPF_DRYRUN) && prp->pReport == NULL)
+			fprintf(pJob->pOut, "Not trimming ROM: only %zu bytes of it are trailing fill.\n", cbRom - cbUsed);
+		return;
+	}
+	
+	pJob->nResize = -(ptrdiff_t)(cbRom - ((size_t)32 << 10 << uRomSizeNew));
+	pJob->uResizeFill = uFill;
+	
+	if ((prp->uFlags & RPF_VERBOSE || prp->uFlags & RPF_DRYRUN) && prp->pReport == NULL) {
+		if (pJob->nResize) fprintf(pJob->pOut, "Trimming ROM from %zukB to %ldkB, dropping 0x%02X fill.\n",
+			cbRom >> 10, 32L << uRomSizeNew, uFill);
+		if (pJob->hdr.uRomSize != uRomSizeNew) fprintf(pJob->pOut, "Updating ROM size to 0x%X.\n", uRomSizeNew);
+	}
+	pJob->hdr.uRomSize = uRomSizeNew;
+	
+}
+
+static inline void printFillRun (FILE* pOut, const size_t iFirst, const size_t iLast, const size_t cbUsed, const size_t cbBank) {
+	
+	if (iFirst == iLast) fprintf(pOut, "\tBank 0x%03zX:\t\t%zu used, %zu fill\n", iFirst, cbUsed, cbBank - cbUsed);
+	else fprintf(pOut, "\tBanks 0x%03zX-0x%03zX:\t%zu used, %zu fill each\n", iFirst, iLast, cbUsed, cbBank - cbUsed);
+	
+}
+
+// Print how much of the ROM is trailing fill, and the used and fill
+// bytes at the end of each bank. Runs of banks that look alike are
+// printed as one range. Each bank is scanned backwards from its end, so
+// banks holding data cost next to nothing.
+static void printRomFill (const PRUN_PARAMS prp, PROM_JOB pJob) {
+	
+	if (!(prp->uFlags & RPF_FILLINFO) || prp->pReport != NULL) return;
+	
+	const size_t cbBank = SUM_BANKSIZE;
+	size_t cbRom = pJob->rf.cbRom;
+	uint8_t uFill;
+	size_t cbUsed = getRomUsedSize(&pJob->rf, &uFill);
+	
+	fprintf(pJob->pOut, g_szDivider, "Fill");
+	fprintf(pJob->pOut, "\tFill Byte:\t\t0x%02X\n", uFill);
+	fprintf(pJob->pOut, "\tUsed:\t\t\t%zu bytes\n", cbUsed);
+	fprintf(pJob->pOut, "\tTrailing Fill:\t\t%zu bytes\n", cbRom - cbUsed);
+	
+	// Extend the current run while banks match it, print it otherwise.
+	size_t iRunFirst = 0, cbRunUsed = 0, cbRunSize = 0;
+	for (size_t iBank = 0; iBank * cbBank < cbRom; iBank++) {
+		
+		size_t cbThis = (cbRom - iBank * cbBank < cbBank) ? cbRom - iBank * cbBank : cbBank;
+		size_t cbBankUsed = findFillStart(pJob->rf.pRom + iBank * cbBank, cbThis, uFill);
+		
+		if (iBank > 0 && cbBankUsed == cbRunUsed && cbThis == cbRunSize) continue;
+		if (iBank > 0) printFillRun(pJob->pOut, iRunFirst, iBank - 1, cbRunUsed, cbRunSize);
+		
+		iRunFirst = iBank;
+		cbRunUsed = cbBankUsed;
+		cbRunSize = cbThis;
+		
 	}
+	printFillRun(pJob->pOut, iRunFirst, (cbRom - 1) / cbBank, cbRunUsed, cbRunSize);
 	
 }
 
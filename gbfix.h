@@ -26,9 +26,19 @@
 #define _GBFIX_H_
 
 // Include module headers.
+#include "inc/chksum.h"
 #include "inc/gbhead.h"
+#include "inc/hdrcheck.h"
+#include "inc/inventory.h"
 #include "inc/messages.h"
+#include "inc/multicart.h"
+#include "inc/patch.h"
+#include "inc/report.h"
+#include "inc/romhash.h"
+#include "inc/romindex.h"
 #include "inc/runparam.h"
+#include "inc/server.h"
+#include "inc/stats.h"
 
 #endif /* _GBFIX_H_ */
 
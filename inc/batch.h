@@ -0,0 +1,63 @@
+/*
+ * inc/batch.h
+ * 
+ * GBFix - Batch Processing Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stddef.h>
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+// List of ROM files to operate on, in command-line order.
+typedef struct tagFILE_LIST
+{
+	char** ppszFiles; // File name buffers.
+	size_t nFiles; // Number of file names in use.
+	size_t nAlloc; // Number of file name slots allocated.
+} FILE_LIST, *PFILE_LIST;
+
+// Job callback, run on a worker thread for each job index.
+typedef void (*PFN_RUNJOB) (size_t iJob, void* pCtx);
+
+// Completion callback, run on the calling thread in job index order.
+typedef void (*PFN_JOBDONE) (size_t iJob, void* pCtx);
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+// File list functions.
+int addFileArg (PFILE_LIST pfl, const char* pszArg);
+int hasRomExt (const char* pszName);
+void freeFileList (PFILE_LIST pfl);
+
+// Thread pool functions.
+unsigned int getDefaultJobCount (void);
+int runJobs (size_t nJobs, unsigned int nThreads, PFN_RUNJOB pfnRun, PFN_JOBDONE pfnDone, void* pCtx);
+
+#endif /* _BATCH_H_ */
+
+// EOF
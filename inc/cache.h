@@ -0,0 +1,128 @@
+/*
+ * inc/cache.h
+ * 
+ * GBFix - Checksum Cache Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/*
+	
+	Cache File Layout:
+	
+	CACHE_HEAD, padded to 64 bytes.
+	CACHE_ENTRY[nSlots], an open-addressed hash table keyed by device
+		and inode number, probed linearly. nSlots is a power of two.
+	
+	An entry is only a hit if the file's size and modification time
+	also match, so a changed file simply misses and is overwritten.
+	Besides the checksums an entry may carry the file's content hashes,
+	so a collection is only hashed once.
+	Readers hold a shared flock() on the file, writers an exclusive one.
+	
+*/
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+#define CACHE_MAGIC 0x48434247 // "GBCH"
+#define CACHE_VERSION 2
+
+// Flags for structure tagCACHE_ENTRY.
+enum {
+	CEF_USED = 0x01, // Slot holds an entry.
+	CEF_HDROK = 0x02, // Stored header checksum was correct.
+	CEF_GLOBALOK = 0x04, // Stored global checksum was correct.
+	CEF_MASK = 0x07
+};
+
+// Flags for structure tagCACHE_HEAD.
+enum {
+	CHF_REBUILDING = 0x0001, // Set while the table is being rehashed.
+	CHF_MASK = 0x0001
+};
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+typedef struct tagCACHE_HEAD
+{
+	uint32_t uMagic;
+	uint16_t uVersion;
+	uint16_t uFlags; // CHF_* flags.
+	uint32_t nSlots; // Number of entry slots.
+	uint32_t nUsed; // Number of slots in use.
+	uint8_t uReserved[48];
+} CACHE_HEAD, *PCACHE_HEAD;
+
+typedef struct tagCACHE_ENTRY
+{
+	uint64_t uDev; // Device number of the ROM file.
+	uint64_t uIno; // Inode number of the ROM file.
+	uint64_t uSize; // Size of the ROM file in bytes.
+	int64_t nMtimeNs; // Modification time in nanoseconds.
+	int64_t nLastUsed; // Time of the last hit or store, in seconds.
+	uint16_t uGlobalChksum; // Correct global checksum.
+	uint8_t uHdrChksum; // Correct header checksum.
+	uint8_t uFlags; // CEF_* flags.
+	uint32_t uCrc32; // Content hashes of the file, as far as uHashes says.
+	uint8_t uMd5[16];
+	uint8_t uSha1[20];
+	uint8_t uHashes; // HASHF_* flags of the hashes held.
+	uint8_t uReserved[3];
+} CACHE_ENTRY, *PCACHE_ENTRY;
+
+// An open cache file.
+typedef struct tagROM_CACHE
+{
+	int fd; // Cache file descriptor, also used for locking.
+	PCACHE_HEAD pHead; // Mapped cache file.
+	size_t cbMap; // Size of the mapping.
+	pthread_mutex_t mtx; // Serializes threads sharing this handle.
+} ROM_CACHE, *PROM_CACHE;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+const char* getDefaultCachePath (void);
+
+int openCache (const char* pszFileName, PROM_CACHE pCache);
+void closeCache (PROM_CACHE pCache);
+
+int lookupCache (PROM_CACHE pCache, const struct stat* pst, PCACHE_ENTRY pEntry);
+int storeCache (PROM_CACHE pCache, const struct stat* pst, const PCACHE_ENTRY pEntry);
+
+int clearCache (PROM_CACHE pCache);
+int gcCache (PROM_CACHE pCache, const time_t tMaxAge, size_t* pnDropped);
+
+#endif /* _CACHE_H_ */
+
+// EOF
@@ -0,0 +1,70 @@
+/*
+ * inc/chksum.h
+ * 
+ * GBFix - Checksum Kernel Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _CHKSUM_H_
+#define _CHKSUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+// Byte sum kernel implementations.
+enum {
+	SUMIMPL_AUTO, // Best implementation supported by the host CPU.
+	SUMIMPL_SCALAR, // Portable C implementation.
+	SUMIMPL_SSE2, // x86 SSE2 (PSADBW, 16 bytes per step).
+	SUMIMPL_AVX2, // x86 AVX2 (VPSADBW, 32 bytes per step).
+	SUMIMPL_AVX512, // x86 AVX-512BW (VPSADBW, 64 bytes per step).
+	SUMIMPL_COUNT
+};
+
+#define SUM_BANKSIZE 0x4000 // Parallel chunks are split on ROM bank boundaries.
+#define SUM_PARMIN (16 << 20) // Smallest buffer summed in parallel.
+#define SUM_CHUNKMIN (4 << 20) // Smallest chunk given to a thread.
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+// Byte sum kernels.
+uint64_t sumBytes (const void* pData, size_t cbData);
+uint64_t sumBytesParallel (const void* pData, size_t cbData);
+size_t findFillStart (const void* pData, size_t cbData, const uint8_t uFill);
+
+// Parallel reduction settings.
+void setSumBytesThreads (const unsigned int nThreads);
+unsigned int getSumBytesThreads (void);
+
+// Kernel selection functions.
+int isSumBytesImplSupported (const unsigned int uImpl);
+int selectSumBytesImpl (const unsigned int uImpl);
+unsigned int getSumBytesImpl (void);
+const char* getSumBytesImplStr (const unsigned int uImpl);
+
+#endif /* _CHKSUM_H_ */
+
+// EOF
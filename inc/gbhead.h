@@ -56,6 +56,7 @@
 	
 */
 
+#include <stddef.h>
 #include <stdint.h>
 
 // ---------------------------------------------------------------------
@@ -97,6 +98,18 @@ enum {
 	REGION_INTERNATIONAL
 };
 
+// Header location.
+#define GBHEAD_OFFSET 0x0100 // Offset of the header in the ROM.
+#define GBHEAD_ROMMIN 0x0150 // Smallest image that contains a full header.
+
+// Largest ROM and RAM size codes.
+#define ROMSIZE_MAX 0x08 // 8MiB.
+#define RAMSIZE_MAX 0x05 // 64kiB.
+
+// Nintendo logo difference masks, one bit per logo byte.
+#define LOGO_MASK UINT64_C(0xFFFFFFFFFFFF) // Whole logo, checked by the DMG and SGB.
+#define LOGO_CGBMASK UINT64_C(0x000000FFFFFF) // First half, checked by the CGB.
+
 // New licensee code.
 #define LICENSEE_NEW 0x33
 
@@ -125,13 +138,32 @@ enum {
 	CT_MBC5_RAM_RUMBLE,
 	CT_MBC5_BATTERY_RAM_RUMBLE,
 	CT_MBC6 = 0x20,
-	CT_MBC7_BATTERY_RAM_RUMBLE_SENSOR,
+	CT_MBC7_BATTERY_RAM_RUMBLE_SENSOR = 0x22,
 	CT_CAMERA = 0xFC,
 	CT_TAMA5 = 0xFD,
 	CT_HuC3 = 0xFE,
 	CT_HuC1_BATTERY_RAM
 };
 
+// ---------------------------------------------------------------------
+// Flags for structure tagHDR_UPDATES.
+// ---------------------------------------------------------------------
+
+enum {
+	UPF_TITLE = 0x0001,
+	UPF_MANU = 0x0002,
+	UPF_CGBF = 0x0004,
+	UPF_LICENSE = 0x0008,
+	UPF_SGBF = 0x0010,
+	UPF_CARTTYPE = 0x0020,
+	UPF_ROMSIZE = 0x0040,
+	UPF_RAMSIZE = 0x0080,
+	UPF_REGION = 0x0100,
+	UPF_ROMVER = 0x0200,
+	UPF_LOGO = 0x0400,
+	UPF_MASK = 0x07FF
+};
+
 // ---------------------------------------------------------------------
 // Define structures.
 // ---------------------------------------------------------------------
@@ -170,6 +202,40 @@ typedef struct tagGBHEAD
 	uint8_t uGlobalChksum[2];
 } __attribute__((packed, aligned(4))) GBHEAD, *PGBHEAD;
 
+// Structure containing information about what to update in the ROM.
+typedef struct tagHDR_UPDATES
+{
+	unsigned long int uFlags; // Flags about what is to be updated.
+	char pszTitle[17];
+	char pszManu[5];
+	uint8_t uCgbFlag;
+	uint8_t uLicensee;
+	uint8_t uSgbFlag;
+	uint8_t uCartType;
+	uint8_t uRomSize;
+	uint8_t uRamSize;
+	uint8_t uRegion;
+	uint8_t uRomVer;
+} __attribute__((packed, aligned(4))) HDR_UPDATES, *PHDR_UPDATES;
+
+// Header updates compiled into the bytes to store and a mask of where
+// to store them. Whether the title covers the manufacturer code and the
+// CGB flag depends on the header it is applied to, so there is a mask
+// for each case.
+typedef struct tagHDR_PLAN
+{
+	uint8_t uBytes[sizeof(GBHEAD)]; // New header bytes, where masked.
+	uint8_t uMask[2][sizeof(GBHEAD)]; // 0xFF for bytes to store: [0] for other, [1] for CGB headers.
+	int fByRev; // Whether the masks differ.
+	int fEmpty; // Whether there is nothing to store.
+} __attribute__((aligned(16))) HDR_PLAN, *PHDR_PLAN;
+
+// ---------------------------------------------------------------------
+// Declare variables.
+// ---------------------------------------------------------------------
+
+extern const uint8_t g_uNintendoLogo[48];
+
 // ---------------------------------------------------------------------
 // Declare functions.
 // ---------------------------------------------------------------------
@@ -188,15 +254,24 @@ const char* getRegionStr (const PGBHEAD pHdr);
 // Data correction functions.
 long int getRomSizeInkB (const PGBHEAD pHdr);
 uint16_t correctGlobalChksum (const PGBHEAD pHdr);
+void setGlobalChksum (PGBHEAD pHdr, const uint16_t uChksum);
+void applyHdrUpdates (PGBHEAD pHdr, const PHDR_UPDATES pHdrUps);
+void compileHdrPlan (const PHDR_UPDATES pHdrUps, PHDR_PLAN pPlan);
+void applyHdrPlan (PGBHEAD pHdr, const PHDR_PLAN pPlan);
+
+// Nintendo logo functions.
+uint64_t cmpGbLogo (const PGBHEAD pHdr);
+void fixGbLogo (PGBHEAD pHdr);
 
 // Checksum functions.
-// TODO: Implement mkGbGlobalChksum.
-// uint16_t mkGbGlobalChksum (const PGBHEAD pHdr);
+uint16_t mkGbGlobalChksum (const PGBHEAD pHdr, const uint8_t* pRom, size_t cbRom);
+uint16_t updGbGlobalChksum (const uint16_t uOldChksum, const PGBHEAD pOldHdr, const PGBHEAD pNewHdr);
 uint8_t mkGbHdrChksum (const PGBHEAD pHdr);
 
 // File I/O functions.
 int loadHeaderFromFile (const char* pszFileName, PGBHEAD pHdr);
 int saveHeaderToFile (const char* pszFileName, const PGBHEAD pHdr);
+int loadRomFromFile (const char* pszFileName, uint8_t** ppRom, size_t* pcbRom);
 
 #endif /* _GBHEAD_H_ */
 
@@ -0,0 +1,77 @@
+/*
+ * inc/hdrcheck.h
+ * 
+ * GBFix - Header Validation Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _HDRCHECK_H_
+#define _HDRCHECK_H_
+
+#include "gbhead.h"
+#include <stdint.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+// Header findings, as bit numbers in a findings mask.
+enum {
+	HCB_ENTRYPOINT, // Entry point does not start with a jump.
+	HCB_LOGO, // Logo damaged in the half every boot ROM checks.
+	HCB_LOGOHALF, // Logo damaged in the half only the DMG and SGB check.
+	HCB_TITLECHARS, // Title holds unprintable characters.
+	HCB_TITLEPAD, // Title has data after its terminator.
+	HCB_MANUFACTURER, // Manufacturer code is neither blank nor printable.
+	HCB_CGBFLAG, // CGB flag has an unknown value.
+	HCB_NEWLICENSEE, // New licensee code is not two ASCII characters.
+	HCB_SGBFLAG, // SGB flag is neither 0x00 nor 0x03.
+	HCB_SGBLICENSEE, // SGB support without the new licensee marker.
+	HCB_CARTTYPE, // Unknown cartridge type.
+	HCB_ROMSIZE, // Invalid ROM size code.
+	HCB_RAMSIZE, // Invalid RAM size code.
+	HCB_ROMNOMBC, // Cartridge without a mapper is larger than 32kiB.
+	HCB_ROMLIMIT, // ROM is larger than the mapper can address.
+	HCB_RAMMISSING, // Cartridge with RAM declares no RAM size.
+	HCB_RAMUNEXPECTED, // Cartridge without RAM declares a RAM size.
+	HCB_RAMLIMIT, // RAM is larger than the mapper can address.
+	HCB_BATTERYNORAM, // Battery with nothing for it to keep.
+	HCB_REGION, // Region is neither Japan nor international.
+	HCB_HDRCHKSUM, // Header checksum is wrong.
+	HCB_FILESIZE, // File size does not match the ROM size code.
+	HCB_COUNT
+};
+
+#define HCF(nBit) (UINT64_C(1) << (nBit))
+
+// Findings that stop the ROM from booting on hardware.
+#define HCF_FATAL (HCF(HCB_LOGO) | HCF(HCB_LOGOHALF) | HCF(HCB_HDRCHKSUM))
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+int checkGbHeader (const PGBHEAD pHdr, const uint64_t cbFile, uint64_t* puFindings);
+const char* getHdrCheckStr (const unsigned int nBit);
+const char* getHdrCheckName (const unsigned int nBit);
+
+#endif /* _HDRCHECK_H_ */
+
+// EOF
@@ -0,0 +1,53 @@
+/*
+ * inc/inventory.h
+ * 
+ * GBFix - Header Inventory Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _INVENTORY_H_
+#define _INVENTORY_H_
+
+#include "gbhead.h"
+#include <stddef.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+#define INV_DEPTH 256 // Files kept in flight by the io_uring scanner.
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+// Header callback, run on the calling thread in file order. pHdr is
+// NULL and nErr holds an errno value if the header could not be read.
+typedef void (*PFN_HEADERDONE) (size_t iFile, const PGBHEAD pHdr, int nErr, void* pCtx);
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+int scanHeaders (const char* const* ppszFiles, size_t nFiles, unsigned int nThreads, PFN_HEADERDONE pfnDone, void* pCtx);
+
+#endif /* _INVENTORY_H_ */
+
+// EOF
@@ -0,0 +1,125 @@
+/*
+ * inc/libgbfix.h
+ * 
+ * GBFix - In-Memory Library Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _LIBGBFIX_H_
+#define _LIBGBFIX_H_
+
+/*
+	libgbfix works on a ROM image already held in memory. Every call
+	takes an explicit context and returns one of the GBFIX_E* codes; the
+	library never reads or writes errno and keeps no state of its own
+	outside the context, so separate contexts can be used from separate
+	threads at the same time.
+	
+	Typical use:
+		GBFIX_CTX ctx;
+		gbfixInit(&ctx, pRom, cbRom);
+		gbfixApplyUpdates(&ctx, &hdrUps);
+		gbfixFix(&ctx, NULL);
+*/
+
+#include "gbhead.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Marks the entry points libgbfix.so exports. The library is built with
+// hidden visibility, so nothing else in it becomes part of its ABI.
+#define GBFIX_API __attribute__((visibility("default")))
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+// Error codes.
+enum {
+	GBFIX_OK = 0, // Success.
+	GBFIX_EFAULT = -1, // A required pointer was NULL.
+	GBFIX_ETOOSMALL = -2, // The image cannot hold a full header.
+	GBFIX_ERDONLY = -3, // The image was attached read only.
+	GBFIX_ENOINIT = -4, // The context has not been initialized.
+	GBFIX_EINVAL = -5 // An argument was out of range.
+};
+
+// Flags for structure tagGBFIX_CTX.
+enum {
+	GBXF_INIT = 0x0001, // Context is attached to an image.
+	GBXF_RDONLY = 0x0002, // Image must not be modified.
+	GBXF_STAGED = 0x0004, // Staged header differs from the image.
+	GBXF_GLOBALKNOWN = 0x0008, // uImgGlobalChksum holds the image's sum.
+	GBXF_MASK = 0x000F
+};
+
+// Flags for structure tagGBFIX_STATUS.
+enum {
+	GBXS_HDROK = 0x0001, // Stored header checksum is correct.
+	GBXS_GLOBALOK = 0x0002, // Stored global checksum is correct.
+	GBXS_MASK = 0x0003
+};
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+// Library context. Treat the members as private.
+typedef struct tagGBFIX_CTX
+{
+	unsigned long int uFlags; // GBXF_* flags.
+	uint8_t* pRom; // Caller's image.
+	size_t cbRom; // Size of the image in bytes.
+	GBHEAD hdrImg; // Header as it is in the image.
+	GBHEAD hdr; // Header with pending edits.
+	uint16_t uImgGlobalChksum; // Computed global checksum of the image.
+} GBFIX_CTX, *PGBFIX_CTX;
+
+// Result of validating an image.
+typedef struct tagGBFIX_STATUS
+{
+	unsigned long int uFlags; // GBXS_* flags.
+	uint8_t uHdrChksum; // Correct header checksum.
+	uint16_t uGlobalChksum; // Correct global checksum.
+} GBFIX_STATUS, *PGBFIX_STATUS;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+// Context lifecycle.
+GBFIX_API int gbfixInit (PGBFIX_CTX pCtx, void* pRom, size_t cbRom);
+GBFIX_API int gbfixInitConst (PGBFIX_CTX pCtx, const void* pRom, size_t cbRom);
+GBFIX_API void gbfixReset (PGBFIX_CTX pCtx);
+
+// Header access.
+GBFIX_API int gbfixGetHeader (const PGBFIX_CTX pCtx, PGBHEAD pHdr);
+GBFIX_API int gbfixSetHeader (PGBFIX_CTX pCtx, const PGBHEAD pHdr);
+GBFIX_API int gbfixApplyUpdates (PGBFIX_CTX pCtx, const PHDR_UPDATES pHdrUps);
+
+// Checksums.
+GBFIX_API int gbfixValidate (PGBFIX_CTX pCtx, PGBFIX_STATUS pStatus);
+GBFIX_API int gbfixFix (PGBFIX_CTX pCtx, PGBFIX_STATUS pStatus);
+
+GBFIX_API const char* gbfixStrError (const int nErr);
+
+#endif /* _LIBGBFIX_H_ */
+
+// EOF
@@ -26,6 +26,8 @@
 #define _MESSAGES_H_
 
 #include "gbhead.h"
+#include "romhash.h"
+#include <stdio.h>
 
 // ---------------------------------------------------------------------
 // Declare external variables and constants.
@@ -37,7 +39,8 @@ extern const char g_szDivider[];
 // Declare functions.
 // ---------------------------------------------------------------------
 
-void printRomInfo (const PGBHEAD pgbHdr);
+void printRomInfo (FILE* pOut, const PGBHEAD pgbHdr);
+void printRomHashes (FILE* pOut, const char* pszFileName, const PROM_HASHES pHashes);
 
 void printGplNotice ();
 void printHelp ();
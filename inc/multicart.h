@@ -0,0 +1,105 @@
+/*
+ * inc/multicart.h
+ * 
+ * GBFix - Multicart Image Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _MULTICART_H_
+#define _MULTICART_H_
+
+/*
+	
+	Multicart Layouts:
+	
+	mbc1:	The menu and up to three games of at most 256kiB each, one
+		to each 256kiB bank slot in the order given, as on the MBC1
+		multicart boards. The menu is in the first slot.
+	mmm01:	Games of any size, each in a slot of the next power of two
+		of its size, packed from the start of the image largest first
+		so that every slot is aligned to its size. The MMM01 boots from
+		the last 32kiB of the image, so the menu is in the last slot.
+	
+	The layout is chosen by the cartridge type of the menu. Everything
+	not covered by a ROM is filled with one byte value. Each ROM keeps
+	its own header and checksums, which are fixed as they are copied
+	in; the menu's header is the outer header and its global checksum
+	covers the whole image.
+	
+*/
+
+#include "gbhead.h"
+#include "romfile.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+// Multicart layouts.
+enum {
+	MCLAYOUT_MBC1,
+	MCLAYOUT_MMM01
+};
+
+#define MC_MBC1SLOT 0x40000 // Bank slot size of the MBC1 layout.
+#define MC_MBC1MAX 4 // ROMs in an MBC1 image, the menu included.
+#define MC_SLOTMIN 0x8000 // Smallest slot, one 32kiB ROM.
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+// One ROM placed in a multicart image.
+typedef struct tagMC_ENTRY
+{
+	const char* pszFileName;
+	ROM_FILE rf; // Open, read-only ROM.
+	GBHEAD hdr; // Header as it is written to the image.
+	size_t cbSlot; // Size of the slot the ROM is placed in.
+	off_t offImage; // Offset of the slot in the image.
+} MC_ENTRY, *PMC_ENTRY;
+
+// A multicart image, planned before it is built.
+typedef struct tagMULTICART
+{
+	unsigned int uLayout; // MCLAYOUT_* code.
+	PMC_ENTRY pEntries; // The menu, then the games.
+	size_t nEntries;
+	size_t cbImage; // Size of the image in bytes.
+	uint8_t uFill; // Byte value for everything not covered by a ROM.
+} MULTICART, *PMULTICART;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+int openMulticart (PMULTICART pmc, const char* const* ppszFiles, const size_t nFiles, const uint8_t uFill);
+void closeMulticart (PMULTICART pmc);
+const char* getMulticartLayoutStr (const unsigned int uLayout);
+
+int planMulticart (PMULTICART pmc);
+int buildMulticart (PMULTICART pmc, int fdOut);
+
+#endif /* _MULTICART_H_ */
+
+// EOF
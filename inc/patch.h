@@ -0,0 +1,95 @@
+/*
+ * inc/patch.h
+ * 
+ * GBFix - IPS/BPS Patch Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _PATCH_H_
+#define _PATCH_H_
+
+/*
+	
+	Patch Formats:
+	
+	ips:	"PATCH", then records of a 24-bit big-endian offset and a
+		16-bit size followed by that many bytes, or a zero size, a
+		16-bit run length and the byte to repeat. Ends with "EOF",
+		optionally followed by a 24-bit size to truncate the ROM to.
+	bps:	"BPS1", varints for the source, target and metadata sizes,
+		the metadata, then actions until the last 12 bytes, which
+		hold the CRC-32 of the source, the target and the patch.
+	
+	Both are applied to a target that is a separate file: IPS records
+	are written over a copy of the source, BPS actions build the target
+	from nothing.
+	
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+// Patch formats.
+enum {
+	PATCHFMT_IPS,
+	PATCHFMT_BPS
+};
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+// An open, mapped patch file.
+typedef struct tagROM_PATCH
+{
+	int fd;
+	const uint8_t* pData; // Mapped patch.
+	size_t cbData;
+	unsigned int uFormat; // PATCHFMT_* code.
+	const uint8_t* pRecords; // First IPS record or BPS action.
+	const uint8_t* pEnd; // End of the records or actions.
+	size_t cbIpsEnd; // End of the furthest IPS record.
+	int fIpsTrunc; // Whether the IPS patch sets the target size.
+	size_t cbSource; // Source size the BPS patch was made for.
+	size_t cbTarget; // Size of the BPS target, or of a truncated IPS target.
+	uint32_t uSourceCrc; // CRC-32 of the BPS source.
+	uint32_t uTargetCrc; // CRC-32 of the BPS target.
+} ROM_PATCH, *PROM_PATCH;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+int openRomPatch (const char* pszFileName, PROM_PATCH pPatch);
+void closeRomPatch (PROM_PATCH pPatch);
+const char* getRomPatchFormatStr (const unsigned int uFormat);
+
+int getRomPatchTarget (const PROM_PATCH pPatch, const size_t cbSource, size_t* pcbTarget);
+int checkRomPatchSource (const PROM_PATCH pPatch, const uint8_t* pSource, const size_t cbSource, uint32_t* puCrc32);
+int applyRomPatch (const PROM_PATCH pPatch, const uint8_t* pSource, const size_t cbSource,
+	uint8_t* pTarget, const size_t cbTarget, uint16_t* puGlobalChksum);
+
+#endif /* _PATCH_H_ */
+
+// EOF
@@ -0,0 +1,144 @@
+/*
+ * inc/report.h
+ * 
+ * GBFix - Machine-Readable Report Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _REPORT_H_
+#define _REPORT_H_
+
+/*
+	
+	Report Formats:
+	
+	jsonl:	One JSON object per file and line.
+	csv:	A line naming the columns, then one line per file. Strings
+		are quoted, findings are joined with '|'.
+	bin:	REPORT_BINHEAD, then per file a REPORT_BINREC directly
+		followed by cchName bytes of file name. Native byte order.
+	
+	Text formats carry the same fields in the same order; fields that
+	do not apply are null in JSON and empty in CSV.
+	
+*/
+
+#include "gbhead.h"
+#include "romhash.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+// Output formats.
+enum {
+	OUTFMT_TEXT, // Human-readable text, not handled by this module.
+	OUTFMT_JSONL,
+	OUTFMT_CSV,
+	OUTFMT_BIN
+};
+
+#define REPORT_BUFSIZE 0x100000 // Output is written in chunks of this size.
+
+#define REPORT_BINMAGIC 0x4F464247 // "GBFO"
+#define REPORT_BINVERSION 2
+
+// Flags for structure tagREPORT_BINREC.
+enum {
+	RBF_ERROR = 0x0001, // File could not be read; only nErr is valid.
+	RBF_HDROK = 0x0002, // Stored header checksum is correct.
+	RBF_GLOBALKNOWN = 0x0004, // uGlobalChksum holds the correct value.
+	RBF_GLOBALOK = 0x0008, // Stored global checksum is correct.
+	RBF_SIZEKNOWN = 0x0010, // cbFile holds the file size.
+	RBF_UPDATED = 0x0020, // Header was rewritten.
+	RBF_CRC32 = 0x0040, // uCrc32 is valid.
+	RBF_MD5 = 0x0080, // uMd5 is valid.
+	RBF_SHA1 = 0x0100, // uSha1 is valid.
+	RBF_MASK = 0x01FF
+};
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+typedef struct tagREPORT_BINHEAD
+{
+	uint32_t uMagic;
+	uint16_t uVersion;
+	uint16_t cbRecord; // Size of REPORT_BINREC.
+} __attribute__((packed)) REPORT_BINHEAD, *PREPORT_BINHEAD;
+
+typedef struct tagREPORT_BINREC
+{
+	uint16_t uFlags; // RBF_* flags.
+	uint16_t cchName; // Length of the file name following the record.
+	int32_t nErr; // errno value if RBF_ERROR is set.
+	uint64_t cbFile; // File size in bytes.
+	uint64_t uFindings; // HCF(HCB_*) mask.
+	uint64_t uLogoDiff; // cmpGbLogo() mask.
+	uint16_t uGlobalChksum; // Correct global checksum.
+	uint8_t uHdrChksum; // Correct header checksum.
+	uint8_t uHdrRev; // HDRREV_* code.
+	GBHEAD hdr; // Header as read.
+	uint32_t uCrc32; // Content hashes of the file as read.
+	uint8_t uMd5[16];
+	uint8_t uSha1[20];
+} __attribute__((packed, aligned(4))) REPORT_BINREC, *PREPORT_BINREC;
+
+// Everything reported about one file.
+typedef struct tagREPORT_REC
+{
+	const char* pszFileName;
+	int nErr; // errno value if the file could not be read, else zero.
+	const GBHEAD* pHdr; // Header as read, or NULL on error.
+	uint64_t cbFile; // File size in bytes, or zero if unknown.
+	int fGlobalKnown; // Whether uGlobalChksum was computed.
+	uint16_t uGlobalChksum; // Correct global checksum for pHdr.
+	int fUpdated; // Whether the header was rewritten.
+	const ROM_HASHES* pHashes; // Content hashes, or NULL if none were computed.
+} REPORT_REC, *PREPORT_REC;
+
+// An open report. Owned by one thread; output is collected in one
+// buffer and written with as few write() calls as possible.
+typedef struct tagREPORT
+{
+	int fd; // Descriptor written to.
+	unsigned int uFormat; // OUTFMT_* code.
+	char* pBuf; // Output buffer of REPORT_BUFSIZE bytes.
+	size_t cbUsed;
+	int nErr; // errno value of the first failed write, if any.
+} REPORT, *PREPORT;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+int getReportFormat (const char* pszFormat, unsigned int* puFormat);
+
+int openReport (PREPORT pr, const int fd, const unsigned int uFormat);
+int writeReport (PREPORT pr, const PREPORT_REC prr);
+int flushReport (PREPORT pr);
+int closeReport (PREPORT pr);
+
+#endif /* _REPORT_H_ */
+
+// EOF
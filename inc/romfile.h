@@ -0,0 +1,78 @@
+/*
+ * inc/romfile.h
+ * 
+ * GBFix - Mapped ROM File Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _ROMFILE_H_
+#define _ROMFILE_H_
+
+#include "gbhead.h"
+#include <stddef.h>
+#include <sys/types.h>
+
+// ---------------------------------------------------------------------
+// Flags for structure tagROM_FILE.
+// ---------------------------------------------------------------------
+
+enum {
+	RFF_WRITE = 0x0001, // Mapping is writable and shared with the file.
+	RFF_DIRTY = 0x0002, // Header page modified but not yet flushed.
+	RFF_MASK = 0x0003
+};
+
+#define ROM_PADBUFSIZE 0x10000 // Fill is written from a stack buffer of this size.
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+// An open ROM file, mapped once for its whole lifetime.
+typedef struct tagROM_FILE
+{
+	int fd; // File descriptor backing the mapping.
+	unsigned long int uFlags; // RFF_* flags.
+	uint8_t* pRom; // Mapped image.
+	size_t cbRom; // Size of the image in bytes.
+} ROM_FILE, *PROM_FILE;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+int openRomFile (const char* pszFileName, PROM_FILE prf, const unsigned long int uFlags);
+int createRomFile (char* pszTemplate, const size_t cbRom, const PROM_FILE prfCopy, PROM_FILE prf);
+int closeRomFile (PROM_FILE prf);
+
+int readRomHeader (const PROM_FILE prf, PGBHEAD pHdr);
+int writeRomHeader (PROM_FILE prf, const PGBHEAD pHdr);
+int syncRomFile (PROM_FILE prf);
+int resizeRomFile (PROM_FILE prf, const size_t cbNew, const uint8_t uFill);
+
+// Descriptor I/O helpers.
+ssize_t readFull (int fd, void* pBuf, size_t cbBuf);
+int writeFull (int fd, const void* pBuf, size_t cbBuf);
+int writeFill (int fd, off_t off, size_t cb, const uint8_t uFill);
+int copyFull (int fdIn, int fdOut, off_t offOut, size_t cb);
+
+#endif /* _ROMFILE_H_ */
+
+// EOF
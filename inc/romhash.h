@@ -0,0 +1,82 @@
+/*
+ * inc/romhash.h
+ * 
+ * GBFix - Content Hash Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _ROMHASH_H_
+#define _ROMHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+// Content hashes.
+enum {
+	HASHF_CRC32 = 0x01, // CRC-32 as used by zip and No-Intro DATs.
+	HASHF_MD5 = 0x02,
+	HASHF_SHA1 = 0x04,
+	HASHF_MASK = 0x07
+};
+
+// Hash kernel implementations.
+enum {
+	HASHIMPL_AUTO, // Fastest kernels supported by the host CPU.
+	HASHIMPL_SCALAR, // Portable C implementations only.
+	HASHIMPL_COUNT
+};
+
+#define HASH_CHUNKSIZE 0x10000 // Bytes fed to every hash before moving on.
+#define HASH_STRMAX 41 // Longest hash as a hex string, including the NUL.
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+typedef struct tagROM_HASHES
+{
+	unsigned int uHashes; // HASHF_* flags of the hashes held.
+	uint32_t uCrc32;
+	uint8_t uMd5[16];
+	uint8_t uSha1[20];
+	uint64_t uSum; // Sum of every byte, as read in the same pass.
+} ROM_HASHES, *PROM_HASHES;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+int getRomHashFlags (const char* pszHashes, unsigned int* puHashes);
+const char* getRomHashName (const unsigned int uHash);
+char* getRomHashStr (const PROM_HASHES pHashes, const unsigned int uHash, char* pszBuf);
+
+int hashRomImage (const void* pData, size_t cbData, const unsigned int uHashes, PROM_HASHES pHashes);
+
+// Kernel selection functions.
+int selectRomHashImpl (const unsigned int uImpl);
+const char* getRomHashImplStr (const unsigned int uHash);
+
+#endif /* _ROMHASH_H_ */
+
+// EOF
@@ -0,0 +1,155 @@
+/*
+ * inc/romindex.h
+ * 
+ * GBFix - ROM Collection Index Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _ROMINDEX_H_
+#define _ROMINDEX_H_
+
+/*
+	
+	Index File Layout:
+	
+	INDEX_HEAD, 64 bytes.
+	Then, each section starting on a 64 byte boundary:
+	uint8_t[80][nRows]		Header bytes, one column per byte of GBHEAD.
+	uint32_t[nRows]			HCF(HCB_*) findings.
+	uint16_t[nRows]			Correct global checksums.
+	uint8_t[nRows]			IXS_* status flags.
+	INDEX_ID[nRows]			File identities.
+	char[cbPaths]			NUL terminated absolute paths.
+	
+	A query touches only the columns it names, so each predicate is a
+	linear pass over nRows bytes or words. Native byte order.
+	
+*/
+
+#include "gbhead.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+#define INDEX_MAGIC 0x58494247 // "GBIX"
+#define INDEX_VERSION 2
+
+// Row status flags.
+enum {
+	IXS_HDROK = 0x01, // Stored header checksum is correct.
+	IXS_GLOBALOK = 0x02, // Stored global checksum is correct.
+	IXS_MASK = 0x03
+};
+
+// Query operators.
+enum {
+	IXOP_EQ, // =
+	IXOP_NE, // !=
+	IXOP_LT, // <
+	IXOP_LE, // <=
+	IXOP_GT, // >
+	IXOP_GE, // >=
+	IXOP_AND, // &, any of the bits set.
+	IXOP_PREFIX // ^, string starts with.
+};
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+typedef struct tagINDEX_HEAD
+{
+	uint32_t uMagic;
+	uint16_t uVersion;
+	uint16_t uReserved;
+	uint64_t nRows; // Number of ROMs in the index.
+	uint64_t cbPaths; // Size of the path section.
+	uint8_t uPadding[40];
+} INDEX_HEAD, *PINDEX_HEAD;
+
+// Identity of an indexed file, to tell whether it changed.
+typedef struct tagINDEX_ID
+{
+	uint64_t uDev;
+	uint64_t uIno;
+	uint64_t uSize;
+	int64_t nMtimeNs;
+	uint64_t uPathOffset; // Offset of the path in the path section.
+} INDEX_ID, *PINDEX_ID;
+
+// One ROM, as gathered from or written to the columns.
+typedef struct tagINDEX_ROW
+{
+	GBHEAD hdr;
+	uint32_t uFindings; // HCF(HCB_*) mask.
+	uint16_t uGlobalChksum; // Correct global checksum.
+	uint8_t uStatus; // IXS_* flags.
+	INDEX_ID id; // uPathOffset is ignored when writing.
+	const char* pszPath;
+} INDEX_ROW, *PINDEX_ROW;
+
+// An open, mapped index.
+typedef struct tagROM_INDEX
+{
+	void* pMap;
+	size_t cbMap;
+	size_t nRows;
+	const uint8_t* pHdrCols; // Column of header byte n at n * nRows.
+	const uint32_t* puFindings;
+	const uint16_t* puGlobalChksums;
+	const uint8_t* puStatus;
+	const INDEX_ID* pIds;
+	const char* pszPaths;
+	size_t cbPaths;
+	uint32_t* puSlots; // Path hash table, built on first lookup.
+	size_t nSlots;
+} ROM_INDEX, *PROM_INDEX;
+
+// A parsed query predicate.
+typedef struct tagINDEX_PRED
+{
+	unsigned int uField; // Index into the field table.
+	unsigned int uOp; // IXOP_* operator.
+	uint64_t uValue; // Value of numeric fields.
+	char szValue[17]; // Value of string fields.
+} INDEX_PRED, *PINDEX_PRED;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+int openRomIndex (const char* pszFileName, PROM_INDEX pIndex);
+void closeRomIndex (PROM_INDEX pIndex);
+int writeRomIndex (const char* pszFileName, const PINDEX_ROW pRows, const size_t nRows);
+
+const char* getRomIndexPath (const PROM_INDEX pIndex, const size_t iRow);
+int getRomIndexRow (const PROM_INDEX pIndex, const size_t iRow, PINDEX_ROW pRow);
+int findRomIndexRow (PROM_INDEX pIndex, const char* pszPath, size_t* piRow);
+
+int parseIndexPred (const char* pszPred, PINDEX_PRED pPred);
+int queryRomIndex (const PROM_INDEX pIndex, const PINDEX_PRED pPreds, const size_t nPreds, uint8_t* pSel, size_t* pnMatches);
+
+#endif /* _ROMINDEX_H_ */
+
+// EOF
@@ -25,31 +25,21 @@
 #ifndef _RUNPARAM_H_
 #define _RUNPARAM_H_
 
+#include "batch.h"
+#include "cache.h"
 #include "gbhead.h"
+#include "patch.h"
+#include "report.h"
+#include "romfile.h"
+#include "romhash.h"
+#include "stats.h"
 #include <stddef.h>
+#include <stdio.h>
 
 // ---------------------------------------------------------------------
 // Define flags.
 // ---------------------------------------------------------------------
 
-// ---------------------------------------------------------------------
-// Flags for structure tagHDR_UPDATES.
-// ---------------------------------------------------------------------
-
-enum {
-	UPF_TITLE = 0x0001,
-	UPF_MANU = 0x0002,
-	UPF_CGBF = 0x0004,
-	UPF_LICENSE = 0x0008,
-	UPF_SGBF = 0x0010,
-	UPF_CARTTYPE = 0x0020,
-	UPF_ROMSIZE = 0x0040,
-	UPF_RAMSIZE = 0x0080,
-	UPF_REGION = 0x0100,
-	UPF_ROMVER = 0x0200,
-	UPF_MASK = 0x03FF
-};
-
 // ---------------------------------------------------------------------
 // Flags for structure tagRUN_PARAMS.
 // ---------------------------------------------------------------------
@@ -62,42 +52,118 @@ enum {
 	RPF_ROMFILE = 0x0010, // ROM file specified.
 	RPF_UPDATEROM = 0x0020, // ROM is to be updated.
 	RPF_DRYRUN = 0x0040, // Dry-run mode enabled.
-	RPF_MASK = 0x007F // Mask of all flags.
+	RPF_FULLRESCAN = 0x0080, // Rescan the whole ROM for the global checksum even if cached.
+	RPF_CACHE = 0x0100, // Checksum cache enabled.
+	RPF_CACHECLEAR = 0x0200, // Invalidate the checksum cache.
+	RPF_CACHEGC = 0x0400, // Drop stale checksum cache entries.
+	RPF_SERVE = 0x0800, // Run as a daemon serving requests on a socket.
+	RPF_CLIENT = 0x1000, // Send the files to a daemon instead.
+	RPF_WATCH = 0x2000, // Fix ROMs in a directory whenever they are rewritten.
+	RPF_AUDIT = 0x4000, // Only validate the headers and report findings.
+	RPF_INVENTORY = 0x8000, // Only print the headers, read in bulk.
+	RPF_PAD = 0x10000, // Pad ROMs to the next valid ROM size.
+	RPF_TRIM = 0x20000, // Trim trailing fill down to the smallest valid ROM size.
+	RPF_FILLINFO = 0x40000, // Report used and fill bytes per bank.
+	RPF_STATS = 0x80000, // Time each phase of each file and print totals at exit.
+	RPF_MASK = 0xFFFFF // Mask of all flags.
 };
 
 // ---------------------------------------------------------------------
 // Define structures.
 // ---------------------------------------------------------------------
 
-// Structure containing information about what to update in the ROM.
-typedef struct tagHDR_UPDATES
-{
-	unsigned long int uFlags; // Flags about what is to be updated.
-	char pszTitle[17];
-	char pszManu[5];
-	uint8_t uCgbFlag;
-	uint8_t uLicensee;
-	uint8_t uSgbFlag;
-	uint8_t uCartType;
-	uint8_t uRomSize;
-	uint8_t uRamSize;
-	uint8_t uRegion;
-	uint8_t uRomVer;
-} __attribute__((packed, aligned(4))) HDR_UPDATES, *PHDR_UPDATES;
-
 // Structure containing information about the user's choices and what
 // operations to perform.
 typedef struct tagRUN_PARAMS
 {
 	unsigned long int uFlags; // Flags about
 	unsigned long int nExitCode; // Code to exit with.
-	size_t cchFileName; // Length of file name buffer in chars.
-	char* pszFileName; // File name buffer.
+	PFILE_LIST pFileList; // Pointer to the list of ROM files.
+	unsigned int nJobs; // Number of files to process in parallel (0: one per CPU).
 	unsigned long int uHdrRev; // Header revision code.
-	PGBHEAD pHdr; // Pointer to ROM header structure.
 	PHDR_UPDATES pHdrUps; // Pointer to header updates structure.
+	PHDR_PLAN pHdrPlan; // Pointer to the header updates, compiled.
+	const char* pszOutFile; // Output file name, or NULL to update ROMs in place.
+	const char* pszCachePath; // Checksum cache file name, or NULL for the default.
+	unsigned int nCacheGcDays; // Age in days after which cache entries are dropped.
+	PROM_CACHE pCache; // Pointer to the open checksum cache, if any.
+	const char* pszSocket; // Daemon socket for --serve and --client.
+	const char* pszWatchDir; // Directory to watch for rewritten ROMs.
+	unsigned int uFormat; // OUTFMT_* output format.
+	PREPORT pReport; // Open report, unless the output format is text.
+	const char* pszCommand; // Command named before any file, or NULL.
+	char** ppszCmdArgs; // Arguments following the command.
+	int nCmdArgs;
+	unsigned int uHashes; // HASHF_* content hashes to compute, or zero.
+	uint8_t uPadByte; // Fill byte for --pad.
+	const char* pszPatch; // IPS or BPS patch to apply, or NULL.
+	PROM_PATCH pPatch; // Pointer to the open patch, if any.
+	unsigned int uStatsFormat; // STATFMT_* format for --stats.
+	PRUN_STATS pStats; // Pointer to the run statistics, if collected.
 } __attribute__((packed, aligned(4))) RUN_PARAMS, *PRUN_PARAMS;
 
+#define JOB_OUTSIZE 0x2000 // Regular output kept for each job run in parallel.
+#define JOB_ERRSIZE 0x2000 // Error output kept for each job run in parallel.
+
+// Where a worker's stream writes the output of its current job.
+typedef struct tagJOB_OUTSINK
+{
+	char* pch; // The job's part of the batch's output arena.
+	size_t cch; // Bytes written.
+	size_t cchMax;
+	int fTruncated; // Whether output past cchMax was dropped.
+} JOB_OUTSINK, *PJOB_OUTSINK;
+
+// Output streams of one worker thread, made before the workers start.
+// For each job the worker runs they are pointed at the job's part of
+// the output arena, where the output waits to be printed in order.
+typedef struct tagJOB_OUTBUF
+{
+	FILE* pOut; // Unbuffered stream writing to sinkOut.
+	FILE* pErr; // Unbuffered stream writing to sinkErr.
+	JOB_OUTSINK sinkOut;
+	JOB_OUTSINK sinkErr;
+} JOB_OUTBUF, *PJOB_OUTBUF;
+
+// Structure containing the state of one ROM file being processed.
+typedef struct tagROM_JOB
+{
+	const char* pszFileName; // Name of the ROM file.
+	const char* pszPath; // Path to open the file by, or NULL to use pszFileName.
+	FILE* pOut; // Stream for regular output.
+	FILE* pErr; // Stream for error output.
+	char* pszOut; // Buffered regular output, when run by the daemon.
+	size_t cchOut;
+	char* pszErr; // Buffered error output, when run by the daemon.
+	size_t cchErr;
+	PJOB_OUTBUF pOutBuf; // Worker streams holding the output, when run in parallel.
+	const char* pchJobOut; // Regular output kept in the output arena.
+	size_t cchJobOut;
+	const char* pchJobErr; // Error output kept in the output arena.
+	size_t cchJobErr;
+	int fOutTruncated; // Whether kept output did not fit.
+	int nResult; // Zero if the file was processed successfully.
+	int nErr; // errno value if the file or its header could not be read.
+	GBHEAD hdr; // ROM header.
+	GBHEAD hdrOrig; // ROM header as it was read from the file.
+	ROM_FILE rf; // Mapped ROM file.
+	struct stat stRom; // Status of the ROM file when it was opened.
+	int fCached; // Whether ceCached holds checksums for the file as opened.
+	CACHE_ENTRY ceCached; // Cached checksums.
+	int fGlobalExact; // Whether uGlobalChksum is known to be correct.
+	uint16_t uGlobalChksum; // Correct global checksum for the current header.
+	ROM_HASHES hashes; // Content hashes of the file as read.
+	int fSummed; // Whether hashes.uSum is the byte sum of the image as read.
+	ptrdiff_t nResize; // Bytes --pad appends or, if negative, --trim cuts; uGlobalChksum includes them.
+	uint8_t uResizeFill; // Value of those bytes.
+	int fResized; // Whether the file was resized.
+	ROM_FILE rfOut; // Copy written instead of rf when the output goes to a new file.
+	char* pszTemp; // Name of the new file the ROM is written to, until it is published.
+	int fPatched; // Whether rf is the patched ROM, built in a new file.
+	uint16_t uPatchChksum; // Correct global checksum of the patched ROM as built.
+	JOB_STATS stats; // Phase timings, kept only with RPF_STATS.
+} ROM_JOB, *PROM_JOB;
+
 // ---------------------------------------------------------------------
 // Declare functions.
 // ---------------------------------------------------------------------
@@ -0,0 +1,133 @@
+/*
+ * inc/server.h
+ * 
+ * GBFix - Daemon Protocol Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+/*
+	Daemon protocol:
+	
+	A client connects to the daemon's UNIX stream socket and sends one
+	or more requests, each answered by one response before the next
+	request is read. All fields are in host byte order, as both ends
+	always run on the same machine.
+	
+	Request:	SRV_REQ, then cchPath bytes of absolute file name, then
+				cchName bytes of the name to show in the output.
+	Response:	SRV_RESP, then cbOut bytes of regular output, then cbErr
+				bytes of error output.
+*/
+
+#include "gbhead.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+#define SRV_REQMAGIC 0x51464247 // "GBFQ".
+#define SRV_RESPMAGIC 0x52464247 // "GBFR".
+#define SRV_VERSION 1
+#define SRV_PATHMAX 4095 // Longest file name accepted in a request.
+
+// Request operations.
+enum {
+	SRVOP_INFO, // Print the ROM header only.
+	SRVOP_VERIFY, // Print the header and check both checksums.
+	SRVOP_FIX, // Apply header updates and fix both checksums.
+	SRVOP_COUNT
+};
+
+// Request options.
+enum {
+	SRVO_VERBOSE = 0x01,
+	SRVO_DRYRUN = 0x02,
+	SRVO_NOROMINFO = 0x04,
+	SRVO_FULLRESCAN = 0x08,
+	SRVO_PAD = 0x10, // Pad the ROM with uPadByte.
+	SRVO_TRIM = 0x20, // Trim trailing fill from the ROM.
+	SRVO_FILLINFO = 0x40, // Report used and fill bytes per bank.
+	SRVO_MASK = 0x7F
+};
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+// Fixed part of a request.
+typedef struct tagSRV_REQ
+{
+	uint32_t uMagic; // SRV_REQMAGIC.
+	uint8_t uVersion; // SRV_VERSION.
+	uint8_t uOp; // SRVOP_* operation.
+	uint8_t uOpts; // SRVO_* options.
+	uint8_t uPadByte; // Fill byte if SRVO_PAD is set.
+	uint16_t cchPath; // Length of the file name that follows.
+	uint16_t cchName; // Length of the display name after it, or zero.
+	uint16_t uUpFlags; // UPF_* flags of the header updates.
+	char strTitle[16] __attribute__((nonstring));
+	char strManu[4] __attribute__((nonstring));
+	uint8_t uCgbFlag;
+	uint8_t uLicensee;
+	uint8_t uSgbFlag;
+	uint8_t uCartType;
+	uint8_t uRomSize;
+	uint8_t uRamSize;
+	uint8_t uRegion;
+	uint8_t uRomVer;
+} __attribute__((packed)) SRV_REQ, *PSRV_REQ;
+
+// Fixed part of a response.
+typedef struct tagSRV_RESP
+{
+	uint32_t uMagic; // SRV_RESPMAGIC.
+	int32_t nResult; // Zero if the request succeeded.
+	uint32_t cbOut; // Length of the regular output that follows.
+	uint32_t cbErr; // Length of the error output that follows.
+} __attribute__((packed)) SRV_RESP, *PSRV_RESP;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+// Socket functions.
+int listenServer (const char* pszPath);
+int connectServer (const char* pszPath);
+int checkServerPeer (int fd);
+
+// Request functions.
+void packRequest (PSRV_REQ pReq, const unsigned int uOp, const unsigned int uOpts, const PHDR_UPDATES pHdrUps);
+void unpackRequest (const PSRV_REQ pReq, PHDR_UPDATES pHdrUps);
+int sendRequest (int fd, PSRV_REQ pReq, const char* pszPath, const char* pszName);
+int recvRequest (int fd, PSRV_REQ pReq, char* pszPath, char* pszName);
+
+// Response functions.
+int sendResponse (int fd, const int nResult, const char* pszOut, size_t cbOut, const char* pszErr, size_t cbErr);
+int recvResponse (int fd, int* pnResult, FILE* pOut, FILE* pErr);
+
+#endif /* _SERVER_H_ */
+
+// EOF
@@ -0,0 +1,91 @@
+/*
+ * inc/stats.h
+ * 
+ * GBFix - Run Statistics Module Header
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// ---------------------------------------------------------------------
+// Define flags.
+// ---------------------------------------------------------------------
+
+// Phases of a file job.
+enum {
+	STATPH_OPEN, // Opening, mapping and reading the header.
+	STATPH_PATCH, // Applying a patch.
+	STATPH_HASH, // Content hashes.
+	STATPH_INFO, // Printing ROM information and warnings.
+	STATPH_CHKSUM, // Updating the header, planning a resize and settling both checksums.
+	STATPH_SAVE, // Resizing, writing the header and publishing.
+	STATPH_COUNT
+};
+
+// Statistics output formats.
+enum {
+	STATFMT_TEXT,
+	STATFMT_JSON
+};
+
+// ---------------------------------------------------------------------
+// Define structures.
+// ---------------------------------------------------------------------
+
+// Timings of one file job, in monotonic nanoseconds.
+typedef struct tagJOB_STATS
+{
+	uint64_t nPhaseNs[STATPH_COUNT]; // Time spent in each phase.
+	uint64_t cbPhase[STATPH_COUNT]; // Bytes of ROM image each phase scanned or wrote.
+	uint64_t nTotalNs; // Time from opening the file to closing it.
+	uint64_t cbFile; // Size of the file.
+	int fFailed; // Whether the job failed.
+} JOB_STATS, *PJOB_STATS;
+
+// Statistics of a whole run, gathered on one thread.
+typedef struct tagRUN_STATS
+{
+	uint64_t nStartNs; // When the run started.
+	PJOB_STATS pJobs; // Stats of each finished job.
+	size_t nJobs;
+	size_t nAlloc;
+} RUN_STATS, *PRUN_STATS;
+
+// ---------------------------------------------------------------------
+// Declare functions.
+// ---------------------------------------------------------------------
+
+uint64_t getMonotonicNs (void);
+int getStatsFormat (const char* pszFormat, unsigned int* puFormat);
+
+void initRunStats (PRUN_STATS prs);
+int reserveRunStats (PRUN_STATS prs, const size_t nJobs);
+int addRunStats (PRUN_STATS prs, const PJOB_STATS pjs);
+void printRunStats (FILE* pOut, PRUN_STATS prs, const unsigned int uFormat);
+void freeRunStats (PRUN_STATS prs);
+
+#endif /* _STATS_H_ */
+
+// EOF
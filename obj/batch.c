@@ -0,0 +1,414 @@
+/*
+ * obj/batch.c
+ * 
+ * GBFix - Batch Processing Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/batch.h"
+
+// File extensions picked up when scanning directories.
+static const char* const s_pszRomExts[] = { ".gb", ".gbc", ".sgb" };
+
+// Range of job indices owned by one worker. The owner takes jobs from
+// the front, thieves split off the back half.
+typedef struct tagJOB_RANGE
+{
+	pthread_mutex_t mtx;
+	size_t iNext;
+	size_t iEnd;
+} JOB_RANGE, *PJOB_RANGE;
+
+typedef struct tagJOB_POOL
+{
+	size_t nJobs;
+	unsigned int nWorkers;
+	PJOB_RANGE pRanges;
+	PFN_RUNJOB pfnRun;
+	void* pCtx;
+	unsigned char* pfDone; // Completion flag per job.
+	pthread_mutex_t mtxDone;
+	pthread_cond_t cvDone;
+} JOB_POOL, *PJOB_POOL;
+
+typedef struct tagJOB_WORKER
+{
+	PJOB_POOL pPool;
+	unsigned int iWorker;
+} JOB_WORKER, *PJOB_WORKER;
+
+static int addPath (PFILE_LIST pfl, const char* pszPath);
+
+// ---------------------------------------------------------------------
+// File list functions.
+// ---------------------------------------------------------------------
+
+static int appendFile (PFILE_LIST pfl, const char* pszFileName) {
+	
+	if (pfl->nFiles == pfl->nAlloc) {
+		size_t nNewAlloc = pfl->nAlloc ? pfl->nAlloc * 2 : 16;
+		char** ppszNew;
+		if ((ppszNew = realloc(pfl->ppszFiles, nNewAlloc * sizeof(char*))) == NULL) return -1;
+		pfl->ppszFiles = ppszNew;
+		pfl->nAlloc = nNewAlloc;
+	}
+	
+	if ((pfl->ppszFiles[pfl->nFiles] = strdup(pszFileName)) == NULL) return -1;
+	pfl->nFiles++;
+	return 0;
+	
+}
+
+int hasRomExt (const char* pszName) {
+	
+	const char* pszExt = strrchr(pszName, '.');
+	if (pszExt == NULL) return 0;
+	
+	for (size_t iExt = 0; iExt < sizeof(s_pszRomExts) / sizeof(s_pszRomExts[0]); iExt++)
+		if (strcasecmp(pszExt, s_pszRomExts[iExt]) == 0) return 1;
+	
+	return 0;
+	
+}
+
+static int addDirectory (PFILE_LIST pfl, const char* pszDir) {
+	
+	struct dirent** ppEnts;
+	int nEnts;
+	
+	// Sort entries so batch output is the same from run to run.
+	if ((nEnts = scandir(pszDir, &ppEnts, NULL, alphasort)) < 0) return -1;
+	
+	int nRet = 0;
+	for (int iEnt = 0; iEnt < nEnts; iEnt++) {
+		const char* pszName = ppEnts[iEnt]->d_name;
+		
+		if (nRet == 0 && pszName[0] != '.') {
+			size_t cchPath = strlen(pszDir) + strlen(pszName) + 2;
+			char* pszPath;
+			
+			if ((pszPath = malloc(cchPath)) == NULL) {
+				nRet = -1;
+			} else {
+				snprintf(pszPath, cchPath, "%s/%s", pszDir, pszName);
+				
+				struct stat st;
+				if (stat(pszPath, &st) == 0) {
+					if (S_ISDIR(st.st_mode)) nRet = addDirectory(pfl, pszPath);
+					else if (S_ISREG(st.st_mode) && hasRomExt(pszName)) nRet = appendFile(pfl, pszPath);
+				}
+				free(pszPath);
+			}
+		}
+		free(ppEnts[iEnt]);
+	}
+	free(ppEnts);
+	
+	return nRet;
+	
+}
+
+static int addPath (PFILE_LIST pfl, const char* pszPath) {
+	
+	struct stat st;
+	
+	// Directories are expanded to the ROMs inside them. Anything else is
+	// taken as given, so a bad name is reported when it is processed.
+	if (stat(pszPath, &st) == 0 && S_ISDIR(st.st_mode)) return addDirectory(pfl, pszPath);
+	return appendFile(pfl, pszPath);
+	
+}
+
+static int addListFile (PFILE_LIST pfl, const char* pszListFile) {
+	
+	FILE* pFile;
+	if ((pFile = fopen(pszListFile, "r")) == NULL) return -1;
+	
+	char* pszLine = NULL;
+	size_t cchLine = 0;
+	ssize_t cchRead;
+	int nRet = 0;
+	
+	while (nRet == 0 && (cchRead = getline(&pszLine, &cchLine, pFile)) >= 0) {
+		
+		// Strip the line ending, skip blank lines and comments.
+		while (cchRead > 0 && (pszLine[cchRead - 1] == '\n' || pszLine[cchRead - 1] == '\r'))
+			pszLine[--cchRead] = '\0';
+		if (cchRead == 0 || pszLine[0] == '#') continue;
+		
+		nRet = addPath(pfl, pszLine);
+	}
+	
+	free(pszLine);
+	fclose(pFile);
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: addFileArg
+ * 
+ * 		Adds a command-line file argument to a file list. Directories
+ * 	are scanned recursively for ROM files in sorted order, and an
+ * 	argument of the form "@FILE" adds every path listed in FILE, one
+ * 	per line.
+ * 
+ * @param:
+ * 		PFILE_LIST pfl:
+ * 			Pointer to the file list to add to.
+ * 
+ * 		const char* pszArg:
+ * 			The file, directory or @listfile argument.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int addFileArg (PFILE_LIST pfl, const char* pszArg) {
+	
+	if (pfl == NULL || pszArg == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (pszArg[0] == '@') return addListFile(pfl, pszArg + 1);
+	return addPath(pfl, pszArg);
+	
+}
+
+void freeFileList (PFILE_LIST pfl) {
+	
+	if (pfl == NULL) return;
+	
+	for (size_t iFile = 0; iFile < pfl->nFiles; iFile++) free(pfl->ppszFiles[iFile]);
+	free(pfl->ppszFiles);
+	
+	pfl->ppszFiles = NULL;
+	pfl->nFiles = pfl->nAlloc = 0;
+	
+}
+
+// ---------------------------------------------------------------------
+// Thread pool functions.
+// ---------------------------------------------------------------------
+
+unsigned int getDefaultJobCount (void) {
+	
+	long int nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return (nCpus > 0) ? (unsigned int)nCpus : 1;
+	
+}
+
+// Take the next job from the worker's own range.
+static int popJob (PJOB_RANGE pRange, size_t* piJob) {
+	
+	int fGot = 0;
+	
+	pthread_mutex_lock(&pRange->mtx);
+	if (pRange->iNext < pRange->iEnd) {
+		*piJob = pRange->iNext++;
+		fGot = 1;
+	}
+	pthread_mutex_unlock(&pRange->mtx);
+	
+	return fGot;
+	
+}
+
+// Steal the back half of another worker's range into our own.
+static int stealJobs (PJOB_POOL pPool, unsigned int iThief) {
+	
+	for (unsigned int iStep = 1; iStep < pPool->nWorkers; iStep++) {
+		PJOB_RANGE pVictim = &pPool->pRanges[(iThief + iStep) % pPool->nWorkers];
+		size_t iBegin = 0, iEnd = 0;
+		
+		pthread_mutex_lock(&pVictim->mtx);
+		if (pVictim->iNext < pVictim->iEnd) {
+			size_t nLeft = pVictim->iEnd - pVictim->iNext;
+			iEnd = pVictim->iEnd;
+			iBegin = iEnd - (nLeft + 1) / 2;
+			pVictim->iEnd = iBegin;
+		}
+		pthread_mutex_unlock(&pVictim->mtx);
+		
+		if (iBegin < iEnd) {
+			PJOB_RANGE pOwn = &pPool->pRanges[iThief];
+			pthread_mutex_lock(&pOwn->mtx);
+			pOwn->iNext = iBegin;
+			pOwn->iEnd = iEnd;
+			pthread_mutex_unlock(&pOwn->mtx);
+			return 1;
+		}
+	}
+	
+	return 0;
+	
+}
+
+static void* workerMain (void* pParam) {
+	
+	PJOB_WORKER pWorker = (PJOB_WORKER)pParam;
+	PJOB_POOL pPool = pWorker->pPool;
+	size_t iJob;
+	
+	// Jobs never spawn jobs, so once every range is empty we are done.
+	do {
+		while (popJob(&pPool->pRanges[pWorker->iWorker], &iJob)) {
+			pPool->pfnRun(iJob, pPool->pCtx);
+			
+			pthread_mutex_lock(&pPool->mtxDone);
+			pPool->pfDone[iJob] = 1;
+			pthread_cond_broadcast(&pPool->cvDone);
+			pthread_mutex_unlock(&pPool->mtxDone);
+		}
+	} while (stealJobs(pPool, pWorker->iWorker));
+	
+	return NULL;
+	
+}
+
+/*
+ * 
+ * name: runJobs
+ * 
+ * 		Runs a set of independent jobs on a work-stealing thread pool.
+ * 	Each worker starts with an equal slice of the job indices and
+ * 	steals half of a busier worker's remaining slice when it runs dry.
+ * 	The completion callback is run on the calling thread strictly in
+ * 	index order as soon as each job and all jobs before it are done.
+ * 
+ * @param:
+ * 		size_t nJobs:
+ * 			Number of jobs to run.
+ * 
+ * 		unsigned int nThreads:
+ * 			Number of worker threads. With one thread, or one job, the
+ * 		jobs are run directly on the calling thread.
+ * 
+ * 		PFN_RUNJOB pfnRun:
+ * 			Callback that performs a job.
+ * 
+ * 		PFN_JOBDONE pfnDone:
+ * 			Callback run after a job completes. May be NULL.
+ * 
+ * 		void* pCtx:
+ * 			Context passed to both callbacks.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero if
+ * 	the pool could not be started. No jobs are run in that case.
+ * 
+ */
+int runJobs (size_t nJobs, unsigned int nThreads, PFN_RUNJOB pfnRun, PFN_JOBDONE pfnDone, void* pCtx) {
+	
+	if (pfnRun == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (nThreads > nJobs) nThreads = (unsigned int)nJobs;
+	
+	// Run small batches inline.
+	if (nThreads <= 1) {
+		for (size_t iJob = 0; iJob < nJobs; iJob++) {
+			pfnRun(iJob, pCtx);
+			if (pfnDone != NULL) pfnDone(iJob, pCtx);
+		}
+		return 0;
+	}
+	
+	JOB_POOL pool;
+	memset(&pool, 0, sizeof(JOB_POOL));
+	pool.nJobs = nJobs;
+	pool.nWorkers = nThreads;
+	pool.pfnRun = pfnRun;
+	pool.pCtx = pCtx;
+	
+	pthread_t* pThreads = calloc(nThreads, sizeof(pthread_t));
+	PJOB_WORKER pWorkers = calloc(nThreads, sizeof(JOB_WORKER));
+	pool.pRanges = calloc(nThreads, sizeof(JOB_RANGE));
+	pool.pfDone = calloc(nJobs, 1);
+	
+	if (pThreads == NULL || pWorkers == NULL || pool.pRanges == NULL || pool.pfDone == NULL) {
+		free(pThreads);
+		free(pWorkers);
+		free(pool.pRanges);
+		free(pool.pfDone);
+		errno = ENOMEM;
+		return -1;
+	}
+	
+	pthread_mutex_init(&pool.mtxDone, NULL);
+	pthread_cond_init(&pool.cvDone, NULL);
+	
+	// Hand out equal slices up front.
+	for (unsigned int iWorker = 0; iWorker < nThreads; iWorker++) {
+		pthread_mutex_init(&pool.pRanges[iWorker].mtx, NULL);
+		pool.pRanges[iWorker].iNext = nJobs * iWorker / nThreads;
+		pool.pRanges[iWorker].iEnd = nJobs * (iWorker + 1) / nThreads;
+		pWorkers[iWorker].pPool = &pool;
+		pWorkers[iWorker].iWorker = iWorker;
+	}
+	
+	// Start workers. If some fail to start, the rest steal their share.
+	unsigned int nStarted = 0;
+	for (unsigned int iWorker = 0; iWorker < nThreads; iWorker++)
+		if (pthread_create(&pThreads[nStarted], NULL, workerMain, &pWorkers[iWorker]) == 0) nStarted++;
+	
+	if (nStarted == 0) workerMain(&pWorkers[0]);
+	
+	// Report completions in order.
+	for (size_t iJob = 0; iJob < nJobs; iJob++) {
+		pthread_mutex_lock(&pool.mtxDone);
+		while (!pool.pfDone[iJob]) pthread_cond_wait(&pool.cvDone, &pool.mtxDone);
+		pthread_mutex_unlock(&pool.mtxDone);
+		
+		if (pfnDone != NULL) pfnDone(iJob, pCtx);
+	}
+	
+	for (unsigned int iWorker = 0; iWorker < nStarted; iWorker++) pthread_join(pThreads[iWorker], NULL);
+	
+	for (unsigned int iWorker = 0; iWorker < nThreads; iWorker++) pthread_mutex_destroy(&pool.pRanges[iWorker].mtx);
+	pthread_cond_destroy(&pool.cvDone);
+	pthread_mutex_destroy(&pool.mtxDone);
+	
+	free(pThreads);
+	free(pWorkers);
+	free(pool.pRanges);
+	free(pool.pfDone);
+	return 0;
+	
+}
+
+// EOF
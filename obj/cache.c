@@ -0,0 +1,482 @@
+/*
+ * obj/cache.c
+ * 
+ * GBFix - Checksum Cache Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/cache.h"
+
+#define CACHE_MINSLOTS 4096 // Initial and minimum table size.
+#define CACHE_TOUCHSECS 86400 // Granularity of last-used updates on hits.
+
+static char s_szDefaultPath[4096];
+
+/*
+ * 
+ * name: getDefaultCachePath
+ * 
+ * 		Gets the default location of the cache file: $GBFIX_CACHE if
+ * 	set, otherwise gbfix.cache in $XDG_CACHE_HOME or ~/.cache.
+ * 
+ * @return: const char*
+ * 		Returns the path, or NULL and sets errno to ENOENT if no
+ * 	location could be determined.
+ * 
+ */
+const char* getDefaultCachePath (void) {
+	
+	const char* pszEnv;
+	
+	if ((pszEnv = getenv("GBFIX_CACHE")) != NULL && *pszEnv) return pszEnv;
+	
+	if ((pszEnv = getenv("XDG_CACHE_HOME")) != NULL && *pszEnv) {
+		snprintf(s_szDefaultPath, sizeof(s_szDefaultPath), "%s/gbfix.cache", pszEnv);
+		return s_szDefaultPath;
+	}
+	
+	if ((pszEnv = getenv("HOME")) != NULL && *pszEnv) {
+		snprintf(s_szDefaultPath, sizeof(s_szDefaultPath), "%s/.cache", pszEnv);
+		mkdir(s_szDefaultPath, 0700);
+		snprintf(s_szDefaultPath, sizeof(s_szDefaultPath), "%s/.cache/gbfix.cache", pszEnv);
+		return s_szDefaultPath;
+	}
+	
+	errno = ENOENT;
+	return NULL;
+	
+}
+
+static inline PCACHE_ENTRY getEntries (PROM_CACHE pCache) {
+	
+	return (PCACHE_ENTRY)(pCache->pHead + 1);
+	
+}
+
+static inline size_t getCacheSize (const uint32_t nSlots) {
+	
+	return sizeof(CACHE_HEAD) + (size_t)nSlots * sizeof(CACHE_ENTRY);
+	
+}
+
+static inline uint64_t hashKey (const uint64_t uDev, const uint64_t uIno) {
+	
+	uint64_t uHash = uIno * 0x9E3779B97F4A7C15ull ^ uDev;
+	uHash ^= uHash >> 31;
+	uHash *= 0xBF58476D1CE4E5B9ull;
+	return uHash ^ (uHash >> 29);
+	
+}
+
+static inline int64_t getMtimeNs (const struct stat* pst) {
+	
+	return (int64_t)pst->st_mtim.tv_sec * 1000000000 + pst->st_mtim.tv_nsec;
+	
+}
+
+// Map the cache file at its current size.
+static int mapCache (PROM_CACHE pCache) {
+	
+	struct stat st;
+	
+	if (pCache->pHead != NULL) munmap(pCache->pHead, pCache->cbMap);
+	pCache->pHead = NULL;
+	
+	if (fstat(pCache->fd, &st)) return -1;
+	pCache->cbMap = (size_t)st.st_size;
+	
+	void* pMap = mmap(NULL, pCache->cbMap, PROT_READ | PROT_WRITE, MAP_SHARED, pCache->fd, 0);
+	if (pMap == MAP_FAILED) return -1;
+	
+	pCache->pHead = (PCACHE_HEAD)pMap;
+	return 0;
+	
+}
+
+// Rebuild the table with nSlots slots, keeping entries used since
+// nMinLastUsed. Must be called with the exclusive lock held.
+static int rebuildCache (PROM_CACHE pCache, uint32_t nSlots, const int64_t nMinLastUsed, size_t* pnDropped) {
+	
+	PCACHE_ENTRY pKeep = NULL;
+	size_t nKeep = 0, nDropped = 0;
+	
+	// Save the entries that survive.
+	if (pCache->pHead != NULL && pCache->pHead->uMagic == CACHE_MAGIC &&
+		!(pCache->pHead->uFlags & CHF_REBUILDING) &&
+		pCache->cbMap >= getCacheSize(pCache->pHead->nSlots)) {
+		
+		PCACHE_ENTRY pEntries = getEntries(pCache);
+		uint32_t nOldSlots = pCache->pHead->nSlots;
+		
+		if ((pKeep = malloc((size_t)pCache->pHead->nUsed * sizeof(CACHE_ENTRY) + 1)) == NULL) return -1;
+		
+		for (uint32_t iSlot = 0; iSlot < nOldSlots; iSlot++) {
+			if (!(pEntries[iSlot].uFlags & CEF_USED)) continue;
+			if (pEntries[iSlot].nLastUsed < nMinLastUsed || nKeep >= pCache->pHead->nUsed) {
+				nDropped++;
+				continue;
+			}
+			pKeep[nKeep++] = pEntries[iSlot];
+		}
+		
+		// Mark the table as being rebuilt so a crash leaves it recognizably invalid.
+		pCache->pHead->uFlags |= CHF_REBUILDING;
+	}
+	
+	while (nSlots < CACHE_MINSLOTS || (uint64_t)nKeep * 4 > (uint64_t)nSlots * 3) nSlots <<= 1;
+	
+	// Resize and reinitialize the file.
+	if (ftruncate(pCache->fd, (off_t)sizeof(CACHE_HEAD)) ||
+		ftruncate(pCache->fd, (off_t)getCacheSize(nSlots)) || mapCache(pCache)) {
+		free(pKeep);
+		return -1;
+	}
+	
+	PCACHE_HEAD pHead = pCache->pHead;
+	PCACHE_ENTRY pEntries = getEntries(pCache);
+	uint32_t uMask = nSlots - 1;
+	
+	pHead->uMagic = CACHE_MAGIC;
+	pHead->uVersion = CACHE_VERSION;
+	pHead->uFlags = CHF_REBUILDING;
+	pHead->nSlots = nSlots;
+	
+	for (size_t iKeep = 0; iKeep < nKeep; iKeep++) {
+		uint32_t iSlot = (uint32_t)hashKey(pKeep[iKeep].uDev, pKeep[iKeep].uIno) & uMask;
+		while (pEntries[iSlot].uFlags & CEF_USED) iSlot = (iSlot + 1) & uMask;
+		pEntries[iSlot] = pKeep[iKeep];
+	}
+	
+	pHead->nUsed = (uint32_t)nKeep;
+	pHead->uFlags = 0;
+	
+	free(pKeep);
+	if (pnDropped != NULL) *pnDropped = nDropped;
+	return 0;
+	
+}
+
+// Take the cache lock, picking up any resize made by another process.
+static int lockCache (PROM_CACHE pCache, const int nOp) {
+	
+	pthread_mutex_lock(&pCache->mtx);
+	
+	if (flock(pCache->fd, nOp)) {
+		pthread_mutex_unlock(&pCache->mtx);
+		return -1;
+	}
+	
+	if (pCache->pHead == NULL || pCache->cbMap != getCacheSize(pCache->pHead->nSlots)) {
+		if (mapCache(pCache) || pCache->cbMap < sizeof(CACHE_HEAD) ||
+			pCache->cbMap < getCacheSize(pCache->pHead->nSlots)) {
+			flock(pCache->fd, LOCK_UN);
+			pthread_mutex_unlock(&pCache->mtx);
+			errno = EIO;
+			return -1;
+		}
+	}
+	
+	return 0;
+	
+}
+
+static void unlockCache (PROM_CACHE pCache) {
+	
+	flock(pCache->fd, LOCK_UN);
+	pthread_mutex_unlock(&pCache->mtx);
+	
+}
+
+/*
+ * 
+ * name: openCache
+ * 
+ * 		Opens a cache file, creating or resetting it if it is missing,
+ * 	from another version, or was left half-rebuilt.
+ * 
+ * @param:
+ * 		const char* pszFileName:
+ * 			Name of the cache file.
+ * 
+ * 		PROM_CACHE pCache:
+ * 			Pointer to the cache structure to initialize.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int openCache (const char* pszFileName, PROM_CACHE pCache) {
+	
+	if (pszFileName == NULL || pCache == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memset(pCache, 0, sizeof(ROM_CACHE));
+	pCache->fd = -1;
+	
+	if ((pCache->fd = open(pszFileName, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) return -1;
+	
+	pthread_mutex_init(&pCache->mtx, NULL);
+	
+	if (flock(pCache->fd, LOCK_EX)) goto fail;
+	
+	struct stat st;
+	int fValid = 0;
+	
+	if (fstat(pCache->fd, &st) == 0 && st.st_size >= (off_t)sizeof(CACHE_HEAD) && mapCache(pCache) == 0) {
+		PCACHE_HEAD pHead = pCache->pHead;
+		fValid = (pHead->uMagic == CACHE_MAGIC && pHead->uVersion == CACHE_VERSION &&
+			!(pHead->uFlags & CHF_REBUILDING) && pHead->nSlots >= CACHE_MINSLOTS &&
+			!(pHead->nSlots & (pHead->nSlots - 1)) && pCache->cbMap == getCacheSize(pHead->nSlots));
+	}
+	
+	if (!fValid) {
+		if (pCache->pHead != NULL) pCache->pHead->uMagic = 0;
+		if (rebuildCache(pCache, CACHE_MINSLOTS, INT64_MAX, NULL)) {
+			flock(pCache->fd, LOCK_UN);
+			goto fail;
+		}
+	}
+	
+	flock(pCache->fd, LOCK_UN);
+	return 0;
+	
+fail:
+	{
+		int nErr = errno;
+		closeCache(pCache);
+		errno = nErr;
+	}
+	return -1;
+	
+}
+
+void closeCache (PROM_CACHE pCache) {
+	
+	if (pCache == NULL || pCache->fd < 0) return;
+	
+	if (pCache->pHead != NULL) munmap(pCache->pHead, pCache->cbMap);
+	close(pCache->fd);
+	pthread_mutex_destroy(&pCache->mtx);
+	
+	memset(pCache, 0, sizeof(ROM_CACHE));
+	pCache->fd = -1;
+	
+}
+
+/*
+ * 
+ * name: lookupCache
+ * 
+ * 		Looks up the cached checksums of a ROM file.
+ * 
+ * @param:
+ * 		PROM_CACHE pCache:
+ * 			Pointer to the open cache.
+ * 
+ * 		const struct stat* pst:
+ * 			Pointer to the current status of the ROM file.
+ * 
+ * 		PCACHE_ENTRY pEntry:
+ * 			Receives the cached entry on a hit.
+ * 
+ * @return: int
+ * 		Returns 1 on a hit, 0 on a miss, or sets errno and returns -1
+ * 	on error.
+ * 
+ */
+int lookupCache (PROM_CACHE pCache, const struct stat* pst, PCACHE_ENTRY pEntry) {
+	
+	if (pCache == NULL || pst == NULL || pEntry == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (lockCache(pCache, LOCK_SH)) return -1;
+	
+	PCACHE_ENTRY pEntries = getEntries(pCache);
+	uint32_t uMask = pCache->pHead->nSlots - 1;
+	uint32_t iSlot = (uint32_t)hashKey(pst->st_dev, pst->st_ino) & uMask;
+	int nRet = 0;
+	
+	for (; pEntries[iSlot].uFlags & CEF_USED; iSlot = (iSlot + 1) & uMask) {
+		PCACHE_ENTRY pCur = &pEntries[iSlot];
+		if (pCur->uDev != (uint64_t)pst->st_dev || pCur->uIno != (uint64_t)pst->st_ino) continue;
+		
+		if (pCur->uSize == (uint64_t)pst->st_size && pCur->nMtimeNs == getMtimeNs(pst)) {
+			*pEntry = *pCur;
+			nRet = 1;
+			
+			// Keep the entry alive for the garbage collector. This is an
+			// aligned single-word store, so racing readers are harmless.
+			int64_t nNow = (int64_t)time(NULL);
+			if (nNow - pCur->nLastUsed > CACHE_TOUCHSECS) pCur->nLastUsed = nNow;
+		}
+		break;
+	}
+	
+	unlockCache(pCache);
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: storeCache
+ * 
+ * 		Stores the checksums of a ROM file in the cache, replacing any
+ * 	entry for an older version of the file. The table is grown when it
+ * 	becomes three quarters full.
+ * 
+ * @param:
+ * 		PROM_CACHE pCache:
+ * 			Pointer to the open cache.
+ * 
+ * 		const struct stat* pst:
+ * 			Pointer to the current status of the ROM file.
+ * 
+ * 		const PCACHE_ENTRY pEntry:
+ * 			Entry holding the checksums and CEF_* flags to store. The
+ * 		key fields are filled in from pst.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int storeCache (PROM_CACHE pCache, const struct stat* pst, const PCACHE_ENTRY pEntry) {
+	
+	if (pCache == NULL || pst == NULL || pEntry == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (lockCache(pCache, LOCK_EX)) return -1;
+	
+	PCACHE_ENTRY pEntries = getEntries(pCache);
+	uint32_t uMask = pCache->pHead->nSlots - 1;
+	uint32_t iSlot = (uint32_t)hashKey(pst->st_dev, pst->st_ino) & uMask;
+	
+	for (; pEntries[iSlot].uFlags & CEF_USED; iSlot = (iSlot + 1) & uMask)
+		if (pEntries[iSlot].uDev == (uint64_t)pst->st_dev && pEntries[iSlot].uIno == (uint64_t)pst->st_ino) break;
+	
+	if (!(pEntries[iSlot].uFlags & CEF_USED)) pCache->pHead->nUsed++;
+	
+	CACHE_ENTRY ce = *pEntry;
+	ce.uDev = (uint64_t)pst->st_dev;
+	ce.uIno = (uint64_t)pst->st_ino;
+	ce.uSize = (uint64_t)pst->st_size;
+	ce.nMtimeNs = getMtimeNs(pst);
+	ce.nLastUsed = (int64_t)time(NULL);
+	ce.uFlags |= CEF_USED;
+	pEntries[iSlot] = ce;
+	
+	int nRet = 0;
+	if ((uint64_t)pCache->pHead->nUsed * 4 > (uint64_t)pCache->pHead->nSlots * 3)
+		nRet = rebuildCache(pCache, pCache->pHead->nSlots * 2, INT64_MIN, NULL);
+	
+	unlockCache(pCache);
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: clearCache
+ * 
+ * 		Invalidates every entry in the cache and shrinks it back to its
+ * 	initial size.
+ * 
+ * @param:
+ * 		PROM_CACHE pCache:
+ * 			Pointer to the open cache.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int clearCache (PROM_CACHE pCache) {
+	
+	if (pCache == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (lockCache(pCache, LOCK_EX)) return -1;
+	int nRet = rebuildCache(pCache, CACHE_MINSLOTS, INT64_MAX, NULL);
+	unlockCache(pCache);
+	
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: gcCache
+ * 
+ * 		Drops entries that have not been used for a given time and
+ * 	compacts the table.
+ * 
+ * @param:
+ * 		PROM_CACHE pCache:
+ * 			Pointer to the open cache.
+ * 
+ * 		const time_t tMaxAge:
+ * 			Entries not hit or stored within this many seconds are
+ * 		dropped.
+ * 
+ * 		size_t* pnDropped:
+ * 			Receives the number of dropped entries. May be NULL.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int gcCache (PROM_CACHE pCache, const time_t tMaxAge, size_t* pnDropped) {
+	
+	if (pCache == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (lockCache(pCache, LOCK_EX)) return -1;
+	int nRet = rebuildCache(pCache, CACHE_MINSLOTS, (int64_t)(time(NULL) - tMaxAge), pnDropped);
+	unlockCache(pCache);
+	
+	return nRet;
+	
+}
+
+// EOF
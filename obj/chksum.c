@@ -0,0 +1,544 @@
+/*
+ * obj/chksum.c
+ * 
+ * GBFix - Checksum Kernel Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define CHKSUM_X86
+	#include <immintrin.h>
+#endif
+
+// Include module header(s):
+#include "../inc/chksum.h"
+
+typedef uint64_t (*PFN_SUMBYTES) (const uint8_t* pData, size_t cbData);
+
+static uint64_t sumBytesScalar (const uint8_t* pData, size_t cbData);
+#ifdef CHKSUM_X86
+static uint64_t sumBytesSse2 (const uint8_t* pData, size_t cbData);
+static uint64_t sumBytesAvx2 (const uint8_t* pData, size_t cbData);
+static uint64_t sumBytesAvx512 (const uint8_t* pData, size_t cbData);
+#endif
+
+typedef size_t (*PFN_FINDFILL) (const uint8_t* pData, size_t cbData, const uint8_t uFill);
+
+static size_t findFillStartScalar (const uint8_t* pData, size_t cbData, const uint8_t uFill);
+#ifdef CHKSUM_X86
+static size_t findFillStartSse2 (const uint8_t* pData, size_t cbData, const uint8_t uFill);
+static size_t findFillStartAvx2 (const uint8_t* pData, size_t cbData, const uint8_t uFill);
+static size_t findFillStartAvx512 (const uint8_t* pData, size_t cbData, const uint8_t uFill);
+#endif
+
+// Kernel table, indexed by SUMIMPL_*.
+static const PFN_SUMBYTES s_pfnSumBytesImpls[SUMIMPL_COUNT] = {
+	[SUMIMPL_SCALAR] = sumBytesScalar,
+#ifdef CHKSUM_X86
+	[SUMIMPL_SSE2] = sumBytesSse2,
+	[SUMIMPL_AVX2] = sumBytesAvx2,
+	[SUMIMPL_AVX512] = sumBytesAvx512
+#endif
+};
+
+// Trailing fill scan kernels, selected together with the sum kernels.
+static const PFN_FINDFILL s_pfnFindFillImpls[SUMIMPL_COUNT] = {
+	[SUMIMPL_SCALAR] = findFillStartScalar,
+#ifdef CHKSUM_X86
+	[SUMIMPL_SSE2] = findFillStartSse2,
+	[SUMIMPL_AVX2] = findFillStartAvx2,
+	[SUMIMPL_AVX512] = findFillStartAvx512
+#endif
+};
+
+static const char* const s_pszSumBytesImpls[SUMIMPL_COUNT] = {
+	[SUMIMPL_AUTO] = "auto",
+	[SUMIMPL_SCALAR] = "scalar",
+	[SUMIMPL_SSE2] = "sse2",
+	[SUMIMPL_AVX2] = "avx2",
+	[SUMIMPL_AVX512] = "avx512"
+};
+
+// Currently selected kernel. Resolved once before main() runs, so every
+// thread sees the same value without any locking.
+static unsigned int s_uSumBytesImpl = SUMIMPL_SCALAR;
+static PFN_SUMBYTES s_pfnSumBytes = sumBytesScalar;
+static PFN_FINDFILL s_pfnFindFill = findFillStartScalar;
+
+// Maximum number of threads used by sumBytesParallel().
+static unsigned int s_nSumBytesThreads = 1;
+
+// Work item of the parallel reduction.
+typedef struct tagSUM_CHUNK
+{
+	const uint8_t* pData;
+	size_t cbData;
+	uint64_t uSum;
+} SUM_CHUNK, *PSUM_CHUNK;
+
+__attribute__((constructor)) static void initSumBytes (void) {
+	
+	selectSumBytesImpl(SUMIMPL_AUTO);
+	
+	long int nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	s_nSumBytesThreads = (nCpus > 0) ? (unsigned int)nCpus : 1;
+	
+}
+
+/*
+ * 
+ * name: sumBytes
+ * 
+ * 		Adds up every byte in a buffer using the fastest kernel the
+ * 	host CPU supports.
+ * 
+ * @param:
+ * 		const void* pData:
+ * 			Pointer to the data to sum.
+ * 
+ * 		size_t cbData:
+ * 			Size of the data in bytes.
+ * 
+ * @return: uint64_t
+ * 		Returns the sum of all bytes. The sum cannot overflow for any
+ * 	buffer that fits in memory.
+ * 
+ */
+uint64_t sumBytes (const void* pData, size_t cbData) {
+	
+	if (pData == NULL || cbData == 0) return 0;
+	return s_pfnSumBytes((const uint8_t*)pData, cbData);
+	
+}
+
+/*
+ * 
+ * name: findFillStart
+ * 
+ * 		Finds where the trailing run of fill bytes of a buffer starts.
+ * 	The buffer is scanned backwards from its end, so only the fill and
+ * 	the block holding the last other byte are read.
+ * 
+ * @param:
+ * 		const void* pData:
+ * 			Pointer to the data to scan.
+ * 
+ * 		size_t cbData:
+ * 			Size of the data in bytes.
+ * 
+ * 		const uint8_t uFill:
+ * 			Value of the fill bytes.
+ * 
+ * @return: size_t
+ * 		Returns the offset just past the last byte that differs from
+ * 	uFill, which is zero if the whole buffer is fill and cbData if
+ * 	it does not end in fill.
+ * 
+ */
+size_t findFillStart (const void* pData, size_t cbData, const uint8_t uFill) {
+	
+	if (pData == NULL || cbData == 0) return 0;
+	return s_pfnFindFill((const uint8_t*)pData, cbData, uFill);
+	
+}
+
+static void* sumChunkMain (void* pParam) {
+	
+	PSUM_CHUNK pChunk = (PSUM_CHUNK)pParam;
+	pChunk->uSum = s_pfnSumBytes(pChunk->pData, pChunk->cbData);
+	return NULL;
+	
+}
+
+/*
+ * 
+ * name: sumBytesParallel
+ * 
+ * 		Adds up every byte in a buffer, splitting large buffers into
+ * 	bank-aligned chunks that are summed on separate threads. The
+ * 	partial sums are added exactly, so the result is identical to
+ * 	sumBytes(). Buffers smaller than SUM_PARMIN are summed on the
+ * 	calling thread.
+ * 
+ * @param:
+ * 		const void* pData:
+ * 			Pointer to the data to sum.
+ * 
+ * 		size_t cbData:
+ * 			Size of the data in bytes.
+ * 
+ * @return: uint64_t
+ * 		Returns the sum of all bytes.
+ * 
+ */
+uint64_t sumBytesParallel (const void* pData, size_t cbData) {
+	
+	unsigned int nChunks = s_nSumBytesThreads;
+	
+	if (cbData < SUM_PARMIN || nChunks <= 1) return sumBytes(pData, cbData);
+	if (nChunks > cbData / SUM_CHUNKMIN) nChunks = (unsigned int)(cbData / SUM_CHUNKMIN);
+	if (nChunks > 64) nChunks = 64;
+	
+	SUM_CHUNK scChunks[64];
+	pthread_t thChunks[64];
+	int fStarted[64];
+	
+	// Split on bank boundaries; the last chunk takes the remainder.
+	size_t cbChunk = (cbData / nChunks + SUM_BANKSIZE - 1) & ~(size_t)(SUM_BANKSIZE - 1);
+	size_t iOffset = 0;
+	for (unsigned int iChunk = 0; iChunk < nChunks; iChunk++) {
+		scChunks[iChunk].pData = (const uint8_t*)pData + iOffset;
+		scChunks[iChunk].cbData = (iChunk + 1 < nChunks) ? cbChunk : cbData - iOffset;
+		scChunks[iChunk].uSum = 0;
+		iOffset += scChunks[iChunk].cbData;
+	}
+	
+	// The calling thread takes the first chunk itself. Chunks whose
+	// thread could not be started are summed here too.
+	for (unsigned int iChunk = 1; iChunk < nChunks; iChunk++)
+		fStarted[iChunk] = (pthread_create(&thChunks[iChunk], NULL, sumChunkMain, &scChunks[iChunk]) == 0);
+	
+	sumChunkMain(&scChunks[0]);
+	uint64_t uSum = scChunks[0].uSum;
+	
+	for (unsigned int iChunk = 1; iChunk < nChunks; iChunk++) {
+		if (fStarted[iChunk]) pthread_join(thChunks[iChunk], NULL);
+		else sumChunkMain(&scChunks[iChunk]);
+		uSum += scChunks[iChunk].uSum;
+	}
+	
+	return uSum;
+	
+}
+
+/*
+ * 
+ * name: setSumBytesThreads
+ * 
+ * 		Sets the maximum number of threads used by sumBytesParallel().
+ * 	Defaults to the number of online CPUs. Callers that already run
+ * 	one scan per CPU should set this to one.
+ * 
+ * @param:
+ * 		const unsigned int nThreads:
+ * 			Maximum number of threads, including the calling one.
+ * 
+ */
+void setSumBytesThreads (const unsigned int nThreads) {
+	
+	s_nSumBytesThreads = nThreads ? nThreads : 1;
+	
+}
+
+unsigned int getSumBytesThreads (void) {
+	
+	return s_nSumBytesThreads;
+	
+}
+
+/*
+ * 
+ * name: isSumBytesImplSupported
+ * 
+ * 		Checks whether a byte sum kernel can run on the host CPU.
+ * 
+ * @param:
+ * 		const unsigned int uImpl:
+ * 			SUMIMPL_* value of the kernel to check.
+ * 
+ * @return: int
+ * 		Returns nonzero if the kernel is usable, or zero if it is not.
+ * 
+ */
+int isSumBytesImplSupported (const unsigned int uImpl) {
+	
+	switch (uImpl) {
+	case SUMIMPL_AUTO:
+	case SUMIMPL_SCALAR:
+		return 1;
+		
+#ifdef CHKSUM_X86
+	case SUMIMPL_SSE2:
+		return !!__builtin_cpu_supports("sse2");
+		
+	case SUMIMPL_AVX2:
+		return !!__builtin_cpu_supports("avx2");
+		
+	case SUMIMPL_AVX512:
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+		
+	default:
+		return 0;
+	}
+	
+}
+
+/*
+ * 
+ * name: selectSumBytesImpl
+ * 
+ * 		Selects the byte sum kernel used by sumBytes(), along with the
+ * 	matching fill scan kernel used by findFillStart(). Intended for
+ * 	startup and benchmarking only; do not call while other threads
+ * 	are summing.
+ * 
+ * @param:
+ * 		const unsigned int uImpl:
+ * 			SUMIMPL_* value of the kernel to use. SUMIMPL_AUTO picks the
+ * 		widest kernel the CPU supports.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno to ENOTSUP and returns
+ * 	nonzero if the kernel is not supported.
+ * 
+ */
+int selectSumBytesImpl (const unsigned int uImpl) {
+	
+	unsigned int uNewImpl = uImpl;
+	
+	if (uNewImpl == SUMIMPL_AUTO) {
+		for (uNewImpl = SUMIMPL_COUNT - 1; uNewImpl > SUMIMPL_SCALAR; uNewImpl--)
+			if (s_pfnSumBytesImpls[uNewImpl] != NULL && isSumBytesImplSupported(uNewImpl)) break;
+	}
+	
+	if (uNewImpl >= SUMIMPL_COUNT || s_pfnSumBytesImpls[uNewImpl] == NULL ||
+		!isSumBytesImplSupported(uNewImpl)) {
+		errno = ENOTSUP;
+		return -1;
+	}
+	
+	s_uSumBytesImpl = uNewImpl;
+	s_pfnSumBytes = s_pfnSumBytesImpls[uNewImpl];
+	s_pfnFindFill = s_pfnFindFillImpls[uNewImpl];
+	return 0;
+	
+}
+
+unsigned int getSumBytesImpl (void) {
+	
+	return s_uSumBytesImpl;
+	
+}
+
+const char* getSumBytesImplStr (const unsigned int uImpl) {
+	
+	if (uImpl >= SUMIMPL_COUNT) return "unknown";
+	return s_pszSumBytesImpls[uImpl];
+	
+}
+
+// ---------------------------------------------------------------------
+// Kernels.
+// ---------------------------------------------------------------------
+
+static uint64_t sumBytesScalar (const uint8_t* pData, size_t cbData) {
+	
+	uint64_t uSum[4] = { 0, 0, 0, 0 };
+	size_t iByte = 0;
+	
+	for (; iByte + 4 <= cbData; iByte += 4) {
+		uSum[0] += pData[iByte];
+		uSum[1] += pData[iByte + 1];
+		uSum[2] += pData[iByte + 2];
+		uSum[3] += pData[iByte + 3];
+	}
+	for (; iByte < cbData; iByte++) uSum[0] += pData[iByte];
+	
+	return uSum[0] + uSum[1] + uSum[2] + uSum[3];
+	
+}
+
+// Compares a word at a time, then finds the exact byte in the last word
+// that is not all fill.
+static size_t findFillStartScalar (const uint8_t* pData, size_t cbData, const uint8_t uFill) {
+	
+	const uint64_t uPattern = 0x0101010101010101ULL * uFill;
+	
+	while ((cbData & 7) && pData[cbData - 1] == uFill) cbData--;
+	if (cbData & 7) return cbData;
+	
+	for (; cbData >= 8; cbData -= 8) {
+		uint64_t uWord;
+		memcpy(&uWord, pData + cbData - 8, sizeof(uWord));
+		if (uWord != uPattern) break;
+	}
+	
+	while (cbData && pData[cbData - 1] == uFill) cbData--;
+	return cbData;
+	
+}
+
+#ifdef CHKSUM_X86
+
+// PSADBW against zero sums each group of 8 bytes into a 64-bit lane, so
+// the accumulators never need widening or periodic flushing.
+
+__attribute__((target("sse2")))
+static uint64_t sumBytesSse2 (const uint8_t* pData, size_t cbData) {
+	
+	const __m128i vZero = _mm_setzero_si128();
+	__m128i vAcc0 = vZero, vAcc1 = vZero, vAcc2 = vZero, vAcc3 = vZero;
+	size_t iByte = 0;
+	
+	for (; iByte + 64 <= cbData; iByte += 64) {
+		const __m128i* pv = (const __m128i*)(pData + iByte);
+		vAcc0 = _mm_add_epi64(vAcc0, _mm_sad_epu8(_mm_loadu_si128(pv), vZero));
+		vAcc1 = _mm_add_epi64(vAcc1, _mm_sad_epu8(_mm_loadu_si128(pv + 1), vZero));
+		vAcc2 = _mm_add_epi64(vAcc2, _mm_sad_epu8(_mm_loadu_si128(pv + 2), vZero));
+		vAcc3 = _mm_add_epi64(vAcc3, _mm_sad_epu8(_mm_loadu_si128(pv + 3), vZero));
+	}
+	for (; iByte + 16 <= cbData; iByte += 16)
+		vAcc0 = _mm_add_epi64(vAcc0, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pData + iByte)), vZero));
+	
+	vAcc0 = _mm_add_epi64(_mm_add_epi64(vAcc0, vAcc1), _mm_add_epi64(vAcc2, vAcc3));
+	
+	uint64_t uLanes[2];
+	_mm_storeu_si128((__m128i*)uLanes, vAcc0);
+	
+	return uLanes[0] + uLanes[1] + sumBytesScalar(pData + iByte, cbData - iByte);
+	
+}
+
+__attribute__((target("avx2")))
+static uint64_t sumBytesAvx2 (const uint8_t* pData, size_t cbData) {
+	
+	const __m256i vZero = _mm256_setzero_si256();
+	__m256i vAcc0 = vZero, vAcc1 = vZero, vAcc2 = vZero, vAcc3 = vZero;
+	size_t iByte = 0;
+	
+	for (; iByte + 128 <= cbData; iByte += 128) {
+		const __m256i* pv = (const __m256i*)(pData + iByte);
+		vAcc0 = _mm256_add_epi64(vAcc0, _mm256_sad_epu8(_mm256_loadu_si256(pv), vZero));
+		vAcc1 = _mm256_add_epi64(vAcc1, _mm256_sad_epu8(_mm256_loadu_si256(pv + 1), vZero));
+		vAcc2 = _mm256_add_epi64(vAcc2, _mm256_sad_epu8(_mm256_loadu_si256(pv + 2), vZero));
+		vAcc3 = _mm256_add_epi64(vAcc3, _mm256_sad_epu8(_mm256_loadu_si256(pv + 3), vZero));
+	}
+	
+	vAcc0 = _mm256_add_epi64(_mm256_add_epi64(vAcc0, vAcc1), _mm256_add_epi64(vAcc2, vAcc3));
+	
+	uint64_t uLanes[4];
+	_mm256_storeu_si256((__m256i*)uLanes, vAcc0);
+	
+	return uLanes[0] + uLanes[1] + uLanes[2] + uLanes[3] +
+		sumBytesSse2(pData + iByte, cbData - iByte);
+	
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t sumBytesAvx512 (const uint8_t* pData, size_t cbData) {
+	
+	const __m512i vZero = _mm512_setzero_si512();
+	__m512i vAcc0 = vZero, vAcc1 = vZero, vAcc2 = vZero, vAcc3 = vZero;
+	size_t iByte = 0;
+	
+	for (; iByte + 256 <= cbData; iByte += 256) {
+		const uint8_t* p = pData + iByte;
+		vAcc0 = _mm512_add_epi64(vAcc0, _mm512_sad_epu8(_mm512_loadu_si512(p), vZero));
+		vAcc1 = _mm512_add_epi64(vAcc1, _mm512_sad_epu8(_mm512_loadu_si512(p + 64), vZero));
+		vAcc2 = _mm512_add_epi64(vAcc2, _mm512_sad_epu8(_mm512_loadu_si512(p + 128), vZero));
+		vAcc3 = _mm512_add_epi64(vAcc3, _mm512_sad_epu8(_mm512_loadu_si512(p + 192), vZero));
+	}
+	
+	// Handle the remaining bytes with a masked load instead of falling
+	// back to narrower kernels.
+	for (; iByte < cbData; iByte += 64) {
+		size_t cbLeft = cbData - iByte;
+		__mmask64 kMask = (cbLeft >= 64) ? ~(__mmask64)0 : (((__mmask64)1 << cbLeft) - 1);
+		vAcc0 = _mm512_add_epi64(vAcc0, _mm512_sad_epu8(_mm512_maskz_loadu_epi8(kMask, pData + iByte), vZero));
+	}
+	
+	vAcc0 = _mm512_add_epi64(_mm512_add_epi64(vAcc0, vAcc1), _mm512_add_epi64(vAcc2, vAcc3));
+	
+	return (uint64_t)_mm512_reduce_add_epi64(vAcc0);
+	
+}
+
+// The fill scans compare whole blocks from the end and stop at the first
+// block holding any other byte; the narrower kernel then finds the byte.
+
+__attribute__((target("sse2")))
+static size_t findFillStartSse2 (const uint8_t* pData, size_t cbData, const uint8_t uFill) {
+	
+	const __m128i vFill = _mm_set1_epi8((char)uFill);
+	
+	for (; cbData >= 64; cbData -= 64) {
+		const __m128i* pv = (const __m128i*)(pData + cbData - 64);
+		__m128i vEq = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(pv), vFill), _mm_cmpeq_epi8(_mm_loadu_si128(pv + 1), vFill)),
+			_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(pv + 2), vFill), _mm_cmpeq_epi8(_mm_loadu_si128(pv + 3), vFill)));
+		if (_mm_movemask_epi8(vEq) != 0xFFFF) break;
+	}
+	
+	return findFillStartScalar(pData, cbData, uFill);
+	
+}
+
+__attribute__((target("avx2")))
+static size_t findFillStartAvx2 (const uint8_t* pData, size_t cbData, const uint8_t uFill) {
+	
+	const __m256i vFill = _mm256_set1_epi8((char)uFill);
+	
+	for (; cbData >= 128; cbData -= 128) {
+		const __m256i* pv = (const __m256i*)(pData + cbData - 128);
+		__m256i vEq = _mm256_and_si256(
+			_mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(pv), vFill), _mm256_cmpeq_epi8(_mm256_loadu_si256(pv + 1), vFill)),
+			_mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(pv + 2), vFill), _mm256_cmpeq_epi8(_mm256_loadu_si256(pv + 3), vFill)));
+		if (_mm256_movemask_epi8(vEq) != -1) break;
+	}
+	
+	return findFillStartSse2(pData, cbData, uFill);
+	
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t findFillStartAvx512 (const uint8_t* pData, size_t cbData, const uint8_t uFill) {
+	
+	const __m512i vFill = _mm512_set1_epi8((char)uFill);
+	
+	for (; cbData >= 256; cbData -= 256) {
+		const uint8_t* p = pData + cbData - 256;
+		__mmask64 kNe = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(p), vFill) |
+			_mm512_cmpneq_epi8_mask(_mm512_loadu_si512(p + 64), vFill) |
+			_mm512_cmpneq_epi8_mask(_mm512_loadu_si512(p + 128), vFill) |
+			_mm512_cmpneq_epi8_mask(_mm512_loadu_si512(p + 192), vFill);
+		if (kNe) break;
+	}
+	
+	// Find the byte in the remaining tail, 64 bytes at a time.
+	while (cbData >= 64) {
+		__mmask64 kNe = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(pData + cbData - 64), vFill);
+		if (kNe) return cbData - (size_t)__builtin_clzll(kNe);
+		cbData -= 64;
+	}
+	
+	return findFillStartScalar(pData, cbData, uFill);
+	
+}
+
+#endif /* CHKSUM_X86 */
+
+// EOF
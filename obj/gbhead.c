@@ -25,14 +25,30 @@
 // Include used C header(s):
 #include <endian.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
 
 // Include module header(s):
+#include "../inc/chksum.h"
 #include "../inc/gbhead.h"
 
 const char s_pszUnknown[] = "Unknown";
 
+// The logo the boot ROM compares against.
+const uint8_t g_uNintendoLogo[48] __attribute__((aligned(16))) = {
+	0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83,
+	0x00, 0x0C, 0x00, 0x0D, 0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
+	0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99, 0xBB, 0xBB, 0x67, 0x63,
+	0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+};
+
 unsigned int getHdrRev (const PGBHEAD pHdr) {
 	
 	if (pHdr == NULL) {
@@ -198,7 +214,7 @@ const char* getRegionStr (const PGBHEAD pHdr) {
  * @return: long int
  * 		Returns the ROM size, or 0 on error. Sets errno on an error.
  * 	Sets EFAULT if pHdr was NULL, or EINVAL if the ROM size field's value
- * is zero.
+ * is not a valid size code.
  * 
  */
 long int getRomSizeInkB (const PGBHEAD pHdr) {
@@ -208,7 +224,7 @@ long int getRomSizeInkB (const PGBHEAD pHdr) {
 		return 0;
 	}
 	
-	if (pHdr->uRomSize == 0) {
+	if (pHdr->uRomSize > ROMSIZE_MAX) {
 		errno = EINVAL;
 		return 0;
 	}
@@ -222,8 +238,8 @@ long int getRomSizeInkB (const PGBHEAD pHdr) {
  * name: correctGlobalChksum
  * 
  * 		Corrects the global checksum to the host machine's endianness.
- * 	This does nothing on big-endian machines, but performs a byteswap
- * 	on little-endian ones.
+ * 	The checksum is always stored big-endian in the header, so it is
+ * 	assembled bytewise regardless of the host's byte order.
  * 
  * @param:
  * 		const PGBHEAD pHdr:
@@ -231,9 +247,8 @@ long int getRomSizeInkB (const PGBHEAD pHdr) {
  * 		the checksum to correct.
  * 
  * @return: uint16_t
- * 		Returns either the corrected checksum, or 0 on error. Sets 
- * 	errno on error. Sets either EFAULT if pHdr was NULL, or EINVAL if 
- * 	the checksum's value is zero.
+ * 		Returns the corrected checksum, or 0 on error. Sets errno to
+ * 	EFAULT if pHdr was NULL.
  * 
  */
 uint16_t correctGlobalChksum (const PGBHEAD pHdr) {
@@ -243,24 +258,341 @@ uint16_t correctGlobalChksum (const PGBHEAD pHdr) {
 		return 0;
 	}
 	
-	if (pHdr->uGlobalChksum == 0) {
+	return (uint16_t)((pHdr->uGlobalChksum[0] << 8) | pHdr->uGlobalChksum[1]);
+	
+}
+
+/*
+ * 
+ * name: setGlobalChksum
+ * 
+ * 		Stores a host-endian global checksum into the header in the
+ * 	big-endian order used by the hardware.
+ * 
+ * @param:
+ * 		PGBHEAD pHdr:
+ * 			Pointer to the GameBoy header structure to update.
+ * 
+ * 		const uint16_t uChksum:
+ * 			The checksum to store.
+ * 
+ */
+void setGlobalChksum (PGBHEAD pHdr, const uint16_t uChksum) {
+	
+	if (pHdr == NULL) {
+		errno = EFAULT;
+		return;
+	}
+	
+	pHdr->uGlobalChksum[0] = (uint8_t)(uChksum >> 8);
+	pHdr->uGlobalChksum[1] = (uint8_t)(uChksum & 0xFF);
+	
+}
+
+/*
+ * 
+ * name: applyHdrUpdates
+ * 
+ * 		Copies the fields selected in a header updates structure into a
+ * 	header. The header checksum is left for the caller to settle. To
+ * 	apply the same updates to many headers, compile them once with
+ * 	compileHdrPlan() and use applyHdrPlan() instead.
+ * 
+ * @param:
+ * 		PGBHEAD pHdr:
+ * 			Pointer to the GameBoy header structure to update.
+ * 
+ * 		const PHDR_UPDATES pHdrUps:
+ * 			Constant pointer to the updates to apply.
+ * 
+ */
+void applyHdrUpdates (PGBHEAD pHdr, const PHDR_UPDATES pHdrUps) {
+	
+	if (pHdr == NULL || pHdrUps == NULL) {
+		errno = EFAULT;
+		return;
+	}
+	
+	HDR_PLAN plan;
+	compileHdrPlan(pHdrUps, &plan);
+	applyHdrPlan(pHdr, &plan);
+	
+}
+
+// Add bytes to store at a header offset to the masks selected by uRevs
+// (bit 0: other headers, bit 1: CGB headers).
+static void addPlanBytes (PHDR_PLAN pPlan, const size_t iOffset, const void* pData, const size_t cb,
+	const unsigned int uRevs) {
+	
+	memcpy(&pPlan->uBytes[iOffset], pData, cb);
+	for (unsigned int iRev = 0; iRev < 2; iRev++)
+		if (uRevs & (1U << iRev)) memset(&pPlan->uMask[iRev][iOffset], 0xFF, cb);
+	
+}
+
+/*
+ * 
+ * name: compileHdrPlan
+ * 
+ * 		Compiles header updates into the bytes they store and where, so
+ * 	that applying them takes a few masked stores per header instead of
+ * 	a branch and a copy per field. Text fields are zero-padded as
+ * 	strncpy() would pad them.
+ * 
+ * @param:
+ * 		const PHDR_UPDATES pHdrUps:
+ * 			Constant pointer to the updates to compile.
+ * 
+ * 		PHDR_PLAN pPlan:
+ * 			Pointer to the plan to fill in.
+ * 
+ */
+void compileHdrPlan (const PHDR_UPDATES pHdrUps, PHDR_PLAN pPlan) {
+	
+	if (pHdrUps == NULL || pPlan == NULL) {
+		errno = EFAULT;
+		return;
+	}
+	
+	memset(pPlan, 0, sizeof(HDR_PLAN));
+	unsigned long int uFlags = pHdrUps->uFlags;
+	GBHEAD hdr;
+	
+	// On CGB headers the title shares its space with the manufacturer
+	// code and the CGB flag, which must be left intact. Unless either is
+	// being set as well, only the header decides whether it is CGB, and
+	// there the title stops at its 11 bytes.
+	if (uFlags & UPF_TITLE) {
+		const size_t cchNewTitle = sizeof(hdr.htTitle.newTitle.strTitle);
+		size_t cchTitle = sizeof(hdr.htTitle.oldTitle.strTitle);
+		if (uFlags & UPF_MANU) cchTitle = cchNewTitle;
+		else if (uFlags & UPF_CGBF) cchTitle--;
+		
+		strncpy(hdr.htTitle.oldTitle.strTitle, pHdrUps->pszTitle, cchTitle);
+		addPlanBytes(pPlan, offsetof(GBHEAD, htTitle), hdr.htTitle.oldTitle.strTitle, cchTitle, 0x3);
+		if (cchTitle > cchNewTitle) {
+			memset(&pPlan->uMask[1][offsetof(GBHEAD, htTitle) + cchNewTitle], 0, cchTitle - cchNewTitle);
+			pPlan->fByRev = 1;
+		}
+	}
+	
+	if (uFlags & UPF_MANU) {
+		strncpy(hdr.htTitle.newTitle.strManufacturer, pHdrUps->pszManu, sizeof(hdr.htTitle.newTitle.strManufacturer));
+		addPlanBytes(pPlan, offsetof(GBHEAD, htTitle) + offsetof(GBH_TITLE, newTitle.strManufacturer),
+			hdr.htTitle.newTitle.strManufacturer, sizeof(hdr.htTitle.newTitle.strManufacturer), 0x3);
+	}
+	
+	if (uFlags & UPF_CGBF)
+		addPlanBytes(pPlan, offsetof(GBHEAD, htTitle) + offsetof(GBH_TITLE, newTitle.uCgbFlag), &pHdrUps->uCgbFlag, 1, 0x3);
+	if (uFlags & UPF_LICENSE) addPlanBytes(pPlan, offsetof(GBHEAD, uOldLicensee), &pHdrUps->uLicensee, 1, 0x3);
+	if (uFlags & UPF_SGBF) addPlanBytes(pPlan, offsetof(GBHEAD, uSgbFlag), &pHdrUps->uSgbFlag, 1, 0x3);
+	if (uFlags & UPF_CARTTYPE) addPlanBytes(pPlan, offsetof(GBHEAD, uCartType), &pHdrUps->uCartType, 1, 0x3);
+	if (uFlags & UPF_ROMSIZE) addPlanBytes(pPlan, offsetof(GBHEAD, uRomSize), &pHdrUps->uRomSize, 1, 0x3);
+	if (uFlags & UPF_RAMSIZE) addPlanBytes(pPlan, offsetof(GBHEAD, uRamSize), &pHdrUps->uRamSize, 1, 0x3);
+	if (uFlags & UPF_REGION) addPlanBytes(pPlan, offsetof(GBHEAD, uRegion), &pHdrUps->uRegion, 1, 0x3);
+	if (uFlags & UPF_ROMVER) addPlanBytes(pPlan, offsetof(GBHEAD, uRomVer), &pHdrUps->uRomVer, 1, 0x3);
+	if (uFlags & UPF_LOGO) addPlanBytes(pPlan, offsetof(GBHEAD, uNintendoLogo), g_uNintendoLogo, sizeof(g_uNintendoLogo), 0x3);
+	
+	pPlan->fEmpty = !(uFlags & UPF_MASK);
+	
+}
+
+/*
+ * 
+ * name: applyHdrPlan
+ * 
+ * 		Applies compiled header updates to a header, a word at a time.
+ * 	The header checksum is left for the caller to settle.
+ * 
+ * @param:
+ * 		PGBHEAD pHdr:
+ * 			Pointer to the GameBoy header structure to update.
+ * 
+ * 		const PHDR_PLAN pPlan:
+ * 			Constant pointer to the compiled updates.
+ * 
+ */
+void applyHdrPlan (PGBHEAD pHdr, const PHDR_PLAN pPlan) {
+	
+	if (pHdr == NULL || pPlan == NULL) {
+		errno = EFAULT;
+		return;
+	}
+	
+	if (pPlan->fEmpty) return;
+	
+	const uint8_t* pMask = pPlan->uMask[pPlan->fByRev && getHdrRev(pHdr) == HDRREV_CGB];
+	uint8_t* pBytes = (uint8_t*)pHdr;
+	
+	for (size_t iWord = 0; iWord < sizeof(GBHEAD); iWord += sizeof(uint64_t)) {
+		uint64_t uWord, uNew, uMask;
+		memcpy(&uWord, pBytes + iWord, sizeof(uint64_t));
+		memcpy(&uNew, &pPlan->uBytes[iWord], sizeof(uint64_t));
+		memcpy(&uMask, pMask + iWord, sizeof(uint64_t));
+		uWord = (uWord & ~uMask) | (uNew & uMask);
+		memcpy(pBytes + iWord, &uWord, sizeof(uint64_t));
+	}
+	
+}
+
+/*
+ * 
+ * name: cmpGbLogo
+ * 
+ * 		Compares the header's Nintendo logo with the one the boot ROM
+ * 	expects. The 48 bytes are compared as three 16-byte vectors, and
+ * 	the byte masks are packed into one difference mask.
+ * 
+ * @param:
+ * 		const PGBHEAD pHdr:
+ * 			Constant pointer to the GameBoy header structure to check.
+ * 
+ * @return: uint64_t
+ * 		Returns a mask with bit N set if logo byte N differs, so zero
+ * 	means the logo is intact. Bits outside LOGO_CGBMASK only stop the
+ * 	ROM from booting on the DMG and SGB, which check the whole logo.
+ * 	Sets errno and returns LOGO_MASK on error.
+ * 
+ */
+uint64_t cmpGbLogo (const PGBHEAD pHdr) {
+	
+	if (pHdr == NULL) {
+		errno = EFAULT;
+		return LOGO_MASK;
+	}
+	
+#ifdef __SSE2__
+	const __m128i* pLogo = (const __m128i*)pHdr->uNintendoLogo;
+	const __m128i* pRef = (const __m128i*)g_uNintendoLogo;
+	uint64_t uSame;
+	
+	uSame = (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(pLogo), _mm_loadu_si128(pRef)));
+	uSame |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(pLogo + 1), _mm_loadu_si128(pRef + 1))) << 16;
+	uSame |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(pLogo + 2), _mm_loadu_si128(pRef + 2))) << 32;
+	
+	return ~uSame & LOGO_MASK;
+#else
+	uint64_t uDiff = 0;
+	
+	for (int iByte = 0; iByte < sizeof(g_uNintendoLogo); iByte++)
+		if (pHdr->uNintendoLogo[iByte] != g_uNintendoLogo[iByte]) uDiff |= UINT64_C(1) << iByte;
+	
+	return uDiff;
+#endif
+	
+}
+
+/*
+ * 
+ * name: fixGbLogo
+ * 
+ * 		Restores the header's Nintendo logo.
+ * 
+ * @param:
+ * 		PGBHEAD pHdr:
+ * 			Pointer to the GameBoy header structure to update.
+ * 
+ */
+void fixGbLogo (PGBHEAD pHdr) {
+	
+	if (pHdr == NULL) {
+		errno = EFAULT;
+		return;
+	}
+	
+	memcpy(pHdr->uNintendoLogo, g_uNintendoLogo, sizeof(g_uNintendoLogo));
+	
+}
+
+/*
+ * 
+ * name: mkGbGlobalChksum
+ * 
+ * 		Generates a new global checksum: the 16-bit sum of every byte
+ * 	in the ROM except the two checksum bytes themselves. The header
+ * 	bytes are taken from pHdr rather than from the image, so pending
+ * 	header edits are accounted for without writing them out first.
+ * 
+ * @param:
+ * 		const PGBHEAD pHdr:
+ * 			Constant pointer to the GameBoy header structure to use.
+ * 
+ * 		const uint8_t* pRom:
+ * 			Pointer to the whole ROM image.
+ * 
+ * 		size_t cbRom:
+ * 			Size of the ROM image in bytes.
+ * 
+ * @return: uint16_t
+ * 		Returns the newly generated checksum, or sets errno and
+ * 	returns zero on error. Sets EFAULT if a pointer was NULL, or EINVAL
+ * 	if the image is too small to contain a header.
+ * 
+ */
+uint16_t mkGbGlobalChksum (const PGBHEAD pHdr, const uint8_t* pRom, size_t cbRom) {
+	
+	if (pHdr == NULL || pRom == NULL) {
+		errno = EFAULT;
+		return 0;
+	}
+	
+	if (cbRom < GBHEAD_ROMMIN) {
 		errno = EINVAL;
 		return 0;
 	}
 	
-	uint16_t uRetVal;
+	uint64_t uChksum; // Buffer for the checksum.
+	
+	uChksum = sumBytes(pRom, GBHEAD_OFFSET);
+	uChksum += sumBytes(pHdr, offsetof(GBHEAD, uGlobalChksum));
+	uChksum += sumBytesParallel(pRom + GBHEAD_ROMMIN, cbRom - GBHEAD_ROMMIN);
+	
+	return (uint16_t)(uChksum & 0xFFFF);
+	
+}
+
+/*
+ * 
+ * name: updGbGlobalChksum
+ * 
+ * 		Derives a new global checksum from an old one when only the
+ * 	header has changed. The global checksum is a plain sum, so the
+ * 	result is the old value plus the difference between the old and
+ * 	new header bytes. It is only correct if the old checksum was.
+ * 
+ * @param:
+ * 		const uint16_t uOldChksum:
+ * 			The global checksum of the image with the old header.
+ * 
+ * 		const PGBHEAD pOldHdr:
+ * 			Constant pointer to the header before the edit.
+ * 
+ * 		const PGBHEAD pNewHdr:
+ * 			Constant pointer to the header after the edit, with its
+ * 		header checksum already settled.
+ * 
+ * @return: uint16_t
+ * 		Returns the updated checksum, or sets errno and returns zero on
+ * 	error.
+ * 
+ */
+uint16_t updGbGlobalChksum (const uint16_t uOldChksum, const PGBHEAD pOldHdr, const PGBHEAD pNewHdr) {
+	
+	if (pOldHdr == NULL || pNewHdr == NULL) {
+		errno = EFAULT;
+		return 0;
+	}
+	
+	const uint8_t* pOld = (const uint8_t*)pOldHdr;
+	const uint8_t* pNew = (const uint8_t*)pNewHdr;
+	uint16_t uChksum = uOldChksum;
+	int iByte;
 	
-	#if __BYTE_ORDER == __LITTLE_ENDIAN
-		// If little endian.
-		//return be16toh((uint16_t)pHdr->uGlobalChksum);
-		uRetVal = ((pHdr->uGlobalChksum[1] << 8) | pHdr->uGlobalChksum[0]);
-	#else
-		// If big endian.
-		//return (uint16_t)pHdr->uGlobalChksum;
-		uRetVal = ((pHdr->uGlobalChksum[0] << 8) | pHdr->uGlobalChksum[1]);
-	#endif
+	// Modular arithmetic makes the subtraction safe.
+	for (iByte = 0; iByte < offsetof(GBHEAD, uGlobalChksum); iByte++)
+		uChksum += pNew[iByte] - pOld[iByte];
 	
-	return uRetVal;
+	return uChksum;
 	
 }
 
@@ -365,8 +697,9 @@ int saveHeaderToFile (const char* pszFileName, const PGBHEAD pHdr) {
 	
 	FILE* pFile;
 	
-	// Open the file for binary write.
-	if ((pFile = fopen(pszFileName, "wb")) == NULL) return -1;
+	// Open the existing file for binary update. Opening with "wb" would
+	// truncate the image down to just the header.
+	if ((pFile = fopen(pszFileName, "r+b")) == NULL) return -1;
 	
 	// Seek to header offset and write in the header.
 	if (fseek(pFile, 0x0100, SEEK_SET) || (fwrite(pHdr, sizeof(GBHEAD), 1, pFile) < 1)) {
@@ -380,4 +713,72 @@ int saveHeaderToFile (const char* pszFileName, const PGBHEAD pHdr) {
 	
 }
 
+/*
+ * 
+ * name: loadRomFromFile
+ * 
+ * 		Loads a whole ROM image from a given file into a newly
+ * 	allocated buffer.
+ * 
+ * @param:
+ * 		const char* pszFileName:
+ * 			Name of the file to read from.
+ * 
+ * 		uint8_t** ppRom:
+ * 			Receives a pointer to the image. Free it with free().
+ * 
+ * 		size_t* pcbRom:
+ * 			Receives the size of the image in bytes.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int loadRomFromFile (const char* pszFileName, uint8_t** ppRom, size_t* pcbRom) {
+	
+	if (ppRom == NULL || pcbRom == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	FILE* pFile;
+	struct stat st;
+	
+	// Open the file for binary read.
+	if ((pFile = fopen(pszFileName, "rb")) == NULL) return -1;
+	
+	// Get the image size.
+	if (fstat(fileno(pFile), &st)) {
+		fclose(pFile);
+		return -1;
+	}
+	
+	if (st.st_size < GBHEAD_ROMMIN) {
+		fclose(pFile);
+		errno = EINVAL;
+		return -1;
+	}
+	
+	// Read the image in.
+	if ((*ppRom = malloc((size_t)st.st_size)) == NULL) {
+		fclose(pFile);
+		return -1;
+	}
+	
+	if (fread(*ppRom, (size_t)st.st_size, 1, pFile) < 1) {
+		free(*ppRom);
+		*ppRom = NULL;
+		fclose(pFile);
+		return -1;
+	}
+	
+	*pcbRom = (size_t)st.st_size;
+	
+	// Close the file.
+	fclose(pFile);
+	return 0;
+	
+}
+
 // EOF
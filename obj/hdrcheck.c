@@ -0,0 +1,292 @@
+/*
+ * obj/hdrcheck.c
+ * 
+ * GBFix - Header Validation Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+
+// Include used C header(s):
+#include <errno.h>
+
+// Include module header(s):
+#include "../inc/hdrcheck.h"
+
+// Cartridge features.
+enum {
+	CTF_KNOWN = 0x01, // Cartridge type is defined.
+	CTF_NOMBC = 0x02, // No mapper; the ROM is mapped directly.
+	CTF_RAM = 0x04, // External RAM sized by the RAM size code.
+	CTF_BATTERY = 0x08, // Battery backup.
+	CTF_TIMER = 0x10, // Real time clock.
+	CTF_BUILTINRAM = 0x20 // RAM or EEPROM inside the mapper.
+};
+
+// What a cartridge type supports.
+typedef struct tagCART_INFO
+{
+	uint8_t uFeatures; // CTF_* flags.
+	uint8_t uRomMax; // Largest ROM size code the mapper addresses.
+	uint8_t uRamMax; // Largest RAM size code the mapper addresses.
+} CART_INFO, *PCART_INFO;
+
+static const CART_INFO s_ciCartTypes[256] = {
+	[CT_ROM_ONLY] = { CTF_KNOWN | CTF_NOMBC, 0x00, 0x00 },
+	[CT_MBC1] = { CTF_KNOWN, 0x06, 0x00 },
+	[CT_MBC1_RAM] = { CTF_KNOWN | CTF_RAM, 0x06, 0x03 },
+	[CT_MBC1_BATTERY_RAM] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY, 0x06, 0x03 },
+	[CT_MBC2] = { CTF_KNOWN | CTF_BUILTINRAM, 0x03, 0x00 },
+	[CT_MBC2_BATTERY] = { CTF_KNOWN | CTF_BUILTINRAM | CTF_BATTERY, 0x03, 0x00 },
+	[CT_ROM_RAM] = { CTF_KNOWN | CTF_NOMBC | CTF_RAM, 0x00, 0x02 },
+	[CT_ROM_BATTERY_RAM] = { CTF_KNOWN | CTF_NOMBC | CTF_RAM | CTF_BATTERY, 0x00, 0x02 },
+	[CT_MMM01] = { CTF_KNOWN, 0x08, 0x00 },
+	[CT_MMM01_RAM] = { CTF_KNOWN | CTF_RAM, 0x08, 0x03 },
+	[CT_MMM01_BATTERY_RAM] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY, 0x08, 0x03 },
+	[CT_MBC3_BATTERY_TIMER] = { CTF_KNOWN | CTF_BATTERY | CTF_TIMER, 0x07, 0x00 },
+	[CT_MBC3_BATTERY_RAM_TIMER] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY | CTF_TIMER, 0x07, 0x05 },
+	[CT_MBC3] = { CTF_KNOWN, 0x07, 0x00 },
+	[CT_MBC3_RAM] = { CTF_KNOWN | CTF_RAM, 0x07, 0x05 },
+	[CT_MBC3_BATTERY_RAM] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY, 0x07, 0x05 },
+	[CT_MBC5] = { CTF_KNOWN, 0x08, 0x00 },
+	[CT_MBC5_RAM] = { CTF_KNOWN | CTF_RAM, 0x08, 0x04 },
+	[CT_MBC5_BATTERY_RAM] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY, 0x08, 0x04 },
+	[CT_MBC5_RUMBLE] = { CTF_KNOWN, 0x08, 0x00 },
+	[CT_MBC5_RAM_RUMBLE] = { CTF_KNOWN | CTF_RAM, 0x08, 0x04 },
+	[CT_MBC5_BATTERY_RAM_RUMBLE] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY, 0x08, 0x04 },
+	[CT_MBC6] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY, 0x05, 0x03 },
+	[CT_MBC7_BATTERY_RAM_RUMBLE_SENSOR] = { CTF_KNOWN | CTF_BUILTINRAM | CTF_BATTERY, 0x06, 0x00 },
+	[CT_CAMERA] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY, 0x05, 0x04 },
+	[CT_TAMA5] = { CTF_KNOWN | CTF_BUILTINRAM | CTF_BATTERY | CTF_TIMER, 0x05, 0x00 },
+	[CT_HuC3] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY | CTF_TIMER, 0x06, 0x04 },
+	[CT_HuC1_BATTERY_RAM] = { CTF_KNOWN | CTF_RAM | CTF_BATTERY, 0x06, 0x03 }
+};
+
+// Character classes.
+enum {
+	CC_PRINT = 0x01, // Printable ASCII.
+	CC_ALNUM = 0x02, // ASCII letter or digit.
+	CC_JUMP = 0x04, // Opcode of JP or JR.
+	CC_PREFIX = 0x08 // NOP or DI, allowed before the entry jump.
+};
+
+// Later ranges override earlier ones.
+static const uint8_t s_uCharClass[256] = {
+	[0x20 ... 0x7E] = CC_PRINT,
+	['0' ... '9'] = CC_PRINT | CC_ALNUM,
+	['A' ... 'Z'] = CC_PRINT | CC_ALNUM,
+	['a' ... 'z'] = CC_PRINT | CC_ALNUM,
+	[0x00] = CC_PREFIX,
+	[0xF3] = CC_PREFIX,
+	[0xC3] = CC_JUMP,
+	[0x18] = CC_JUMP
+};
+
+static const char* const s_pszFindings[HCB_COUNT] = {
+	[HCB_ENTRYPOINT] = "entry point does not jump",
+	[HCB_LOGO] = "Nintendo logo damaged",
+	[HCB_LOGOHALF] = "Nintendo logo damaged (DMG and SGB only)",
+	[HCB_TITLECHARS] = "title has unprintable characters",
+	[HCB_TITLEPAD] = "title has data after its end",
+	[HCB_MANUFACTURER] = "bad manufacturer code",
+	[HCB_CGBFLAG] = "unknown CGB flag",
+	[HCB_NEWLICENSEE] = "bad new licensee code",
+	[HCB_SGBFLAG] = "unknown SGB flag",
+	[HCB_SGBLICENSEE] = "SGB support needs old licensee 0x33",
+	[HCB_CARTTYPE] = "unknown cartridge type",
+	[HCB_ROMSIZE] = "invalid ROM size code",
+	[HCB_RAMSIZE] = "invalid RAM size code",
+	[HCB_ROMNOMBC] = "ROM over 32kiB without a mapper",
+	[HCB_ROMLIMIT] = "ROM too large for the mapper",
+	[HCB_RAMMISSING] = "cartridge RAM has no size",
+	[HCB_RAMUNEXPECTED] = "RAM size given for a cartridge without RAM",
+	[HCB_RAMLIMIT] = "RAM too large for the mapper",
+	[HCB_BATTERYNORAM] = "battery with no RAM to keep",
+	[HCB_REGION] = "unknown region",
+	[HCB_HDRCHKSUM] = "bad header checksum",
+	[HCB_FILESIZE] = "file size does not match ROM size"
+};
+
+// Short names of the findings, for reports and queries.
+static const char* const s_pszFindingNames[HCB_COUNT] = {
+	"entrypoint", "logo", "logohalf", "titlechars", "titlepad",
+	"manufacturer", "cgbflag", "newlicensee", "sgbflag", "sgblicensee",
+	"carttype", "romsize", "ramsize", "romnombc", "romlimit",
+	"rammissing", "ramunexpected", "ramlimit", "batterynoram", "region",
+	"hdrchksum", "filesize"
+};
+
+/*
+ * 
+ * name: checkGbHeader
+ * 
+ * 		Validates every field of a header, and the fields against each
+ * 	other, in one pass. Each field is classified through a lookup table
+ * 	rather than a chain of comparisons.
+ * 
+ * @param:
+ * 		const PGBHEAD pHdr:
+ * 			Constant pointer to the GameBoy header structure to check.
+ * 
+ * 		const uint64_t cbFile:
+ * 			Size of the ROM file in bytes, or zero if it is not known.
+ * 
+ * 		uint64_t* puFindings:
+ * 			Pointer to receive the findings as a mask of HCF(HCB_*)
+ * 		bits. Zero means nothing was found.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int checkGbHeader (const PGBHEAD pHdr, const uint64_t cbFile, uint64_t* puFindings) {
+	
+	if (pHdr == NULL || puFindings == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	const CART_INFO* pci = &s_ciCartTypes[pHdr->uCartType];
+	const uint8_t uCgbFlag = pHdr->htTitle.newTitle.uCgbFlag;
+	uint64_t uFindings = 0;
+	
+	// Entry point: an optional NOP or DI, then a jump.
+	uint8_t uOp = pHdr->uEntryPoint[0];
+	if (s_uCharClass[uOp] & CC_PREFIX) uOp = pHdr->uEntryPoint[1];
+	if (!(s_uCharClass[uOp] & CC_JUMP)) uFindings |= HCF(HCB_ENTRYPOINT);
+	
+	// Logo: the CGB boot ROM only checks the first half.
+	uint64_t uLogoDiff = cmpGbLogo(pHdr);
+	if (uLogoDiff & LOGO_CGBMASK) uFindings |= HCF(HCB_LOGO);
+	else if (uLogoDiff) uFindings |= HCF(HCB_LOGOHALF);
+	
+	// Title: on CGB aware ROMs it is followed by the manufacturer code
+	// and the CGB flag.
+	const char* pszTitle = pHdr->htTitle.oldTitle.strTitle;
+	size_t cchTitle = (uCgbFlag & CGBF_FUNC) ? sizeof(pHdr->htTitle.newTitle.strTitle) :
+		sizeof(pHdr->htTitle.oldTitle.strTitle);
+	int fEnded = 0;
+	
+	for (size_t iChar = 0; iChar < cchTitle; iChar++) {
+		uint8_t uChar = (uint8_t)pszTitle[iChar];
+		if (uChar == 0) {
+			fEnded = 1;
+		} else {
+			if (fEnded) uFindings |= HCF(HCB_TITLEPAD);
+			if (!(s_uCharClass[uChar] & CC_PRINT)) uFindings |= HCF(HCB_TITLECHARS);
+		}
+	}
+	
+	// Manufacturer code: all blank or four printable characters.
+	if (uCgbFlag & CGBF_FUNC) {
+		const uint8_t* puManu = (const uint8_t*)pHdr->htTitle.newTitle.strManufacturer;
+		uint8_t uClass = CC_PRINT, uAny = 0;
+		for (size_t iChar = 0; iChar < sizeof(pHdr->htTitle.newTitle.strManufacturer); iChar++) {
+			uClass &= s_uCharClass[puManu[iChar]];
+			uAny |= puManu[iChar];
+		}
+		if (uAny && !(uClass & CC_PRINT)) uFindings |= HCF(HCB_MANUFACTURER);
+	}
+	
+	if ((uCgbFlag & CGBF_FUNC) && (uCgbFlag & ~CGBF_MASK)) uFindings |= HCF(HCB_CGBFLAG);
+	
+	// Licensee and SGB support.
+	if (pHdr->uOldLicensee == LICENSEE_NEW &&
+		!(s_uCharClass[pHdr->uLicensee[0]] & s_uCharClass[pHdr->uLicensee[1]] & CC_ALNUM))
+		uFindings |= HCF(HCB_NEWLICENSEE);
+	if (pHdr->uSgbFlag != 0x00 && pHdr->uSgbFlag != SGBF_SGBSUPPORT) uFindings |= HCF(HCB_SGBFLAG);
+	if (pHdr->uSgbFlag == SGBF_SGBSUPPORT && pHdr->uOldLicensee != LICENSEE_NEW) uFindings |= HCF(HCB_SGBLICENSEE);
+	
+	// Size codes on their own.
+	if (pHdr->uRomSize > ROMSIZE_MAX) uFindings |= HCF(HCB_ROMSIZE);
+	if (pHdr->uRamSize > RAMSIZE_MAX || pHdr->uRamSize == 0x01) uFindings |= HCF(HCB_RAMSIZE);
+	
+	// Size codes against what the cartridge supports.
+	if (!(pci->uFeatures & CTF_KNOWN)) {
+		uFindings |= HCF(HCB_CARTTYPE);
+	} else {
+		if ((pci->uFeatures & CTF_NOMBC) && pHdr->uRomSize != 0) uFindings |= HCF(HCB_ROMNOMBC);
+		else if (pHdr->uRomSize <= ROMSIZE_MAX && pHdr->uRomSize > pci->uRomMax) uFindings |= HCF(HCB_ROMLIMIT);
+		
+		if (!(pci->uFeatures & CTF_RAM)) {
+			if (pHdr->uRamSize != 0) uFindings |= HCF(HCB_RAMUNEXPECTED);
+		} else if (pHdr->uRamSize == 0) {
+			uFindings |= ((pci->uFeatures & (CTF_BATTERY | CTF_TIMER)) == CTF_BATTERY) ?
+				HCF(HCB_BATTERYNORAM) : HCF(HCB_RAMMISSING);
+		} else if (pHdr->uRamSize <= RAMSIZE_MAX && pHdr->uRamSize > pci->uRamMax) {
+			uFindings |= HCF(HCB_RAMLIMIT);
+		}
+	}
+	
+	if (pHdr->uRegion > REGION_INTERNATIONAL) uFindings |= HCF(HCB_REGION);
+	if (mkGbHdrChksum(pHdr) != pHdr->uHdrChksum) uFindings |= HCF(HCB_HDRCHKSUM);
+	
+	if (cbFile != 0 && pHdr->uRomSize <= ROMSIZE_MAX && cbFile != (UINT64_C(0x8000) << pHdr->uRomSize))
+		uFindings |= HCF(HCB_FILESIZE);
+	
+	*puFindings = uFindings;
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: getHdrCheckStr
+ * 
+ * 		Describes a header finding.
+ * 
+ * @param:
+ * 		const unsigned int nBit:
+ * 			HCB_* bit number of the finding.
+ * 
+ * @return: const char*
+ * 		Returns a constant string.
+ * 
+ */
+const char* getHdrCheckStr (const unsigned int nBit) {
+	
+	if (nBit >= HCB_COUNT) return "unknown finding";
+	return s_pszFindings[nBit];
+	
+}
+
+/*
+ * 
+ * name: getHdrCheckName
+ * 
+ * 		Gets the short name of a header finding, a lowercase word that
+ * 	is stable across versions.
+ * 
+ * @param:
+ * 		const unsigned int nBit:
+ * 			HCB_* bit number of the finding.
+ * 
+ * @return: const char*
+ * 		Returns a constant string, or NULL if nBit is out of range.
+ * 
+ */
+const char* getHdrCheckName (const unsigned int nBit) {
+	
+	if (nBit >= HCB_COUNT) return NULL;
+	return s_pszFindingNames[nBit];
+	
+}
+
+// EOF
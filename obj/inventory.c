@@ -0,0 +1,471 @@
+/*
+ * obj/inventory.c
+ * 
+ * GBFix - Header Inventory Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+
+// Include used C header(s):
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/batch.h"
+#include "../inc/inventory.h"
+
+// Steps of a file's linked open, read and close chain.
+enum {
+	INVOP_OPEN,
+	INVOP_READ,
+	INVOP_CLOSE,
+	INVOP_COUNT
+};
+
+// Minimal io_uring instance, driven through the raw system calls.
+typedef struct tagURING
+{
+	int fd;
+	void* pSqRing; // Submission ring, or both rings with IORING_FEAT_SINGLE_MMAP.
+	size_t cbSqRing;
+	void* pCqRing; // Completion ring.
+	size_t cbCqRing;
+	struct io_uring_sqe* pSqes;
+	size_t cbSqes;
+	unsigned int* puSqHead;
+	unsigned int* puSqTail;
+	unsigned int* puSqArray;
+	unsigned int uSqMask;
+	unsigned int nSqEntries;
+	unsigned int* puCqHead;
+	unsigned int* puCqTail;
+	struct io_uring_cqe* pCqes;
+	unsigned int uCqMask;
+	unsigned int nToSubmit; // Entries queued since the last submit.
+} URING, *PURING;
+
+// State of one file in the scan.
+typedef struct tagINV_FILE
+{
+	GBHEAD hdr;
+	int nErr; // errno value of the first failed step.
+	unsigned int uSlot; // Direct descriptor slot while in flight.
+	unsigned char nSteps; // Completed steps of the chain.
+} INV_FILE, *PINV_FILE;
+
+// Scan state shared by the thread pool fallback.
+typedef struct tagINV_CTX
+{
+	const char* const* ppszFiles;
+	PINV_FILE pFiles;
+	size_t iFirst; // First file left to the thread pool.
+	int fInFlight; // Whether the kernel may still write to pFiles.
+	PFN_HEADERDONE pfnDone;
+	void* pCtx;
+} INV_CTX, *PINV_CTX;
+
+// Progress of the io_uring scan.
+typedef struct tagINV_SCAN
+{
+	unsigned int uSlots[INV_DEPTH]; // Free descriptor slots.
+	unsigned int nFree;
+	size_t nInFlight; // Chains submitted but not yet complete.
+} INV_SCAN, *PINV_SCAN;
+
+// ---------------------------------------------------------------------
+// io_uring plumbing.
+// ---------------------------------------------------------------------
+
+static void closeUring (PURING pur) {
+	
+	if (pur->pSqes != NULL && pur->pSqes != MAP_FAILED) munmap(pur->pSqes, pur->cbSqes);
+	if (pur->pCqRing != NULL && pur->pCqRing != MAP_FAILED && pur->pCqRing != pur->pSqRing) munmap(pur->pCqRing, pur->cbCqRing);
+	if (pur->pSqRing != NULL && pur->pSqRing != MAP_FAILED) munmap(pur->pSqRing, pur->cbSqRing);
+	if (pur->fd >= 0) close(pur->fd);
+	memset(pur, 0, sizeof(URING));
+	pur->fd = -1;
+	
+}
+
+static int openUring (PURING pur, unsigned int nEntries, struct io_uring_params* piup) {
+	
+	struct io_uring_params iup;
+	memset(pur, 0, sizeof(URING));
+	memset(&iup, 0, sizeof(struct io_uring_params));
+	
+	if ((pur->fd = (int)syscall(__NR_io_uring_setup, nEntries, &iup)) < 0) {
+		pur->fd = -1;
+		return -1;
+	}
+	
+	// Map the rings.
+	pur->cbSqRing = iup.sq_off.array + iup.sq_entries * sizeof(unsigned int);
+	pur->cbCqRing = iup.cq_off.cqes + iup.cq_entries * sizeof(struct io_uring_cqe);
+	if (iup.features & IORING_FEAT_SINGLE_MMAP) {
+		if (pur->cbCqRing > pur->cbSqRing) pur->cbSqRing = pur->cbCqRing;
+		pur->cbCqRing = pur->cbSqRing;
+	}
+	
+	pur->pSqRing = mmap(NULL, pur->cbSqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pur->fd, IORING_OFF_SQ_RING);
+	if (pur->pSqRing == MAP_FAILED) goto fail;
+	
+	if (iup.features & IORING_FEAT_SINGLE_MMAP) {
+		pur->pCqRing = pur->pSqRing;
+	} else {
+		pur->pCqRing = mmap(NULL, pur->cbCqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pur->fd, IORING_OFF_CQ_RING);
+		if (pur->pCqRing == MAP_FAILED) goto fail;
+	}
+	
+	pur->cbSqes = iup.sq_entries * sizeof(struct io_uring_sqe);
+	pur->pSqes = mmap(NULL, pur->cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pur->fd, IORING_OFF_SQES);
+	if (pur->pSqes == MAP_FAILED) goto fail;
+	
+	pur->puSqHead = (unsigned int*)((char*)pur->pSqRing + iup.sq_off.head);
+	pur->puSqTail = (unsigned int*)((char*)pur->pSqRing + iup.sq_off.tail);
+	pur->puSqArray = (unsigned int*)((char*)pur->pSqRing + iup.sq_off.array);
+	pur->uSqMask = *(unsigned int*)((char*)pur->pSqRing + iup.sq_off.ring_mask);
+	pur->nSqEntries = iup.sq_entries;
+	pur->puCqHead = (unsigned int*)((char*)pur->pCqRing + iup.cq_off.head);
+	pur->puCqTail = (unsigned int*)((char*)pur->pCqRing + iup.cq_off.tail);
+	pur->pCqes = (struct io_uring_cqe*)((char*)pur->pCqRing + iup.cq_off.cqes);
+	pur->uCqMask = *(unsigned int*)((char*)pur->pCqRing + iup.cq_off.ring_mask);
+	
+	memcpy(piup, &iup, sizeof(struct io_uring_params));
+	return 0;
+	
+fail:
+	{
+		int nErr = errno;
+		closeUring(pur);
+		errno = nErr;
+	}
+	return -1;
+	
+}
+
+static struct io_uring_sqe* getUringSqe (PURING pur) {
+	
+	unsigned int uTail = *pur->puSqTail + pur->nToSubmit;
+	if (uTail - __atomic_load_n(pur->puSqHead, __ATOMIC_ACQUIRE) >= pur->nSqEntries) return NULL;
+	
+	unsigned int iSqe = uTail & pur->uSqMask;
+	struct io_uring_sqe* pSqe = &pur->pSqes[iSqe];
+	
+	memset(pSqe, 0, sizeof(struct io_uring_sqe));
+	pur->puSqArray[iSqe] = iSqe;
+	pur->nToSubmit++;
+	return pSqe;
+	
+}
+
+static int submitUring (PURING pur, unsigned int nWait) {
+	
+	// Publish the queued entries, then submit and wait in one call.
+	__atomic_store_n(pur->puSqTail, *pur->puSqTail + pur->nToSubmit, __ATOMIC_RELEASE);
+	
+	unsigned int nToSubmit = pur->nToSubmit;
+	pur->nToSubmit = 0;
+	
+	while (syscall(__NR_io_uring_enter, pur->fd, nToSubmit, nWait, nWait ? IORING_ENTER_GETEVENTS : 0, NULL, 0) < 0) {
+		if (errno != EINTR) return -1;
+		nToSubmit = 0;
+	}
+	
+	return 0;
+	
+}
+
+// ---------------------------------------------------------------------
+// Scanners.
+// ---------------------------------------------------------------------
+
+static void queueHeaderChain (PURING pur, const char* pszFile, PINV_FILE pif, size_t iFile) {
+	
+	struct io_uring_sqe* pSqe;
+	
+	// Open into a direct descriptor slot, so the read and close can be
+	// linked to the open and the whole chain costs one submission.
+	pSqe = getUringSqe(pur);
+	pSqe->opcode = IORING_OP_OPENAT;
+	pSqe->fd = AT_FDCWD;
+	pSqe->addr = (uint64_t)(uintptr_t)pszFile;
+	pSqe->open_flags = O_RDONLY;
+	pSqe->file_index = pif->uSlot + 1;
+	pSqe->flags = IOSQE_IO_LINK;
+	pSqe->user_data = (uint64_t)iFile * INVOP_COUNT + INVOP_OPEN;
+	
+	// A short read breaks a plain link, so hard link the close to it.
+	pSqe = getUringSqe(pur);
+	pSqe->opcode = IORING_OP_READ;
+	pSqe->fd = (int)pif->uSlot;
+	pSqe->addr = (uint64_t)(uintptr_t)&pif->hdr;
+	pSqe->len = sizeof(GBHEAD);
+	pSqe->off = GBHEAD_OFFSET;
+	pSqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+	pSqe->user_data = (uint64_t)iFile * INVOP_COUNT + INVOP_READ;
+	
+	pSqe = getUringSqe(pur);
+	pSqe->opcode = IORING_OP_CLOSE;
+	pSqe->file_index = pif->uSlot + 1;
+	pSqe->user_data = (uint64_t)iFile * INVOP_COUNT + INVOP_CLOSE;
+	
+}
+
+// Take the completions off the ring, and free the slots of the chains
+// they complete.
+static void reapHeaderChains (PURING pur, PINV_CTX pic, PINV_SCAN pis) {
+	
+	unsigned int uHead = *pur->puCqHead;
+	unsigned int uTail = __atomic_load_n(pur->puCqTail, __ATOMIC_ACQUIRE);
+	
+	for (; uHead != uTail; uHead++) {
+		const struct io_uring_cqe* pCqe = &pur->pCqes[uHead & pur->uCqMask];
+		PINV_FILE pif = &pic->pFiles[pCqe->user_data / INVOP_COUNT];
+		unsigned int uOp = (unsigned int)(pCqe->user_data % INVOP_COUNT);
+		
+		// Keep the first real error; later steps only see ECANCELED.
+		if (uOp != INVOP_CLOSE && pif->nErr == 0) {
+			if (pCqe->res < 0) pif->nErr = -pCqe->res;
+			else if (uOp == INVOP_READ && pCqe->res != sizeof(GBHEAD)) pif->nErr = EINVAL;
+		}
+		
+		if (++pif->nSteps == INVOP_COUNT) {
+			pis->uSlots[pis->nFree++] = pif->uSlot;
+			pis->nInFlight--;
+		}
+	}
+	__atomic_store_n(pur->puCqHead, uHead, __ATOMIC_RELEASE);
+	
+}
+
+// After a failed submission, take back the entries the kernel did not
+// consume, counting them as steps done so that every chain still ends
+// at INVOP_COUNT, then wait for the rest. The headers are read into
+// pic->pFiles, which must outlive every chain the kernel holds.
+static int drainHeaderChains (PURING pur, PINV_CTX pic, PINV_SCAN pis) {
+	
+	unsigned int uHead = __atomic_load_n(pur->puSqHead, __ATOMIC_ACQUIRE);
+	unsigned int uTail = *pur->puSqTail;
+	
+	for (; uHead != uTail; uHead++) {
+		const struct io_uring_sqe* pSqe = &pur->pSqes[pur->puSqArray[uHead & pur->uSqMask]];
+		PINV_FILE pif = &pic->pFiles[pSqe->user_data / INVOP_COUNT];
+		if (++pif->nSteps == INVOP_COUNT) {
+			pis->uSlots[pis->nFree++] = pif->uSlot;
+			pis->nInFlight--;
+		}
+	}
+	__atomic_store_n(pur->puSqTail, uHead, __ATOMIC_RELEASE);
+	
+	while (pis->nInFlight > 0) {
+		if (syscall(__NR_io_uring_enter, pur->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+			errno != EINTR && errno != EAGAIN && errno != EBUSY) return -1;
+		reapHeaderChains(pur, pic, pis);
+	}
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: scanHeadersUring
+ * 
+ * 		Reads the headers of many files with up to INV_DEPTH linked
+ * 	open, read and close chains in flight at once, so the latency of
+ * 	slow storage overlaps instead of adding up.
+ * 
+ * @return: int
+ * 		Returns zero on success, or 1 if the rest of the files from
+ * 	pic->iFirst on are left to the thread pool, either because io_uring
+ * 	or direct descriptors are unavailable or because submitting failed
+ * 	part way. Sets errno and returns -1 if the chains in flight could
+ * 	not be waited for, in which case pic->fInFlight is set.
+ * 
+ */
+static int scanHeadersUring (PINV_CTX pic, size_t nFiles) {
+	
+	URING ur;
+	INV_SCAN is;
+	int fdSlots[INV_DEPTH];
+	
+	struct io_uring_params iup;
+	if (openUring(&ur, INV_DEPTH * INVOP_COUNT, &iup)) return 1;
+	
+	// Opening into direct descriptors arrived in 5.15; older kernels
+	// would fail every open, so require a feature from soon after.
+	if (!(iup.features & IORING_FEAT_CQE_SKIP)) {
+		closeUring(&ur);
+		return 1;
+	}
+	
+	// Register an empty table of direct descriptors.
+	for (unsigned int iSlot = 0; iSlot < INV_DEPTH; iSlot++) {
+		fdSlots[iSlot] = -1;
+		is.uSlots[iSlot] = INV_DEPTH - 1 - iSlot;
+	}
+	is.nFree = INV_DEPTH;
+	is.nInFlight = 0;
+	if (syscall(__NR_io_uring_register, ur.fd, IORING_REGISTER_FILES, fdSlots, INV_DEPTH) < 0) {
+		closeUring(&ur);
+		return 1;
+	}
+	
+	size_t iNext = 0, iReport = 0;
+	int nRet = 0;
+	
+	while (iReport < nFiles) {
+		
+		// Keep the queue full.
+		while (is.nFree > 0 && iNext < nFiles) {
+			pic->pFiles[iNext].uSlot = is.uSlots[--is.nFree];
+			queueHeaderChain(&ur, pic->ppszFiles[iNext], &pic->pFiles[iNext], iNext);
+			is.nInFlight++;
+			iNext++;
+		}
+		
+		// Let the thread pool read the files not reported yet, once every
+		// chain in flight is done with its buffer.
+		if (submitUring(&ur, 1)) {
+			if (drainHeaderChains(&ur, pic, &is)) {
+				int nErr = errno;
+				pic->fInFlight = 1;
+				closeUring(&ur);
+				errno = nErr;
+				return -1;
+			}
+			pic->iFirst = iReport;
+			nRet = 1;
+			break;
+		}
+		
+		reapHeaderChains(&ur, pic, &is);
+		
+		// Report finished files in order.
+		for (; iReport < nFiles && pic->pFiles[iReport].nSteps == INVOP_COUNT; iReport++) {
+			PINV_FILE pif = &pic->pFiles[iReport];
+			pic->pfnDone(iReport, pif->nErr ? NULL : &pif->hdr, pif->nErr, pic->pCtx);
+		}
+	}
+	
+	closeUring(&ur);
+	return nRet;
+	
+}
+
+static void runHeaderJob (size_t iJob, void* pCtx) {
+	
+	PINV_CTX pic = (PINV_CTX)pCtx;
+	iJob += pic->iFirst;
+	PINV_FILE pif = &pic->pFiles[iJob];
+	int fd;
+	
+	// The file may have been part read by the io_uring scan.
+	pif->nErr = 0;
+	if ((fd = open(pic->ppszFiles[iJob], O_RDONLY | O_CLOEXEC)) < 0) {
+		pif->nErr = errno;
+	} else {
+		ssize_t cbRead = pread(fd, &pif->hdr, sizeof(GBHEAD), GBHEAD_OFFSET);
+		if (cbRead < 0) pif->nErr = errno;
+		else if (cbRead != sizeof(GBHEAD)) pif->nErr = EINVAL;
+		close(fd);
+	}
+	errno = 0;
+	
+}
+
+static void finishHeaderJob (size_t iJob, void* pCtx) {
+	
+	PINV_CTX pic = (PINV_CTX)pCtx;
+	iJob += pic->iFirst;
+	PINV_FILE pif = &pic->pFiles[iJob];
+	
+	pic->pfnDone(iJob, pif->nErr ? NULL : &pif->hdr, pif->nErr, pic->pCtx);
+	
+}
+
+/*
+ * 
+ * name: scanHeaders
+ * 
+ * 		Reads only the header of each file in a list, with many reads in
+ * 	flight at once, and hands each header to a callback in list order.
+ * 	io_uring is used where the kernel supports opening into direct
+ * 	descriptors; otherwise a thread pool issues plain reads.
+ * 
+ * @param:
+ * 		const char* const* ppszFiles:
+ * 			File names to read.
+ * 
+ * 		size_t nFiles:
+ * 			Number of file names.
+ * 
+ * 		unsigned int nThreads:
+ * 			Number of threads for the fallback.
+ * 
+ * 		PFN_HEADERDONE pfnDone:
+ * 			Callback for each file.
+ * 
+ * 		void* pCtx:
+ * 			Context passed to the callback.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int scanHeaders (const char* const* ppszFiles, size_t nFiles, unsigned int nThreads, PFN_HEADERDONE pfnDone, void* pCtx) {
+	
+	if (ppszFiles == NULL || pfnDone == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (nFiles == 0) return 0;
+	
+	INV_CTX ic;
+	memset(&ic, 0, sizeof(INV_CTX));
+	ic.ppszFiles = ppszFiles;
+	ic.pfnDone = pfnDone;
+	ic.pCtx = pCtx;
+	if ((ic.pFiles = calloc(nFiles, sizeof(INV_FILE))) == NULL) return -1;
+	
+	// io_uring may be missing, disabled by policy, or too old, or fail
+	// part way; the thread pool reads whatever it left.
+	int nRet = scanHeadersUring(&ic, nFiles);
+	if (nRet > 0) {
+		errno = 0;
+		nRet = runJobs(nFiles - ic.iFirst, nThreads, runHeaderJob, finishHeaderJob, &ic);
+	}
+	
+	// Chains the kernel still holds may write to the files' buffers, so
+	// those are left to it.
+	if (!ic.fInFlight) free(ic.pFiles);
+	return nRet;
+	
+}
+
+// EOF
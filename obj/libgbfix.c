@@ -0,0 +1,362 @@
+/*
+ * obj/libgbfix.c
+ * 
+ * GBFix - In-Memory Library
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+
+// Include used C header(s):
+#include <string.h>
+
+// Include module header(s):
+#include "../inc/chksum.h"
+#include "../inc/libgbfix.h"
+
+static const char* s_pszErrors[] = {
+	"Success",
+	"Required pointer was NULL",
+	"Image too small to hold a header",
+	"Image is read only",
+	"Context not initialized",
+	"Invalid argument"
+};
+
+/*
+ * 
+ * name: sumImage
+ * 
+ * 		Computes the global checksum of the context's image as it would
+ * 	be with a given header. Sums on the calling thread only.
+ * 
+ * @param:
+ * 		const PGBFIX_CTX pCtx:
+ * 			Constant pointer to an initialized context.
+ * 
+ * 		const PGBHEAD pHdr:
+ * 			Constant pointer to the header to sum in place of the one in
+ * 		the image.
+ * 
+ * @return: uint16_t
+ * 		Returns the global checksum.
+ * 
+ */
+static uint16_t sumImage (const PGBFIX_CTX pCtx, const PGBHEAD pHdr) {
+	
+	uint64_t uChksum;
+	
+	uChksum = sumBytes(pCtx->pRom, GBHEAD_OFFSET);
+	uChksum += sumBytes(pHdr, offsetof(GBHEAD, uGlobalChksum));
+	uChksum += sumBytes(pCtx->pRom + GBHEAD_ROMMIN, pCtx->cbRom - GBHEAD_ROMMIN);
+	
+	return (uint16_t)(uChksum & 0xFFFF);
+	
+}
+
+/*
+ * 
+ * name: gbfixInit
+ * 
+ * 		Attaches a context to a writable ROM image in memory and parses
+ * 	its header. The image must stay valid for as long as the context
+ * 	is used.
+ * 
+ * @param:
+ * 		PGBFIX_CTX pCtx:
+ * 			Pointer to the context to initialize.
+ * 
+ * 		void* pRom:
+ * 			Pointer to the ROM image.
+ * 
+ * 		size_t cbRom:
+ * 			Size of the ROM image in bytes.
+ * 
+ * @return: int
+ * 		Returns GBFIX_OK on success, or a GBFIX_E* code on error.
+ * 
+ */
+int gbfixInit (PGBFIX_CTX pCtx, void* pRom, size_t cbRom) {
+	
+	if (pCtx == NULL) return GBFIX_EFAULT;
+	memset(pCtx, 0, sizeof(GBFIX_CTX));
+	
+	if (pRom == NULL) return GBFIX_EFAULT;
+	if (cbRom < GBHEAD_ROMMIN) return GBFIX_ETOOSMALL;
+	
+	pCtx->pRom = (uint8_t*)pRom;
+	pCtx->cbRom = cbRom;
+	memcpy(&pCtx->hdrImg, pCtx->pRom + GBHEAD_OFFSET, sizeof(GBHEAD));
+	memcpy(&pCtx->hdr, &pCtx->hdrImg, sizeof(GBHEAD));
+	pCtx->uFlags = GBXF_INIT;
+	
+	return GBFIX_OK;
+	
+}
+
+/*
+ * 
+ * name: gbfixInitConst
+ * 
+ * 		Attaches a context to a read only ROM image. Edits may still be
+ * 	staged and validated, but gbfixFix will refuse to write them.
+ * 
+ * @param:
+ * 		PGBFIX_CTX pCtx:
+ * 			Pointer to the context to initialize.
+ * 
+ * 		const void* pRom:
+ * 			Constant pointer to the ROM image.
+ * 
+ * 		size_t cbRom:
+ * 			Size of the ROM image in bytes.
+ * 
+ * @return: int
+ * 		Returns GBFIX_OK on success, or a GBFIX_E* code on error.
+ * 
+ */
+int gbfixInitConst (PGBFIX_CTX pCtx, const void* pRom, size_t cbRom) {
+	
+	int nErr = gbfixInit(pCtx, (void*)pRom, cbRom);
+	
+	if (nErr == GBFIX_OK) pCtx->uFlags |= GBXF_RDONLY;
+	return nErr;
+	
+}
+
+/*
+ * 
+ * name: gbfixReset
+ * 
+ * 		Detaches a context from its image. The image is not touched.
+ * 
+ * @param:
+ * 		PGBFIX_CTX pCtx:
+ * 			Pointer to the context to reset.
+ * 
+ */
+void gbfixReset (PGBFIX_CTX pCtx) {
+	
+	if (pCtx != NULL) memset(pCtx, 0, sizeof(GBFIX_CTX));
+	
+}
+
+/*
+ * 
+ * name: gbfixGetHeader
+ * 
+ * 		Copies out the context's header, including any staged edits.
+ * 
+ * @param:
+ * 		const PGBFIX_CTX pCtx:
+ * 			Constant pointer to an initialized context.
+ * 
+ * 		PGBHEAD pHdr:
+ * 			Pointer to the header structure to fill.
+ * 
+ * @return: int
+ * 		Returns GBFIX_OK on success, or a GBFIX_E* code on error.
+ * 
+ */
+int gbfixGetHeader (const PGBFIX_CTX pCtx, PGBHEAD pHdr) {
+	
+	if (pCtx == NULL || pHdr == NULL) return GBFIX_EFAULT;
+	if (!(pCtx->uFlags & GBXF_INIT)) return GBFIX_ENOINIT;
+	
+	memcpy(pHdr, &pCtx->hdr, sizeof(GBHEAD));
+	return GBFIX_OK;
+	
+}
+
+/*
+ * 
+ * name: gbfixSetHeader
+ * 
+ * 		Stages a whole replacement header. Its checksum fields are
+ * 	ignored; gbfixFix settles them.
+ * 
+ * @param:
+ * 		PGBFIX_CTX pCtx:
+ * 			Pointer to an initialized context.
+ * 
+ * 		const PGBHEAD pHdr:
+ * 			Constant pointer to the new header.
+ * 
+ * @return: int
+ * 		Returns GBFIX_OK on success, or a GBFIX_E* code on error.
+ * 
+ */
+int gbfixSetHeader (PGBFIX_CTX pCtx, const PGBHEAD pHdr) {
+	
+	if (pCtx == NULL || pHdr == NULL) return GBFIX_EFAULT;
+	if (!(pCtx->uFlags & GBXF_INIT)) return GBFIX_ENOINIT;
+	
+	memcpy(&pCtx->hdr, pHdr, sizeof(GBHEAD));
+	pCtx->uFlags |= GBXF_STAGED;
+	
+	return GBFIX_OK;
+	
+}
+
+/*
+ * 
+ * name: gbfixApplyUpdates
+ * 
+ * 		Stages the fields selected in a header updates structure, the
+ * 	same way the command line options do.
+ * 
+ * @param:
+ * 		PGBFIX_CTX pCtx:
+ * 			Pointer to an initialized context.
+ * 
+ * 		const PHDR_UPDATES pHdrUps:
+ * 			Constant pointer to the updates to stage.
+ * 
+ * @return: int
+ * 		Returns GBFIX_OK on success, or a GBFIX_E* code on error.
+ * 
+ */
+int gbfixApplyUpdates (PGBFIX_CTX pCtx, const PHDR_UPDATES pHdrUps) {
+	
+	if (pCtx == NULL || pHdrUps == NULL) return GBFIX_EFAULT;
+	if (!(pCtx->uFlags & GBXF_INIT)) return GBFIX_ENOINIT;
+	if (pHdrUps->uFlags & ~UPF_MASK) return GBFIX_EINVAL;
+	
+	applyHdrUpdates(&pCtx->hdr, pHdrUps);
+	pCtx->uFlags |= GBXF_STAGED;
+	
+	return GBFIX_OK;
+	
+}
+
+/*
+ * 
+ * name: gbfixValidate
+ * 
+ * 		Computes the correct checksums of the image as it is, without
+ * 	staged edits, and compares them with the stored ones. The global
+ * 	checksum is remembered so later calls only pay for the header.
+ * 
+ * @param:
+ * 		PGBFIX_CTX pCtx:
+ * 			Pointer to an initialized context.
+ * 
+ * 		PGBFIX_STATUS pStatus:
+ * 			Pointer to the status structure to fill.
+ * 
+ * @return: int
+ * 		Returns GBFIX_OK on success, or a GBFIX_E* code on error.
+ * 
+ */
+int gbfixValidate (PGBFIX_CTX pCtx, PGBFIX_STATUS pStatus) {
+	
+	if (pCtx == NULL || pStatus == NULL) return GBFIX_EFAULT;
+	if (!(pCtx->uFlags & GBXF_INIT)) return GBFIX_ENOINIT;
+	
+	if (!(pCtx->uFlags & GBXF_GLOBALKNOWN)) {
+		pCtx->uImgGlobalChksum = sumImage(pCtx, &pCtx->hdrImg);
+		pCtx->uFlags |= GBXF_GLOBALKNOWN;
+	}
+	
+	pStatus->uFlags = 0;
+	pStatus->uHdrChksum = mkGbHdrChksum(&pCtx->hdrImg);
+	pStatus->uGlobalChksum = pCtx->uImgGlobalChksum;
+	
+	if (pStatus->uHdrChksum == pCtx->hdrImg.uHdrChksum)
+		pStatus->uFlags |= GBXS_HDROK;
+	if (pStatus->uGlobalChksum == correctGlobalChksum(&pCtx->hdrImg))
+		pStatus->uFlags |= GBXS_GLOBALOK;
+	
+	return GBFIX_OK;
+	
+}
+
+/*
+ * 
+ * name: gbfixFix
+ * 
+ * 		Settles both checksums of the staged header and writes it into
+ * 	the image. If the image's global checksum is already known only the
+ * 	changed header bytes are summed, otherwise the image is scanned once.
+ * 
+ * @param:
+ * 		PGBFIX_CTX pCtx:
+ * 			Pointer to an initialized, writable context.
+ * 
+ * 		PGBFIX_STATUS pStatus:
+ * 			Pointer to a status structure to fill with the new checksums,
+ * 		or NULL.
+ * 
+ * @return: int
+ * 		Returns GBFIX_OK on success, or a GBFIX_E* code on error.
+ * 
+ */
+int gbfixFix (PGBFIX_CTX pCtx, PGBFIX_STATUS pStatus) {
+	
+	if (pCtx == NULL) return GBFIX_EFAULT;
+	if (!(pCtx->uFlags & GBXF_INIT)) return GBFIX_ENOINIT;
+	if (pCtx->uFlags & GBXF_RDONLY) return GBFIX_ERDONLY;
+	
+	uint16_t uChksum;
+	
+	pCtx->hdr.uHdrChksum = mkGbHdrChksum(&pCtx->hdr);
+	
+	if (pCtx->uFlags & GBXF_GLOBALKNOWN)
+		uChksum = updGbGlobalChksum(pCtx->uImgGlobalChksum, &pCtx->hdrImg, &pCtx->hdr);
+	else uChksum = sumImage(pCtx, &pCtx->hdr);
+	setGlobalChksum(&pCtx->hdr, uChksum);
+	
+	memcpy(pCtx->pRom + GBHEAD_OFFSET, &pCtx->hdr, sizeof(GBHEAD));
+	memcpy(&pCtx->hdrImg, &pCtx->hdr, sizeof(GBHEAD));
+	pCtx->uImgGlobalChksum = uChksum;
+	pCtx->uFlags = (pCtx->uFlags & ~GBXF_STAGED) | GBXF_GLOBALKNOWN;
+	
+	if (pStatus != NULL) {
+		pStatus->uFlags = GBXS_HDROK | GBXS_GLOBALOK;
+		pStatus->uHdrChksum = pCtx->hdr.uHdrChksum;
+		pStatus->uGlobalChksum = uChksum;
+	}
+	
+	return GBFIX_OK;
+	
+}
+
+/*
+ * 
+ * name: gbfixStrError
+ * 
+ * 		Gets a description of a library error code.
+ * 
+ * @param:
+ * 		const int nErr:
+ * 			A GBFIX_E* code.
+ * 
+ * @return: const char*
+ * 		Returns a constant string.
+ * 
+ */
+const char* gbfixStrError (const int nErr) {
+	
+	if (nErr > 0 || -nErr >= (int)(sizeof(s_pszErrors) / sizeof(s_pszErrors[0])))
+		return "Unknown error";
+	return s_pszErrors[-nErr];
+	
+}
+
+// EOF
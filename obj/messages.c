@@ -23,6 +23,7 @@
  */
 
 // Include used C header(s):
+#include <errno.h>
 #include <stdio.h>
 
 // Include module header(s):
@@ -30,31 +31,34 @@
 
 const char g_szDivider[] = "\n--[ %s ]--\n";
 
-void printRomInfo (const PGBHEAD pgbHdr) {
+void printRomInfo (FILE* pOut, const PGBHEAD pgbHdr) {
 	
 	if (pgbHdr == NULL) {
 		fprintf(stderr, "Error: Bad header info structure.\n");
 		return;
 	}
 	
+	// The header functions report problems through errno, so start clean.
+	errno = 0;
+	
 	// Compute header revision.
 	unsigned int uHdrRev = getHdrRev(pgbHdr);
 	
-	printf(g_szDivider, "ROM Info");
+	fprintf(pOut, g_szDivider, "ROM Info");
 	
-	printf("\tHeader Format:      %s\n", getHdrRevStr(uHdrRev));
+	fprintf(pOut, "\tHeader Format:      %s\n", getHdrRevStr(uHdrRev));
 	
 	// Print out title information.
 	switch (uHdrRev) {
 	case HDRREV_DMG:
 	case HDRREV_SGB:
-		printf("\tTitle:              \"%s\"\n", pgbHdr->htTitle.oldTitle.strTitle);
+		fprintf(pOut, "\tTitle:              \"%s\"\n", pgbHdr->htTitle.oldTitle.strTitle);
 		break;
 	case HDRREV_CGB:
-		printf("\tTitle (Old Format): \"%s\"\n", pgbHdr->htTitle.oldTitle.strTitle);
-		printf("\tTitle (New Format): \"%s\"\n", pgbHdr->htTitle.newTitle.strTitle);
-		printf("\tManufacturer:       \"%s\"\n", pgbHdr->htTitle.newTitle.strManufacturer);
-		printf("\tCGB Flags:          0x%X\n", pgbHdr->htTitle.newTitle.uCgbFlag);
+		fprintf(pOut, "\tTitle (Old Format): \"%s\"\n", pgbHdr->htTitle.oldTitle.strTitle);
+		fprintf(pOut, "\tTitle (New Format): \"%s\"\n", pgbHdr->htTitle.newTitle.strTitle);
+		fprintf(pOut, "\tManufacturer:       \"%s\"\n", pgbHdr->htTitle.newTitle.strManufacturer);
+		fprintf(pOut, "\tCGB Flags:          0x%X\n", pgbHdr->htTitle.newTitle.uCgbFlag);
 		break;
 	default:
 		fprintf(stderr, "Error: Invalid header format.\n");
@@ -62,15 +66,30 @@ void printRomInfo (const PGBHEAD pgbHdr) {
 	}
 	
 	// Print out remaining header information.
-	printf("\tLicensee Code:      0x%X (%s type)\n", getLicenseeCode(pgbHdr), getLicenseeTypeStr(pgbHdr));
-	printf("\tSGB Flags:          0x%X\n", pgbHdr->uSgbFlag);
-	printf("\tROM Size:           %ldkB (%ldB)\n", getRomSizeInkB(pgbHdr), getRomSizeInkB(pgbHdr) * 1024);
-	printf("\tRegion:             %s (0x%X)\n", getRegionStr(pgbHdr), pgbHdr->uRegion);
-	printf("\tROM Version:        0x%X\n", pgbHdr->uRomVer);
-	printf("\tHeader Checksum:    0x%X\n", pgbHdr->uHdrChksum);
-	printf("\tGlobal Checksum:    0x%X\n", correctGlobalChksum(pgbHdr));
+	long int nRomSizeInkB = getRomSizeInkB(pgbHdr);
+	fprintf(pOut, "\tLicensee Code:      0x%X (%s type)\n", getLicenseeCode(pgbHdr), getLicenseeTypeStr(pgbHdr));
+	fprintf(pOut, "\tSGB Flags:          0x%X\n", pgbHdr->uSgbFlag);
+	fprintf(pOut, "\tROM Size:           %ldkB (%ldB)\n", nRomSizeInkB, nRomSizeInkB * 1024);
+	fprintf(pOut, "\tRegion:             %s (0x%X)\n", getRegionStr(pgbHdr), pgbHdr->uRegion);
+	fprintf(pOut, "\tROM Version:        0x%X\n", pgbHdr->uRomVer);
+	fprintf(pOut, "\tHeader Checksum:    0x%X\n", pgbHdr->uHdrChksum);
+	fprintf(pOut, "\tGlobal Checksum:    0x%X\n", correctGlobalChksum(pgbHdr));
 	
-	printf("\n");
+	fprintf(pOut, "\n");
+	
+}
+
+// Print content hashes in the tagged format of the *sum tools, so that
+// duplicates can be found by sorting on the hash.
+void printRomHashes (FILE* pOut, const char* pszFileName, const PROM_HASHES pHashes) {
+	
+	static const char* const pszTags[] = { "CRC32", "MD5", "SHA1" };
+	char szHash[HASH_STRMAX];
+	
+	for (unsigned int iHash = 0; iHash < 3; iHash++)
+		if (getRomHashStr(pHashes, 1U << iHash, szHash) != NULL)
+			fprintf(pOut, "%s (%s) = %s\n", pszTags[iHash], pszFileName, szHash);
+	errno = 0;
 	
 }
 
@@ -80,10 +99,49 @@ void printHelp () {
 	printf(g_szDivider, "Help");
 	printf("\t-h, --help                Show this help.\n");
 	printf("\t    --gpl                 Show the GNU GPL3 notice.\n");
-	printf("\t-f, --file <FILE>         Set file to use to <FILE>.\n");
+	printf("\t-f, --file <FILE>         Add <FILE> to the files to use. May be given more than once.\n");
+	printf("\t                          Directories are scanned for ROMs, @<LIST> reads names from <LIST>.\n");
+	printf("\t                          File names may also follow the options.\n");
+	printf("\t                          \"-\" reads a single ROM from stdin; it is fixed as it streams\n");
+	printf("\t                          through and written to the file given with -o.\n");
+	printf("\t-o, --output <FILE>       Write the fixed ROM to <FILE> instead of updating it in place.\n");
+	printf("\t                          <FILE> is replaced at once when done, sharing the original's\n");
+	printf("\t                          blocks where the file system allows. Must be seekable for a\n");
+	printf("\t                          ROM read from stdin.\n");
+	printf("\t-j, --jobs <N>            Process up to <N> files in parallel. Defaults to one per CPU.\n");
 	printf("\t-v, --verbose             Enable verbose mode.\n");
 	printf("\t-d, --dry-run             Don't make changes, only show what changes would be made.\n");
 	printf("\t    --norominfo           Don't show ROM information.\n");
+	printf("\t    --audit               Only check every header field and list what is wrong. Reads\n");
+	printf("\t                          just the headers, so it suits very large sets of files.\n");
+	printf("\t    --inventory           Only show ROM information, reading many headers at once.\n");
+	printf("\t    --format <FMT>        Show results as text (default), jsonl, csv or bin, a packed\n");
+	printf("\t                          binary record per file. Works with --audit and --inventory.\n");
+	printf("\t    --pad[=<BYTE>]        Pad each ROM with <BYTE> (default 0xFF) up to the next valid ROM\n");
+	printf("\t                          size and set the ROM size field to match.\n");
+	printf("\t    --trim                Cut trailing 0xFF or 0x00 fill down to the smallest valid ROM\n");
+	printf("\t                          size that holds the rest, and set the ROM size field to match.\n");
+	printf("\t    --fill-info           Show how much of each ROM is trailing fill, bank by bank.\n");
+	printf("\t    --patch <FILE>        Apply the IPS or BPS patch <FILE> to each ROM before fixing it.\n");
+	printf("\t                          The patched ROM is built next to the original and replaces it.\n");
+	printf("\t    --hash[=<LIST>]       Show the CRC32, MD5 and SHA-1 of each ROM as read, or only those\n");
+	printf("\t                          in the comma separated <LIST>. All are computed in one pass;\n");
+	printf("\t                          with --cache they are remembered, so each ROM is hashed once.\n");
+	printf("\t    --full-rescan         Recompute the global checksum from the whole ROM even when the\n");
+	printf("\t                          checksum cache holds it. Use on ROMs that may have changed\n");
+	printf("\t                          without their size or modification time changing.\n");
+	printf("\t    --stats[=<FMT>]       Time each phase of each file and show totals, MB/s, files/s and\n");
+	printf("\t                          latency percentiles on stderr at exit, as text (default) or json.\n");
+	printf("\t    --cache[=<FILE>]      Remember checksums of unchanged ROMs in <FILE>. Defaults to\n");
+	printf("\t                          $GBFIX_CACHE, or gbfix.cache in $XDG_CACHE_HOME or ~/.cache.\n");
+	printf("\t    --cache-clear         Invalidate every entry in the checksum cache.\n");
+	printf("\t    --cache-gc[=<DAYS>]   Drop cache entries unused for <DAYS> days (default 30).\n");
+	printf("\t    --serve <SOCKET>      Run as a daemon answering requests on the UNIX socket <SOCKET>\n");
+	printf("\t                          with -j workers, keeping the checksum cache open. Stop with\n");
+	printf("\t                          SIGINT or SIGTERM.\n");
+	printf("\t    --client <SOCKET>     Have the daemon on <SOCKET> process the files instead.\n");
+	printf("\t    --watch <DIR>         Fix ROMs in <DIR> each time they are rewritten, applying the\n");
+	printf("\t                          header updates given. Stop with SIGINT or SIGTERM.\n");
 	printf(g_szDivider, "ROM Manipulation");
 	printf("\t-r, --region <REGION>     Set ROM region to <REGION>.\n");
 	printf("\t-s, --sgbflags <FLAGS>    Set SGB (Super GameBoy) flags to <FLAGS>.\n");
@@ -93,6 +151,24 @@ void printHelp () {
 	printf("\t-c, --cgbflags <CGBFLAGS> Set CGB flags to <CGBFLAGS>. Only available on \"CGB\" type ROMs.\n");
 	printf("\t-C, --carttype <CART>     Set cart type to <CART>.\n");
 	printf("\t-R, --ramsize <SIZE>      Set save RAM size to <SIZE>.\n");
+	printf("\t    --fix-logo            Restore the Nintendo logo the boot ROM checks.\n");
+	printf(g_szDivider, "Collection Index");
+	printf("\tindex build <INDEX> <FILE>...\n");
+	printf("\t                          Index the headers and checksums of the files in <INDEX>. Entries\n");
+	printf("\t                          of files that did not change since the last build are reused.\n");
+	printf("\tindex refresh <INDEX>     Rescan the indexed files that changed and drop vanished ones.\n");
+	printf("\tindex query <INDEX> <PREDICATE>...\n");
+	printf("\t                          List the indexed ROMs matching every <FIELD><OP><VALUE> predicate.\n");
+	printf("\t                          Fields: title, manufacturer, newlicensee, cgbflag, sgbflag,\n");
+	printf("\t                          carttype, romsize, ramsize, region, oldlicensee, romver, hdrchksum,\n");
+	printf("\t                          globalchksum, hdrok, globalok, size, finding, format.\n");
+	printf("\t                          Operators: = != < <= > >= & (any bit set) ^ (text prefix).\n");
+	printf(g_szDivider, "Multicart");
+	printf("\tmulticart <OUT> <MENU> <ROM>...\n");
+	printf("\t                          Build a multicart image in <OUT> from the menu and the ROMs, fixing\n");
+	printf("\t                          every header and checksum. An MBC1 menu takes up to three ROMs of\n");
+	printf("\t                          at most 256kiB, an MMM01 menu any number. The header updates apply\n");
+	printf("\t                          to the menu; gaps are filled with the --pad byte, or 0xFF.\n");
 	printf("\n");
 	
 }
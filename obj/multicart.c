@@ -0,0 +1,292 @@
+/*
+ * obj/multicart.c
+ * 
+ * GBFix - Multicart Image Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/multicart.h"
+
+static const char* const s_pszMulticartLayouts[] = {
+	[MCLAYOUT_MBC1] = "MBC1",
+	[MCLAYOUT_MMM01] = "MMM01"
+};
+
+// Round a size up to a power of two, but no less than one 32kiB ROM.
+static size_t getSlotSize (size_t cb) {
+	
+	size_t cbSlot = MC_SLOTMIN;
+	while (cbSlot < cb) cbSlot <<= 1;
+	return cbSlot;
+	
+}
+
+/*
+ * 
+ * name: openMulticart
+ * 
+ * 		Opens the ROMs of a multicart image and reads their headers.
+ * 
+ * @param:
+ * 		PMULTICART pmc:
+ * 			Pointer to the multicart structure to initialize.
+ * 
+ * 		const char* const* ppszFiles:
+ * 			Names of the ROM files, the menu first.
+ * 
+ * 		const size_t nFiles:
+ * 			Number of ROM files.
+ * 
+ * 		const uint8_t uFill:
+ * 			Byte value for everything not covered by a ROM.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. On error nEntries is the index of the file that failed, and
+ * 	the structure must still be closed with closeMulticart().
+ * 
+ */
+int openMulticart (PMULTICART pmc, const char* const* ppszFiles, const size_t nFiles, const uint8_t uFill) {
+	
+	if (pmc == NULL || ppszFiles == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memset(pmc, 0, sizeof(MULTICART));
+	pmc->uFill = uFill;
+	if ((pmc->pEntries = calloc(nFiles, sizeof(MC_ENTRY))) == NULL) return -1;
+	
+	for (; pmc->nEntries < nFiles; pmc->nEntries++) {
+		PMC_ENTRY pEnt = &pmc->pEntries[pmc->nEntries];
+		pEnt->pszFileName = ppszFiles[pmc->nEntries];
+		if (openRomFile(pEnt->pszFileName, &pEnt->rf, 0)) return -1;
+		if (readRomHeader(&pEnt->rf, &pEnt->hdr)) {
+			int nErr = errno;
+			closeRomFile(&pEnt->rf);
+			errno = nErr;
+			return -1;
+		}
+	}
+	
+	return 0;
+	
+}
+
+void closeMulticart (PMULTICART pmc) {
+	
+	if (pmc == NULL) return;
+	for (size_t iEnt = 0; iEnt < pmc->nEntries; iEnt++) closeRomFile(&pmc->pEntries[iEnt].rf);
+	free(pmc->pEntries);
+	
+	memset(pmc, 0, sizeof(MULTICART));
+	
+}
+
+const char* getMulticartLayoutStr (const unsigned int uLayout) {
+	
+	if (uLayout > MCLAYOUT_MMM01) return "unknown";
+	return s_pszMulticartLayouts[uLayout];
+	
+}
+
+/*
+ * 
+ * name: planMulticart
+ * 
+ * 		Chooses the layout from the menu's cartridge type, places every
+ * 	ROM in its slot, and sets the ROM size of the outer header to the
+ * 	size of the image. Sizes past 8MiB get a size code extrapolated
+ * 	from the standard ones.
+ * 
+ * @param:
+ * 		PMULTICART pmc:
+ * 			Pointer to the opened multicart.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Sets ENOTSUP if the menu is not for a multicart mapper, and
+ * 	EFBIG if the ROMs do not fit the layout.
+ * 
+ */
+int planMulticart (PMULTICART pmc) {
+	
+	if (pmc == NULL || pmc->pEntries == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (pmc->nEntries < 2) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	PMC_ENTRY pMenu = &pmc->pEntries[0];
+	switch (pMenu->hdr.uCartType) {
+		case CT_MBC1:
+		case CT_MBC1_RAM:
+		case CT_MBC1_BATTERY_RAM:
+			pmc->uLayout = MCLAYOUT_MBC1;
+			break;
+		
+		case CT_MMM01:
+		case CT_MMM01_RAM:
+		case CT_MMM01_BATTERY_RAM:
+			pmc->uLayout = MCLAYOUT_MMM01;
+			break;
+		
+		default:
+			errno = ENOTSUP;
+			return -1;
+	}
+	
+	size_t cbSlotMax = 0;
+	for (size_t iEnt = 0; iEnt < pmc->nEntries; iEnt++) {
+		PMC_ENTRY pEnt = &pmc->pEntries[iEnt];
+		pEnt->cbSlot = getSlotSize(pEnt->rf.cbRom);
+		if (pEnt->cbSlot > cbSlotMax) cbSlotMax = pEnt->cbSlot;
+	}
+	
+	if (pmc->uLayout == MCLAYOUT_MBC1) {
+		if (pmc->nEntries > MC_MBC1MAX || cbSlotMax > MC_MBC1SLOT) {
+			errno = EFBIG;
+			return -1;
+		}
+		for (size_t iEnt = 0; iEnt < pmc->nEntries; iEnt++) {
+			pmc->pEntries[iEnt].cbSlot = MC_MBC1SLOT;
+			pmc->pEntries[iEnt].offImage = (off_t)(iEnt * MC_MBC1SLOT);
+		}
+		pmc->cbImage = getSlotSize(pmc->nEntries * MC_MBC1SLOT);
+	} else {
+		// Largest slots first keeps every slot aligned to its size. Games
+		// of one size stay in the order given.
+		size_t cbUsed = 0;
+		for (size_t cbSlot = cbSlotMax; cbSlot >= MC_SLOTMIN; cbSlot >>= 1) {
+			for (size_t iEnt = 1; iEnt < pmc->nEntries; iEnt++) {
+				if (pmc->pEntries[iEnt].cbSlot != cbSlot) continue;
+				pmc->pEntries[iEnt].offImage = (off_t)cbUsed;
+				cbUsed += cbSlot;
+			}
+		}
+		
+		// The image is a power of two, and so a multiple of the menu's
+		// slot, which ends it.
+		pmc->cbImage = getSlotSize(cbUsed + pMenu->cbSlot);
+		pMenu->offImage = (off_t)(pmc->cbImage - pMenu->cbSlot);
+	}
+	
+	pMenu->hdr.uRomSize = (uint8_t)__builtin_ctzll(pmc->cbImage / MC_SLOTMIN);
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: buildMulticart
+ * 
+ * 		Builds a planned multicart image. Each ROM is copied into its
+ * 	slot by the kernel with copyFull(), so the ROMs are only read here
+ * 	to sum them. Every header and global checksum is fixed, and the
+ * 	gaps are filled.
+ * 
+ * @param:
+ * 		PMULTICART pmc:
+ * 			Pointer to the planned multicart. The headers are left as
+ * 			they were written.
+ * 
+ * 		int fdOut:
+ * 			Descriptor of the new, empty image file, open for writing.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int buildMulticart (PMULTICART pmc, int fdOut) {
+	
+	if (pmc == NULL || pmc->pEntries == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (ftruncate(fdOut, (off_t)pmc->cbImage)) return -1;
+	
+	// The outer global checksum is the sum of every ROM, each with its
+	// own fixed header, plus the fill. Only the menu leaves out its
+	// global checksum bytes.
+	uint64_t uSum = 0;
+	for (size_t iEnt = 0; iEnt < pmc->nEntries; iEnt++) {
+		PMC_ENTRY pEnt = &pmc->pEntries[iEnt];
+		pEnt->hdr.uHdrChksum = mkGbHdrChksum(&pEnt->hdr);
+		
+		uint16_t uChksum = mkGbGlobalChksum(&pEnt->hdr, pEnt->rf.pRom, pEnt->rf.cbRom);
+		uSum += uChksum;
+		if (iEnt == 0) continue;
+		setGlobalChksum(&pEnt->hdr, uChksum);
+		uSum += (uint64_t)pEnt->hdr.uGlobalChksum[0] + pEnt->hdr.uGlobalChksum[1];
+	}
+	
+	// Copy the ROMs in order of their place in the image, filling up
+	// to each one.
+	off_t offNext = 0;
+	for (size_t nDone = 0; nDone < pmc->nEntries; nDone++) {
+		PMC_ENTRY pEnt = NULL;
+		for (size_t iEnt = 0; iEnt < pmc->nEntries; iEnt++) {
+			PMC_ENTRY pCand = &pmc->pEntries[iEnt];
+			if (pCand->offImage >= offNext && (pEnt == NULL || pCand->offImage < pEnt->offImage)) pEnt = pCand;
+		}
+		
+		size_t cbGap = (size_t)(pEnt->offImage - offNext);
+		if (pmc->uFill != 0 && cbGap != 0 && writeFill(fdOut, offNext, cbGap, pmc->uFill)) return -1;
+		uSum += (uint64_t)pmc->uFill * cbGap;
+		
+		if (copyFull(pEnt->rf.fd, fdOut, pEnt->offImage, pEnt->rf.cbRom)) return -1;
+		offNext = pEnt->offImage + (off_t)pEnt->rf.cbRom;
+	}
+	
+	size_t cbGap = pmc->cbImage - (size_t)offNext;
+	if (pmc->uFill != 0 && cbGap != 0 && writeFill(fdOut, offNext, cbGap, pmc->uFill)) return -1;
+	uSum += (uint64_t)pmc->uFill * cbGap;
+	
+	setGlobalChksum(&pmc->pEntries[0].hdr, (uint16_t)(uSum & 0xFFFF));
+	
+	// Write the fixed headers over the copied ones.
+	for (size_t iEnt = 0; iEnt < pmc->nEntries; iEnt++) {
+		PMC_ENTRY pEnt = &pmc->pEntries[iEnt];
+		ssize_t cbWritten = pwrite(fdOut, &pEnt->hdr, sizeof(GBHEAD), pEnt->offImage + GBHEAD_OFFSET);
+		if (cbWritten < 0) return -1;
+		if (cbWritten != sizeof(GBHEAD)) {
+			errno = EIO;
+			return -1;
+		}
+	}
+	
+	return 0;
+	
+}
+
+// EOF
@@ -0,0 +1,521 @@
+/*
+ * obj/patch.c
+ * 
+ * GBFix - IPS/BPS Patch Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/chksum.h"
+#include "../inc/gbhead.h"
+#include "../inc/patch.h"
+#include "../inc/romhash.h"
+
+// Offset of the global checksum in the ROM, which the checksum skips.
+#define PATCH_CHKSUMOFS (GBHEAD_OFFSET + offsetof(GBHEAD, uGlobalChksum))
+
+static const char* const s_pszPatchFormats[] = {
+	[PATCHFMT_IPS] = "IPS",
+	[PATCHFMT_BPS] = "BPS"
+};
+
+static inline uint32_t getBe24 (const uint8_t* p) {
+	
+	return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+	
+}
+
+static inline uint32_t getLe32 (const uint8_t* p) {
+	
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	
+}
+
+// Decodes a BPS varint. Returns nonzero if it runs past pEnd or does not
+// fit a size_t.
+static int readVarint (const uint8_t** pp, const uint8_t* pEnd, size_t* pnValue) {
+	
+	size_t nValue = 0, nShift = 1;
+	
+	while (*pp < pEnd) {
+		uint8_t uByte = *(*pp)++;
+		if ((uByte & 0x7F) && nShift > SIZE_MAX / (uByte & 0x7F)) break;
+		nValue += (size_t)(uByte & 0x7F) * nShift;
+		if (uByte & 0x80) {
+			*pnValue = nValue;
+			return 0;
+		}
+		if (nShift > SIZE_MAX >> 7) break;
+		nShift <<= 7;
+		nValue += nShift;
+	}
+	
+	errno = EINVAL;
+	return -1;
+	
+}
+
+// Walks the IPS records once to check that they all lie inside the
+// patch and to find how far they reach.
+static int scanIpsRecords (PROM_PATCH pPatch) {
+	
+	const uint8_t* p = pPatch->pData + 5;
+	const uint8_t* pEnd = pPatch->pData + pPatch->cbData;
+	
+	pPatch->pRecords = p;
+	while (1) {
+		
+		if (pEnd - p < 3) break;
+		if (memcmp(p, "EOF", 3) == 0) {
+			pPatch->pEnd = p;
+			p += 3;
+			if (pEnd - p >= 3) {
+				pPatch->fIpsTrunc = 1;
+				pPatch->cbTarget = getBe24(p);
+			}
+			return 0;
+		}
+		
+		if (pEnd - p < 5) break;
+		size_t iOffset = getBe24(p);
+		size_t cbRecord = ((size_t)p[3] << 8) | p[4];
+		p += 5;
+		
+		if (cbRecord == 0) {
+			if (pEnd - p < 3) break;
+			cbRecord = ((size_t)p[0] << 8) | p[1];
+			p += 3;
+		} else {
+			if ((size_t)(pEnd - p) < cbRecord) break;
+			p += cbRecord;
+		}
+		
+		if (iOffset + cbRecord > pPatch->cbIpsEnd) pPatch->cbIpsEnd = iOffset + cbRecord;
+		
+	}
+	
+	errno = EINVAL;
+	return -1;
+	
+}
+
+// Reads the BPS header and footer and checks the CRC-32 of the patch.
+static int scanBpsHeader (PROM_PATCH pPatch) {
+	
+	if (pPatch->cbData < 4 + 3 + 12) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	const uint8_t* p = pPatch->pData + 4;
+	const uint8_t* pEnd = pPatch->pData + pPatch->cbData - 12;
+	
+	ROM_HASHES rh;
+	if (hashRomImage(pPatch->pData, pPatch->cbData - 4, HASHF_CRC32, &rh)) return -1;
+	if (rh.uCrc32 != getLe32(pEnd + 8)) {
+		errno = EBADMSG;
+		return -1;
+	}
+	
+	size_t cbMeta;
+	if (readVarint(&p, pEnd, &pPatch->cbSource) || readVarint(&p, pEnd, &pPatch->cbTarget) ||
+		readVarint(&p, pEnd, &cbMeta)) return -1;
+	if ((size_t)(pEnd - p) < cbMeta) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	pPatch->pRecords = p + cbMeta;
+	pPatch->pEnd = pEnd;
+	pPatch->uSourceCrc = getLe32(pEnd);
+	pPatch->uTargetCrc = getLe32(pEnd + 4);
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: openRomPatch
+ * 
+ * 		Opens and maps an IPS or BPS patch, telling them apart by their
+ * 	magic. The records are checked to lie within the file, and the
+ * 	CRC-32 of a BPS patch is verified, before any ROM is touched.
+ * 
+ * @param:
+ * 		const char* pszFileName:
+ * 			Name of the patch file.
+ * 
+ * 		PROM_PATCH pPatch:
+ * 			Pointer to the patch structure to initialize.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Sets EINVAL if the file is not a well-formed patch, or
+ * 	EBADMSG if a BPS patch fails its own CRC-32 check.
+ * 
+ */
+int openRomPatch (const char* pszFileName, PROM_PATCH pPatch) {
+	
+	if (pszFileName == NULL || pPatch == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memset(pPatch, 0, sizeof(ROM_PATCH));
+	if ((pPatch->fd = open(pszFileName, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+	
+	struct stat st;
+	if (fstat(pPatch->fd, &st)) goto fail;
+	if (!S_ISREG(st.st_mode) || st.st_size < 8) {
+		errno = EINVAL;
+		goto fail;
+	}
+	
+	pPatch->cbData = (size_t)st.st_size;
+	void* pMap = mmap(NULL, pPatch->cbData, PROT_READ, MAP_PRIVATE, pPatch->fd, 0);
+	if (pMap == MAP_FAILED) goto fail;
+	pPatch->pData = pMap;
+	
+	// Records are read once, front to back.
+	madvise(pMap, pPatch->cbData, MADV_SEQUENTIAL);
+	
+	if (memcmp(pPatch->pData, "PATCH", 5) == 0) {
+		pPatch->uFormat = PATCHFMT_IPS;
+		if (scanIpsRecords(pPatch)) goto fail;
+	} else if (memcmp(pPatch->pData, "BPS1", 4) == 0) {
+		pPatch->uFormat = PATCHFMT_BPS;
+		if (scanBpsHeader(pPatch)) goto fail;
+	} else {
+		errno = EINVAL;
+		goto fail;
+	}
+	
+	return 0;
+	
+fail:
+	{
+		int nErr = errno;
+		closeRomPatch(pPatch);
+		errno = nErr;
+	}
+	return -1;
+	
+}
+
+void closeRomPatch (PROM_PATCH pPatch) {
+	
+	if (pPatch == NULL) return;
+	if (pPatch->pData != NULL) munmap((void*)pPatch->pData, pPatch->cbData);
+	if (pPatch->fd >= 0) close(pPatch->fd);
+	
+	memset(pPatch, 0, sizeof(ROM_PATCH));
+	pPatch->fd = -1;
+	
+}
+
+const char* getRomPatchFormatStr (const unsigned int uFormat) {
+	
+	if (uFormat > PATCHFMT_BPS) return "unknown";
+	return s_pszPatchFormats[uFormat];
+	
+}
+
+/*
+ * 
+ * name: getRomPatchTarget
+ * 
+ * 		Works out the size of the patched ROM.
+ * 
+ * @param:
+ * 		const PROM_PATCH pPatch:
+ * 			Pointer to the open patch.
+ * 
+ * 		const size_t cbSource:
+ * 			Size of the ROM the patch is applied to.
+ * 
+ * 		size_t* pcbTarget:
+ * 			Receives the size of the patched ROM.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno to EINVAL and returns
+ * 	nonzero if a BPS patch was made for a ROM of another size, or the
+ * 	patched ROM would be too small to hold a header.
+ * 
+ */
+int getRomPatchTarget (const PROM_PATCH pPatch, const size_t cbSource, size_t* pcbTarget) {
+	
+	size_t cbTarget;
+	
+	if (pPatch->uFormat == PATCHFMT_BPS) {
+		if (pPatch->cbSource != cbSource) {
+			errno = EINVAL;
+			return -1;
+		}
+		cbTarget = pPatch->cbTarget;
+	} else if (pPatch->fIpsTrunc) {
+		cbTarget = pPatch->cbTarget;
+	} else {
+		cbTarget = (pPatch->cbIpsEnd > cbSource) ? pPatch->cbIpsEnd : cbSource;
+	}
+	
+	if (cbTarget < GBHEAD_ROMMIN) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	*pcbTarget = cbTarget;
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: checkRomPatchSource
+ * 
+ * 		Checks that a ROM is the one a BPS patch was made for. IPS
+ * 	patches carry nothing to check against, so any ROM passes.
+ * 
+ * @param:
+ * 		const PROM_PATCH pPatch:
+ * 			Pointer to the open patch.
+ * 
+ * 		const uint8_t* pSource:
+ * 			Pointer to the ROM image.
+ * 
+ * 		const size_t cbSource:
+ * 			Size of the ROM image in bytes.
+ * 
+ * 		uint32_t* puCrc32:
+ * 			Receives the CRC-32 of the ROM, if it was computed.
+ * 
+ * @return: int
+ * 		Returns zero if the patch applies, or sets errno to EBADMSG and
+ * 	returns nonzero if the CRC-32 of the ROM differs from the one the
+ * 	patch expects.
+ * 
+ */
+int checkRomPatchSource (const PROM_PATCH pPatch, const uint8_t* pSource, const size_t cbSource, uint32_t* puCrc32) {
+	
+	if (pPatch->uFormat != PATCHFMT_BPS) return 0;
+	
+	ROM_HASHES rh;
+	if (hashRomImage(pSource, cbSource, HASHF_CRC32, &rh)) return -1;
+	if (puCrc32 != NULL) *puCrc32 = rh.uCrc32;
+	
+	if (rh.uCrc32 != pPatch->uSourceCrc) {
+		errno = EBADMSG;
+		return -1;
+	}
+	return 0;
+	
+}
+
+// Sum of the bytes of target range [iOffset, iOffset + cbData) that the
+// global checksum covers, taken from pData.
+static inline uint64_t sumChksumBytes (const uint8_t* pData, const size_t iOffset, const size_t cbData) {
+	
+	uint64_t uSum = sumBytes(pData, cbData);
+	for (size_t iByte = PATCH_CHKSUMOFS; iByte < PATCH_CHKSUMOFS + 2; iByte++)
+		if (iByte >= iOffset && iByte < iOffset + cbData) uSum -= pData[iByte - iOffset];
+	return uSum;
+	
+}
+
+// Writes the IPS records over the copy of the source in pTarget. Every
+// record adds the difference between its bytes and the ones it replaces
+// to the checksum, so only the patched ranges are read.
+static int applyIpsRecords (const PROM_PATCH pPatch, const uint8_t* pSource, const size_t cbSource,
+	uint8_t* pTarget, const size_t cbTarget, uint16_t* puGlobalChksum) {
+	
+	uint16_t uChksum = *puGlobalChksum;
+	
+	// Source bytes cut off by a truncation leave the sum first.
+	if (cbTarget < cbSource) uChksum -= (uint16_t)sumChksumBytes(pSource + cbTarget, cbTarget, cbSource - cbTarget);
+	
+	const uint8_t* p = pPatch->pRecords;
+	while (p < pPatch->pEnd) {
+		
+		size_t iOffset = getBe24(p);
+		size_t cbRecord = ((size_t)p[3] << 8) | p[4];
+		const uint8_t* pBytes = p + 5;
+		int fRun = (cbRecord == 0);
+		
+		if (fRun) {
+			cbRecord = ((size_t)pBytes[0] << 8) | pBytes[1];
+			p = pBytes + 3;
+		} else {
+			p = pBytes + cbRecord;
+		}
+		
+		// Records past a truncation are dropped.
+		if (iOffset >= cbTarget) continue;
+		if (cbRecord > cbTarget - iOffset) cbRecord = cbTarget - iOffset;
+		
+		uChksum -= (uint16_t)sumChksumBytes(pTarget + iOffset, iOffset, cbRecord);
+		if (fRun) memset(pTarget + iOffset, pBytes[2], cbRecord);
+		else memcpy(pTarget + iOffset, pBytes, cbRecord);
+		uChksum += (uint16_t)sumChksumBytes(pTarget + iOffset, iOffset, cbRecord);
+		
+	}
+	
+	*puGlobalChksum = uChksum;
+	return 0;
+	
+}
+
+// Builds the BPS target from its actions, then checks its CRC-32. The
+// same pass yields the byte sum, so the checksum comes out exact.
+static int applyBpsActions (const PROM_PATCH pPatch, const uint8_t* pSource, const size_t cbSource,
+	uint8_t* pTarget, const size_t cbTarget, uint16_t* puGlobalChksum) {
+	
+	const uint8_t* p = pPatch->pRecords;
+	size_t iOut = 0, iSourceRel = 0, iTargetRel = 0;
+	
+	while (p < pPatch->pEnd) {
+		
+		size_t nCmd, nRel;
+		if (readVarint(&p, pPatch->pEnd, &nCmd)) return -1;
+		size_t cbAction = (nCmd >> 2) + 1;
+		if (cbAction > cbTarget - iOut) goto bad;
+		
+		switch (nCmd & 3) {
+		case 0:
+			// SourceRead: same offset in the source.
+			if (iOut + cbAction > cbSource) goto bad;
+			memcpy(pTarget + iOut, pSource + iOut, cbAction);
+			break;
+			
+		case 1:
+			// TargetRead: bytes stored in the patch.
+			if ((size_t)(pPatch->pEnd - p) < cbAction) goto bad;
+			memcpy(pTarget + iOut, p, cbAction);
+			p += cbAction;
+			break;
+			
+		case 2:
+			// SourceCopy: anywhere in the source.
+			if (readVarint(&p, pPatch->pEnd, &nRel)) return -1;
+			if (nRel & 1) {
+				if ((nRel >> 1) > iSourceRel) goto bad;
+				iSourceRel -= nRel >> 1;
+			} else {
+				iSourceRel += nRel >> 1;
+			}
+			if (iSourceRel > cbSource || cbAction > cbSource - iSourceRel) goto bad;
+			memcpy(pTarget + iOut, pSource + iSourceRel, cbAction);
+			iSourceRel += cbAction;
+			break;
+			
+		case 3:
+			// TargetCopy: earlier output, which may overlap the bytes
+			// being written, so copy a byte at a time.
+			if (readVarint(&p, pPatch->pEnd, &nRel)) return -1;
+			if (nRel & 1) {
+				if ((nRel >> 1) > iTargetRel) goto bad;
+				iTargetRel -= nRel >> 1;
+			} else {
+				iTargetRel += nRel >> 1;
+			}
+			if (iTargetRel >= iOut) goto bad;
+			for (size_t iByte = 0; iByte < cbAction; iByte++) pTarget[iOut + iByte] = pTarget[iTargetRel + iByte];
+			iTargetRel += cbAction;
+			break;
+		}
+		iOut += cbAction;
+		
+	}
+	
+	ROM_HASHES rh;
+	if (iOut != cbTarget) goto bad;
+	if (hashRomImage(pTarget, cbTarget, HASHF_CRC32, &rh)) return -1;
+	if (rh.uCrc32 != pPatch->uTargetCrc) {
+		errno = EBADMSG;
+		return -1;
+	}
+	
+	*puGlobalChksum = (uint16_t)(rh.uSum - pTarget[PATCH_CHKSUMOFS] - pTarget[PATCH_CHKSUMOFS + 1]);
+	return 0;
+	
+bad:
+	errno = EINVAL;
+	return -1;
+	
+}
+
+/*
+ * 
+ * name: applyRomPatch
+ * 
+ * 		Applies a patch, writing the patched ROM to pTarget. For an IPS
+ * 	patch, pTarget must already hold a copy of the source, zero filled
+ * 	past its end; only the patched ranges are then read and written.
+ * 	For a BPS patch, the target is built from the actions alone.
+ * 
+ * @param:
+ * 		const PROM_PATCH pPatch:
+ * 			Pointer to the open patch.
+ * 
+ * 		const uint8_t* pSource:
+ * 			Pointer to the source ROM image.
+ * 
+ * 		const size_t cbSource:
+ * 			Size of the source image in bytes.
+ * 
+ * 		uint8_t* pTarget:
+ * 			Pointer to the target image, see getRomPatchTarget().
+ * 
+ * 		const size_t cbTarget:
+ * 			Size of the target image in bytes.
+ * 
+ * 		uint16_t* puGlobalChksum:
+ * 			On entry, the correct global checksum of the source; on
+ * 		return, that of the target. IPS patches adjust it by the byte
+ * 		differences of each record. BPS patches compute it exactly
+ * 		while checking the target CRC-32.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Sets EINVAL if the patch does not fit the source, or
+ * 	EBADMSG if the patched ROM fails the target CRC-32 check.
+ * 
+ */
+int applyRomPatch (const PROM_PATCH pPatch, const uint8_t* pSource, const size_t cbSource,
+	uint8_t* pTarget, const size_t cbTarget, uint16_t* puGlobalChksum) {
+	
+	if (pPatch == NULL || pSource == NULL || pTarget == NULL || puGlobalChksum == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (pPatch->uFormat == PATCHFMT_BPS)
+		return applyBpsActions(pPatch, pSource, cbSource, pTarget, cbTarget, puGlobalChksum);
+	return applyIpsRecords(pPatch, pSource, cbSource, pTarget, cbTarget, puGlobalChksum);
+	
+}
+
+// EOF
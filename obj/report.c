@@ -0,0 +1,574 @@
+/*
+ * obj/report.c
+ * 
+ * GBFix - Machine-Readable Report Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/hdrcheck.h"
+#include "../inc/report.h"
+
+// Fields of the text formats, in output order.
+enum {
+	RF_FILE,
+	RF_ERROR,
+	RF_FORMAT,
+	RF_ENTRYPOINT,
+	RF_LOGOOK,
+	RF_LOGODIFF,
+	RF_TITLE,
+	RF_MANUFACTURER,
+	RF_CGBFLAG,
+	RF_NEWLICENSEE,
+	RF_SGBFLAG,
+	RF_CARTTYPE,
+	RF_ROMSIZE,
+	RF_ROMKB,
+	RF_RAMSIZE,
+	RF_REGION,
+	RF_OLDLICENSEE,
+	RF_ROMVERSION,
+	RF_HDRCHKSUM,
+	RF_HDRCHKSUMOK,
+	RF_HDRCHKSUMCORRECT,
+	RF_GLOBALCHKSUM,
+	RF_GLOBALCHKSUMOK,
+	RF_GLOBALCHKSUMCORRECT,
+	RF_FILESIZE,
+	RF_FINDINGS,
+	RF_FATAL,
+	RF_UPDATED,
+	RF_CRC32,
+	RF_MD5,
+	RF_SHA1,
+	RF_COUNT
+};
+
+static const char* const s_pszFields[RF_COUNT] = {
+	"file", "error", "format", "entry_point", "logo_ok", "logo_diff",
+	"title", "manufacturer", "cgb_flag", "new_licensee", "sgb_flag",
+	"cart_type", "rom_size", "rom_kb", "ram_size", "region",
+	"old_licensee", "rom_version", "hdr_chksum", "hdr_chksum_ok",
+	"hdr_chksum_correct", "global_chksum", "global_chksum_ok",
+	"global_chksum_correct", "file_size", "findings", "fatal", "updated",
+	"crc32", "md5", "sha1"
+};
+
+static const char s_szHexDigits[] = "0123456789ABCDEF";
+
+/*
+ * 
+ * name: getReportFormat
+ * 
+ * 		Looks up an output format by name.
+ * 
+ * @param:
+ * 		const char* pszFormat:
+ * 			"text", "jsonl", "csv" or "bin".
+ * 
+ * 		unsigned int* puFormat:
+ * 			Receives the OUTFMT_* code.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno to EINVAL if the
+ * 	format is unknown.
+ * 
+ */
+int getReportFormat (const char* pszFormat, unsigned int* puFormat) {
+	
+	static const char* const pszNames[] = { "text", "jsonl", "csv", "bin" };
+	
+	if (pszFormat == NULL || puFormat == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	for (unsigned int uFormat = 0; uFormat < sizeof(pszNames) / sizeof(pszNames[0]); uFormat++) {
+		if (strcmp(pszFormat, pszNames[uFormat]) == 0) {
+			*puFormat = uFormat;
+			return 0;
+		}
+	}
+	
+	errno = EINVAL;
+	return -1;
+	
+}
+
+/*
+ * 
+ * name: flushReport
+ * 
+ * 		Writes out everything buffered so far.
+ * 
+ * @param:
+ * 		PREPORT pr:
+ * 			Pointer to the open report.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno on error. After
+ * 	an error further output is discarded.
+ * 
+ */
+int flushReport (PREPORT pr) {
+	
+	size_t cbDone = 0;
+	
+	while (cbDone < pr->cbUsed && pr->nErr == 0) {
+		ssize_t cbWritten = write(pr->fd, pr->pBuf + cbDone, pr->cbUsed - cbDone);
+		if (cbWritten < 0) {
+			if (errno == EINTR) continue;
+			pr->nErr = errno;
+			break;
+		}
+		cbDone += (size_t)cbWritten;
+	}
+	pr->cbUsed = 0;
+	
+	if (pr->nErr) {
+		errno = pr->nErr;
+		return -1;
+	}
+	return 0;
+	
+}
+
+static inline void putBytes (PREPORT pr, const void* pData, size_t cbData) {
+	
+	const char* pSrc = (const char*)pData;
+	
+	while (cbData > 0) {
+		if (pr->cbUsed == REPORT_BUFSIZE) flushReport(pr);
+		
+		size_t cbCopy = REPORT_BUFSIZE - pr->cbUsed;
+		if (cbCopy > cbData) cbCopy = cbData;
+		memcpy(pr->pBuf + pr->cbUsed, pSrc, cbCopy);
+		pr->cbUsed += cbCopy;
+		pSrc += cbCopy;
+		cbData -= cbCopy;
+	}
+	
+}
+
+static inline void putChar (PREPORT pr, const char ch) {
+	
+	if (pr->cbUsed == REPORT_BUFSIZE) flushReport(pr);
+	pr->pBuf[pr->cbUsed++] = ch;
+	
+}
+
+static inline void putStr (PREPORT pr, const char* psz) {
+	
+	putBytes(pr, psz, strlen(psz));
+	
+}
+
+static void putUint (PREPORT pr, uint64_t uValue) {
+	
+	char szDigits[20];
+	size_t iDigit = sizeof(szDigits);
+	
+	do {
+		szDigits[--iDigit] = (char)('0' + uValue % 10);
+		uValue /= 10;
+	} while (uValue);
+	
+	putBytes(pr, szDigits + iDigit, sizeof(szDigits) - iDigit);
+	
+}
+
+static void putHex (PREPORT pr, const uint8_t* pData, size_t cbData) {
+	
+	for (size_t iByte = 0; iByte < cbData; iByte++) {
+		putChar(pr, s_szHexDigits[pData[iByte] >> 4]);
+		putChar(pr, s_szHexDigits[pData[iByte] & 0x0F]);
+	}
+	
+}
+
+// Write a quoted string of at most cchMax bytes, stopping at a NUL.
+// Header text is taken as Latin-1, file names are passed through.
+static void putQuoted (PREPORT pr, const char* pStr, size_t cchMax, const int fLatin1) {
+	
+	putChar(pr, '"');
+	
+	for (size_t iChar = 0; iChar < cchMax && pStr[iChar]; iChar++) {
+		uint8_t ch = (uint8_t)pStr[iChar];
+		
+		if (pr->uFormat == OUTFMT_CSV) {
+			if (ch == '"') putChar(pr, '"');
+			if (ch < 0x20 || ch == 0x7F) ch = '?';
+		} else if (ch == '"' || ch == '\\') {
+			putChar(pr, '\\');
+		} else if (ch < 0x20 || ch == 0x7F || (fLatin1 && ch >= 0x80)) {
+			putStr(pr, "\\u00");
+			putHex(pr, &ch, 1);
+			continue;
+		}
+		
+		if (fLatin1 && ch >= 0x80) {
+			putChar(pr, (char)(0xC0 | (ch >> 6)));
+			ch = 0x80 | (ch & 0x3F);
+		}
+		putChar(pr, (char)ch);
+	}
+	
+	putChar(pr, '"');
+	
+}
+
+// Start field nField of a text record.
+static inline void putField (PREPORT pr, const unsigned int nField) {
+	
+	if (pr->uFormat == OUTFMT_JSONL) {
+		putStr(pr, (nField == 0) ? "{\"" : ",\"");
+		putStr(pr, s_pszFields[nField]);
+		putStr(pr, "\":");
+	} else if (nField != 0) {
+		putChar(pr, ',');
+	}
+	
+}
+
+static inline void putNull (PREPORT pr) {
+	
+	if (pr->uFormat == OUTFMT_JSONL) putStr(pr, "null");
+	
+}
+
+static inline void putBool (PREPORT pr, const int fValue) {
+	
+	if (pr->uFormat == OUTFMT_JSONL) putStr(pr, fValue ? "true" : "false");
+	else putChar(pr, fValue ? '1' : '0');
+	
+}
+
+static void writeTextRecord (PREPORT pr, const PREPORT_REC prr) {
+	
+	const PGBHEAD pHdr = (const PGBHEAD)prr->pHdr;
+	
+	putField(pr, RF_FILE);
+	putQuoted(pr, prr->pszFileName, SIZE_MAX, 0);
+	
+	putField(pr, RF_ERROR);
+	if (pHdr == NULL) {
+		const char* pszErr = strerror(prr->nErr);
+		putQuoted(pr, pszErr, strlen(pszErr), 0);
+		for (unsigned int nField = RF_ERROR + 1; nField < RF_COUNT; nField++) {
+			putField(pr, nField);
+			putNull(pr);
+		}
+		putStr(pr, (pr->uFormat == OUTFMT_JSONL) ? "}\n" : "\n");
+		return;
+	}
+	putNull(pr);
+	
+	unsigned int uHdrRev = getHdrRev(pHdr);
+	uint64_t uLogoDiff = cmpGbLogo(pHdr);
+	uint64_t uFindings = 0;
+	uint8_t uHdrChksum = mkGbHdrChksum(pHdr);
+	checkGbHeader(pHdr, prr->cbFile, &uFindings);
+	
+	putField(pr, RF_FORMAT);
+	putQuoted(pr, getHdrRevStr(uHdrRev), 3, 0);
+	
+	putField(pr, RF_ENTRYPOINT);
+	putChar(pr, '"');
+	putHex(pr, pHdr->uEntryPoint, sizeof(pHdr->uEntryPoint));
+	putChar(pr, '"');
+	
+	putField(pr, RF_LOGOOK);
+	putBool(pr, uLogoDiff == 0);
+	putField(pr, RF_LOGODIFF);
+	putUint(pr, uLogoDiff);
+	
+	// Titles are laid out as in printRomInfo().
+	putField(pr, RF_TITLE);
+	if (uHdrRev == HDRREV_CGB) {
+		putQuoted(pr, pHdr->htTitle.newTitle.strTitle, sizeof(pHdr->htTitle.newTitle.strTitle), 1);
+		putField(pr, RF_MANUFACTURER);
+		putQuoted(pr, pHdr->htTitle.newTitle.strManufacturer, sizeof(pHdr->htTitle.newTitle.strManufacturer), 1);
+		putField(pr, RF_CGBFLAG);
+		putUint(pr, pHdr->htTitle.newTitle.uCgbFlag);
+	} else {
+		putQuoted(pr, pHdr->htTitle.oldTitle.strTitle, sizeof(pHdr->htTitle.oldTitle.strTitle), 1);
+		putField(pr, RF_MANUFACTURER);
+		putNull(pr);
+		putField(pr, RF_CGBFLAG);
+		putNull(pr);
+	}
+	
+	putField(pr, RF_NEWLICENSEE);
+	putQuoted(pr, (const char*)pHdr->uLicensee, sizeof(pHdr->uLicensee), 1);
+	putField(pr, RF_SGBFLAG);
+	putUint(pr, pHdr->uSgbFlag);
+	putField(pr, RF_CARTTYPE);
+	putUint(pr, pHdr->uCartType);
+	putField(pr, RF_ROMSIZE);
+	putUint(pr, pHdr->uRomSize);
+	putField(pr, RF_ROMKB);
+	if (pHdr->uRomSize <= ROMSIZE_MAX) putUint(pr, (uint64_t)getRomSizeInkB(pHdr));
+	else putNull(pr);
+	putField(pr, RF_RAMSIZE);
+	putUint(pr, pHdr->uRamSize);
+	putField(pr, RF_REGION);
+	putUint(pr, pHdr->uRegion);
+	putField(pr, RF_OLDLICENSEE);
+	putUint(pr, pHdr->uOldLicensee);
+	putField(pr, RF_ROMVERSION);
+	putUint(pr, pHdr->uRomVer);
+	
+	putField(pr, RF_HDRCHKSUM);
+	putUint(pr, pHdr->uHdrChksum);
+	putField(pr, RF_HDRCHKSUMOK);
+	putBool(pr, pHdr->uHdrChksum == uHdrChksum);
+	putField(pr, RF_HDRCHKSUMCORRECT);
+	putUint(pr, uHdrChksum);
+	
+	putField(pr, RF_GLOBALCHKSUM);
+	putUint(pr, correctGlobalChksum(pHdr));
+	putField(pr, RF_GLOBALCHKSUMOK);
+	if (prr->fGlobalKnown) putBool(pr, correctGlobalChksum(pHdr) == prr->uGlobalChksum);
+	else putNull(pr);
+	putField(pr, RF_GLOBALCHKSUMCORRECT);
+	if (prr->fGlobalKnown) putUint(pr, prr->uGlobalChksum);
+	else putNull(pr);
+	
+	putField(pr, RF_FILESIZE);
+	if (prr->cbFile) putUint(pr, prr->cbFile);
+	else putNull(pr);
+	
+	putField(pr, RF_FINDINGS);
+	const char* pszSep = "";
+	if (pr->uFormat == OUTFMT_JSONL) putChar(pr, '[');
+	for (unsigned int nBit = 0; nBit < HCB_COUNT; nBit++) {
+		if (!(uFindings & HCF(nBit))) continue;
+		putStr(pr, pszSep);
+		if (pr->uFormat == OUTFMT_JSONL) {
+			putQuoted(pr, getHdrCheckName(nBit), SIZE_MAX, 0);
+			pszSep = ",";
+		} else {
+			putStr(pr, getHdrCheckName(nBit));
+			pszSep = "|";
+		}
+	}
+	if (pr->uFormat == OUTFMT_JSONL) putChar(pr, ']');
+	
+	putField(pr, RF_FATAL);
+	putBool(pr, (uFindings & HCF_FATAL) != 0);
+	putField(pr, RF_UPDATED);
+	putBool(pr, prr->fUpdated);
+	
+	// Hashes are strings, as DAT files and the *sum tools write them.
+	for (unsigned int nField = RF_CRC32; nField <= RF_SHA1; nField++) {
+		char szHash[HASH_STRMAX];
+		putField(pr, nField);
+		if (prr->pHashes != NULL && getRomHashStr((const PROM_HASHES)prr->pHashes, 1U << (nField - RF_CRC32), szHash) != NULL)
+			putQuoted(pr, szHash, sizeof(szHash), 0);
+		else putNull(pr);
+	}
+	
+	putStr(pr, (pr->uFormat == OUTFMT_JSONL) ? "}\n" : "\n");
+	
+}
+
+static void writeBinRecord (PREPORT pr, const PREPORT_REC prr) {
+	
+	REPORT_BINREC rbr;
+	size_t cchName = strlen(prr->pszFileName);
+	
+	memset(&rbr, 0, sizeof(REPORT_BINREC));
+	if (cchName > UINT16_MAX) cchName = UINT16_MAX;
+	rbr.cchName = (uint16_t)cchName;
+	
+	if (prr->pHdr == NULL) {
+		rbr.uFlags = RBF_ERROR;
+		rbr.nErr = prr->nErr;
+	} else {
+		const PGBHEAD pHdr = (const PGBHEAD)prr->pHdr;
+		uint64_t uFindings = 0;
+		
+		checkGbHeader(pHdr, prr->cbFile, &uFindings);
+		memcpy(&rbr.hdr, pHdr, sizeof(GBHEAD));
+		rbr.cbFile = prr->cbFile;
+		rbr.uFindings = uFindings;
+		rbr.uLogoDiff = cmpGbLogo(pHdr);
+		rbr.uHdrChksum = mkGbHdrChksum(pHdr);
+		rbr.uHdrRev = (uint8_t)getHdrRev(pHdr);
+		
+		if (pHdr->uHdrChksum == rbr.uHdrChksum) rbr.uFlags |= RBF_HDROK;
+		if (prr->cbFile) rbr.uFlags |= RBF_SIZEKNOWN;
+		if (prr->fUpdated) rbr.uFlags |= RBF_UPDATED;
+		if (prr->fGlobalKnown) {
+			rbr.uFlags |= RBF_GLOBALKNOWN;
+			rbr.uGlobalChksum = prr->uGlobalChksum;
+			if (correctGlobalChksum(pHdr) == prr->uGlobalChksum) rbr.uFlags |= RBF_GLOBALOK;
+		}
+		
+		const ROM_HASHES* pHashes = prr->pHashes;
+		if (pHashes != NULL && (pHashes->uHashes & HASHF_CRC32)) {
+			rbr.uFlags |= RBF_CRC32;
+			rbr.uCrc32 = pHashes->uCrc32;
+		}
+		if (pHashes != NULL && (pHashes->uHashes & HASHF_MD5)) {
+			rbr.uFlags |= RBF_MD5;
+			memcpy(rbr.uMd5, pHashes->uMd5, sizeof(rbr.uMd5));
+		}
+		if (pHashes != NULL && (pHashes->uHashes & HASHF_SHA1)) {
+			rbr.uFlags |= RBF_SHA1;
+			memcpy(rbr.uSha1, pHashes->uSha1, sizeof(rbr.uSha1));
+		}
+	}
+	
+	putBytes(pr, &rbr, sizeof(REPORT_BINREC));
+	putBytes(pr, prr->pszFileName, cchName);
+	
+}
+
+/*
+ * 
+ * name: openReport
+ * 
+ * 		Opens a report and writes its preamble: the column names for
+ * 	CSV, the file header for the binary format.
+ * 
+ * @param:
+ * 		PREPORT pr:
+ * 			Pointer to the report to open.
+ * 
+ * 		const int fd:
+ * 			Descriptor to write to.
+ * 
+ * 		const unsigned int uFormat:
+ * 			OUTFMT_* code, other than OUTFMT_TEXT.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno on error.
+ * 
+ */
+int openReport (PREPORT pr, const int fd, const unsigned int uFormat) {
+	
+	if (pr == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (uFormat == OUTFMT_TEXT || uFormat > OUTFMT_BIN) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	memset(pr, 0, sizeof(REPORT));
+	pr->fd = fd;
+	pr->uFormat = uFormat;
+	if ((pr->pBuf = malloc(REPORT_BUFSIZE)) == NULL) return -1;
+	
+	if (uFormat == OUTFMT_CSV) {
+		for (unsigned int nField = 0; nField < RF_COUNT; nField++) {
+			if (nField) putChar(pr, ',');
+			putStr(pr, s_pszFields[nField]);
+		}
+		putChar(pr, '\n');
+	} else if (uFormat == OUTFMT_BIN) {
+		REPORT_BINHEAD rbh;
+		rbh.uMagic = REPORT_BINMAGIC;
+		rbh.uVersion = REPORT_BINVERSION;
+		rbh.cbRecord = sizeof(REPORT_BINREC);
+		putBytes(pr, &rbh, sizeof(REPORT_BINHEAD));
+	}
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: writeReport
+ * 
+ * 		Adds the record of one file to the report.
+ * 
+ * @param:
+ * 		PREPORT pr:
+ * 			Pointer to the open report.
+ * 
+ * 		const PREPORT_REC prr:
+ * 			Pointer to what is known about the file.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno if output could
+ * 	not be written.
+ * 
+ */
+int writeReport (PREPORT pr, const PREPORT_REC prr) {
+	
+	if (pr == NULL || pr->pBuf == NULL || prr == NULL || prr->pszFileName == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (pr->uFormat == OUTFMT_BIN) writeBinRecord(pr, prr);
+	else writeTextRecord(pr, prr);
+	
+	if (pr->nErr) {
+		errno = pr->nErr;
+		return -1;
+	}
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: closeReport
+ * 
+ * 		Writes out the rest of the report and frees its buffer.
+ * 
+ * @param:
+ * 		PREPORT pr:
+ * 			Pointer to the open report.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno if any output
+ * 	could not be written.
+ * 
+ */
+int closeReport (PREPORT pr) {
+	
+	if (pr == NULL || pr->pBuf == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	int nRet = flushReport(pr);
+	free(pr->pBuf);
+	pr->pBuf = NULL;
+	
+	return nRet;
+	
+}
+
+// EOF
@@ -0,0 +1,593 @@
+/*
+ * obj/romfile.c
+ * 
+ * GBFix - Mapped ROM File Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// copy_file_range(), memfd_create() and mkostemp() are GNU extensions.
+#define _GNU_SOURCE
+
+// Include used C header(s):
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/romfile.h"
+
+/*
+ * 
+ * name: openRomFile
+ * 
+ * 		Opens a ROM file and maps the whole image into memory. The
+ * 	header, the global checksum scan and any later patching all go
+ * 	through this one mapping.
+ * 
+ * @param:
+ * 		const char* pszFileName:
+ * 			Name of the file to open.
+ * 
+ * 		PROM_FILE prf:
+ * 			Pointer to the ROM file structure to initialize.
+ * 
+ * 		const unsigned long int uFlags:
+ * 			RFF_WRITE to map the file shared and writable, or zero for
+ * 		a read-only mapping.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Sets EINVAL if the file is too small to hold a header.
+ * 
+ */
+int openRomFile (const char* pszFileName, PROM_FILE prf, const unsigned long int uFlags) {
+	
+	if (pszFileName == NULL || prf == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memset(prf, 0, sizeof(ROM_FILE));
+	prf->fd = -1;
+	
+	// Open the file.
+	if ((prf->fd = open(pszFileName, ((uFlags & RFF_WRITE) ? O_RDWR : O_RDONLY) | O_CLOEXEC)) < 0)
+		return -1;
+	
+	// Get the image size.
+	struct stat st;
+	if (fstat(prf->fd, &st)) goto fail;
+	
+	if (!S_ISREG(st.st_mode) || st.st_size < GBHEAD_ROMMIN) {
+		errno = EINVAL;
+		goto fail;
+	}
+	prf->cbRom = (size_t)st.st_size;
+	
+	// Map the image.
+	int nProt = PROT_READ | ((uFlags & RFF_WRITE) ? PROT_WRITE : 0);
+	if ((prf->pRom = mmap(NULL, prf->cbRom, nProt, MAP_SHARED, prf->fd, 0)) == MAP_FAILED) {
+		prf->pRom = NULL;
+		goto fail;
+	}
+	
+	// The checksum pass reads the image front to back exactly once.
+	madvise(prf->pRom, prf->cbRom, MADV_SEQUENTIAL);
+	
+	prf->uFlags = uFlags & RFF_WRITE;
+	return 0;
+	
+fail:
+	{
+		int nErr = errno;
+		close(prf->fd);
+		prf->fd = -1;
+		errno = nErr;
+	}
+	return -1;
+	
+}
+
+/*
+ * 
+ * name: closeRomFile
+ * 
+ * 		Flushes any pending header changes, then unmaps and closes a ROM
+ * 	file.
+ * 
+ * @param:
+ * 		PROM_FILE prf:
+ * 			Pointer to the ROM file structure to close.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero if
+ * 	the flush failed. The file is closed either way.
+ * 
+ */
+int closeRomFile (PROM_FILE prf) {
+	
+	if (prf == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	int nRet = syncRomFile(prf);
+	int nErr = errno;
+	
+	if (prf->pRom != NULL) munmap(prf->pRom, prf->cbRom);
+	if (prf->fd >= 0) close(prf->fd);
+	
+	memset(prf, 0, sizeof(ROM_FILE));
+	prf->fd = -1;
+	
+	errno = nErr;
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: readRomHeader
+ * 
+ * 		Copies the header out of a mapped ROM file.
+ * 
+ * @param:
+ * 		const PROM_FILE prf:
+ * 			Pointer to the open ROM file.
+ * 
+ * 		PGBHEAD pHdr:
+ * 			Pointer to the header structure to read data into.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int readRomHeader (const PROM_FILE prf, PGBHEAD pHdr) {
+	
+	if (prf == NULL || pHdr == NULL || prf->pRom == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memcpy(pHdr, prf->pRom + GBHEAD_OFFSET, sizeof(GBHEAD));
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: writeRomHeader
+ * 
+ * 		Patches a header into a mapped ROM file in place. Nothing is
+ * 	written if the header is unchanged; otherwise the header page is
+ * 	marked dirty and flushed by syncRomFile() or closeRomFile().
+ * 
+ * @param:
+ * 		PROM_FILE prf:
+ * 			Pointer to the open ROM file.
+ * 
+ * 		const PGBHEAD pHdr:
+ * 			Pointer to the header structure to write.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Sets EBADF if the file was opened read-only.
+ * 
+ */
+int writeRomHeader (PROM_FILE prf, const PGBHEAD pHdr) {
+	
+	if (prf == NULL || pHdr == NULL || prf->pRom == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (!(prf->uFlags & RFF_WRITE)) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	if (memcmp(prf->pRom + GBHEAD_OFFSET, pHdr, sizeof(GBHEAD)) == 0) return 0;
+	
+	memcpy(prf->pRom + GBHEAD_OFFSET, pHdr, sizeof(GBHEAD));
+	prf->uFlags |= RFF_DIRTY;
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: syncRomFile
+ * 
+ * 		Flushes the header page of a mapped ROM file to disk if it was
+ * 	modified. The header sits entirely within the first page, so that
+ * 	is the only page ever written back.
+ * 
+ * @param:
+ * 		PROM_FILE prf:
+ * 			Pointer to the open ROM file.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int syncRomFile (PROM_FILE prf) {
+	
+	if (prf == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (!(prf->uFlags & RFF_DIRTY)) return 0;
+	
+	size_t cbPage = (size_t)sysconf(_SC_PAGESIZE);
+	if (cbPage > prf->cbRom) cbPage = prf->cbRom;
+	
+	if (msync(prf->pRom, cbPage, MS_SYNC)) return -1;
+	
+	prf->uFlags &= ~RFF_DIRTY;
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: resizeRomFile
+ * 
+ * 		Resizes a ROM file to cbNew bytes. A smaller size truncates the
+ * 	file. A larger size fills the new space with uFill: only the
+ * 	appended range is touched, its blocks are allocated in one go,
+ * 	which already leaves them zeroed, and any other fill is written
+ * 	from one large buffer. The mapping is not resized; after a
+ * 	truncation only the pages still inside the file may be touched,
+ * 	which always includes the header.
+ * 
+ * @param:
+ * 		PROM_FILE prf:
+ * 			Pointer to the open ROM file.
+ * 
+ * 		const size_t cbNew:
+ * 			New size of the file in bytes.
+ * 
+ * 		const uint8_t uFill:
+ * 			Value of the appended bytes, if any.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Sets EBADF if the file was opened read-only, or EINVAL if
+ * 	cbNew would cut into the header.
+ * 
+ */
+int resizeRomFile (PROM_FILE prf, const size_t cbNew, const uint8_t uFill) {
+	
+	if (prf == NULL || prf->fd < 0) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (!(prf->uFlags & RFF_WRITE)) {
+		errno = EBADF;
+		return -1;
+	}
+	
+	struct stat st;
+	if (fstat(prf->fd, &st)) return -1;
+	
+	size_t cbOld = (size_t)st.st_size;
+	if (cbNew < GBHEAD_OFFSET + sizeof(GBHEAD)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (cbNew == cbOld) return 0;
+	if (cbNew < cbOld) return ftruncate(prf->fd, (off_t)cbNew);
+	
+	// Allocating up front also reports a full disk before anything is
+	// written, and keeps the new range in one extent where possible.
+	size_t cbPad = cbNew - cbOld;
+	int nErr = posix_fallocate(prf->fd, (off_t)cbOld, (off_t)cbPad);
+	if (nErr) {
+		errno = nErr;
+		return -1;
+	}
+	if (uFill == 0) return 0;
+	
+	return writeFill(prf->fd, (off_t)cbOld, cbPad, uFill);
+	
+}
+
+/*
+ * 
+ * name: createRomFile
+ * 
+ * 		Creates a new ROM file of cbRom bytes and maps it writable. If
+ * 	prfCopy is given, the start of its image is copied in first. The
+ * 	copy is a reflink sharing the original's blocks where the file
+ * 	system supports them, or else made by the kernel, so the data never
+ * 	passes through user space. The rest of the file reads as zero.
+ * 	Without a name the file only lives in memory, and nothing is written
+ * 	to disk.
+ * 
+ * @param:
+ * 		char* pszTemplate:
+ * 			Name of the file to create, ending in "XXXXXX", which is
+ * 			replaced to make the name unique as with mkstemp(), or
+ * 		NULL for an anonymous file in memory.
+ * 
+ * 		const size_t cbRom:
+ * 			Size of the new file in bytes.
+ * 
+ * 		const PROM_FILE prfCopy:
+ * 			Pointer to an open ROM file to copy from, or NULL.
+ * 
+ * 		PROM_FILE prf:
+ * 			Pointer to the ROM file structure to initialize.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. The file is removed again on error.
+ * 
+ */
+int createRomFile (char* pszTemplate, const size_t cbRom, const PROM_FILE prfCopy, PROM_FILE prf) {
+	
+	if (prf == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memset(prf, 0, sizeof(ROM_FILE));
+	prf->fd = (pszTemplate != NULL) ? mkostemp(pszTemplate, O_CLOEXEC) : memfd_create("gbfix", MFD_CLOEXEC);
+	if (prf->fd < 0) return -1;
+	
+	// Clone the whole file, or copy in the kernel until the file system
+	// refuses, then finish through the mappings. A clone larger than
+	// cbRom is cut to size below.
+	size_t cbCopy = 0, cbCopied = 0;
+	if (prfCopy != NULL) {
+		cbCopy = (prfCopy->cbRom < cbRom) ? prfCopy->cbRom : cbRom;
+		if (ioctl(prf->fd, FICLONE, prfCopy->fd) == 0) cbCopied = cbCopy;
+		
+		loff_t offIn = (loff_t)cbCopied, offOut = (loff_t)cbCopied;
+		while (cbCopied < cbCopy) {
+			ssize_t cbDone = copy_file_range(prfCopy->fd, &offIn, prf->fd, &offOut, cbCopy - cbCopied, 0);
+			if (cbDone <= 0) break;
+			cbCopied += (size_t)cbDone;
+		}
+	}
+	
+	if (ftruncate(prf->fd, (off_t)cbRom)) goto fail;
+	if ((prf->pRom = mmap(NULL, cbRom, PROT_READ | PROT_WRITE, MAP_SHARED, prf->fd, 0)) == MAP_FAILED) {
+		prf->pRom = NULL;
+		goto fail;
+	}
+	
+	if (cbCopied < cbCopy) memcpy(prf->pRom + cbCopied, prfCopy->pRom + cbCopied, cbCopy - cbCopied);
+	
+	prf->cbRom = cbRom;
+	prf->uFlags = RFF_WRITE;
+	errno = 0;
+	return 0;
+	
+fail:
+	{
+		int nErr = errno;
+		close(prf->fd);
+		if (pszTemplate != NULL) unlink(pszTemplate);
+		memset(prf, 0, sizeof(ROM_FILE));
+		prf->fd = -1;
+		errno = nErr;
+	}
+	return -1;
+	
+}
+
+/*
+ * 
+ * name: readFull
+ * 
+ * 		Reads from a descriptor until the buffer is full or the end of
+ * 	the input is reached, retrying short reads from pipes.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Descriptor to read from.
+ * 
+ * 		void* pBuf:
+ * 			Buffer to read into.
+ * 
+ * 		size_t cbBuf:
+ * 			Number of bytes to read.
+ * 
+ * @return: ssize_t
+ * 		Returns the number of bytes read, which is less than cbBuf only
+ * 	at the end of the input, or sets errno and returns -1 on error.
+ * 
+ */
+ssize_t readFull (int fd, void* pBuf, size_t cbBuf) {
+	
+	size_t cbDone = 0;
+	
+	while (cbDone < cbBuf) {
+		ssize_t cbRead = read(fd, (uint8_t*)pBuf + cbDone, cbBuf - cbDone);
+		if (cbRead < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (cbRead == 0) break;
+		cbDone += (size_t)cbRead;
+	}
+	
+	return (ssize_t)cbDone;
+	
+}
+
+/*
+ * 
+ * name: writeFull
+ * 
+ * 		Writes a whole buffer to a descriptor, retrying short writes.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Descriptor to write to.
+ * 
+ * 		const void* pBuf:
+ * 			Buffer to write.
+ * 
+ * 		size_t cbBuf:
+ * 			Number of bytes to write.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int writeFull (int fd, const void* pBuf, size_t cbBuf) {
+	
+	size_t cbDone = 0;
+	
+	while (cbDone < cbBuf) {
+		ssize_t cbWritten = write(fd, (const uint8_t*)pBuf + cbDone, cbBuf - cbDone);
+		if (cbWritten < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		cbDone += (size_t)cbWritten;
+	}
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: writeFill
+ * 
+ * 		Writes a run of one byte value at an offset of a descriptor,
+ * 	from a stack buffer of up to ROM_PADBUFSIZE bytes.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Descriptor to write to.
+ * 
+ * 		off_t off:
+ * 			Offset of the run.
+ * 
+ * 		size_t cb:
+ * 			Length of the run.
+ * 
+ * 		const uint8_t uFill:
+ * 			Byte value to write.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int writeFill (int fd, off_t off, size_t cb, const uint8_t uFill) {
+	
+	uint8_t uBuf[ROM_PADBUFSIZE];
+	size_t cbBuf = (cb < ROM_PADBUFSIZE) ? cb : ROM_PADBUFSIZE;
+	memset(uBuf, uFill, cbBuf);
+	
+	size_t cbDone = 0;
+	while (cbDone < cb) {
+		size_t cbChunk = (cb - cbDone < cbBuf) ? cb - cbDone : cbBuf;
+		ssize_t cbWritten = pwrite(fd, uBuf, cbChunk, off + (off_t)cbDone);
+		if (cbWritten < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		cbDone += (size_t)cbWritten;
+	}
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: copyFull
+ * 
+ * 		Copies the start of one file into another at an offset, inside
+ * 	the kernel so that the data never passes through user space. Uses
+ * 	copy_file_range(), which file systems may turn into a reflink, and
+ * 	falls back on sendfile() where it is refused, as between file
+ * 	systems on older kernels.
+ * 
+ * @param:
+ * 		int fdIn:
+ * 			Descriptor to copy from, starting at offset zero.
+ * 
+ * 		int fdOut:
+ * 			Descriptor to copy to.
+ * 
+ * 		off_t offOut:
+ * 			Offset to copy to.
+ * 
+ * 		size_t cb:
+ * 			Number of bytes to copy.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Copying past the end of fdIn fails with EIO.
+ * 
+ */
+int copyFull (int fdIn, int fdOut, off_t offOut, size_t cb) {
+	
+	loff_t offIn = 0, offTo = (loff_t)offOut;
+	size_t cbDone = 0;
+	
+	while (cbDone < cb) {
+		ssize_t cbCopied = copy_file_range(fdIn, &offIn, fdOut, &offTo, cb - cbDone, 0);
+		if (cbCopied < 0 && errno == EINTR) continue;
+		if (cbCopied <= 0) break;
+		cbDone += (size_t)cbCopied;
+	}
+	if (cbDone == cb) return 0;
+	
+	// sendfile() writes at the file position of fdOut.
+	if (lseek(fdOut, offOut + (off_t)cbDone, SEEK_SET) < 0) return -1;
+	off_t offFrom = (off_t)cbDone;
+	while (cbDone < cb) {
+		ssize_t cbSent = sendfile(fdOut, fdIn, &offFrom, cb - cbDone);
+		if (cbSent < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		if (cbSent == 0) {
+			errno = EIO;
+			return -1;
+		}
+		cbDone += (size_t)cbSent;
+	}
+	
+	return 0;
+	
+}
+
+// EOF
@@ -0,0 +1,746 @@
+/*
+ * obj/romhash.c
+ * 
+ * GBFix - Content Hash Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <errno.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define ROMHASH_X86
+	#include <immintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+	#define ROMHASH_ARMCRC
+	#include <arm_acle.h>
+#endif
+
+// Include module header(s):
+#include "../inc/chksum.h"
+#include "../inc/romhash.h"
+
+#define ROTL32(u, n) (((u) << (n)) | ((u) >> (32 - (n))))
+
+typedef uint32_t (*PFN_CRC32) (uint32_t uCrc, const uint8_t* pData, size_t cbData);
+typedef void (*PFN_SHA1BLOCKS) (uint32_t* puState, const uint8_t* pData, size_t nBlocks);
+
+static uint32_t crc32Scalar (uint32_t uCrc, const uint8_t* pData, size_t cbData);
+static void sha1BlocksScalar (uint32_t* puState, const uint8_t* pData, size_t nBlocks);
+#ifdef ROMHASH_X86
+static uint32_t crc32Pclmul (uint32_t uCrc, const uint8_t* pData, size_t cbData);
+static void sha1BlocksShaNi (uint32_t* puState, const uint8_t* pData, size_t nBlocks);
+#endif
+#ifdef ROMHASH_ARMCRC
+static uint32_t crc32Arm (uint32_t uCrc, const uint8_t* pData, size_t cbData);
+#endif
+
+// Slicing-by-8 tables of the reflected CRC-32 polynomial.
+static uint32_t s_uCrcTable[8][256];
+
+// Currently selected kernels. Resolved once before main() runs, so
+// every thread sees the same values without any locking.
+static PFN_CRC32 s_pfnCrc32 = crc32Scalar;
+static PFN_SHA1BLOCKS s_pfnSha1Blocks = sha1BlocksScalar;
+static const char* s_pszCrc32Impl = "scalar";
+static const char* s_pszSha1Impl = "scalar";
+
+__attribute__((constructor)) static void initRomHash (void) {
+	
+	for (uint32_t uByte = 0; uByte < 256; uByte++) {
+		uint32_t uCrc = uByte;
+		for (unsigned int iBit = 0; iBit < 8; iBit++) uCrc = (uCrc >> 1) ^ (0xEDB88320 & -(uCrc & 1));
+		s_uCrcTable[0][uByte] = uCrc;
+	}
+	
+	for (unsigned int iTable = 1; iTable < 8; iTable++)
+		for (unsigned int uByte = 0; uByte < 256; uByte++)
+			s_uCrcTable[iTable][uByte] = (s_uCrcTable[iTable - 1][uByte] >> 8) ^
+				s_uCrcTable[0][s_uCrcTable[iTable - 1][uByte] & 0xFF];
+	
+	selectRomHashImpl(HASHIMPL_AUTO);
+	
+}
+
+/*
+ * 
+ * name: getRomHashFlags
+ * 
+ * 		Parses a comma separated list of hash names.
+ * 
+ * @param:
+ * 		const char* pszHashes:
+ * 			Any of "crc32", "md5" and "sha1", or "all". NULL or an
+ * 		empty string also select all of them.
+ * 
+ * 		unsigned int* puHashes:
+ * 			Receives the HASHF_* flags.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno to EINVAL if a
+ * 	name is unknown.
+ * 
+ */
+int getRomHashFlags (const char* pszHashes, unsigned int* puHashes) {
+	
+	if (puHashes == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (pszHashes == NULL || *pszHashes == '\0') {
+		*puHashes = HASHF_MASK;
+		return 0;
+	}
+	
+	unsigned int uHashes = 0;
+	
+	while (*pszHashes) {
+		size_t cchName = strcspn(pszHashes, ",");
+		unsigned int uHash;
+		
+		for (uHash = HASHF_CRC32; uHash & HASHF_MASK; uHash <<= 1)
+			if (strlen(getRomHashName(uHash)) == cchName && strncmp(pszHashes, getRomHashName(uHash), cchName) == 0) break;
+		
+		if (uHash & HASHF_MASK) {
+			uHashes |= uHash;
+		} else if (cchName == 3 && strncmp(pszHashes, "all", 3) == 0) {
+			uHashes |= HASHF_MASK;
+		} else {
+			errno = EINVAL;
+			return -1;
+		}
+		
+		pszHashes += cchName;
+		if (*pszHashes == ',') pszHashes++;
+	}
+	
+	*puHashes = uHashes;
+	return 0;
+	
+}
+
+const char* getRomHashName (const unsigned int uHash) {
+	
+	switch (uHash) {
+	case HASHF_CRC32:
+		return "crc32";
+		
+	case HASHF_MD5:
+		return "md5";
+		
+	case HASHF_SHA1:
+		return "sha1";
+		
+	default:
+		return NULL;
+	}
+	
+}
+
+/*
+ * 
+ * name: getRomHashStr
+ * 
+ * 		Formats one hash as a lowercase hex string, the way DAT files
+ * 	and the *sum tools write them.
+ * 
+ * @param:
+ * 		const PROM_HASHES pHashes:
+ * 			Pointer to the hashes.
+ * 
+ * 		const unsigned int uHash:
+ * 			HASHF_* flag of the hash to format.
+ * 
+ * 		char* pszBuf:
+ * 			Buffer of at least HASH_STRMAX characters.
+ * 
+ * @return: char*
+ * 		Returns pszBuf, or NULL and sets errno to EINVAL if pHashes
+ * 	does not hold the hash.
+ * 
+ */
+char* getRomHashStr (const PROM_HASHES pHashes, const unsigned int uHash, char* pszBuf) {
+	
+	static const char szDigits[] = "0123456789abcdef";
+	
+	if (pHashes == NULL || pszBuf == NULL) {
+		errno = EFAULT;
+		return NULL;
+	}
+	
+	if (getRomHashName(uHash) == NULL || !(pHashes->uHashes & uHash)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	uint8_t uCrc[4];
+	const uint8_t* pDigest;
+	size_t cbDigest;
+	
+	if (uHash == HASHF_CRC32) {
+		for (unsigned int iByte = 0; iByte < 4; iByte++) uCrc[iByte] = (uint8_t)(pHashes->uCrc32 >> (24 - iByte * 8));
+		pDigest = uCrc;
+		cbDigest = sizeof(uCrc);
+	} else if (uHash == HASHF_MD5) {
+		pDigest = pHashes->uMd5;
+		cbDigest = sizeof(pHashes->uMd5);
+	} else {
+		pDigest = pHashes->uSha1;
+		cbDigest = sizeof(pHashes->uSha1);
+	}
+	
+	for (size_t iByte = 0; iByte < cbDigest; iByte++) {
+		pszBuf[iByte * 2] = szDigits[pDigest[iByte] >> 4];
+		pszBuf[iByte * 2 + 1] = szDigits[pDigest[iByte] & 0x0F];
+	}
+	pszBuf[cbDigest * 2] = '\0';
+	
+	return pszBuf;
+	
+}
+
+// ---------------------------------------------------------------------
+// Portable kernels.
+// ---------------------------------------------------------------------
+
+static inline uint32_t loadLe32 (const uint8_t* p) {
+	
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	
+}
+
+static inline uint32_t loadBe32 (const uint8_t* p) {
+	
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+	
+}
+
+// Updates the inverted CRC register eight bytes at a time.
+static uint32_t crc32Scalar (uint32_t uCrc, const uint8_t* pData, size_t cbData) {
+	
+	for (; cbData >= 8; pData += 8, cbData -= 8) {
+		uint32_t uLo = loadLe32(pData) ^ uCrc;
+		uint32_t uHi = loadLe32(pData + 4);
+		uCrc = s_uCrcTable[7][uLo & 0xFF] ^ s_uCrcTable[6][(uLo >> 8) & 0xFF] ^
+			s_uCrcTable[5][(uLo >> 16) & 0xFF] ^ s_uCrcTable[4][uLo >> 24] ^
+			s_uCrcTable[3][uHi & 0xFF] ^ s_uCrcTable[2][(uHi >> 8) & 0xFF] ^
+			s_uCrcTable[1][(uHi >> 16) & 0xFF] ^ s_uCrcTable[0][uHi >> 24];
+	}
+	
+	for (; cbData; pData++, cbData--) uCrc = (uCrc >> 8) ^ s_uCrcTable[0][(uCrc ^ *pData) & 0xFF];
+	
+	return uCrc;
+	
+}
+
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, x, k, s) \
+	(a) += f((b), (c), (d)) + (x) + (k); \
+	(a) = ROTL32((a), (s)) + (b)
+
+// There is no MD5 instruction on any common CPU, and its rounds are one
+// serial dependency chain, so this is fully unrolled portable code.
+static void md5Blocks (uint32_t* puState, const uint8_t* pData, size_t nBlocks) {
+	
+	for (; nBlocks; pData += 64, nBlocks--) {
+		uint32_t uW[16];
+		for (unsigned int iWord = 0; iWord < 16; iWord++) uW[iWord] = loadLe32(pData + iWord * 4);
+		
+		uint32_t uA = puState[0], uB = puState[1], uC = puState[2], uD = puState[3];
+		
+		MD5_STEP(MD5_F, uA, uB, uC, uD, uW[0], 0xD76AA478, 7);
+		MD5_STEP(MD5_F, uD, uA, uB, uC, uW[1], 0xE8C7B756, 12);
+		MD5_STEP(MD5_F, uC, uD, uA, uB, uW[2], 0x242070DB, 17);
+		MD5_STEP(MD5_F, uB, uC, uD, uA, uW[3], 0xC1BDCEEE, 22);
+		MD5_STEP(MD5_F, uA, uB, uC, uD, uW[4], 0xF57C0FAF, 7);
+		MD5_STEP(MD5_F, uD, uA, uB, uC, uW[5], 0x4787C62A, 12);
+		MD5_STEP(MD5_F, uC, uD, uA, uB, uW[6], 0xA8304613, 17);
+		MD5_STEP(MD5_F, uB, uC, uD, uA, uW[7], 0xFD469501, 22);
+		MD5_STEP(MD5_F, uA, uB, uC, uD, uW[8], 0x698098D8, 7);
+		MD5_STEP(MD5_F, uD, uA, uB, uC, uW[9], 0x8B44F7AF, 12);
+		MD5_STEP(MD5_F, uC, uD, uA, uB, uW[10], 0xFFFF5BB1, 17);
+		MD5_STEP(MD5_F, uB, uC, uD, uA, uW[11], 0x895CD7BE, 22);
+		MD5_STEP(MD5_F, uA, uB, uC, uD, uW[12], 0x6B901122, 7);
+		MD5_STEP(MD5_F, uD, uA, uB, uC, uW[13], 0xFD987193, 12);
+		MD5_STEP(MD5_F, uC, uD, uA, uB, uW[14], 0xA679438E, 17);
+		MD5_STEP(MD5_F, uB, uC, uD, uA, uW[15], 0x49B40821, 22);
+		
+		MD5_STEP(MD5_G, uA, uB, uC, uD, uW[1], 0xF61E2562, 5);
+		MD5_STEP(MD5_G, uD, uA, uB, uC, uW[6], 0xC040B340, 9);
+		MD5_STEP(MD5_G, uC, uD, uA, uB, uW[11], 0x265E5A51, 14);
+		MD5_STEP(MD5_G, uB, uC, uD, uA, uW[0], 0xE9B6C7AA, 20);
+		MD5_STEP(MD5_G, uA, uB, uC, uD, uW[5], 0xD62F105D, 5);
+		MD5_STEP(MD5_G, uD, uA, uB, uC, uW[10], 0x02441453, 9);
+		MD5_STEP(MD5_G, uC, uD, uA, uB, uW[15], 0xD8A1E681, 14);
+		MD5_STEP(MD5_G, uB, uC, uD, uA, uW[4], 0xE7D3FBC8, 20);
+		MD5_STEP(MD5_G, uA, uB, uC, uD, uW[9], 0x21E1CDE6, 5);
+		MD5_STEP(MD5_G, uD, uA, uB, uC, uW[14], 0xC33707D6, 9);
+		MD5_STEP(MD5_G, uC, uD, uA, uB, uW[3], 0xF4D50D87, 14);
+		MD5_STEP(MD5_G, uB, uC, uD, uA, uW[8], 0x455A14ED, 20);
+		MD5_STEP(MD5_G, uA, uB, uC, uD, uW[13], 0xA9E3E905, 5);
+		MD5_STEP(MD5_G, uD, uA, uB, uC, uW[2], 0xFCEFA3F8, 9);
+		MD5_STEP(MD5_G, uC, uD, uA, uB, uW[7], 0x676F02D9, 14);
+		MD5_STEP(MD5_G, uB, uC, uD, uA, uW[12], 0x8D2A4C8A, 20);
+		
+		MD5_STEP(MD5_H, uA, uB, uC, uD, uW[5], 0xFFFA3942, 4);
+		MD5_STEP(MD5_H, uD, uA, uB, uC, uW[8], 0x8771F681, 11);
+		MD5_STEP(MD5_H, uC, uD, uA, uB, uW[11], 0x6D9D6122, 16);
+		MD5_STEP(MD5_H, uB, uC, uD, uA, uW[14], 0xFDE5380C, 23);
+		MD5_STEP(MD5_H, uA, uB, uC, uD, uW[1], 0xA4BEEA44, 4);
+		MD5_STEP(MD5_H, uD, uA, uB, uC, uW[4], 0x4BDECFA9, 11);
+		MD5_STEP(MD5_H, uC, uD, uA, uB, uW[7], 0xF6BB4B60, 16);
+		MD5_STEP(MD5_H, uB, uC, uD, uA, uW[10], 0xBEBFBC70, 23);
+		MD5_STEP(MD5_H, uA, uB, uC, uD, uW[13], 0x289B7EC6, 4);
+		MD5_STEP(MD5_H, uD, uA, uB, uC, uW[0], 0xEAA127FA, 11);
+		MD5_STEP(MD5_H, uC, uD, uA, uB, uW[3], 0xD4EF3085, 16);
+		MD5_STEP(MD5_H, uB, uC, uD, uA, uW[6], 0x04881D05, 23);
+		MD5_STEP(MD5_H, uA, uB, uC, uD, uW[9], 0xD9D4D039, 4);
+		MD5_STEP(MD5_H, uD, uA, uB, uC, uW[12], 0xE6DB99E5, 11);
+		MD5_STEP(MD5_H, uC, uD, uA, uB, uW[15], 0x1FA27CF8, 16);
+		MD5_STEP(MD5_H, uB, uC, uD, uA, uW[2], 0xC4AC5665, 23);
+		
+		MD5_STEP(MD5_I, uA, uB, uC, uD, uW[0], 0xF4292244, 6);
+		MD5_STEP(MD5_I, uD, uA, uB, uC, uW[7], 0x432AFF97, 10);
+		MD5_STEP(MD5_I, uC, uD, uA, uB, uW[14], 0xAB9423A7, 15);
+		MD5_STEP(MD5_I, uB, uC, uD, uA, uW[5], 0xFC93A039, 21);
+		MD5_STEP(MD5_I, uA, uB, uC, uD, uW[12], 0x655B59C3, 6);
+		MD5_STEP(MD5_I, uD, uA, uB, uC, uW[3], 0x8F0CCC92, 10);
+		MD5_STEP(MD5_I, uC, uD, uA, uB, uW[10], 0xFFEFF47D, 15);
+		MD5_STEP(MD5_I, uB, uC, uD, uA, uW[1], 0x85845DD1, 21);
+		MD5_STEP(MD5_I, uA, uB, uC, uD, uW[8], 0x6FA87E4F, 6);
+		MD5_STEP(MD5_I, uD, uA, uB, uC, uW[15], 0xFE2CE6E0, 10);
+		MD5_STEP(MD5_I, uC, uD, uA, uB, uW[6], 0xA3014314, 15);
+		MD5_STEP(MD5_I, uB, uC, uD, uA, uW[13], 0x4E0811A1, 21);
+		MD5_STEP(MD5_I, uA, uB, uC, uD, uW[4], 0xF7537E82, 6);
+		MD5_STEP(MD5_I, uD, uA, uB, uC, uW[11], 0xBD3AF235, 10);
+		MD5_STEP(MD5_I, uC, uD, uA, uB, uW[2], 0x2AD7D2BB, 15);
+		MD5_STEP(MD5_I, uB, uC, uD, uA, uW[9], 0xEB86D391, 21);
+		
+		puState[0] += uA;
+		puState[1] += uB;
+		puState[2] += uC;
+		puState[3] += uD;
+	}
+	
+}
+
+static void sha1BlocksScalar (uint32_t* puState, const uint8_t* pData, size_t nBlocks) {
+	
+	for (; nBlocks; pData += 64, nBlocks--) {
+		uint32_t uW[16];
+		for (unsigned int iWord = 0; iWord < 16; iWord++) uW[iWord] = loadBe32(pData + iWord * 4);
+		
+		uint32_t uA = puState[0], uB = puState[1], uC = puState[2], uD = puState[3], uE = puState[4];
+		
+		for (unsigned int iRound = 0; iRound < 80; iRound++) {
+			uint32_t uF, uK;
+			
+			// The schedule is kept in a 16 word ring.
+			if (iRound >= 16) {
+				uint32_t uNext = uW[(iRound + 13) & 15] ^ uW[(iRound + 8) & 15] ^ uW[(iRound + 2) & 15] ^ uW[iRound & 15];
+				uW[iRound & 15] = ROTL32(uNext, 1);
+			}
+			
+			if (iRound < 20) {
+				uF = uD ^ (uB & (uC ^ uD));
+				uK = 0x5A827999;
+			} else if (iRound < 40) {
+				uF = uB ^ uC ^ uD;
+				uK = 0x6ED9EBA1;
+			} else if (iRound < 60) {
+				uF = (uB & uC) | (uD & (uB | uC));
+				uK = 0x8F1BBCDC;
+			} else {
+				uF = uB ^ uC ^ uD;
+				uK = 0xCA62C1D6;
+			}
+			
+			uint32_t uTemp = ROTL32(uA, 5) + uF + uE + uK + uW[iRound & 15];
+			uE = uD;
+			uD = uC;
+			uC = ROTL32(uB, 30);
+			uB = uA;
+			uA = uTemp;
+		}
+		
+		puState[0] += uA;
+		puState[1] += uB;
+		puState[2] += uC;
+		puState[3] += uD;
+		puState[4] += uE;
+	}
+	
+}
+
+// ---------------------------------------------------------------------
+// Accelerated kernels.
+// ---------------------------------------------------------------------
+
+#ifdef ROMHASH_X86
+
+// Folds 64 bytes per step with carry-less multiplies, then reduces the
+// remainder with a Barrett reduction. See Intel's "Fast CRC Computation
+// for Generic Polynomials Using PCLMULQDQ Instruction". cbData must be
+// at least 64 and a multiple of 16.
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t crc32PclmulFold (uint32_t uCrc, const uint8_t* pData, size_t cbData) {
+	
+	const __m128i vK1K2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+	const __m128i vK3K4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+	const __m128i vK5K0 = _mm_set_epi64x(0, 0x0163CD6124);
+	const __m128i vPoly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+	const __m128i vMask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i vX0, vX1, vX2, vX3, vX4, vX5, vX6, vX7, vX8;
+	
+	vX1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)pData), _mm_cvtsi32_si128((int)uCrc));
+	vX2 = _mm_loadu_si128((const __m128i*)(pData + 16));
+	vX3 = _mm_loadu_si128((const __m128i*)(pData + 32));
+	vX4 = _mm_loadu_si128((const __m128i*)(pData + 48));
+	pData += 64;
+	cbData -= 64;
+	
+	// Fold four lanes of 128 bits in parallel.
+	for (; cbData >= 64; pData += 64, cbData -= 64) {
+		vX5 = _mm_clmulepi64_si128(vX1, vK1K2, 0x00);
+		vX6 = _mm_clmulepi64_si128(vX2, vK1K2, 0x00);
+		vX7 = _mm_clmulepi64_si128(vX3, vK1K2, 0x00);
+		vX8 = _mm_clmulepi64_si128(vX4, vK1K2, 0x00);
+		
+		vX1 = _mm_clmulepi64_si128(vX1, vK1K2, 0x11);
+		vX2 = _mm_clmulepi64_si128(vX2, vK1K2, 0x11);
+		vX3 = _mm_clmulepi64_si128(vX3, vK1K2, 0x11);
+		vX4 = _mm_clmulepi64_si128(vX4, vK1K2, 0x11);
+		
+		vX1 = _mm_xor_si128(_mm_xor_si128(vX1, vX5), _mm_loadu_si128((const __m128i*)pData));
+		vX2 = _mm_xor_si128(_mm_xor_si128(vX2, vX6), _mm_loadu_si128((const __m128i*)(pData + 16)));
+		vX3 = _mm_xor_si128(_mm_xor_si128(vX3, vX7), _mm_loadu_si128((const __m128i*)(pData + 32)));
+		vX4 = _mm_xor_si128(_mm_xor_si128(vX4, vX8), _mm_loadu_si128((const __m128i*)(pData + 48)));
+	}
+	
+	// Fold the lanes into one.
+	vX5 = _mm_clmulepi64_si128(vX1, vK3K4, 0x00);
+	vX1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(vX1, vK3K4, 0x11), vX2), vX5);
+	vX5 = _mm_clmulepi64_si128(vX1, vK3K4, 0x00);
+	vX1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(vX1, vK3K4, 0x11), vX3), vX5);
+	vX5 = _mm_clmulepi64_si128(vX1, vK3K4, 0x00);
+	vX1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(vX1, vK3K4, 0x11), vX4), vX5);
+	
+	// Fold any remaining 128 bit blocks.
+	for (; cbData >= 16; pData += 16, cbData -= 16) {
+		vX5 = _mm_clmulepi64_si128(vX1, vK3K4, 0x00);
+		vX1 = _mm_clmulepi64_si128(vX1, vK3K4, 0x11);
+		vX1 = _mm_xor_si128(_mm_xor_si128(vX1, _mm_loadu_si128((const __m128i*)pData)), vX5);
+	}
+	
+	// Fold 128 bits to 64.
+	vX2 = _mm_clmulepi64_si128(vX1, vK3K4, 0x10);
+	vX1 = _mm_xor_si128(_mm_srli_si128(vX1, 8), vX2);
+	
+	vX2 = _mm_srli_si128(vX1, 4);
+	vX1 = _mm_and_si128(vX1, vMask32);
+	vX1 = _mm_xor_si128(_mm_clmulepi64_si128(vX1, vK5K0, 0x00), vX2);
+	
+	// Barrett reduce to 32 bits.
+	vX0 = _mm_and_si128(vX1, vMask32);
+	vX0 = _mm_clmulepi64_si128(vX0, vPoly, 0x10);
+	vX0 = _mm_and_si128(vX0, vMask32);
+	vX0 = _mm_clmulepi64_si128(vX0, vPoly, 0x00);
+	vX1 = _mm_xor_si128(vX1, vX0);
+	
+	return (uint32_t)_mm_extract_epi32(vX1, 1);
+	
+}
+
+static uint32_t crc32Pclmul (uint32_t uCrc, const uint8_t* pData, size_t cbData) {
+	
+	if (cbData >= 64) {
+		size_t cbFold = cbData & ~(size_t)15;
+		uCrc = crc32PclmulFold(uCrc, pData, cbFold);
+		pData += cbFold;
+		cbData -= cbFold;
+	}
+	
+	return crc32Scalar(uCrc, pData, cbData);
+	
+}
+
+// Four rounds of SHA-1 with the SHA extensions. Group g uses message
+// words 4g..4g+3 held in vM while the schedule for later groups is
+// advanced in the other three registers; g is always a constant, so
+// the conditions fold away.
+#define SHA1NI_GROUP(g, vE, vEOther, vM, vMNext, vMPair, vMPrev) \
+	vE = _mm_sha1nexte_epu32(vE, vM); \
+	vEOther = vABCD; \
+	if ((g) >= 3 && (g) <= 18) vMNext = _mm_sha1msg2_epu32(vMNext, vM); \
+	vABCD = _mm_sha1rnds4_epu32(vABCD, vE, (g) / 5); \
+	if ((g) >= 1 && (g) <= 16) vMPrev = _mm_sha1msg1_epu32(vMPrev, vM); \
+	if ((g) >= 2 && (g) <= 17) vMPair = _mm_xor_si128(vMPair, vM)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha1BlocksShaNi (uint32_t* puState, const uint8_t* pData, size_t nBlocks) {
+	
+	const __m128i vByteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090A0B0C0D0E0FULL);
+	__m128i vABCD, vE0, vE1, vM0, vM1, vM2, vM3;
+	
+	vABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)puState), 0x1B);
+	vE0 = _mm_set_epi32((int)puState[4], 0, 0, 0);
+	
+	for (; nBlocks; pData += 64, nBlocks--) {
+		const __m128i vABCDSave = vABCD;
+		const __m128i vE0Save = vE0;
+		
+		vM0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pData), vByteSwap);
+		vM1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pData + 16)), vByteSwap);
+		vM2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pData + 32)), vByteSwap);
+		vM3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pData + 48)), vByteSwap);
+		
+		vE0 = _mm_add_epi32(vE0, vM0);
+		vE1 = vABCD;
+		vABCD = _mm_sha1rnds4_epu32(vABCD, vE0, 0);
+		
+		SHA1NI_GROUP(1, vE1, vE0, vM1, vM2, vM3, vM0);
+		SHA1NI_GROUP(2, vE0, vE1, vM2, vM3, vM0, vM1);
+		SHA1NI_GROUP(3, vE1, vE0, vM3, vM0, vM1, vM2);
+		SHA1NI_GROUP(4, vE0, vE1, vM0, vM1, vM2, vM3);
+		SHA1NI_GROUP(5, vE1, vE0, vM1, vM2, vM3, vM0);
+		SHA1NI_GROUP(6, vE0, vE1, vM2, vM3, vM0, vM1);
+		SHA1NI_GROUP(7, vE1, vE0, vM3, vM0, vM1, vM2);
+		SHA1NI_GROUP(8, vE0, vE1, vM0, vM1, vM2, vM3);
+		SHA1NI_GROUP(9, vE1, vE0, vM1, vM2, vM3, vM0);
+		SHA1NI_GROUP(10, vE0, vE1, vM2, vM3, vM0, vM1);
+		SHA1NI_GROUP(11, vE1, vE0, vM3, vM0, vM1, vM2);
+		SHA1NI_GROUP(12, vE0, vE1, vM0, vM1, vM2, vM3);
+		SHA1NI_GROUP(13, vE1, vE0, vM1, vM2, vM3, vM0);
+		SHA1NI_GROUP(14, vE0, vE1, vM2, vM3, vM0, vM1);
+		SHA1NI_GROUP(15, vE1, vE0, vM3, vM0, vM1, vM2);
+		SHA1NI_GROUP(16, vE0, vE1, vM0, vM1, vM2, vM3);
+		SHA1NI_GROUP(17, vE1, vE0, vM1, vM2, vM3, vM0);
+		SHA1NI_GROUP(18, vE0, vE1, vM2, vM3, vM0, vM1);
+		SHA1NI_GROUP(19, vE1, vE0, vM3, vM0, vM1, vM2);
+		
+		vE0 = _mm_sha1nexte_epu32(vE0, vE0Save);
+		vABCD = _mm_add_epi32(vABCD, vABCDSave);
+	}
+	
+	_mm_storeu_si128((__m128i*)puState, _mm_shuffle_epi32(vABCD, 0x1B));
+	puState[4] = (uint32_t)_mm_extract_epi32(vE0, 3);
+	
+}
+
+#endif /* ROMHASH_X86 */
+
+#ifdef ROMHASH_ARMCRC
+
+static uint32_t crc32Arm (uint32_t uCrc, const uint8_t* pData, size_t cbData) {
+	
+	for (; cbData >= 8; pData += 8, cbData -= 8) {
+		uint64_t uWord;
+		memcpy(&uWord, pData, sizeof(uWord));
+		uCrc = __crc32d(uCrc, uWord);
+	}
+	
+	for (; cbData; pData++, cbData--) uCrc = __crc32b(uCrc, *pData);
+	
+	return uCrc;
+	
+}
+
+#endif /* ROMHASH_ARMCRC */
+
+// ---------------------------------------------------------------------
+// Hashing.
+// ---------------------------------------------------------------------
+
+// Builds the padded final blocks of MD5 and SHA-1, which differ only in
+// the byte order of the bit count. Returns the number of blocks.
+static size_t padLastBlocks (uint8_t* pBlocks, const uint8_t* pTail, size_t cbTail, uint64_t cbTotal, const int fBigEndian) {
+	
+	size_t nBlocks = (cbTail + 9 > 64) ? 2 : 1;
+	uint64_t cBits = cbTotal << 3;
+	
+	memset(pBlocks, 0, nBlocks * 64);
+	memcpy(pBlocks, pTail, cbTail);
+	pBlocks[cbTail] = 0x80;
+	
+	for (unsigned int iByte = 0; iByte < 8; iByte++)
+		pBlocks[nBlocks * 64 - 8 + iByte] = (uint8_t)(cBits >> (fBigEndian ? 56 - iByte * 8 : iByte * 8));
+	
+	return nBlocks;
+	
+}
+
+/*
+ * 
+ * name: hashRomImage
+ * 
+ * 		Computes the selected content hashes of an image in a single
+ * 	pass. The image is fed to every hash a chunk at a time, so each
+ * 	chunk is read from memory once and from the cache after that. The
+ * 	sum of all bytes is gathered along the way for the global checksum.
+ * 
+ * @param:
+ * 		const void* pData:
+ * 			Pointer to the image.
+ * 
+ * 		size_t cbData:
+ * 			Size of the image in bytes.
+ * 
+ * 		const unsigned int uHashes:
+ * 			HASHF_* flags of the hashes to compute. May be zero to only
+ * 		sum the bytes.
+ * 
+ * 		PROM_HASHES pHashes:
+ * 			Receives the hashes.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno on error.
+ * 
+ */
+int hashRomImage (const void* pData, size_t cbData, const unsigned int uHashes, PROM_HASHES pHashes) {
+	
+	if (pHashes == NULL || (pData == NULL && cbData)) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (uHashes & ~HASHF_MASK) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	const uint8_t* pByte = (const uint8_t*)pData;
+	size_t cbLeft = cbData;
+	uint32_t uCrc = 0xFFFFFFFF;
+	uint32_t uMd5[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+	uint32_t uSha1[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	uint64_t uSum = 0;
+	
+	while (cbLeft >= 64) {
+		size_t cbChunk = ((cbLeft < HASH_CHUNKSIZE) ? cbLeft : HASH_CHUNKSIZE) & ~(size_t)63;
+		
+		if (uHashes & HASHF_CRC32) uCrc = s_pfnCrc32(uCrc, pByte, cbChunk);
+		if (uHashes & HASHF_MD5) md5Blocks(uMd5, pByte, cbChunk / 64);
+		if (uHashes & HASHF_SHA1) s_pfnSha1Blocks(uSha1, pByte, cbChunk / 64);
+		uSum += sumBytes(pByte, cbChunk);
+		
+		pByte += cbChunk;
+		cbLeft -= cbChunk;
+	}
+	
+	uint8_t uLast[128];
+	
+	uSum += sumBytes(pByte, cbLeft);
+	
+	if (uHashes & HASHF_CRC32) uCrc = s_pfnCrc32(uCrc, pByte, cbLeft);
+	if (uHashes & HASHF_MD5) md5Blocks(uMd5, uLast, padLastBlocks(uLast, pByte, cbLeft, cbData, 0));
+	if (uHashes & HASHF_SHA1) s_pfnSha1Blocks(uSha1, uLast, padLastBlocks(uLast, pByte, cbLeft, cbData, 1));
+	
+	memset(pHashes, 0, sizeof(ROM_HASHES));
+	pHashes->uHashes = uHashes;
+	pHashes->uSum = uSum;
+	pHashes->uCrc32 = ~uCrc;
+	for (unsigned int iByte = 0; iByte < sizeof(pHashes->uMd5); iByte++)
+		pHashes->uMd5[iByte] = (uint8_t)(uMd5[iByte / 4] >> ((iByte % 4) * 8));
+	for (unsigned int iByte = 0; iByte < sizeof(pHashes->uSha1); iByte++)
+		pHashes->uSha1[iByte] = (uint8_t)(uSha1[iByte / 4] >> (24 - (iByte % 4) * 8));
+	
+	if (!(uHashes & HASHF_CRC32)) pHashes->uCrc32 = 0;
+	if (!(uHashes & HASHF_MD5)) memset(pHashes->uMd5, 0, sizeof(pHashes->uMd5));
+	if (!(uHashes & HASHF_SHA1)) memset(pHashes->uSha1, 0, sizeof(pHashes->uSha1));
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: selectRomHashImpl
+ * 
+ * 		Selects the hash kernels. Intended for startup and benchmarking
+ * 	only; do not call while other threads are hashing.
+ * 
+ * @param:
+ * 		const unsigned int uImpl:
+ * 			HASHIMPL_AUTO to use CRC and SHA instructions where the CPU
+ * 		has them, or HASHIMPL_SCALAR for the portable kernels.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno to EINVAL if uImpl
+ * 	is unknown.
+ * 
+ */
+int selectRomHashImpl (const unsigned int uImpl) {
+	
+	if (uImpl >= HASHIMPL_COUNT) {
+		errno = EINVAL;
+		return -1;
+	}
+	
+	s_pfnCrc32 = crc32Scalar;
+	s_pszCrc32Impl = "scalar";
+	s_pfnSha1Blocks = sha1BlocksScalar;
+	s_pszSha1Impl = "scalar";
+	
+	if (uImpl == HASHIMPL_SCALAR) return 0;
+	
+#ifdef ROMHASH_X86
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		s_pfnCrc32 = crc32Pclmul;
+		s_pszCrc32Impl = "pclmul";
+	}
+	
+	if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3")) {
+		s_pfnSha1Blocks = sha1BlocksShaNi;
+		s_pszSha1Impl = "sha-ni";
+	}
+#elif defined(ROMHASH_ARMCRC)
+	s_pfnCrc32 = crc32Arm;
+	s_pszCrc32Impl = "armv8-crc";
+#endif
+	
+	return 0;
+	
+}
+
+// Gets the name of the kernel currently used for one hash.
+const char* getRomHashImplStr (const unsigned int uHash) {
+	
+	switch (uHash) {
+	case HASHF_CRC32:
+		return s_pszCrc32Impl;
+		
+	case HASHF_MD5:
+		return "scalar";
+		
+	case HASHF_SHA1:
+		return s_pszSha1Impl;
+		
+	default:
+		return "unknown";
+	}
+	
+}
+
+// EOF
@@ -0,0 +1,721 @@
+/*
+ * obj/romindex.c
+ * 
+ * GBFix - ROM Collection Index Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/hdrcheck.h"
+#include "../inc/romindex.h"
+
+#define INDEX_BLOCKROWS 4096 // Rows transposed at a time when writing.
+
+// Kinds of queryable fields.
+enum {
+	IXK_BYTE, // One header byte.
+	IXK_WORD, // Two header bytes, big endian.
+	IXK_STRING, // Header bytes compared as text.
+	IXK_STATUS, // An IXS_* flag, as 0 or 1.
+	IXK_SIZE, // File size.
+	IXK_FINDING, // A header finding, by name.
+	IXK_FORMAT // Header format, by name.
+};
+
+typedef struct tagINDEX_FIELD
+{
+	const char* pszName;
+	uint8_t uKind; // IXK_* kind.
+	uint8_t uOffset; // Offset in GBHEAD.
+	uint8_t cbField; // Size in GBHEAD, or the IXS_* flag.
+} INDEX_FIELD, *PINDEX_FIELD;
+
+static const INDEX_FIELD s_ifFields[] = {
+	{ "title", IXK_STRING, offsetof(GBHEAD, htTitle), 16 },
+	{ "manufacturer", IXK_STRING, offsetof(GBHEAD, htTitle) + 11, 4 },
+	{ "newlicensee", IXK_STRING, offsetof(GBHEAD, uLicensee), 2 },
+	{ "cgbflag", IXK_BYTE, offsetof(GBHEAD, htTitle) + 15, 1 },
+	{ "sgbflag", IXK_BYTE, offsetof(GBHEAD, uSgbFlag), 1 },
+	{ "carttype", IXK_BYTE, offsetof(GBHEAD, uCartType), 1 },
+	{ "romsize", IXK_BYTE, offsetof(GBHEAD, uRomSize), 1 },
+	{ "ramsize", IXK_BYTE, offsetof(GBHEAD, uRamSize), 1 },
+	{ "region", IXK_BYTE, offsetof(GBHEAD, uRegion), 1 },
+	{ "oldlicensee", IXK_BYTE, offsetof(GBHEAD, uOldLicensee), 1 },
+	{ "romver", IXK_BYTE, offsetof(GBHEAD, uRomVer), 1 },
+	{ "hdrchksum", IXK_BYTE, offsetof(GBHEAD, uHdrChksum), 1 },
+	{ "globalchksum", IXK_WORD, offsetof(GBHEAD, uGlobalChksum), 2 },
+	{ "hdrok", IXK_STATUS, 0, IXS_HDROK },
+	{ "globalok", IXK_STATUS, 0, IXS_GLOBALOK },
+	{ "size", IXK_SIZE, 0, 0 },
+	{ "finding", IXK_FINDING, 0, 0 },
+	{ "format", IXK_FORMAT, 0, 0 }
+};
+
+#define INDEX_NFIELDS (sizeof(s_ifFields) / sizeof(s_ifFields[0]))
+
+// Operators, longest first so that "<=" is not taken for "<".
+static const struct {
+	const char* pszOp;
+	unsigned int uOp;
+} s_ioOps[] = {
+	{ "!=", IXOP_NE }, { "<=", IXOP_LE }, { ">=", IXOP_GE },
+	{ "=", IXOP_EQ }, { "<", IXOP_LT }, { ">", IXOP_GT },
+	{ "&", IXOP_AND }, { "^", IXOP_PREFIX }
+};
+
+// Offsets of the sections of an index with a given number of rows.
+typedef struct tagINDEX_LAYOUT
+{
+	size_t offHdrCols;
+	size_t offFindings;
+	size_t offGlobalChksums;
+	size_t offStatus;
+	size_t offIds;
+	size_t offPaths;
+	size_t cbTotal;
+} INDEX_LAYOUT, *PINDEX_LAYOUT;
+
+static inline size_t alignSection (const size_t cb) {
+	
+	return (cb + 63) & ~(size_t)63;
+	
+}
+
+static void getIndexLayout (const size_t nRows, const size_t cbPaths, PINDEX_LAYOUT pil) {
+	
+	pil->offHdrCols = sizeof(INDEX_HEAD);
+	pil->offFindings = pil->offHdrCols + alignSection(sizeof(GBHEAD) * nRows);
+	pil->offGlobalChksums = pil->offFindings + alignSection(sizeof(uint32_t) * nRows);
+	pil->offStatus = pil->offGlobalChksums + alignSection(sizeof(uint16_t) * nRows);
+	pil->offIds = pil->offStatus + alignSection(nRows);
+	pil->offPaths = pil->offIds + alignSection(sizeof(INDEX_ID) * nRows);
+	pil->cbTotal = pil->offPaths + cbPaths;
+	
+}
+
+/*
+ * 
+ * name: openRomIndex
+ * 
+ * 		Maps an index file for reading.
+ * 
+ * @param:
+ * 		const char* pszFileName:
+ * 			Name of the index file.
+ * 
+ * 		PROM_INDEX pIndex:
+ * 			Pointer to the index structure to fill.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno on error. errno
+ * 	is EINVAL if the file is not a valid index.
+ * 
+ */
+int openRomIndex (const char* pszFileName, PROM_INDEX pIndex) {
+	
+	if (pszFileName == NULL || pIndex == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memset(pIndex, 0, sizeof(ROM_INDEX));
+	
+	int fd;
+	if ((fd = open(pszFileName, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+	
+	struct stat st;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	
+	if (st.st_size < (off_t)sizeof(INDEX_HEAD)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	
+	pIndex->cbMap = (size_t)st.st_size;
+	pIndex->pMap = mmap(NULL, pIndex->cbMap, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pIndex->pMap == MAP_FAILED) {
+		pIndex->pMap = NULL;
+		return -1;
+	}
+	
+	// Check the header and that every section lies within the file.
+	const PINDEX_HEAD pHead = (const PINDEX_HEAD)pIndex->pMap;
+	INDEX_LAYOUT il;
+	if (pHead->uMagic != INDEX_MAGIC || pHead->uVersion != INDEX_VERSION ||
+		pHead->nRows > UINT32_MAX || pHead->cbPaths > pIndex->cbMap) goto invalid;
+	
+	pIndex->nRows = (size_t)pHead->nRows;
+	pIndex->cbPaths = (size_t)pHead->cbPaths;
+	getIndexLayout(pIndex->nRows, pIndex->cbPaths, &il);
+	if (il.cbTotal > pIndex->cbMap) goto invalid;
+	
+	const uint8_t* pBase = (const uint8_t*)pIndex->pMap;
+	pIndex->pHdrCols = pBase + il.offHdrCols;
+	pIndex->puFindings = (const uint32_t*)(pBase + il.offFindings);
+	pIndex->puGlobalChksums = (const uint16_t*)(pBase + il.offGlobalChksums);
+	pIndex->puStatus = pBase + il.offStatus;
+	pIndex->pIds = (const INDEX_ID*)(pBase + il.offIds);
+	pIndex->pszPaths = (const char*)(pBase + il.offPaths);
+	
+	// Paths are only trusted if the last one is terminated.
+	if (pIndex->cbPaths != 0 && pIndex->pszPaths[pIndex->cbPaths - 1] != '\0') goto invalid;
+	
+	return 0;
+	
+invalid:
+	munmap(pIndex->pMap, pIndex->cbMap);
+	pIndex->pMap = NULL;
+	errno = EINVAL;
+	return -1;
+	
+}
+
+void closeRomIndex (PROM_INDEX pIndex) {
+	
+	if (pIndex == NULL) return;
+	
+	if (pIndex->pMap != NULL) munmap(pIndex->pMap, pIndex->cbMap);
+	free(pIndex->puSlots);
+	memset(pIndex, 0, sizeof(ROM_INDEX));
+	
+}
+
+/*
+ * 
+ * name: writeRomIndex
+ * 
+ * 		Writes an index of the given rows. The index is built in a
+ * 	temporary file that then replaces pszFileName, so readers never
+ * 	see a partial index.
+ * 
+ * @param:
+ * 		const char* pszFileName:
+ * 			Name of the index file.
+ * 
+ * 		const PINDEX_ROW pRows:
+ * 			Pointer to the rows to write, in order.
+ * 
+ * 		const size_t nRows:
+ * 			Number of rows.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno on error.
+ * 
+ */
+int writeRomIndex (const char* pszFileName, const PINDEX_ROW pRows, const size_t nRows) {
+	
+	if (pszFileName == NULL || (pRows == NULL && nRows != 0)) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (nRows > UINT32_MAX) {
+		errno = EOVERFLOW;
+		return -1;
+	}
+	
+	size_t cbPaths = 0;
+	for (size_t iRow = 0; iRow < nRows; iRow++) cbPaths += strlen(pRows[iRow].pszPath) + 1;
+	
+	INDEX_LAYOUT il;
+	getIndexLayout(nRows, cbPaths, &il);
+	
+	// Create the temporary file next to the index.
+	size_t cchTemp = strlen(pszFileName) + 8;
+	char* pszTemp;
+	if ((pszTemp = malloc(cchTemp)) == NULL) return -1;
+	snprintf(pszTemp, cchTemp, "%s.XXXXXX", pszFileName);
+	
+	int fd;
+	if ((fd = mkstemp(pszTemp)) < 0) {
+		free(pszTemp);
+		return -1;
+	}
+	
+	uint8_t* pBase = MAP_FAILED;
+	if (fchmod(fd, 0644) || ftruncate(fd, (off_t)il.cbTotal)) goto fail;
+	if ((pBase = mmap(NULL, il.cbTotal, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) goto fail;
+	
+	PINDEX_HEAD pHead = (PINDEX_HEAD)pBase;
+	pHead->uMagic = INDEX_MAGIC;
+	pHead->uVersion = INDEX_VERSION;
+	pHead->nRows = nRows;
+	pHead->cbPaths = cbPaths;
+	
+	uint8_t* pHdrCols = pBase + il.offHdrCols;
+	uint32_t* puFindings = (uint32_t*)(pBase + il.offFindings);
+	uint16_t* puGlobalChksums = (uint16_t*)(pBase + il.offGlobalChksums);
+	uint8_t* puStatus = pBase + il.offStatus;
+	PINDEX_ID pIds = (PINDEX_ID)(pBase + il.offIds);
+	char* pszPaths = (char*)(pBase + il.offPaths);
+	
+	// Transpose the headers a block of rows at a time, so that each
+	// column is written in runs rather than a byte per cache line.
+	for (size_t iBlock = 0; iBlock < nRows; iBlock += INDEX_BLOCKROWS) {
+		size_t iEnd = (nRows - iBlock < INDEX_BLOCKROWS) ? nRows : iBlock + INDEX_BLOCKROWS;
+		for (size_t iByte = 0; iByte < sizeof(GBHEAD); iByte++) {
+			uint8_t* pCol = pHdrCols + iByte * nRows;
+			for (size_t iRow = iBlock; iRow < iEnd; iRow++) pCol[iRow] = ((const uint8_t*)&pRows[iRow].hdr)[iByte];
+		}
+	}
+	
+	size_t offPath = 0;
+	for (size_t iRow = 0; iRow < nRows; iRow++) {
+		puFindings[iRow] = pRows[iRow].uFindings;
+		puGlobalChksums[iRow] = pRows[iRow].uGlobalChksum;
+		puStatus[iRow] = pRows[iRow].uStatus & IXS_MASK;
+		pIds[iRow] = pRows[iRow].id;
+		pIds[iRow].uPathOffset = offPath;
+		
+		size_t cbPath = strlen(pRows[iRow].pszPath) + 1;
+		memcpy(pszPaths + offPath, pRows[iRow].pszPath, cbPath);
+		offPath += cbPath;
+	}
+	
+	if (munmap(pBase, il.cbTotal)) goto fail;
+	pBase = MAP_FAILED;
+	if (fsync(fd) || close(fd)) {
+		fd = -1;
+		goto fail;
+	}
+	fd = -1;
+	
+	if (rename(pszTemp, pszFileName)) goto fail;
+	
+	free(pszTemp);
+	return 0;
+	
+fail:
+	{
+		int nErr = errno;
+		if (pBase != MAP_FAILED) munmap(pBase, il.cbTotal);
+		if (fd >= 0) close(fd);
+		unlink(pszTemp);
+		free(pszTemp);
+		errno = nErr;
+	}
+	return -1;
+	
+}
+
+/*
+ * 
+ * name: getRomIndexPath
+ * 
+ * 		Gets the path of an indexed file.
+ * 
+ * @param:
+ * 		const PROM_INDEX pIndex:
+ * 			Pointer to the open index.
+ * 
+ * 		const size_t iRow:
+ * 			Row of the file.
+ * 
+ * @return: const char*
+ * 		Returns the path, or NULL and sets errno on error.
+ * 
+ */
+const char* getRomIndexPath (const PROM_INDEX pIndex, const size_t iRow) {
+	
+	if (pIndex == NULL || iRow >= pIndex->nRows) {
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	uint64_t offPath = pIndex->pIds[iRow].uPathOffset;
+	if (offPath >= pIndex->cbPaths) {
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	return pIndex->pszPaths + offPath;
+	
+}
+
+/*
+ * 
+ * name: getRomIndexRow
+ * 
+ * 		Gathers one row from the columns of an index.
+ * 
+ * @param:
+ * 		const PROM_INDEX pIndex:
+ * 			Pointer to the open index.
+ * 
+ * 		const size_t iRow:
+ * 			Row to gather.
+ * 
+ * 		PINDEX_ROW pRow:
+ * 			Pointer to the row to fill. pszPath points into the index.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno on error.
+ * 
+ */
+int getRomIndexRow (const PROM_INDEX pIndex, const size_t iRow, PINDEX_ROW pRow) {
+	
+	if (pRow == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if ((pRow->pszPath = getRomIndexPath(pIndex, iRow)) == NULL) return -1;
+	
+	for (size_t iByte = 0; iByte < sizeof(GBHEAD); iByte++)
+		((uint8_t*)&pRow->hdr)[iByte] = pIndex->pHdrCols[iByte * pIndex->nRows + iRow];
+	
+	pRow->uFindings = pIndex->puFindings[iRow];
+	pRow->uGlobalChksum = pIndex->puGlobalChksums[iRow];
+	pRow->uStatus = pIndex->puStatus[iRow];
+	pRow->id = pIndex->pIds[iRow];
+	
+	return 0;
+	
+}
+
+static inline uint64_t hashPath (const char* pszPath) {
+	
+	uint64_t uHash = 0xCBF29CE484222325ull;
+	while (*pszPath) uHash = (uHash ^ (uint8_t)*pszPath++) * 0x100000001B3ull;
+	return uHash;
+	
+}
+
+/*
+ * 
+ * name: findRomIndexRow
+ * 
+ * 		Looks up the row of a file by its path. The first lookup builds
+ * 	a hash table of every path in the index.
+ * 
+ * @param:
+ * 		PROM_INDEX pIndex:
+ * 			Pointer to the open index.
+ * 
+ * 		const char* pszPath:
+ * 			Absolute path of the file.
+ * 
+ * 		size_t* piRow:
+ * 			Pointer to receive the row.
+ * 
+ * @return: int
+ * 		Returns 1 if found, 0 if not, or -1 and sets errno on error.
+ * 
+ */
+int findRomIndexRow (PROM_INDEX pIndex, const char* pszPath, size_t* piRow) {
+	
+	if (pIndex == NULL || pszPath == NULL || piRow == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	if (pIndex->puSlots == NULL) {
+		size_t nSlots = 16;
+		while (nSlots < pIndex->nRows * 2) nSlots <<= 1;
+		if ((pIndex->puSlots = calloc(nSlots, sizeof(uint32_t))) == NULL) return -1;
+		pIndex->nSlots = nSlots;
+		
+		for (size_t iRow = 0; iRow < pIndex->nRows; iRow++) {
+			const char* pszRowPath = getRomIndexPath(pIndex, iRow);
+			if (pszRowPath == NULL) continue;
+			
+			size_t iSlot = hashPath(pszRowPath) & (nSlots - 1);
+			while (pIndex->puSlots[iSlot]) iSlot = (iSlot + 1) & (nSlots - 1);
+			pIndex->puSlots[iSlot] = (uint32_t)(iRow + 1);
+		}
+	}
+	
+	size_t iSlot = hashPath(pszPath) & (pIndex->nSlots - 1);
+	while (pIndex->puSlots[iSlot]) {
+		size_t iRow = pIndex->puSlots[iSlot] - 1;
+		if (strcmp(getRomIndexPath(pIndex, iRow), pszPath) == 0) {
+			*piRow = iRow;
+			return 1;
+		}
+		iSlot = (iSlot + 1) & (pIndex->nSlots - 1);
+	}
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: parseIndexPred
+ * 
+ * 		Parses a query predicate of the form <FIELD><OP><VALUE>, such
+ * 	as "carttype=0x1B", "romsize>=5", "cgbflag&0x80", "title^POKEMON",
+ * 	"finding=romlimit", "format=CGB" or "hdrok=0".
+ * 
+ * @param:
+ * 		const char* pszPred:
+ * 			The predicate.
+ * 
+ * 		PINDEX_PRED pPred:
+ * 			Pointer to the parsed predicate.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno to EINVAL if the
+ * 	predicate is malformed.
+ * 
+ */
+int parseIndexPred (const char* pszPred, PINDEX_PRED pPred) {
+	
+	if (pszPred == NULL || pPred == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memset(pPred, 0, sizeof(INDEX_PRED));
+	
+	// Find the field.
+	size_t cchName = 0;
+	while (pszPred[cchName] >= 'a' && pszPred[cchName] <= 'z') cchName++;
+	
+	for (pPred->uField = 0; pPred->uField < INDEX_NFIELDS; pPred->uField++)
+		if (strncmp(pszPred, s_ifFields[pPred->uField].pszName, cchName) == 0 &&
+			s_ifFields[pPred->uField].pszName[cchName] == '\0') break;
+	if (cchName == 0 || pPred->uField == INDEX_NFIELDS) goto invalid;
+	
+	// Find the operator.
+	const char* pszOp = pszPred + cchName;
+	const char* pszValue = NULL;
+	for (unsigned int iOp = 0; iOp < sizeof(s_ioOps) / sizeof(s_ioOps[0]); iOp++) {
+		size_t cchOp = strlen(s_ioOps[iOp].pszOp);
+		if (strncmp(pszOp, s_ioOps[iOp].pszOp, cchOp) == 0) {
+			pPred->uOp = s_ioOps[iOp].uOp;
+			pszValue = pszOp + cchOp;
+			break;
+		}
+	}
+	if (pszValue == NULL) goto invalid;
+	
+	// Parse the value for the kind of field.
+	const INDEX_FIELD* pif = &s_ifFields[pPred->uField];
+	switch (pif->uKind) {
+	case IXK_STRING:
+		if (pPred->uOp != IXOP_EQ && pPred->uOp != IXOP_NE && pPred->uOp != IXOP_PREFIX) goto invalid;
+		if (strlen(pszValue) > pif->cbField) goto invalid;
+		strcpy(pPred->szValue, pszValue);
+		return 0;
+		
+	case IXK_FINDING:
+		if (pPred->uOp != IXOP_EQ && pPred->uOp != IXOP_NE) goto invalid;
+		for (pPred->uValue = 0; pPred->uValue < HCB_COUNT; pPred->uValue++)
+			if (strcmp(pszValue, getHdrCheckName(pPred->uValue)) == 0) return 0;
+		goto invalid;
+		
+	case IXK_FORMAT:
+		if (pPred->uOp != IXOP_EQ && pPred->uOp != IXOP_NE) goto invalid;
+		for (pPred->uValue = HDRREV_DMG; pPred->uValue < HDRREV_UNKNOWN; pPred->uValue++)
+			if (strcasecmp(pszValue, getHdrRevStr(pPred->uValue)) == 0) return 0;
+		goto invalid;
+		
+	default:
+		if (pPred->uOp == IXOP_PREFIX || *pszValue == '\0') goto invalid;
+		
+		char* pszEnd;
+		errno = 0;
+		pPred->uValue = strtoull(pszValue, &pszEnd, 0);
+		if (errno || *pszEnd != '\0') goto invalid;
+		return 0;
+	}
+	
+invalid:
+	errno = EINVAL;
+	return -1;
+	
+}
+
+static inline int testValue (const uint64_t uValue, const unsigned int uOp, const uint64_t uRef) {
+	
+	switch (uOp) {
+	case IXOP_EQ: return uValue == uRef;
+	case IXOP_NE: return uValue != uRef;
+	case IXOP_LT: return uValue < uRef;
+	case IXOP_LE: return uValue <= uRef;
+	case IXOP_GT: return uValue > uRef;
+	case IXOP_GE: return uValue >= uRef;
+	case IXOP_AND: return (uValue & uRef) != 0;
+	default: return 0;
+	}
+	
+}
+
+// Narrow the selection by a text field. The value must be followed by
+// a NUL unless it fills the field, or it is only a prefix.
+static int selectString (const PROM_INDEX pIndex, const PINDEX_PRED pPred, uint8_t* pSel) {
+	
+	const INDEX_FIELD* pif = &s_ifFields[pPred->uField];
+	size_t nRows = pIndex->nRows;
+	size_t cchValue = strlen(pPred->szValue);
+	size_t cbCompare = cchValue;
+	if (pPred->uOp != IXOP_PREFIX && cchValue < pif->cbField) cbCompare++;
+	
+	// Matches are collected apart from the selection so they can be
+	// negated.
+	uint8_t* pMatch = pSel;
+	if (pPred->uOp == IXOP_NE) {
+		if ((pMatch = malloc(nRows)) == NULL) return -1;
+		memset(pMatch, 1, nRows);
+	}
+	
+	for (size_t iChar = 0; iChar < cbCompare; iChar++) {
+		const uint8_t* pCol = pIndex->pHdrCols + (pif->uOffset + iChar) * nRows;
+		uint8_t uChar = (uint8_t)pPred->szValue[iChar];
+		for (size_t iRow = 0; iRow < nRows; iRow++) pMatch[iRow] &= (pCol[iRow] == uChar);
+	}
+	
+	if (pPred->uOp == IXOP_NE) {
+		for (size_t iRow = 0; iRow < nRows; iRow++) pSel[iRow] &= !pMatch[iRow];
+		free(pMatch);
+	}
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: queryRomIndex
+ * 
+ * 		Selects the rows that satisfy every predicate. Each predicate
+ * 	is one pass over the columns it names; single byte fields go
+ * 	through a 256 entry truth table so that every operator costs the
+ * 	same.
+ * 
+ * @param:
+ * 		const PROM_INDEX pIndex:
+ * 			Pointer to the open index.
+ * 
+ * 		const PINDEX_PRED pPreds:
+ * 			Pointer to the predicates.
+ * 
+ * 		const size_t nPreds:
+ * 			Number of predicates.
+ * 
+ * 		uint8_t* pSel:
+ * 			Buffer of nRows bytes, set to 1 for each selected row and 0
+ * 		otherwise.
+ * 
+ * 		size_t* pnMatches:
+ * 			Pointer to receive the number of selected rows.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno on error.
+ * 
+ */
+int queryRomIndex (const PROM_INDEX pIndex, const PINDEX_PRED pPreds, const size_t nPreds, uint8_t* pSel, size_t* pnMatches) {
+	
+	if (pIndex == NULL || (pPreds == NULL && nPreds != 0) || pSel == NULL || pnMatches == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	size_t nRows = pIndex->nRows;
+	memset(pSel, 1, nRows);
+	
+	for (size_t iPred = 0; iPred < nPreds; iPred++) {
+		const PINDEX_PRED pPred = &pPreds[iPred];
+		const INDEX_FIELD* pif = &s_ifFields[pPred->uField];
+		uint8_t uTable[256];
+		
+		switch (pif->uKind) {
+		case IXK_BYTE: {
+			const uint8_t* pCol = pIndex->pHdrCols + pif->uOffset * nRows;
+			for (unsigned int uByte = 0; uByte < 256; uByte++) uTable[uByte] = testValue(uByte, pPred->uOp, pPred->uValue);
+			for (size_t iRow = 0; iRow < nRows; iRow++) pSel[iRow] &= uTable[pCol[iRow]];
+			break;
+		}
+			
+		case IXK_STATUS:
+			for (unsigned int uByte = 0; uByte < 256; uByte++) uTable[uByte] = testValue((uByte & pif->cbField) != 0, pPred->uOp, pPred->uValue);
+			for (size_t iRow = 0; iRow < nRows; iRow++) pSel[iRow] &= uTable[pIndex->puStatus[iRow]];
+			break;
+			
+		case IXK_WORD: {
+			const uint8_t* pHigh = pIndex->pHdrCols + pif->uOffset * nRows;
+			const uint8_t* pLow = pHigh + nRows;
+			for (size_t iRow = 0; iRow < nRows; iRow++)
+				pSel[iRow] &= testValue((uint16_t)(pHigh[iRow] << 8 | pLow[iRow]), pPred->uOp, pPred->uValue);
+			break;
+		}
+			
+		case IXK_SIZE:
+			for (size_t iRow = 0; iRow < nRows; iRow++)
+				pSel[iRow] &= testValue(pIndex->pIds[iRow].uSize, pPred->uOp, pPred->uValue);
+			break;
+			
+		case IXK_FINDING: {
+			uint32_t uWant = (pPred->uOp == IXOP_EQ);
+			for (size_t iRow = 0; iRow < nRows; iRow++)
+				pSel[iRow] &= (((pIndex->puFindings[iRow] >> pPred->uValue) & 1) == uWant);
+			break;
+		}
+			
+		case IXK_FORMAT: {
+			// The format follows from the CGB and SGB flags alone; let
+			// getHdrRev() classify every CGB flag value once.
+			const uint8_t* pCgbCol = pIndex->pHdrCols + (offsetof(GBHEAD, htTitle) + 15) * nRows;
+			const uint8_t* pSgbCol = pIndex->pHdrCols + offsetof(GBHEAD, uSgbFlag) * nRows;
+			GBHEAD hdr;
+			memset(&hdr, 0, sizeof(GBHEAD));
+			for (unsigned int uByte = 0; uByte < 256; uByte++) {
+				hdr.htTitle.newTitle.uCgbFlag = (uint8_t)uByte;
+				uTable[uByte] = (getHdrRev(&hdr) == HDRREV_CGB);
+			}
+				
+			for (size_t iRow = 0; iRow < nRows; iRow++) {
+				unsigned int uHdrRev = uTable[pCgbCol[iRow]] ? HDRREV_CGB : (pSgbCol[iRow] ? HDRREV_SGB : HDRREV_DMG);
+				pSel[iRow] &= testValue(uHdrRev, pPred->uOp, pPred->uValue);
+			}
+			break;
+		}
+			
+		case IXK_STRING:
+			if (selectString(pIndex, pPred, pSel)) return -1;
+			break;
+		}
+	}
+	
+	size_t nMatches = 0;
+	for (size_t iRow = 0; iRow < nRows; iRow++) nMatches += pSel[iRow];
+	*pnMatches = nMatches;
+	
+	return 0;
+	
+}
+
+// EOF
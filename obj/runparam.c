@@ -46,14 +46,14 @@ void doExit (PRUN_PARAMS pParams) {
 	// Make sure pParams is non-null.
 	if (pParams == NULL) exit(EXIT_FAILURE);
 	
-	// Free filename buffer.
-	if (pParams->pszFileName != NULL) free(pParams->pszFileName);
+	// Free file list.
+	freeFileList(pParams->pFileList);
 	
-	// Free GB header struct.
-	if (pParams->pHdr != NULL) free(pParams->pHdr);
-	
-	// Free header updates structure.
-	if (pParams->pHdrUps != NULL) free(pParams->pHdrUps);
+	// Close checksum cache.
+	if (pParams->pCache != NULL) {
+		closeCache(pParams->pCache);
+		free(pParams->pCache);
+	}
 	
 	// Check for specific exit flag.
 	if ((pParams->uFlags & RPF_MASK) & RPF_EXIT) exit(pParams->nExitCode);
@@ -0,0 +1,520 @@
+/*
+ * obj/server.c
+ * 
+ * GBFix - Daemon Protocol Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// struct ucred is a GNU extension.
+#define _GNU_SOURCE
+
+// Include used C header(s):
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Include module header(s):
+#include "../inc/romfile.h"
+#include "../inc/server.h"
+
+/*
+ * 
+ * name: fillSockAddr
+ * 
+ * 		Fills a UNIX socket address with a path.
+ * 
+ * @param:
+ * 		struct sockaddr_un* psun:
+ * 			Pointer to the address to fill.
+ * 
+ * 		const char* pszPath:
+ * 			File name of the socket.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Sets ENAMETOOLONG if the path does not fit.
+ * 
+ */
+static int fillSockAddr (struct sockaddr_un* psun, const char* pszPath) {
+	
+	if (pszPath == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	
+	memset(psun, 0, sizeof(struct sockaddr_un));
+	psun->sun_family = AF_UNIX;
+	
+	if (strlen(pszPath) >= sizeof(psun->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(psun->sun_path, pszPath);
+	
+	return 0;
+	
+}
+
+// Bind a socket with a file only its owner can connect to, so that
+// nobody else gets files rewritten with the daemon's rights.
+static int bindPrivate (int fd, const struct sockaddr_un* psun) {
+	
+	mode_t uMask = umask(077);
+	int nRet = bind(fd, (const struct sockaddr*)psun, sizeof(struct sockaddr_un));
+	int nErr = errno;
+	umask(uMask);
+	
+	errno = nErr;
+	return nRet;
+	
+}
+
+/*
+ * 
+ * name: listenServer
+ * 
+ * 		Creates the daemon's listening socket. A socket file left
+ * 	behind by a daemon that is no longer running is replaced, but one
+ * 	that still accepts connections is not. The socket file is only
+ * 	accessible to the daemon's user.
+ * 
+ * @param:
+ * 		const char* pszPath:
+ * 			File name of the socket.
+ * 
+ * @return: int
+ * 		Returns a non-blocking listening descriptor, or sets errno and
+ * 	returns -1 on error. Sets EADDRINUSE if another daemon is running.
+ * 
+ */
+int listenServer (const char* pszPath) {
+	
+	struct sockaddr_un sun;
+	if (fillSockAddr(&sun, pszPath)) return -1;
+	
+	int fd;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) return -1;
+	
+	if (bindPrivate(fd, &sun)) {
+		if (errno != EADDRINUSE) goto fail;
+		
+		// Only take over the socket if nobody answers on it.
+		int fdTest = connectServer(pszPath);
+		if (fdTest >= 0) {
+			close(fdTest);
+			errno = EADDRINUSE;
+			goto fail;
+		}
+		if (errno != ECONNREFUSED) goto fail;
+		
+		if (unlink(pszPath) || bindPrivate(fd, &sun)) goto fail;
+	}
+	
+	if (listen(fd, SOMAXCONN)) goto fail;
+	return fd;
+	
+fail:
+	{
+		int nErr = errno;
+		close(fd);
+		errno = nErr;
+	}
+	return -1;
+	
+}
+
+/*
+ * 
+ * name: connectServer
+ * 
+ * 		Connects to a running daemon.
+ * 
+ * @param:
+ * 		const char* pszPath:
+ * 			File name of the daemon's socket.
+ * 
+ * @return: int
+ * 		Returns a connected descriptor, or sets errno and returns -1 on
+ * 	error.
+ * 
+ */
+int connectServer (const char* pszPath) {
+	
+	struct sockaddr_un sun;
+	if (fillSockAddr(&sun, pszPath)) return -1;
+	
+	int fd;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) return -1;
+	
+	if (connect(fd, (struct sockaddr*)&sun, sizeof(struct sockaddr_un))) {
+		int nErr = errno;
+		close(fd);
+		errno = nErr;
+		return -1;
+	}
+	
+	return fd;
+	
+}
+
+/*
+ * 
+ * name: checkServerPeer
+ * 
+ * 		Checks that the other end of a connection runs as the same user
+ * 	as this process.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Connected descriptor.
+ * 
+ * @return: int
+ * 		Returns zero if the users match, or sets errno and returns
+ * 	nonzero otherwise. Sets EACCES if they differ.
+ * 
+ */
+int checkServerPeer (int fd) {
+	
+	struct ucred uc;
+	socklen_t cbCred = sizeof(struct ucred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &uc, &cbCred)) return -1;
+	
+	if (uc.uid != geteuid()) {
+		errno = EACCES;
+		return -1;
+	}
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: packRequest
+ * 
+ * 		Fills the fixed part of a request.
+ * 
+ * @param:
+ * 		PSRV_REQ pReq:
+ * 			Pointer to the request to fill.
+ * 
+ * 		const unsigned int uOp:
+ * 			SRVOP_* operation.
+ * 
+ * 		const unsigned int uOpts:
+ * 			SRVO_* options.
+ * 
+ * 		const PHDR_UPDATES pHdrUps:
+ * 			Constant pointer to the header updates to send, or NULL.
+ * 
+ */
+void packRequest (PSRV_REQ pReq, const unsigned int uOp, const unsigned int uOpts, const PHDR_UPDATES pHdrUps) {
+	
+	memset(pReq, 0, sizeof(SRV_REQ));
+	pReq->uMagic = SRV_REQMAGIC;
+	pReq->uVersion = SRV_VERSION;
+	pReq->uOp = (uint8_t)uOp;
+	pReq->uOpts = (uint8_t)(uOpts & SRVO_MASK);
+	
+	if (pHdrUps == NULL) return;
+	
+	pReq->uUpFlags = (uint16_t)(pHdrUps->uFlags & UPF_MASK);
+	memcpy(pReq->strTitle, pHdrUps->pszTitle, sizeof(pReq->strTitle));
+	memcpy(pReq->strManu, pHdrUps->pszManu, sizeof(pReq->strManu));
+	pReq->uCgbFlag = pHdrUps->uCgbFlag;
+	pReq->uLicensee = pHdrUps->uLicensee;
+	pReq->uSgbFlag = pHdrUps->uSgbFlag;
+	pReq->uCartType = pHdrUps->uCartType;
+	pReq->uRomSize = pHdrUps->uRomSize;
+	pReq->uRamSize = pHdrUps->uRamSize;
+	pReq->uRegion = pHdrUps->uRegion;
+	pReq->uRomVer = pHdrUps->uRomVer;
+	
+}
+
+/*
+ * 
+ * name: unpackRequest
+ * 
+ * 		Extracts the header updates carried by a request.
+ * 
+ * @param:
+ * 		const PSRV_REQ pReq:
+ * 			Constant pointer to a received request.
+ * 
+ * 		PHDR_UPDATES pHdrUps:
+ * 			Pointer to the header updates structure to fill.
+ * 
+ */
+void unpackRequest (const PSRV_REQ pReq, PHDR_UPDATES pHdrUps) {
+	
+	memset(pHdrUps, 0, sizeof(HDR_UPDATES));
+	pHdrUps->uFlags = pReq->uUpFlags & UPF_MASK;
+	memcpy(pHdrUps->pszTitle, pReq->strTitle, sizeof(pReq->strTitle));
+	memcpy(pHdrUps->pszManu, pReq->strManu, sizeof(pReq->strManu));
+	pHdrUps->uCgbFlag = pReq->uCgbFlag;
+	pHdrUps->uLicensee = pReq->uLicensee;
+	pHdrUps->uSgbFlag = pReq->uSgbFlag;
+	pHdrUps->uCartType = pReq->uCartType;
+	pHdrUps->uRomSize = pReq->uRomSize;
+	pHdrUps->uRamSize = pReq->uRamSize;
+	pHdrUps->uRegion = pReq->uRegion;
+	pHdrUps->uRomVer = pReq->uRomVer;
+	
+}
+
+/*
+ * 
+ * name: sendRequest
+ * 
+ * 		Sends a packed request followed by its file names.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Connected descriptor.
+ * 
+ * 		PSRV_REQ pReq:
+ * 			Pointer to the packed request. Its path length is filled in.
+ * 
+ * 		const char* pszPath:
+ * 			Absolute file name to operate on.
+ * 
+ * 		const char* pszName:
+ * 			Name to show for the file in the output, or NULL to show
+ * 		pszPath.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int sendRequest (int fd, PSRV_REQ pReq, const char* pszPath, const char* pszName) {
+	
+	size_t cchPath = strlen(pszPath);
+	size_t cchName = (pszName != NULL) ? strlen(pszName) : 0;
+	if (cchPath == 0 || cchPath > SRV_PATHMAX || cchName > SRV_PATHMAX) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	pReq->cchPath = (uint16_t)cchPath;
+	pReq->cchName = (uint16_t)cchName;
+	
+	if (writeFull(fd, pReq, sizeof(SRV_REQ)) || writeFull(fd, pszPath, cchPath)) return -1;
+	if (cchName && writeFull(fd, pszName, cchName)) return -1;
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: recvRequest
+ * 
+ * 		Receives and checks a request.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Connected descriptor.
+ * 
+ * 		PSRV_REQ pReq:
+ * 			Pointer to the request to fill.
+ * 
+ * 		char* pszPath:
+ * 			Buffer of at least SRV_PATHMAX + 1 characters for the file
+ * 		name.
+ * 
+ * 		char* pszName:
+ * 			Buffer of at least SRV_PATHMAX + 1 characters for the
+ * 		display name. Receives a copy of the file name if none was sent.
+ * 
+ * @return: int
+ * 		Returns 1 if a request was received, zero if the client closed
+ * 	the connection, or sets errno and returns -1 on error. Sets EPROTO
+ * 	if the request is malformed.
+ * 
+ */
+int recvRequest (int fd, PSRV_REQ pReq, char* pszPath, char* pszName) {
+	
+	ssize_t cbRead;
+	
+	if ((cbRead = readFull(fd, pReq, sizeof(SRV_REQ))) <= 0) return (int)cbRead;
+	
+	if (cbRead != sizeof(SRV_REQ) || pReq->uMagic != SRV_REQMAGIC || pReq->uVersion != SRV_VERSION ||
+		pReq->uOp >= SRVOP_COUNT || pReq->cchPath == 0 || pReq->cchPath > SRV_PATHMAX || pReq->cchName > SRV_PATHMAX) {
+		errno = EPROTO;
+		return -1;
+	}
+	
+	if ((cbRead = readFull(fd, pszPath, pReq->cchPath)) < 0) return -1;
+	if (cbRead != pReq->cchPath) {
+		errno = EPROTO;
+		return -1;
+	}
+	pszPath[pReq->cchPath] = '\0';
+	
+	if (pReq->cchName == 0) {
+		strcpy(pszName, pszPath);
+		return 1;
+	}
+	
+	if ((cbRead = readFull(fd, pszName, pReq->cchName)) < 0) return -1;
+	if (cbRead != pReq->cchName) {
+		errno = EPROTO;
+		return -1;
+	}
+	pszName[pReq->cchName] = '\0';
+	
+	return 1;
+	
+}
+
+/*
+ * 
+ * name: sendResponse
+ * 
+ * 		Sends the result of a request with the output it produced.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Connected descriptor.
+ * 
+ * 		const int nResult:
+ * 			Zero if the request succeeded.
+ * 
+ * 		const char* pszOut, size_t cbOut:
+ * 			Regular output.
+ * 
+ * 		const char* pszErr, size_t cbErr:
+ * 			Error output.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+int sendResponse (int fd, const int nResult, const char* pszOut, size_t cbOut, const char* pszErr, size_t cbErr) {
+	
+	SRV_RESP resp;
+	
+	if (cbOut > UINT32_MAX || cbErr > UINT32_MAX) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	
+	resp.uMagic = SRV_RESPMAGIC;
+	resp.nResult = nResult;
+	resp.cbOut = (uint32_t)cbOut;
+	resp.cbErr = (uint32_t)cbErr;
+	
+	if (writeFull(fd, &resp, sizeof(SRV_RESP))) return -1;
+	if (cbOut && writeFull(fd, pszOut, cbOut)) return -1;
+	if (cbErr && writeFull(fd, pszErr, cbErr)) return -1;
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: copyToStream
+ * 
+ * 		Copies a number of bytes from a descriptor to a stream.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Descriptor to read from.
+ * 
+ * 		FILE* pOut:
+ * 			Stream to write to, or NULL to discard the bytes.
+ * 
+ * 		size_t cbCopy:
+ * 			Number of bytes to copy.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error.
+ * 
+ */
+static int copyToStream (int fd, FILE* pOut, size_t cbCopy) {
+	
+	char buf[4096];
+	
+	while (cbCopy > 0) {
+		size_t cbChunk = (cbCopy < sizeof(buf)) ? cbCopy : sizeof(buf);
+		ssize_t cbRead = readFull(fd, buf, cbChunk);
+		
+		if (cbRead < 0) return -1;
+		if ((size_t)cbRead != cbChunk) {
+			errno = EPROTO;
+			return -1;
+		}
+		if (pOut != NULL) fwrite(buf, 1, cbChunk, pOut);
+		cbCopy -= cbChunk;
+	}
+	
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: recvResponse
+ * 
+ * 		Receives a response and writes its output to streams.
+ * 
+ * @param:
+ * 		int fd:
+ * 			Connected descriptor.
+ * 
+ * 		int* pnResult:
+ * 			Pointer to receive the result of the request.
+ * 
+ * 		FILE* pOut:
+ * 			Stream for the regular output, or NULL to discard it.
+ * 
+ * 		FILE* pErr:
+ * 			Stream for the error output, or NULL to discard it.
+ * 
+ * @return: int
+ * 		Returns zero on success, or sets errno and returns nonzero on
+ * 	error. Sets EPROTO if the response is malformed or cut short.
+ * 
+ */
+int recvResponse (int fd, int* pnResult, FILE* pOut, FILE* pErr) {
+	
+	SRV_RESP resp;
+	ssize_t cbRead;
+	
+	if ((cbRead = readFull(fd, &resp, sizeof(SRV_RESP))) < 0) return -1;
+	if (cbRead != sizeof(SRV_RESP) || resp.uMagic != SRV_RESPMAGIC) {
+		errno = EPROTO;
+		return -1;
+	}
+	
+	if (copyToStream(fd, pOut, resp.cbOut) || copyToStream(fd, pErr, resp.cbErr)) return -1;
+	
+	*pnResult = resp.nResult;
+	return 0;
+	
+}
+
+// EOF
@@ -0,0 +1,282 @@
+/*
+ * obj/stats.c
+ * 
+ * GBFix - Run Statistics Module
+ * 
+ * Copyright 2021 Lisa Murray
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ * 
+ */
+
+// Include used C header(s):
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Include module header(s):
+#include "../inc/messages.h"
+#include "../inc/stats.h"
+
+#define STATS_MB 1048576.0
+
+static const char* const s_pszPhases[STATPH_COUNT] = {
+	[STATPH_OPEN] = "open",
+	[STATPH_PATCH] = "patch",
+	[STATPH_HASH] = "hash",
+	[STATPH_INFO] = "info",
+	[STATPH_CHKSUM] = "checksum",
+	[STATPH_SAVE] = "save"
+};
+
+// Totals derived from the job stats when printing.
+typedef struct tagSTATS_SUMMARY
+{
+	size_t nFailed;
+	uint64_t nWallNs;
+	uint64_t cbFiles;
+	uint64_t nPhaseNs[STATPH_COUNT];
+	uint64_t cbPhase[STATPH_COUNT];
+	uint64_t nJobNs; // Sum of all job times, across threads.
+	uint64_t nP50Ns, nP95Ns, nP99Ns, nMaxNs;
+} STATS_SUMMARY, *PSTATS_SUMMARY;
+
+uint64_t getMonotonicNs (void) {
+	
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+	
+}
+
+/*
+ * 
+ * name: getStatsFormat
+ * 
+ * 		Looks up a statistics format by name.
+ * 
+ * @param:
+ * 		const char* pszFormat:
+ * 			"text" or "json", or NULL for text.
+ * 
+ * 		unsigned int* puFormat:
+ * 			Receives the STATFMT_* code.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno to EINVAL if the
+ * 	format is unknown.
+ * 
+ */
+int getStatsFormat (const char* pszFormat, unsigned int* puFormat) {
+	
+	if (pszFormat == NULL || strcmp(pszFormat, "text") == 0) {
+		*puFormat = STATFMT_TEXT;
+	} else if (strcmp(pszFormat, "json") == 0) {
+		*puFormat = STATFMT_JSON;
+	} else {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+	
+}
+
+void initRunStats (PRUN_STATS prs) {
+	
+	memset(prs, 0, sizeof(RUN_STATS));
+	prs->nStartNs = getMonotonicNs();
+	
+}
+
+/*
+ * 
+ * name: reserveRunStats
+ * 
+ * 		Makes room for the stats of at least nJobs jobs, so that adding
+ * 	them does not allocate.
+ * 
+ * @param:
+ * 		PRUN_STATS prs:
+ * 			Pointer to the run stats.
+ * 
+ * 		const size_t nJobs:
+ * 			Number of jobs to make room for.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno if out of memory.
+ * 
+ */
+int reserveRunStats (PRUN_STATS prs, const size_t nJobs) {
+	
+	if (nJobs <= prs->nAlloc) return 0;
+	
+	PJOB_STATS pJobs = realloc(prs->pJobs, nJobs * sizeof(JOB_STATS));
+	if (pJobs == NULL) return -1;
+	prs->pJobs = pJobs;
+	prs->nAlloc = nJobs;
+	return 0;
+	
+}
+
+/*
+ * 
+ * name: addRunStats
+ * 
+ * 		Adds the stats of a finished job to the run. Not thread-safe;
+ * 	call from the thread that collects finished jobs.
+ * 
+ * @param:
+ * 		PRUN_STATS prs:
+ * 			Pointer to the run stats.
+ * 
+ * 		const PJOB_STATS pjs:
+ * 			Pointer to the stats of the job.
+ * 
+ * @return: int
+ * 		Returns zero on success, or -1 and sets errno if out of memory.
+ * 
+ */
+int addRunStats (PRUN_STATS prs, const PJOB_STATS pjs) {
+	
+	if (prs->nJobs == prs->nAlloc && reserveRunStats(prs, prs->nAlloc ? prs->nAlloc * 2 : 256)) return -1;
+	
+	memcpy(&prs->pJobs[prs->nJobs++], pjs, sizeof(JOB_STATS));
+	return 0;
+	
+}
+
+void freeRunStats (PRUN_STATS prs) {
+	
+	free(prs->pJobs);
+	memset(prs, 0, sizeof(RUN_STATS));
+	
+}
+
+static int cmpU64 (const void* pA, const void* pB) {
+	
+	uint64_t uA = *(const uint64_t*)pA, uB = *(const uint64_t*)pB;
+	return (uA > uB) - (uA < uB);
+	
+}
+
+// Nearest-rank percentile of sorted values.
+static inline uint64_t getPercentile (const uint64_t* pnSorted, const size_t nValues, const unsigned int uPercent) {
+	
+	if (nValues == 0) return 0;
+	size_t iRank = (nValues * uPercent + 99) / 100;
+	return pnSorted[(iRank > 0) ? iRank - 1 : 0];
+	
+}
+
+static void summarizeRunStats (const PRUN_STATS prs, PSTATS_SUMMARY pss) {
+	
+	memset(pss, 0, sizeof(STATS_SUMMARY));
+	pss->nWallNs = getMonotonicNs() - prs->nStartNs;
+	
+	uint64_t* pnTotals = malloc((prs->nJobs ? prs->nJobs : 1) * sizeof(uint64_t));
+	
+	for (size_t iJob = 0; iJob < prs->nJobs; iJob++) {
+		const PJOB_STATS pjs = &prs->pJobs[iJob];
+		if (pjs->fFailed) pss->nFailed++;
+		pss->cbFiles += pjs->cbFile;
+		pss->nJobNs += pjs->nTotalNs;
+		for (unsigned int uPhase = 0; uPhase < STATPH_COUNT; uPhase++) {
+			pss->nPhaseNs[uPhase] += pjs->nPhaseNs[uPhase];
+			pss->cbPhase[uPhase] += pjs->cbPhase[uPhase];
+		}
+		if (pnTotals != NULL) pnTotals[iJob] = pjs->nTotalNs;
+	}
+	
+	if (pnTotals == NULL || prs->nJobs == 0) {
+		free(pnTotals);
+		return;
+	}
+	
+	qsort(pnTotals, prs->nJobs, sizeof(uint64_t), cmpU64);
+	pss->nP50Ns = getPercentile(pnTotals, prs->nJobs, 50);
+	pss->nP95Ns = getPercentile(pnTotals, prs->nJobs, 95);
+	pss->nP99Ns = getPercentile(pnTotals, prs->nJobs, 99);
+	pss->nMaxNs = pnTotals[prs->nJobs - 1];
+	free(pnTotals);
+	
+}
+
+static inline double getRate (const double fAmount, const uint64_t nNs) {
+	
+	return nNs ? fAmount * 1e9 / (double)nNs : 0.0;
+	
+}
+
+/*
+ * 
+ * name: printRunStats
+ * 
+ * 		Prints the totals of a run: wall time, throughput in MB/s and
+ * 	files/s, per-file latency percentiles, and the time and bytes of
+ * 	each phase. Phase times are summed over all threads, so their
+ * 	shares are of the total job time rather than of the wall time.
+ * 
+ * @param:
+ * 		FILE* pOut:
+ * 			Stream to print to.
+ * 
+ * 		PRUN_STATS prs:
+ * 			Pointer to the run stats.
+ * 
+ * 		const unsigned int uFormat:
+ * 			STATFMT_* code; JSON is printed as a single line.
+ * 
+ */
+void printRunStats (FILE* pOut, PRUN_STATS prs, const unsigned int uFormat) {
+	
+	STATS_SUMMARY ss;
+	summarizeRunStats(prs, &ss);
+	
+	double fMbPerSec = getRate((double)ss.cbFiles / STATS_MB, ss.nWallNs);
+	double fFilesPerSec = getRate((double)prs->nJobs, ss.nWallNs);
+	
+	if (uFormat == STATFMT_JSON) {
+		fprintf(pOut, "{\"files\":%zu,\"failed\":%zu,\"wall_ns\":%llu,\"bytes\":%llu,\"mb_per_s\":%.3f,\"files_per_s\":%.3f,"
+			"\"latency_ns\":{\"p50\":%llu,\"p95\":%llu,\"p99\":%llu,\"max\":%llu},\"phases\":{",
+			prs->nJobs, ss.nFailed, (unsigned long long)ss.nWallNs, (unsigned long long)ss.cbFiles, fMbPerSec, fFilesPerSec,
+			(unsigned long long)ss.nP50Ns, (unsigned long long)ss.nP95Ns, (unsigned long long)ss.nP99Ns,
+			(unsigned long long)ss.nMaxNs);
+		for (unsigned int uPhase = 0; uPhase < STATPH_COUNT; uPhase++) {
+			fprintf(pOut, "%s\"%s\":{\"ns\":%llu,\"bytes\":%llu,\"mb_per_s\":%.3f}", uPhase ? "," : "", s_pszPhases[uPhase],
+				(unsigned long long)ss.nPhaseNs[uPhase], (unsigned long long)ss.cbPhase[uPhase],
+				getRate((double)ss.cbPhase[uPhase] / STATS_MB, ss.nPhaseNs[uPhase]));
+		}
+		fprintf(pOut, "}}\n");
+		return;
+	}
+	
+	fprintf(pOut, g_szDivider, "Stats");
+	fprintf(pOut, "\tFiles:              %zu (%zu failed)\n", prs->nJobs, ss.nFailed);
+	fprintf(pOut, "\tWall Time:          %.3f ms\n", (double)ss.nWallNs / 1e6);
+	fprintf(pOut, "\tThroughput:         %.1f MB/s, %.1f files/s\n", fMbPerSec, fFilesPerSec);
+	fprintf(pOut, "\tLatency:            p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		(double)ss.nP50Ns / 1e6, (double)ss.nP95Ns / 1e6, (double)ss.nP99Ns / 1e6, (double)ss.nMaxNs / 1e6);
+	fprintf(pOut, "\tPhase       Time (ms)    Share    Bytes          MB/s\n");
+	for (unsigned int uPhase = 0; uPhase < STATPH_COUNT; uPhase++) {
+		fprintf(pOut, "\t%-10s  %11.3f  %6.1f%%  %-13llu  %.1f\n", s_pszPhases[uPhase], (double)ss.nPhaseNs[uPhase] / 1e6,
+			ss.nJobNs ? 100.0 * (double)ss.nPhaseNs[uPhase] / (double)ss.nJobNs : 0.0,
+			(unsigned long long)ss.cbPhase[uPhase], getRate((double)ss.cbPhase[uPhase] / STATS_MB, ss.nPhaseNs[uPhase]));
+	}
+	
+}
+
+// EOF